@@ -32,6 +32,7 @@
 
 #include <string.h>
 
+#include <string>
 #include <vector>
 
 #include "google/ads/googleads/v13/services/google_ads_service.hpbdefs.h"
@@ -43,8 +44,16 @@
 #include "benchmarks/descriptor.hpbdefs.h"
 #include "benchmarks/descriptor_sv.pb.h"
 #include "hpb/base/internal/log2.h"
+#include "hpb/base/status.hpp"
 #include "hpb/mem/arena.h"
+#include "hpb/mem/arena.hpp"
+#include "hpb/message/message.h"
+#include "hpb/mini_descriptor/decode.h"
+#include "hpb/mini_descriptor/internal/encode.hpp"
+#include "hpb/mini_table/message.h"
 #include "hpb/reflection/def.hpp"
+#include "hpb/wire/decode.h"
+#include "hpb/wire/encode.h"
 
 hpb_StringView descriptor = benchmarks_descriptor_proto_hpbdefinit.descriptor;
 namespace protobuf = ::google::protobuf;
@@ -290,6 +299,135 @@ BENCHMARK_TEMPLATE(BM_Parse_Upb_FileDesc, UseArena, Alias);
 BENCHMARK_TEMPLATE(BM_Parse_Upb_FileDesc, InitBlock, Copy);
 BENCHMARK_TEMPLATE(BM_Parse_Upb_FileDesc, InitBlock, Alias);
 
+enum FieldOrder {
+  InOrder,
+  Reversed,
+};
+
+// A message whose fields are numbered from 1000 up in steps of 7, so none of
+// them is in the dense range and every lookup searches the field table.
+static hpb_MiniTable* BuildSparseMiniTable(hpb_Arena* arena) {
+  hpb::MtDataEncoder e;
+  e.StartMessage(0);
+  for (uint32_t i = 0; i < 64; i++) {
+    e.PutField(kHpb_FieldType_Int32, 1000 + 7 * i, 0);
+  }
+  hpb::Status status;
+  return hpb_MiniTable_Build(e.data().data(), e.data().size(), arena,
+                             status.ptr());
+}
+
+static void AppendVarint(std::string* out, uint64_t val) {
+  do {
+    uint8_t byte = val & 0x7f;
+    val >>= 7;
+    if (val) byte |= 0x80;
+    out->push_back(byte);
+  } while (val);
+}
+
+template <FieldOrder Order>
+static void BM_Parse_Upb_SparseFields(benchmark::State& state) {
+  hpb::Arena table_arena;
+  hpb_MiniTable* table = BuildSparseMiniTable(table_arena.ptr());
+  std::string payload;
+  for (uint32_t i = 0; i < 64; i++) {
+    uint32_t number = 1000 + 7 * (Order == InOrder ? i : 63 - i);
+    AppendVarint(&payload, number << 3);
+    AppendVarint(&payload, i * 1000);
+  }
+  for (auto _ : state) {
+    hpb_Arena* arena = hpb_Arena_Init(buf, sizeof(buf), nullptr);
+    hpb_Message* msg = hpb_Message_New(table, arena);
+    if (hpb_Decode(payload.data(), payload.size(), msg, table, nullptr, 0,
+                   arena) != kHpb_DecodeStatus_Ok) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+    hpb_Arena_Free(arena);
+  }
+  state.SetBytesProcessed(state.iterations() * payload.size());
+}
+BENCHMARK_TEMPLATE(BM_Parse_Upb_SparseFields, InOrder);
+BENCHMARK_TEMPLATE(BM_Parse_Upb_SparseFields, Reversed);
+
+static void BM_FindFieldByNumber_Sparse(benchmark::State& state) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildSparseMiniTable(arena.ptr());
+  uint32_t i = 0;
+  for (auto _ : state) {
+    // Step through the fields in a scattered order, hitting and missing.
+    i = (i + 37) % 448;
+    benchmark::DoNotOptimize(hpb_MiniTable_FindFieldByNumber(table, 1000 + i));
+  }
+}
+BENCHMARK(BM_FindFieldByNumber_Sparse);
+
+enum BatchMode {
+  OneByOne,
+  Batched,
+};
+
+// Many tiny messages of one type, where the fixed cost of each hpb_Decode()
+// call is a large part of the total.
+template <BatchMode Mode>
+static void BM_Parse_Upb_SmallMessages(benchmark::State& state) {
+  hpb::Arena table_arena;
+  hpb::MtDataEncoder e;
+  e.StartMessage(0);
+  e.PutField(kHpb_FieldType_Int32, 1, 0);
+  e.PutField(kHpb_FieldType_Int64, 2, 0);
+  e.PutField(kHpb_FieldType_Bytes, 3, 0);
+  hpb::Status status;
+  hpb_MiniTable* table = hpb_MiniTable_Build(
+      e.data().data(), e.data().size(), table_arena.ptr(), status.ptr());
+
+  const size_t kCount = 256;
+  std::vector<std::string> payloads(kCount);
+  std::vector<hpb_StringView> bufs(kCount);
+  size_t bytes = 0;
+  for (size_t i = 0; i < kCount; i++) {
+    std::string* p = &payloads[i];
+    AppendVarint(p, 1 << 3);
+    AppendVarint(p, i);
+    AppendVarint(p, 2 << 3);
+    AppendVarint(p, i * 1000003);
+    AppendVarint(p, (3 << 3) | 2);
+    AppendVarint(p, 4);
+    p->append("data");
+    bufs[i] = hpb_StringView_FromDataAndSize(p->data(), p->size());
+    bytes += p->size();
+  }
+  std::vector<hpb_Message*> msgs(kCount);
+  std::vector<hpb_DecodeStatus> statuses(kCount);
+
+  for (auto _ : state) {
+    hpb_Arena* arena = hpb_Arena_Init(buf, sizeof(buf), nullptr);
+    size_t ok = 0;
+    if (Mode == Batched) {
+      ok = hpb_DecodeBatch(bufs.data(), kCount, msgs.data(), table, nullptr,
+                           kHpb_DecodeOption_AliasString, arena,
+                           statuses.data());
+    } else {
+      for (size_t i = 0; i < kCount; i++) {
+        msgs[i] = hpb_Message_New(table, arena);
+        ok += hpb_Decode(bufs[i].data, bufs[i].size, msgs[i], table, nullptr,
+                         kHpb_DecodeOption_AliasString,
+                         arena) == kHpb_DecodeStatus_Ok;
+      }
+    }
+    if (ok != kCount) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+    hpb_Arena_Free(arena);
+  }
+  state.SetItemsProcessed(state.iterations() * kCount);
+  state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK_TEMPLATE(BM_Parse_Upb_SmallMessages, OneByOne);
+BENCHMARK_TEMPLATE(BM_Parse_Upb_SmallMessages, Batched);
+
 template <ArenaMode AMode, class P>
 struct Proto2Factory;
 
@@ -388,3 +526,30 @@ static void BM_SerializeDescriptor_Upb(benchmark::State& state) {
   state.SetBytesProcessed(total);
 }
 BENCHMARK(BM_SerializeDescriptor_Upb);
+
+static void BM_SerializeDescriptor_Upb_Chunks(benchmark::State& state) {
+  int64_t total = 0;
+  hpb_Arena* arena = hpb_Arena_New();
+  hpb_benchmark_FileDescriptorProto* set =
+      hpb_benchmark_FileDescriptorProto_parse(descriptor.data, descriptor.size,
+                                              arena);
+  if (!set) {
+    printf("Failed to parse.\n");
+    exit(1);
+  }
+  for (auto _ : state) {
+    hpb_Arena* enc_arena = hpb_Arena_Init(buf, sizeof(buf), nullptr);
+    hpb_StringView* chunks;
+    size_t count;
+    size_t size;
+    if (hpb_EncodeToChunks(set, hpb_benchmark_FileDescriptorProto_msg_init(),
+                           0, state.range(0), enc_arena, &chunks, &count,
+                           &size) != kHpb_EncodeStatus_Ok) {
+      printf("Failed to serialize.\n");
+      exit(1);
+    }
+    total += size;
+  }
+  state.SetBytesProcessed(total);
+}
+BENCHMARK(BM_SerializeDescriptor_Upb_Chunks)->Arg(1024)->Arg(16384);
@@ -134,17 +134,13 @@ bool hpb_Array_Resize(hpb_Array* arr, size_t size, hpb_Arena* arena) {
 
 // EVERYTHING BELOW THIS LINE IS INTERNAL - DO NOT USE /////////////////////////
 
-bool _hpb_array_realloc(hpb_Array* arr, size_t min_capacity, hpb_Arena* arena) {
-  size_t new_capacity = HPB_MAX(arr->capacity, 4);
+static bool _hpb_array_setcapacity(hpb_Array* arr, size_t new_capacity,
+                                   hpb_Arena* arena) {
   int elem_size_lg2 = arr->data & 7;
   size_t old_bytes = arr->capacity << elem_size_lg2;
-  size_t new_bytes;
+  size_t new_bytes = new_capacity << elem_size_lg2;
   void* ptr = _hpb_array_ptr(arr);
 
-  // Log2 ceiling of size.
-  while (new_capacity < min_capacity) new_capacity *= 2;
-
-  new_bytes = new_capacity << elem_size_lg2;
   ptr = hpb_Arena_Realloc(arena, ptr, old_bytes, new_bytes);
   if (!ptr) return false;
 
@@ -152,3 +148,18 @@ bool _hpb_array_realloc(hpb_Array* arr, size_t min_capacity, hpb_Arena* arena) {
   arr->capacity = new_capacity;
   return true;
 }
+
+bool _hpb_array_realloc(hpb_Array* arr, size_t min_capacity, hpb_Arena* arena) {
+  size_t new_capacity = HPB_MAX(arr->capacity, 4);
+
+  // Log2 ceiling of size.
+  while (new_capacity < min_capacity) new_capacity *= 2;
+
+  return _hpb_array_setcapacity(arr, new_capacity, arena);
+}
+
+bool _hpb_array_realloc_exact(hpb_Array* arr, size_t capacity,
+                              hpb_Arena* arena) {
+  HPB_ASSERT(capacity >= arr->capacity);
+  return _hpb_array_setcapacity(arr, capacity, arena);
+}
@@ -99,6 +99,11 @@ HPB_INLINE hpb_Array* _hpb_Array_New(hpb_Arena* a, size_t init_capacity,
 // Resizes the capacity of the array to be at least min_size.
 bool _hpb_array_realloc(hpb_Array* arr, size_t min_size, hpb_Arena* arena);
 
+// Grows the capacity of the array to exactly `capacity`, for callers that know
+// the final size up front and want to avoid the slack of doubling.
+bool _hpb_array_realloc_exact(hpb_Array* arr, size_t capacity,
+                              hpb_Arena* arena);
+
 HPB_INLINE bool _hpb_array_reserve(hpb_Array* arr, size_t size,
                                    hpb_Arena* arena) {
   if (arr->capacity < size) return _hpb_array_realloc(arr, size, arena);
@@ -35,6 +35,7 @@
 
 #include "hpb/base/string_view.h"
 #include "hpb/collections/map.h"
+#include "hpb/hash/int_table.h"
 #include "hpb/hash/str_table.h"
 #include "hpb/mem/arena.h"
 
@@ -47,7 +48,21 @@ struct hpb_Map {
   char key_size;
   char val_size;
 
-  hpb_strtable table;
+  // Integer keys that fit in a uintptr_t are stored directly as the key of an
+  // inttable; everything else is stored as a byte string in a strtable.
+  bool is_strtable;
+
+  // Int-keyed maps only: the hash part of an inttable uses a zero key to mark
+  // empty slots, so the entry for the all-zeroes key lives here instead.  This
+  // keeps every entry an hpb_tabent, which generated code and the sorter rely
+  // on.  It is iterated as if it were the slot right after the hash part.
+  bool has_zero_ent;
+  hpb_tabent zero_ent;
+
+  union {
+    hpb_strtable strtable;
+    hpb_inttable inttable;
+  } t;
 };
 
 #ifdef __cplusplus
@@ -57,11 +72,17 @@ extern "C" {
 // Converting between internal table representation and user values.
 //
 // _hpb_map_tokey() and _hpb_map_fromkey() are inverses.
+// _hpb_map_tointkey() and _hpb_map_fromintkey() are inverses.
 // _hpb_map_tovalue() and _hpb_map_fromvalue() are inverses.
 //
 // These functions account for the fact that strings are treated differently
 // from other types when stored in a map.
 
+// Whether keys of this size are stored in an inttable.
+HPB_INLINE bool _hpb_map_isintkey(size_t size) {
+  return size != HPB_MAPTYPE_STRING && size <= sizeof(uintptr_t);
+}
+
 HPB_INLINE hpb_StringView _hpb_map_tokey(const void* key, size_t size) {
   if (size == HPB_MAPTYPE_STRING) {
     return *(hpb_StringView*)key;
@@ -78,6 +99,25 @@ HPB_INLINE void _hpb_map_fromkey(hpb_StringView key, void* out, size_t size) {
   }
 }
 
+HPB_INLINE uintptr_t _hpb_map_tointkey(const void* key, size_t size) {
+  uintptr_t ret = 0;
+  memcpy(&ret, key, size);
+  return ret;
+}
+
+HPB_INLINE void _hpb_map_fromintkey(uintptr_t key, void* out, size_t size) {
+  memcpy(out, &key, size);
+}
+
+// Extracts the user key from a table entry of a map with this key size.
+HPB_INLINE void _hpb_map_fromtabkey(hpb_tabkey key, void* out, size_t size) {
+  if (_hpb_map_isintkey(size)) {
+    _hpb_map_fromintkey(key, out, size);
+  } else {
+    _hpb_map_fromkey(hpb_tabstrview(key), out, size);
+  }
+}
+
 HPB_INLINE bool _hpb_map_tovalue(const void* val, size_t size,
                                  hpb_value* msgval, hpb_Arena* a) {
   if (size == HPB_MAPTYPE_STRING) {
@@ -100,31 +140,78 @@ HPB_INLINE void _hpb_map_fromvalue(hpb_value val, void* out, size_t size) {
   }
 }
 
+// The hash part of the map's table; both table types begin with one.
+HPB_INLINE const hpb_table* _hpb_Map_Table(const hpb_Map* map) {
+  return map->is_strtable ? &map->t.strtable.t : &map->t.inttable.t;
+}
+
+// Returns the entry at iterator position `iter`, or NULL if there is none.
+HPB_INLINE hpb_tabent* _hpb_Map_EntryAt(const hpb_Map* map, size_t iter) {
+  const hpb_table* t = _hpb_Map_Table(map);
+  size_t size = hpb_table_size(t);
+  if (iter < size) {
+    hpb_tabent* ent = &t->entries[iter];
+    return hpb_tabent_isempty(ent) ? NULL : ent;
+  }
+  if (iter == size && map->has_zero_ent) return (hpb_tabent*)&map->zero_ent;
+  return NULL;
+}
+
 HPB_INLINE void* _hpb_map_next(const hpb_Map* map, size_t* iter) {
-  hpb_strtable_iter it;
-  it.t = &map->table;
-  it.index = *iter;
-  hpb_strtable_next(&it);
-  *iter = it.index;
-  if (hpb_strtable_done(&it)) return NULL;
-  return (void*)str_tabent(&it);
+  // One past the hash part is the slot for zero_ent.
+  size_t end = hpb_table_size(_hpb_Map_Table(map)) + 1;
+  for (size_t i = *iter + 1; i < end; i++) {
+    hpb_tabent* ent = _hpb_Map_EntryAt(map, i);
+    if (ent) {
+      *iter = i;
+      return ent;
+    }
+  }
+  *iter = end;
+  return NULL;
 }
 
 HPB_INLINE void _hpb_Map_Clear(hpb_Map* map) {
-  hpb_strtable_clear(&map->table);
+  if (map->is_strtable) {
+    hpb_strtable_clear(&map->t.strtable);
+  } else {
+    hpb_inttable_clear(&map->t.inttable);
+    map->has_zero_ent = false;
+  }
 }
 
 HPB_INLINE bool _hpb_Map_Delete(hpb_Map* map, const void* key, size_t key_size,
                                 hpb_value* val) {
-  hpb_StringView k = _hpb_map_tokey(key, key_size);
-  return hpb_strtable_remove2(&map->table, k.data, k.size, val);
+  if (map->is_strtable) {
+    hpb_StringView k = _hpb_map_tokey(key, key_size);
+    return hpb_strtable_remove2(&map->t.strtable, k.data, k.size, val);
+  }
+  uintptr_t k = _hpb_map_tointkey(key, key_size);
+  if (k == 0) {
+    if (!map->has_zero_ent) return false;
+    if (val) val->val = map->zero_ent.val.val;
+    map->has_zero_ent = false;
+    return true;
+  }
+  return hpb_inttable_remove(&map->t.inttable, k, val);
 }
 
 HPB_INLINE bool _hpb_Map_Get(const hpb_Map* map, const void* key,
                              size_t key_size, void* val, size_t val_size) {
   hpb_value tabval;
-  hpb_StringView k = _hpb_map_tokey(key, key_size);
-  bool ret = hpb_strtable_lookup2(&map->table, k.data, k.size, &tabval);
+  bool ret;
+  if (map->is_strtable) {
+    hpb_StringView k = _hpb_map_tokey(key, key_size);
+    ret = hpb_strtable_lookup2(&map->t.strtable, k.data, k.size, &tabval);
+  } else {
+    uintptr_t k = _hpb_map_tointkey(key, key_size);
+    if (k == 0) {
+      ret = map->has_zero_ent;
+      tabval.val = map->zero_ent.val.val;
+    } else {
+      ret = hpb_inttable_lookup(&map->t.inttable, k, &tabval);
+    }
+  }
   if (ret && val) {
     _hpb_map_fromvalue(tabval, val, val_size);
   }
@@ -134,16 +221,35 @@ HPB_INLINE bool _hpb_Map_Get(const hpb_Map* map, const void* key,
 HPB_INLINE hpb_MapInsertStatus _hpb_Map_Insert(hpb_Map* map, const void* key,
                                                size_t key_size, void* val,
                                                size_t val_size, hpb_Arena* a) {
-  hpb_StringView strkey = _hpb_map_tokey(key, key_size);
   hpb_value tabval = {0};
   if (!_hpb_map_tovalue(val, val_size, &tabval, a)) {
     return kHpb_MapInsertStatus_OutOfMemory;
   }
 
+  if (!map->is_strtable) {
+    uintptr_t k = _hpb_map_tointkey(key, key_size);
+    if (k == 0) {
+      bool replaced = map->has_zero_ent;
+      map->zero_ent.val.val = tabval.val;
+      map->has_zero_ent = true;
+      return replaced ? kHpb_MapInsertStatus_Replaced
+                      : kHpb_MapInsertStatus_Inserted;
+    }
+    if (hpb_inttable_replace(&map->t.inttable, k, tabval)) {
+      return kHpb_MapInsertStatus_Replaced;
+    }
+    if (!hpb_inttable_insert(&map->t.inttable, k, tabval, a)) {
+      return kHpb_MapInsertStatus_OutOfMemory;
+    }
+    return kHpb_MapInsertStatus_Inserted;
+  }
+
+  hpb_StringView strkey = _hpb_map_tokey(key, key_size);
   // TODO(haberman): add overwrite operation to minimize number of lookups.
   bool removed =
-      hpb_strtable_remove2(&map->table, strkey.data, strkey.size, NULL);
-  if (!hpb_strtable_insert(&map->table, strkey.data, strkey.size, tabval, a)) {
+      hpb_strtable_remove2(&map->t.strtable, strkey.data, strkey.size, NULL);
+  if (!hpb_strtable_insert(&map->t.strtable, strkey.data, strkey.size, tabval,
+                           a)) {
     return kHpb_MapInsertStatus_OutOfMemory;
   }
   return removed ? kHpb_MapInsertStatus_Replaced
@@ -151,7 +257,7 @@ HPB_INLINE hpb_MapInsertStatus _hpb_Map_Insert(hpb_Map* map, const void* key,
 }
 
 HPB_INLINE size_t _hpb_Map_Size(const hpb_Map* map) {
-  return map->table.t.count;
+  return _hpb_Map_Table(map)->count + map->has_zero_ent;
 }
 
 // Strings/bytes are special-cased in maps.
@@ -36,6 +36,7 @@
 #include <stdlib.h>
 
 #include "hpb/collections/internal/map.h"
+#include "hpb/mem/arena.h"
 #include "hpb/message/internal/extension.h"
 #include "hpb/message/internal/map_entry.h"
 
@@ -54,6 +55,7 @@ typedef struct {
   void const** entries;
   int size;
   int cap;
+  hpb_Arena* arena;  // Scratch space for sorting, created on first use.
 } _hpb_mapsorter;
 
 typedef struct {
@@ -66,18 +68,19 @@ HPB_INLINE void _hpb_mapsorter_init(_hpb_mapsorter* s) {
   s->entries = NULL;
   s->size = 0;
   s->cap = 0;
+  s->arena = NULL;
 }
 
 HPB_INLINE void _hpb_mapsorter_destroy(_hpb_mapsorter* s) {
   if (s->entries) free(s->entries);
+  if (s->arena) hpb_Arena_Free(s->arena);
 }
 
 HPB_INLINE bool _hpb_sortedmap_next(_hpb_mapsorter* s, const hpb_Map* map,
                                     _hpb_sortedmap* sorted, hpb_MapEntry* ent) {
   if (sorted->pos == sorted->end) return false;
   const hpb_tabent* tabent = (const hpb_tabent*)s->entries[sorted->pos++];
-  hpb_StringView key = hpb_tabstrview(tabent->key);
-  _hpb_map_fromkey(key, &ent->data.k, map->key_size);
+  _hpb_map_fromtabkey(tabent->key, &ent->data.k, map->key_size);
   hpb_value val = {tabent->val.val};
   _hpb_map_fromvalue(val, &ent->data.v, map->val_size);
   return true;
@@ -83,21 +83,20 @@ bool hpb_Map_Delete(hpb_Map* map, hpb_MessageValue key, hpb_MessageValue* val) {
 
 bool hpb_Map_Next(const hpb_Map* map, hpb_MessageValue* key,
                   hpb_MessageValue* val, size_t* iter) {
-  hpb_StringView k;
-  hpb_value v;
-  const bool ok = hpb_strtable_next2(&map->table, &k, &v, (intptr_t*)iter);
-  if (ok) {
-    _hpb_map_fromkey(k, key, map->key_size);
-    _hpb_map_fromvalue(v, val, map->val_size);
-  }
-  return ok;
+  const hpb_tabent* ent = _hpb_map_next(map, iter);
+  if (!ent) return false;
+  _hpb_map_fromtabkey(ent->key, key, map->key_size);
+  _hpb_map_fromvalue((hpb_value){ent->val.val}, val, map->val_size);
+  return true;
 }
 
 HPB_API void hpb_Map_SetEntryValue(hpb_Map* map, size_t iter,
                                    hpb_MessageValue val) {
   hpb_value v;
   _hpb_map_tovalue(&val, map->val_size, &v, NULL);
-  hpb_strtable_setentryvalue(&map->table, iter, v);
+  hpb_tabent* ent = _hpb_Map_EntryAt(map, iter);
+  HPB_ASSERT(ent);
+  ent->val.val = v.val;
 }
 
 bool hpb_MapIterator_Next(const hpb_Map* map, size_t* iter) {
@@ -105,29 +104,21 @@ bool hpb_MapIterator_Next(const hpb_Map* map, size_t* iter) {
 }
 
 bool hpb_MapIterator_Done(const hpb_Map* map, size_t iter) {
-  hpb_strtable_iter i;
   HPB_ASSERT(iter != kHpb_Map_Begin);
-  i.t = &map->table;
-  i.index = iter;
-  return hpb_strtable_done(&i);
+  return _hpb_Map_EntryAt(map, iter) == NULL;
 }
 
 // Returns the key and value for this entry of the map.
 hpb_MessageValue hpb_MapIterator_Key(const hpb_Map* map, size_t iter) {
-  hpb_strtable_iter i;
   hpb_MessageValue ret;
-  i.t = &map->table;
-  i.index = iter;
-  _hpb_map_fromkey(hpb_strtable_iter_key(&i), &ret, map->key_size);
+  _hpb_map_fromtabkey(_hpb_Map_EntryAt(map, iter)->key, &ret, map->key_size);
   return ret;
 }
 
 hpb_MessageValue hpb_MapIterator_Value(const hpb_Map* map, size_t iter) {
-  hpb_strtable_iter i;
   hpb_MessageValue ret;
-  i.t = &map->table;
-  i.index = iter;
-  _hpb_map_fromvalue(hpb_strtable_iter_value(&i), &ret, map->val_size);
+  hpb_value v = {_hpb_Map_EntryAt(map, iter)->val.val};
+  _hpb_map_fromvalue(v, &ret, map->val_size);
   return ret;
 }
 
@@ -137,9 +128,17 @@ hpb_Map* _hpb_Map_New(hpb_Arena* a, size_t key_size, size_t value_size) {
   hpb_Map* map = hpb_Arena_Malloc(a, sizeof(hpb_Map));
   if (!map) return NULL;
 
-  hpb_strtable_init(&map->table, 4, a);
   map->key_size = key_size;
   map->val_size = value_size;
+  map->is_strtable = !_hpb_map_isintkey(key_size);
+  map->has_zero_ent = false;
+  memset(&map->zero_ent, 0, sizeof(map->zero_ent));
+
+  if (map->is_strtable) {
+    if (!hpb_strtable_init(&map->t.strtable, 4, a)) return NULL;
+  } else {
+    if (!hpb_inttable_init(&map->t.inttable, a)) return NULL;
+  }
 
   return map;
 }
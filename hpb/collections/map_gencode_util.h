@@ -46,11 +46,7 @@ extern "C" {
 
 HPB_INLINE void _hpb_msg_map_key(const void* msg, void* key, size_t size) {
   const hpb_tabent* ent = (const hpb_tabent*)msg;
-  uint32_t u32len;
-  hpb_StringView k;
-  k.data = hpb_tabstr(ent->key, &u32len);
-  k.size = u32len;
-  _hpb_map_fromkey(k, key, size);
+  _hpb_map_fromtabkey(ent->key, key, size);
 }
 
 HPB_INLINE void _hpb_msg_map_value(const void* msg, void* val, size_t size) {
@@ -30,7 +30,10 @@
 
 #include "hpb/collections/internal/map_sorter.h"
 
+#include <string.h>
+
 #include "hpb/base/internal/log2.h"
+#include "hpb/mem/arena.h"
 
 // Must be last.
 #include "hpb/port/def.inc"
@@ -39,10 +42,8 @@ static void _hpb_mapsorter_getkeys(const void* _a, const void* _b, void* a_key,
                                    void* b_key, size_t size) {
   const hpb_tabent* const* a = _a;
   const hpb_tabent* const* b = _b;
-  hpb_StringView a_tabkey = hpb_tabstrview((*a)->key);
-  hpb_StringView b_tabkey = hpb_tabstrview((*b)->key);
-  _hpb_map_fromkey(a_tabkey, a_key, size);
-  _hpb_map_fromkey(b_tabkey, b_key, size);
+  _hpb_map_fromtabkey((*a)->key, a_key, size);
+  _hpb_map_fromtabkey((*b)->key, b_key, size);
 }
 
 static int _hpb_mapsorter_cmpi64(const void* _a, const void* _b) {
@@ -106,6 +107,150 @@ static int (*const compar[kHpb_FieldType_SizeOf])(const void*, const void*) = {
     [kHpb_FieldType_Bytes] = _hpb_mapsorter_cmpstr,
 };
 
+// Maps with at least this many entries are radix sorted, on a 64-bit key
+// derived from each map key that orders the entries the same way as the
+// comparators above.  Below it, qsort() is faster.
+#define HPB_MAPSORTER_RADIX_MIN 128
+
+typedef struct {
+  uint64_t key;
+  const hpb_tabent* ent;
+} _hpb_sortitem;
+
+// Returns the radix key for an integer map key, flipping the sign bit of
+// signed keys so that they sort as unsigned, and sets `*bytes` to the number
+// of low-order bytes that can differ.
+static uint64_t _hpb_mapsorter_intkey(hpb_FieldType key_type,
+                                      const hpb_tabent* ent, int* bytes) {
+  switch (key_type) {
+    case kHpb_FieldType_Int64:
+    case kHpb_FieldType_SFixed64:
+    case kHpb_FieldType_SInt64: {
+      int64_t k;
+      _hpb_map_fromtabkey(ent->key, &k, 8);
+      *bytes = 8;
+      return (uint64_t)k ^ (1ULL << 63);
+    }
+    case kHpb_FieldType_UInt64:
+    case kHpb_FieldType_Fixed64: {
+      uint64_t k;
+      _hpb_map_fromtabkey(ent->key, &k, 8);
+      *bytes = 8;
+      return k;
+    }
+    case kHpb_FieldType_Int32:
+    case kHpb_FieldType_SInt32:
+    case kHpb_FieldType_SFixed32:
+    case kHpb_FieldType_Enum: {
+      int32_t k;
+      _hpb_map_fromtabkey(ent->key, &k, 4);
+      *bytes = 4;
+      return (uint32_t)k ^ (1U << 31);
+    }
+    case kHpb_FieldType_UInt32:
+    case kHpb_FieldType_Fixed32: {
+      uint32_t k;
+      _hpb_map_fromtabkey(ent->key, &k, 4);
+      *bytes = 4;
+      return k;
+    }
+    case kHpb_FieldType_Bool: {
+      bool k;
+      _hpb_map_fromtabkey(ent->key, &k, 1);
+      *bytes = 1;
+      return k;
+    }
+    default:
+      HPB_UNREACHABLE();
+  }
+}
+
+// Returns the radix key for a string map key: its first eight bytes, in big
+// endian order, with each byte inverted because _hpb_mapsorter_cmpstr()
+// orders differing bytes from high to low.  Strings that share the same
+// eight-byte prefix, or are shorter than eight bytes, may share a key.
+static uint64_t _hpb_mapsorter_strkey(const hpb_tabent* ent) {
+  hpb_StringView k = hpb_tabstrview(ent->key);
+  uint64_t ret = 0;
+  size_t n = HPB_MIN(k.size, 8);
+  for (size_t i = 0; i < n; i++) {
+    ret |= (uint64_t)(uint8_t)~k.data[i] << (56 - 8 * i);
+  }
+  return ret;
+}
+
+// Sorts `items` by key, using `tmp` (of the same size) as scratch space.
+// Passes over bytes that are the same in every key are skipped.  Returns the
+// array holding the result, which is either `items` or `tmp`.
+static _hpb_sortitem* _hpb_mapsorter_radixsort(_hpb_sortitem* items,
+                                               _hpb_sortitem* tmp, size_t n,
+                                               int bytes) {
+  uint32_t counts[8][256];
+  memset(counts, 0, sizeof(counts[0]) * bytes);
+  for (size_t i = 0; i < n; i++) {
+    uint64_t key = items[i].key;
+    for (int b = 0; b < bytes; b++) counts[b][(key >> (8 * b)) & 0xff]++;
+  }
+
+  for (int b = 0; b < bytes; b++) {
+    uint32_t* count = counts[b];
+    if (count[(items[0].key >> (8 * b)) & 0xff] == n) continue;
+    uint32_t total = 0;
+    for (int d = 0; d < 256; d++) {
+      uint32_t c = count[d];
+      count[d] = total;
+      total += c;
+    }
+    for (size_t i = 0; i < n; i++) {
+      tmp[count[(items[i].key >> (8 * b)) & 0xff]++] = items[i];
+    }
+    _hpb_sortitem* swap = items;
+    items = tmp;
+    tmp = swap;
+  }
+  return items;
+}
+
+static int _hpb_mapsorter_cmpitemstr(const void* _a, const void* _b) {
+  const _hpb_sortitem* a = _a;
+  const _hpb_sortitem* b = _b;
+  return _hpb_mapsorter_cmpstr(&a->ent, &b->ent);
+}
+
+// Sorts the `n` entries at `entries` with radix sort, taking scratch space
+// from the sorter's arena.  Returns false if that could not be allocated.
+static bool _hpb_mapsorter_radix(_hpb_mapsorter* s, hpb_FieldType key_type,
+                                 const void** entries, size_t n) {
+  if (!s->arena && !(s->arena = hpb_Arena_New())) return false;
+  _hpb_sortitem* items = hpb_Arena_Malloc(s->arena, 2 * n * sizeof(*items));
+  if (!items) return false;
+
+  bool is_str = key_type == kHpb_FieldType_String ||
+                key_type == kHpb_FieldType_Bytes;
+  int bytes = 8;
+  for (size_t i = 0; i < n; i++) {
+    const hpb_tabent* ent = entries[i];
+    items[i].key = is_str ? _hpb_mapsorter_strkey(ent)
+                          : _hpb_mapsorter_intkey(key_type, ent, &bytes);
+    items[i].ent = ent;
+  }
+  _hpb_sortitem* sorted = _hpb_mapsorter_radixsort(items, items + n, n, bytes);
+
+  // String keys that share a radix key are put in order by a full comparison.
+  for (size_t i = 0; is_str && i < n;) {
+    size_t j = i + 1;
+    while (j < n && sorted[j].key == sorted[i].key) j++;
+    if (j - i > 1) {
+      qsort(&sorted[i], j - i, sizeof(*sorted), _hpb_mapsorter_cmpitemstr);
+    }
+    i = j;
+  }
+
+  for (size_t i = 0; i < n; i++) entries[i] = sorted[i].ent;
+  hpb_Arena_Reset(s->arena, SIZE_MAX);
+  return true;
+}
+
 static bool _hpb_mapsorter_resize(_hpb_mapsorter* s, _hpb_sortedmap* sorted,
                                   int size) {
   sorted->start = s->size;
@@ -130,19 +275,22 @@ bool _hpb_mapsorter_pushmap(_hpb_mapsorter* s, hpb_FieldType key_type,
 
   // Copy non-empty entries from the table to s->entries.
   const void** dst = &s->entries[sorted->start];
-  const hpb_tabent* src = map->table.t.entries;
-  const hpb_tabent* end = src + hpb_table_size(&map->table.t);
-  for (; src < end; src++) {
-    if (!hpb_tabent_isempty(src)) {
-      *dst = src;
-      dst++;
-    }
+  size_t iter = kHpb_Map_Begin;
+  const hpb_tabent* src;
+  while ((src = _hpb_map_next(map, &iter))) {
+    *dst = src;
+    dst++;
   }
   HPB_ASSERT(dst == &s->entries[sorted->end]);
 
   // Sort entries according to the key type.
-  qsort(&s->entries[sorted->start], map_size, sizeof(*s->entries),
-        compar[key_type]);
+  if (map_size <= 1) return true;
+  if (map_size < HPB_MAPSORTER_RADIX_MIN ||
+      !_hpb_mapsorter_radix(s, key_type, &s->entries[sorted->start],
+                            map_size)) {
+    qsort(&s->entries[sorted->start], map_size, sizeof(*s->entries),
+          compar[key_type]);
+  }
   return true;
 }
 
@@ -0,0 +1,172 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "hpb/collections/internal/map_sorter.h"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "hpb/base/descriptor_constants.h"
+#include "hpb/base/string_view.h"
+#include "hpb/collections/map.h"
+#include "hpb/mem/arena.hpp"
+
+namespace {
+
+// Returns the keys of `map` in the order the sorter puts them in.
+template <class T>
+std::vector<T> SortedKeys(_hpb_mapsorter* sorter, hpb_FieldType key_type,
+                          const hpb_Map* map) {
+  _hpb_sortedmap sorted;
+  EXPECT_TRUE(_hpb_mapsorter_pushmap(sorter, key_type, map, &sorted));
+  std::vector<T> ret;
+  hpb_MapEntry ent;
+  while (_hpb_sortedmap_next(sorter, map, &sorted, &ent)) {
+    T key;
+    memcpy(&key, &ent.data.k, sizeof(key));
+    ret.push_back(key);
+  }
+  _hpb_mapsorter_popmap(sorter, &sorted);
+  return ret;
+}
+
+template <class T>
+void CheckIntKeys(hpb_CType ctype, std::initializer_list<hpb_FieldType> types,
+                  const std::vector<T>& keys) {
+  hpb::Arena arena;
+  hpb_Map* map = hpb_Map_New(arena.ptr(), ctype, kHpb_CType_Int32);
+  for (T k : keys) {
+    hpb_MessageValue key, val;
+    memcpy(&key, &k, sizeof(k));
+    val.int32_val = 0;
+    hpb_Map_Insert(map, key, val, arena.ptr());
+  }
+  std::vector<T> expected = keys;
+  std::sort(expected.begin(), expected.end());
+  expected.erase(std::unique(expected.begin(), expected.end()),
+                 expected.end());
+
+  _hpb_mapsorter sorter;
+  _hpb_mapsorter_init(&sorter);
+  for (hpb_FieldType type : types) {
+    EXPECT_EQ(expected, SortedKeys<T>(&sorter, type, map));
+  }
+  _hpb_mapsorter_destroy(&sorter);
+}
+
+const size_t kSizes[] = {0, 1, 5, 127, 128, 129, 300, 5000};
+
+TEST(MapSorterTest, IntKeys) {
+  std::mt19937_64 rng(1234);
+  for (size_t n : kSizes) {
+    SCOPED_TRACE(n);
+    std::vector<int64_t> i64;
+    std::vector<uint64_t> u64;
+    std::vector<int32_t> i32;
+    std::vector<uint32_t> u32;
+    for (size_t i = 0; i < n; i++) {
+      uint64_t r = rng();
+      // Mix keys that only differ in their low bytes with ones that do not.
+      if (i % 2) r &= 0x8000000000000fff;
+      i64.push_back(r);
+      u64.push_back(r);
+      i32.push_back(r);
+      u32.push_back(r);
+    }
+    CheckIntKeys(kHpb_CType_Int64,
+                 {kHpb_FieldType_Int64, kHpb_FieldType_SInt64,
+                  kHpb_FieldType_SFixed64},
+                 i64);
+    CheckIntKeys(kHpb_CType_UInt64,
+                 {kHpb_FieldType_UInt64, kHpb_FieldType_Fixed64}, u64);
+    CheckIntKeys(kHpb_CType_Int32,
+                 {kHpb_FieldType_Int32, kHpb_FieldType_SInt32,
+                  kHpb_FieldType_SFixed32, kHpb_FieldType_Enum},
+                 i32);
+    CheckIntKeys(kHpb_CType_UInt32,
+                 {kHpb_FieldType_UInt32, kHpb_FieldType_Fixed32}, u32);
+  }
+  CheckIntKeys(kHpb_CType_Bool, {kHpb_FieldType_Bool},
+               std::vector<bool>{true, false});
+}
+
+TEST(MapSorterTest, StringKeys) {
+  std::mt19937 rng(1234);
+  // Differing bytes sort from high to low, and a string sorts before any
+  // longer string that it is a prefix of.
+  auto less = [](const std::string& a, const std::string& b) {
+    size_t n = std::min(a.size(), b.size());
+    int cmp = memcmp(a.data(), b.data(), n);
+    if (cmp) return cmp > 0;
+    return a.size() < b.size();
+  };
+  for (size_t n : kSizes) {
+    SCOPED_TRACE(n);
+    hpb::Arena arena;
+    hpb_Map* map = hpb_Map_New(arena.ptr(), kHpb_CType_String,
+                               kHpb_CType_Int32);
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < n; i++) {
+      // Short keys over a small alphabet, including \0 and \xff, so that
+      // many keys share their first eight bytes or are prefixes of others.
+      std::string key(rng() % 12, 0);
+      for (char& c : key) c = "\0\x01" "ab\xfe\xff"[rng() % 6];
+      if (i % 7 == 0) key = std::string(8, 'x') + key;
+      keys.push_back(key);
+    }
+    for (const std::string& k : keys) {
+      hpb_MessageValue key, val;
+      key.str_val = hpb_StringView_FromDataAndSize(k.data(), k.size());
+      val.int32_val = 0;
+      hpb_Map_Insert(map, key, val, arena.ptr());
+    }
+    std::sort(keys.begin(), keys.end(), less);
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    _hpb_mapsorter sorter;
+    _hpb_mapsorter_init(&sorter);
+    for (hpb_FieldType type : {kHpb_FieldType_String, kHpb_FieldType_Bytes}) {
+      std::vector<std::string> sorted;
+      for (hpb_StringView k :
+           SortedKeys<hpb_StringView>(&sorter, type, map)) {
+        sorted.emplace_back(k.data, k.size);
+      }
+      EXPECT_EQ(keys, sorted);
+    }
+    _hpb_mapsorter_destroy(&sorter);
+  }
+}
+
+}  // namespace
@@ -30,6 +30,8 @@
 
 #include "hpb/collections/map.h"
 
+#include <map>
+
 #include "gtest/gtest.h"
 #include "hpb/base/string_view.h"
 #include "hpb/mem/arena.hpp"
@@ -54,3 +56,88 @@ TEST(MapTest, DeleteRegression) {
   EXPECT_TRUE(
       hpb_StringView_IsEqual(insert_value.str_val, delete_value.str_val));
 }
+
+TEST(MapTest, Int64Keys) {
+  hpb::Arena arena;
+  hpb_Map* map = hpb_Map_New(arena.ptr(), kHpb_CType_Int64, kHpb_CType_Int64);
+
+  // Include zero, negative keys, keys that only differ above bit 31, and a
+  // value of -1 (which the inttable array part can't store).
+  std::map<int64_t, int64_t> expected;
+  for (int64_t i = -50; i < 50; i++) expected[i] = i * 3;
+  for (int64_t i = 1; i < 50; i++) expected[i << 32] = -1;
+  expected[INT64_MIN] = 7;
+  expected[INT64_MAX] = 8;
+
+  for (const auto& kv : expected) {
+    hpb_MessageValue key, val;
+    key.int64_val = kv.first;
+    val.int64_val = kv.second;
+    EXPECT_EQ(kHpb_MapInsertStatus_Inserted,
+              hpb_Map_Insert(map, key, val, arena.ptr()));
+  }
+  EXPECT_EQ(expected.size(), hpb_Map_Size(map));
+
+  for (const auto& kv : expected) {
+    hpb_MessageValue key, val;
+    key.int64_val = kv.first;
+    ASSERT_TRUE(hpb_Map_Get(map, key, &val));
+    EXPECT_EQ(kv.second, val.int64_val);
+  }
+
+  std::map<int64_t, int64_t> seen;
+  size_t iter = kHpb_Map_Begin;
+  hpb_MessageValue key, val;
+  while (hpb_Map_Next(map, &key, &val, &iter)) {
+    EXPECT_TRUE(seen.emplace(key.int64_val, val.int64_val).second);
+  }
+  EXPECT_EQ(expected, seen);
+
+  key.int64_val = 0;
+  val.int64_val = 99;
+  EXPECT_EQ(kHpb_MapInsertStatus_Replaced,
+            hpb_Map_Insert(map, key, val, arena.ptr()));
+  ASSERT_TRUE(hpb_Map_Get(map, key, &val));
+  EXPECT_EQ(99, val.int64_val);
+  EXPECT_TRUE(hpb_Map_Delete(map, key, &val));
+  EXPECT_EQ(99, val.int64_val);
+  EXPECT_FALSE(hpb_Map_Get(map, key, &val));
+  EXPECT_EQ(expected.size() - 1, hpb_Map_Size(map));
+
+  hpb_Map_Clear(map);
+  EXPECT_EQ(0, hpb_Map_Size(map));
+  iter = kHpb_Map_Begin;
+  EXPECT_FALSE(hpb_Map_Next(map, &key, &val, &iter));
+}
+
+TEST(MapTest, IntKeyIteratorApis) {
+  hpb::Arena arena;
+  hpb_Map* map = hpb_Map_New(arena.ptr(), kHpb_CType_Bool, kHpb_CType_Int32);
+  hpb_MessageValue key, val;
+  for (bool b : {false, true}) {
+    key.bool_val = b;
+    val.int32_val = b ? 1 : 0;
+    hpb_Map_Insert(map, key, val, arena.ptr());
+  }
+
+  int count = 0;
+  size_t iter = kHpb_Map_Begin;
+  while (hpb_MapIterator_Next(map, &iter)) {
+    EXPECT_FALSE(hpb_MapIterator_Done(map, iter));
+    key = hpb_MapIterator_Key(map, iter);
+    val = hpb_MapIterator_Value(map, iter);
+    EXPECT_EQ(key.bool_val ? 1 : 0, val.int32_val);
+    val.int32_val += 10;
+    hpb_Map_SetEntryValue(map, iter, val);
+    count++;
+  }
+  EXPECT_TRUE(hpb_MapIterator_Done(map, iter));
+  EXPECT_EQ(2, count);
+
+  key.bool_val = false;
+  ASSERT_TRUE(hpb_Map_Get(map, key, &val));
+  EXPECT_EQ(10, val.int32_val);
+  key.bool_val = true;
+  ASSERT_TRUE(hpb_Map_Get(map, key, &val));
+  EXPECT_EQ(11, val.int32_val);
+}
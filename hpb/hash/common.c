@@ -116,7 +116,11 @@ typedef bool eqlfunc_t(hpb_tabkey k1, lookupkey_t k2);
 
 /* Base table (shared code) ***************************************************/
 
-static uint32_t hpb_inthash(uintptr_t key) { return (uint32_t)key; }
+static uint32_t hpb_inthash(uintptr_t key) {
+  // Fold in the high bits so that 64-bit keys which differ only above bit 31
+  // (eg. int64 map keys) don't all land in the same chain.
+  return (uint32_t)key ^ (uint32_t)((uint64_t)key >> 32);
+}
 
 static const hpb_tabent* hpb_getentry(const hpb_table* t, uint32_t hash) {
   return t->entries + (hash & t->mask);
@@ -638,12 +642,11 @@ bool hpb_inttable_init(hpb_inttable* t, hpb_Arena* a) {
 
 bool hpb_inttable_insert(hpb_inttable* t, uintptr_t key, hpb_value val,
                          hpb_Arena* a) {
-  hpb_tabval tabval;
-  tabval.val = val.val;
-  HPB_ASSERT(
-      hpb_arrhas(tabval)); /* This will reject (uint64_t)-1.  Fix this. */
-
   if (key < t->array_size) {
+    hpb_tabval tabval;
+    tabval.val = val.val;
+    /* The array part can't hold (uint64_t)-1, the hash part can. */
+    HPB_ASSERT(hpb_arrhas(tabval));
     HPB_ASSERT(!hpb_arrhas(t->array[key]));
     t->array_count++;
     mutable_array(t)[key].val = val.val;
@@ -712,6 +715,14 @@ bool hpb_inttable_remove(hpb_inttable* t, uintptr_t key, hpb_value* val) {
   return success;
 }
 
+void hpb_inttable_clear(hpb_inttable* t) {
+  size_t bytes = hpb_table_size(&t->t) * sizeof(hpb_tabent);
+  t->t.count = 0;
+  memset((char*)t->t.entries, 0, bytes);
+  t->array_count = 0;
+  memset(mutable_array(t), 0xff, t->array_size * sizeof(hpb_tabval));
+}
+
 void hpb_inttable_compact(hpb_inttable* t, hpb_Arena* a) {
   /* A power-of-two histogram of the table keys. */
   size_t counts[HPB_MAXARRSIZE + 1] = {0};
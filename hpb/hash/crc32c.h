@@ -0,0 +1,64 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// CRC32C (Castagnoli), the checksum used by iSCSI, ext4, LevelDB and Abseil's
+// absl::ComputeCrc32c(), with which the results agree.
+
+#ifndef HPB_HASH_CRC32C_H_
+#define HPB_HASH_CRC32C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Must be last.
+#include "hpb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns the CRC32C of the concatenation of the data `crc` was computed over
+// and the `size` bytes at `data`.  The CRC32C of no data is 0.
+//
+// Uses the CRC32 instruction of SSE4.2 (detected at run time) or ARMv8 when
+// available, which checksums several GB/s.
+HPB_API uint32_t hpb_Crc32c_Extend(uint32_t crc, const void* data, size_t size);
+
+HPB_INLINE uint32_t hpb_Crc32c(const void* data, size_t size) {
+  return hpb_Crc32c_Extend(0, data, size);
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "hpb/port/undef.inc"
+
+#endif /* HPB_HASH_CRC32C_H_ */
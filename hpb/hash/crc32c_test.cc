@@ -0,0 +1,89 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "hpb/hash/crc32c.h"
+
+#include <stdint.h>
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// One bit at a time, straight from the definition.
+uint32_t ReferenceCrc32c(const std::string& data) {
+  uint32_t crc = 0xffffffff;
+  for (unsigned char c : data) {
+    crc ^= c;
+    for (int i = 0; i < 8; i++) crc = (crc >> 1) ^ (0x82f63b78 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+std::string Iota(int n) {
+  std::string s;
+  for (int i = 0; i < n; i++) s.push_back(static_cast<char>(i));
+  return s;
+}
+
+TEST(Crc32cTest, KnownValues) {
+  // From RFC 3720, appendix B.4.
+  EXPECT_EQ(0, hpb_Crc32c("", 0));
+  EXPECT_EQ(0xe3069283, hpb_Crc32c("123456789", 9));
+  EXPECT_EQ(0x8a9136aa, hpb_Crc32c(std::string(32, '\0').data(), 32));
+  EXPECT_EQ(0x62a8ab43, hpb_Crc32c(std::string(32, '\xff').data(), 32));
+  EXPECT_EQ(0x46dd794e, hpb_Crc32c(Iota(32).data(), 32));
+}
+
+TEST(Crc32cTest, MatchesReference) {
+  // Covers every alignment and tail length of the word-at-a-time loops.
+  std::string data;
+  for (int i = 0; i < 300; i++) data.push_back(static_cast<char>(i * 131 + 7));
+  for (size_t begin = 0; begin < 16; begin++) {
+    for (size_t size = 0; begin + size <= data.size(); size += 1 + size / 8) {
+      std::string s = data.substr(begin, size);
+      EXPECT_EQ(ReferenceCrc32c(s), hpb_Crc32c(data.data() + begin, size))
+          << begin << " " << size;
+    }
+  }
+}
+
+TEST(Crc32cTest, Extend) {
+  std::string data = Iota(100);
+  uint32_t whole = hpb_Crc32c(data.data(), data.size());
+  for (size_t split = 0; split <= data.size(); split++) {
+    uint32_t crc = hpb_Crc32c(data.data(), split);
+    crc = hpb_Crc32c_Extend(crc, data.data() + split, data.size() - split);
+    EXPECT_EQ(whole, crc) << split;
+  }
+}
+
+}  // namespace
@@ -54,9 +54,12 @@ bool hpb_inttable_init(hpb_inttable* table, hpb_Arena* a);
 // Returns the number of values in the table.
 size_t hpb_inttable_count(const hpb_inttable* t);
 
+// Removes all entries from the table, keeping its current capacity.
+void hpb_inttable_clear(hpb_inttable* t);
+
 // Inserts the given key into the hashtable with the given value.
 // The key must not already exist in the hash table.
-// The value must not be UINTPTR_MAX.
+// If the key falls in the array part, the value must not be UINTPTR_MAX.
 //
 // If a table resize was required but memory allocation failed, false is
 // returned and the table is unchanged.
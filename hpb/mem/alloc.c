@@ -28,9 +28,18 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE  // For posix_memalign() and MADV_HUGEPAGE.
+#endif
+
 #include "hpb/mem/alloc.h"
 
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
 
 // Must be last.
 #include "hpb/port/def.inc"
@@ -48,3 +57,42 @@ static void* hpb_global_allocfunc(hpb_alloc* alloc, void* ptr, size_t oldsize,
 }
 
 hpb_alloc hpb_alloc_global = {&hpb_global_allocfunc};
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+
+static void* hpb_hugepage_malloc(size_t size) {
+  if (size < HPB_HUGEPAGE_SIZE) return malloc(size);
+
+  void* ret;
+  size = HPB_ALIGN_UP(size, HPB_HUGEPAGE_SIZE);
+  if (posix_memalign(&ret, HPB_HUGEPAGE_SIZE, size) != 0) return NULL;
+  // This is only a hint; the memory is usable even if it fails.
+  madvise(ret, size, MADV_HUGEPAGE);
+  return ret;
+}
+
+static void* hpb_hugepage_allocfunc(hpb_alloc* alloc, void* ptr,
+                                    size_t oldsize, size_t size) {
+  HPB_UNUSED(alloc);
+  if (size == 0) {
+    free(ptr);
+    return NULL;
+  }
+  if (!ptr) return hpb_hugepage_malloc(size);
+
+  // realloc() would not preserve the alignment.
+  void* ret = hpb_hugepage_malloc(size);
+  if (ret) {
+    memcpy(ret, ptr, HPB_MIN(oldsize, size));
+    free(ptr);
+  }
+  return ret;
+}
+
+hpb_alloc hpb_alloc_hugepage = {&hpb_hugepage_allocfunc};
+
+#else
+
+hpb_alloc hpb_alloc_hugepage = {&hpb_global_allocfunc};
+
+#endif
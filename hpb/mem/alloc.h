@@ -77,6 +77,18 @@ HPB_INLINE void hpb_free(hpb_alloc* alloc, void* ptr) {
 
 extern hpb_alloc hpb_alloc_global;
 
+// An allocator for arena blocks that backs every allocation of at least
+// HPB_HUGEPAGE_SIZE bytes with HPB_HUGEPAGE_SIZE-aligned memory that is
+// advised to use transparent huge pages, which cuts TLB misses when walking
+// large arenas.  Such allocations are rounded up to a multiple of
+// HPB_HUGEPAGE_SIZE, so it works best with arenas whose max_block_size is a
+// multiple of it (see hpb_ArenaOptions).  Smaller allocations, and all
+// allocations on platforms without transparent huge pages, use malloc().
+
+#define HPB_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+extern hpb_alloc hpb_alloc_hugepage;
+
 /* Functions that hard-code the global malloc.
  *
  * We still get benefit because we can put custom logic into our global
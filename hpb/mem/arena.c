@@ -32,6 +32,10 @@
 
 #include "hpb/port/atomic.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+
 // Must be last.
 #include "hpb/port/def.inc"
 
@@ -42,6 +46,12 @@ struct _hpb_MemBlock {
   // Data follows.
 };
 
+struct _hpb_ArenaCleanup {
+  _hpb_ArenaCleanup* next;
+  hpb_CleanupFunc* func;
+  void* context;
+};
+
 static const size_t memblock_reserve =
     HPB_ALIGN_UP(sizeof(_hpb_MemBlock), HPB_MALLOC_ALIGN);
 
@@ -118,6 +128,10 @@ uint32_t hpb_Arena_DebugRefCount(hpb_Arena* a) {
 static void hpb_Arena_AddBlock(hpb_Arena* a, void* ptr, size_t size) {
   _hpb_MemBlock* block = ptr;
 
+  a->wasted += a->head.end - a->head.ptr;
+  a->capacity += size - memblock_reserve;
+  a->block_count++;
+
   // Insert into linked list.
   block->size = (uint32_t)size;
   hpb_Atomic_Init(&block->next, a->blocks);
@@ -129,19 +143,40 @@ static void hpb_Arena_AddBlock(hpb_Arena* a, void* ptr, size_t size) {
   HPB_POISON_MEMORY_REGION(a->head.ptr, a->head.end - a->head.ptr);
 }
 
+static void hpb_Arena_AddSpace(hpb_Arena* a, size_t size) {
+  a->space_allocated += size;
+  if (a->space_allocated > a->peak_space_allocated) {
+    a->peak_space_allocated = a->space_allocated;
+  }
+}
+
 static bool hpb_Arena_AllocBlock(hpb_Arena* a, size_t size) {
-  if (!a->block_alloc) return false;
+  // `block_alloc` is tagged, so test the allocator itself.
+  if (!hpb_Arena_BlockAlloc(a)) return false;
   _hpb_MemBlock* last_block = hpb_Atomic_Load(&a->blocks, memory_order_acquire);
-  size_t last_size = last_block != NULL ? last_block->size : 128;
-  size_t block_size = HPB_MAX(size, last_size * 2) + memblock_reserve;
+  uint64_t block_size = last_block != NULL
+                            ? (uint64_t)last_block->size * a->growth_factor
+                            : a->initial_block_size;
+  if (a->max_block_size && block_size > a->max_block_size) {
+    block_size = a->max_block_size;
+  }
+
+  // A single allocation that does not fit gets a block of exactly its size.
+  size_t min_size = size + HPB_ASAN_GUARD_SIZE + memblock_reserve;
+  if (min_size < size || min_size > UINT32_MAX) return false;
+  block_size = HPB_MAX(block_size, min_size);
+  if (block_size > UINT32_MAX) block_size = UINT32_MAX;
+
   _hpb_MemBlock* block = hpb_malloc(hpb_Arena_BlockAlloc(a), block_size);
 
   if (!block) return false;
   hpb_Arena_AddBlock(a, block, block_size);
+  hpb_Arena_AddSpace(a, block_size);
   return true;
 }
 
 void* _hpb_Arena_SlowMalloc(hpb_Arena* a, size_t size) {
+  a->slow_malloc_count++;
   if (!hpb_Arena_AllocBlock(a, size)) return NULL; /* Out of memory. */
   HPB_ASSERT(_hpb_ArenaHas(a) >= size);
   return hpb_Arena_Malloc(a, size);
@@ -149,34 +184,338 @@ void* _hpb_Arena_SlowMalloc(hpb_Arena* a, size_t size) {
 
 /* Public Arena API ***********************************************************/
 
-static hpb_Arena* hpb_Arena_InitSlow(hpb_alloc* alloc) {
-  const size_t first_block_overhead = sizeof(hpb_Arena) + memblock_reserve;
+static const hpb_ArenaOptions hpb_Arena_DefaultOptions = {
+    .initial_block_size = 256,
+    .growth_factor = 2,
+    .max_block_size = 0,
+};
+
+static void hpb_Arena_SetOptions(hpb_Arena* a,
+                                 const hpb_ArenaOptions* options) {
+  const hpb_ArenaOptions* d = &hpb_Arena_DefaultOptions;
+  size_t initial = HPB_ALIGN_MALLOC(options->initial_block_size
+                                       ? options->initial_block_size
+                                       : d->initial_block_size);
+  uint32_t growth =
+      options->growth_factor ? options->growth_factor : d->growth_factor;
+  a->initial_block_size =
+      (uint32_t)HPB_MIN(initial + memblock_reserve, UINT32_MAX);
+  a->growth_factor = growth;
+  a->max_block_size = (uint32_t)HPB_MIN(options->max_block_size, UINT32_MAX);
+}
+
+// Process-wide sampling state; see hpb_ArenaSampler_SetPeriod().
+static HPB_ATOMIC(uint32_t) hpb_ArenaSampler_period;
+static HPB_ATOMIC(uint32_t) hpb_ArenaSampler_tick;
+static HPB_ATOMIC(size_t) hpb_ArenaSampler_samples;
+static HPB_ATOMIC(size_t) hpb_ArenaSampler_bytes_allocated;
+static HPB_ATOMIC(size_t) hpb_ArenaSampler_bytes_wasted;
+static HPB_ATOMIC(size_t) hpb_ArenaSampler_space_allocated;
+static HPB_ATOMIC(size_t) hpb_ArenaSampler_peak_space_allocated;
+static HPB_ATOMIC(size_t) hpb_ArenaSampler_block_count;
+static HPB_ATOMIC(size_t) hpb_ArenaSampler_fuse_count;
+static HPB_ATOMIC(size_t) hpb_ArenaSampler_slow_malloc_count;
+
+static void hpb_Arena_InitStats(hpb_Arena* a) {
+  a->capacity = 0;
+  a->wasted = 0;
+  a->space_allocated = 0;
+  a->peak_space_allocated = 0;
+  a->block_count = 0;
+  a->slow_malloc_count = 0;
+  hpb_Atomic_Init(&a->fuse_count, 0);
+  a->sampled = false;
+
+  uint32_t period =
+      hpb_Atomic_Load(&hpb_ArenaSampler_period, memory_order_relaxed);
+  if (HPB_UNLIKELY(period)) {
+    uint32_t tick =
+        hpb_Atomic_Add(&hpb_ArenaSampler_tick, 1, memory_order_relaxed);
+    a->sampled = tick % period == 0;
+  }
+}
+
+// Stats of this one arena, ignoring any arenas it is fused with.
+static void hpb_Arena_GetOwnStats(hpb_Arena* a, hpb_ArenaStats* stats) {
+  stats->bytes_allocated =
+      a->capacity - a->wasted - (size_t)(a->head.end - a->head.ptr);
+  stats->bytes_wasted = a->wasted;
+  stats->space_allocated = a->space_allocated;
+  stats->peak_space_allocated = a->peak_space_allocated;
+  stats->block_count = a->block_count;
+  stats->fuse_count = hpb_Atomic_Load(&a->fuse_count, memory_order_relaxed);
+  stats->slow_malloc_count = a->slow_malloc_count;
+}
+
+// Adds the stats of `a` to the process-wide totals if it is sampled.
+static void hpb_Arena_ReportStats(hpb_Arena* a) {
+  if (HPB_LIKELY(!a->sampled)) return;
+  hpb_ArenaStats stats;
+  hpb_Arena_GetOwnStats(a, &stats);
+  hpb_Atomic_Add(&hpb_ArenaSampler_samples, 1, memory_order_relaxed);
+  hpb_Atomic_Add(&hpb_ArenaSampler_bytes_allocated, stats.bytes_allocated,
+                 memory_order_relaxed);
+  hpb_Atomic_Add(&hpb_ArenaSampler_bytes_wasted, stats.bytes_wasted,
+                 memory_order_relaxed);
+  hpb_Atomic_Add(&hpb_ArenaSampler_space_allocated, stats.space_allocated,
+                 memory_order_relaxed);
+  hpb_Atomic_Add(&hpb_ArenaSampler_peak_space_allocated,
+                 stats.peak_space_allocated, memory_order_relaxed);
+  hpb_Atomic_Add(&hpb_ArenaSampler_block_count, stats.block_count,
+                 memory_order_relaxed);
+  hpb_Atomic_Add(&hpb_ArenaSampler_fuse_count, stats.fuse_count,
+                 memory_order_relaxed);
+  hpb_Atomic_Add(&hpb_ArenaSampler_slow_malloc_count, stats.slow_malloc_count,
+                 memory_order_relaxed);
+}
+
+void hpb_Arena_GetStats(hpb_Arena* a, hpb_ArenaStats* stats) {
+  memset(stats, 0, sizeof(*stats));
+  a = _hpb_Arena_FindRoot(a).root;
+  while (a != NULL) {
+    hpb_ArenaStats own;
+    hpb_Arena_GetOwnStats(a, &own);
+    stats->bytes_allocated += own.bytes_allocated;
+    stats->bytes_wasted += own.bytes_wasted;
+    stats->space_allocated += own.space_allocated;
+    stats->peak_space_allocated += own.peak_space_allocated;
+    stats->block_count += own.block_count;
+    stats->fuse_count += own.fuse_count;
+    stats->slow_malloc_count += own.slow_malloc_count;
+    a = hpb_Atomic_Load(&a->next, memory_order_relaxed);
+  }
+}
+
+void hpb_ArenaSampler_SetPeriod(uint32_t period) {
+  hpb_Atomic_Store(&hpb_ArenaSampler_period, period, memory_order_relaxed);
+}
+
+size_t hpb_ArenaSampler_GetStats(hpb_ArenaStats* stats) {
+  stats->bytes_allocated = hpb_Atomic_Load(&hpb_ArenaSampler_bytes_allocated,
+                                           memory_order_relaxed);
+  stats->bytes_wasted =
+      hpb_Atomic_Load(&hpb_ArenaSampler_bytes_wasted, memory_order_relaxed);
+  stats->space_allocated =
+      hpb_Atomic_Load(&hpb_ArenaSampler_space_allocated, memory_order_relaxed);
+  stats->peak_space_allocated = hpb_Atomic_Load(
+      &hpb_ArenaSampler_peak_space_allocated, memory_order_relaxed);
+  stats->block_count =
+      hpb_Atomic_Load(&hpb_ArenaSampler_block_count, memory_order_relaxed);
+  stats->fuse_count =
+      hpb_Atomic_Load(&hpb_ArenaSampler_fuse_count, memory_order_relaxed);
+  stats->slow_malloc_count = hpb_Atomic_Load(
+      &hpb_ArenaSampler_slow_malloc_count, memory_order_relaxed);
+  return hpb_Atomic_Load(&hpb_ArenaSampler_samples, memory_order_relaxed);
+}
+
+// Returns every block of the arena, including the one holding the arena
+// itself, to the block allocator.
+static void hpb_Arena_FreeBlocks(hpb_Arena* a) {
+  hpb_alloc* block_alloc = hpb_Arena_BlockAlloc(a);
+  _hpb_MemBlock* block = hpb_Atomic_Load(&a->blocks, memory_order_acquire);
+  while (block != NULL) {
+    // Load first since we are deleting block.
+    _hpb_MemBlock* next_block =
+        hpb_Atomic_Load(&block->next, memory_order_acquire);
+    hpb_free(block_alloc, block);
+    block = next_block;
+  }
+}
+
+static void hpb_Arena_DoReset(hpb_Arena* a, size_t max_retained);
+
+/* Arena pool *****************************************************************/
+
+static void* hpb_arena_pool_allocfunc(hpb_alloc* alloc, void* ptr,
+                                      size_t oldsize, size_t size) {
+  HPB_UNUSED(alloc);
+  return hpb_alloc_global.func(&hpb_alloc_global, ptr, oldsize, size);
+}
+
+hpb_alloc hpb_alloc_arena_pool = {&hpb_arena_pool_allocfunc};
+
+static HPB_ATOMIC(size_t) hpb_ArenaPool_max_bytes = 256 * 1024;
+
+void hpb_ArenaPool_SetMaxBytes(size_t max_bytes) {
+  hpb_Atomic_Store(&hpb_ArenaPool_max_bytes, max_bytes, memory_order_relaxed);
+}
+
+// Caching needs thread-local storage and a way to free the cache when its
+// thread exits.
+#if defined(HPB_THREAD_LOCAL) && (defined(__unix__) || defined(__APPLE__))
+
+// The calling thread's cached arenas, linked through `next`, and the bytes of
+// blocks they hold.
+static HPB_THREAD_LOCAL hpb_Arena* hpb_ArenaPool_arenas;
+static HPB_THREAD_LOCAL size_t hpb_ArenaPool_bytes;
+
+// Whether the calling thread has arranged for its cache to be flushed when it
+// exits.
+static HPB_THREAD_LOCAL bool hpb_ArenaPool_registered;
+
+static pthread_key_t hpb_ArenaPool_key;
+static pthread_once_t hpb_ArenaPool_once = PTHREAD_ONCE_INIT;
+static bool hpb_ArenaPool_key_ok;
+
+static void hpb_ArenaPool_ThreadExit(void* unused) {
+  HPB_UNUSED(unused);
+  hpb_ArenaPool_Flush();
+}
+
+static void hpb_ArenaPool_CreateKey(void) {
+  hpb_ArenaPool_key_ok =
+      pthread_key_create(&hpb_ArenaPool_key, &hpb_ArenaPool_ThreadExit) == 0;
+}
+
+// Arranges for the calling thread's cache to be flushed when it exits.
+// Returns false if that is not possible, in which case it must not cache.
+static bool hpb_ArenaPool_Register(void) {
+  if (HPB_LIKELY(hpb_ArenaPool_registered)) return true;
+  pthread_once(&hpb_ArenaPool_once, &hpb_ArenaPool_CreateKey);
+  // The destructor only runs for threads with a non-NULL value for the key.
+  if (!hpb_ArenaPool_key_ok ||
+      pthread_setspecific(hpb_ArenaPool_key, &hpb_ArenaPool_registered) != 0) {
+    return false;
+  }
+  hpb_ArenaPool_registered = true;
+  return true;
+}
+
+// Caches a pooled arena that is being freed, in place of freeing its blocks.
+// Returns false if `a` is not pooled, in which case nothing was done.  The
+// arena's cleanups must already have run.
+static bool hpb_ArenaPool_Put(hpb_Arena* a) {
+  if (hpb_Arena_BlockAlloc(a) != &hpb_alloc_arena_pool ||
+      hpb_Arena_HasInitialBlock(a) || !hpb_ArenaPool_Register()) {
+    return false;
+  }
+
+  size_t max_bytes =
+      hpb_Atomic_Load(&hpb_ArenaPool_max_bytes, memory_order_relaxed);
+  size_t budget =
+      max_bytes > hpb_ArenaPool_bytes ? max_bytes - hpb_ArenaPool_bytes : 0;
+
+  // The other arenas this one was fused with are being freed too, so nothing
+  // else can reference its blocks any more.
+  hpb_Arena_DoReset(a, budget);
+  if (a->space_allocated > budget) {
+    hpb_Arena_FreeBlocks(a);
+    return true;
+  }
+
+  hpb_Atomic_Store(&a->parent_or_count, _hpb_Arena_TaggedFromRefcount(1),
+                   memory_order_relaxed);
+  hpb_Atomic_Store(&a->tail, a, memory_order_relaxed);
+  hpb_Atomic_Store(&a->next, hpb_ArenaPool_arenas, memory_order_relaxed);
+  hpb_ArenaPool_arenas = a;
+  hpb_ArenaPool_bytes += a->space_allocated;
+  return true;
+}
+
+// Takes the most recently cached arena of the calling thread, or returns NULL
+// if the cache is empty.
+static hpb_Arena* hpb_ArenaPool_Get(void) {
+  hpb_Arena* a = hpb_ArenaPool_arenas;
+  if (!a) return NULL;
+  hpb_ArenaPool_arenas = hpb_Atomic_Load(&a->next, memory_order_relaxed);
+  hpb_ArenaPool_bytes -= a->space_allocated;
+  hpb_Atomic_Store(&a->next, NULL, memory_order_relaxed);
+
+  // Start the statistics over, as for a new arena, but keep accounting for the
+  // retained blocks.
+  size_t capacity = a->capacity;
+  size_t space_allocated = a->space_allocated;
+  uint32_t block_count = a->block_count;
+  hpb_Arena_InitStats(a);
+  a->capacity = capacity;
+  a->space_allocated = space_allocated;
+  a->peak_space_allocated = space_allocated;
+  a->block_count = block_count;
+  return a;
+}
+
+void hpb_ArenaPool_Flush(void) {
+  hpb_Arena* a = hpb_ArenaPool_arenas;
+  hpb_ArenaPool_arenas = NULL;
+  hpb_ArenaPool_bytes = 0;
+  while (a != NULL) {
+    // Load first since arena itself is in one of its blocks.
+    hpb_Arena* next = hpb_Atomic_Load(&a->next, memory_order_relaxed);
+    hpb_Arena_FreeBlocks(a);
+    a = next;
+  }
+}
+
+#else
+
+// Without caching, pooled arenas are plain malloc'd arenas.
+static bool hpb_ArenaPool_Put(hpb_Arena* a) {
+  HPB_UNUSED(a);
+  return false;
+}
+
+static hpb_Arena* hpb_ArenaPool_Get(void) { return NULL; }
+
+void hpb_ArenaPool_Flush(void) {}
+
+#endif
+
+hpb_alloc* _hpb_Arena_DefaultAlloc = &hpb_alloc_global;
+
+void hpb_Arena_SetDefaultAlloc(hpb_alloc* alloc) {
+  _hpb_Arena_DefaultAlloc = alloc;
+}
+
+static hpb_Arena* hpb_Arena_InitSlow(hpb_alloc* alloc,
+                                     const hpb_ArenaOptions* options) {
   hpb_Arena* a;
 
+  if (alloc == &hpb_alloc_arena_pool && (a = hpb_ArenaPool_Get())) {
+    hpb_Arena_SetOptions(a, options);
+    return a;
+  }
+
   /* We need to malloc the initial block. */
   char* mem;
-  size_t n = first_block_overhead + 256;
-  if (!alloc || !(mem = hpb_malloc(alloc, n))) {
+  const size_t first_block_overhead = sizeof(hpb_Arena) + memblock_reserve;
+  size_t initial = options->initial_block_size
+                       ? options->initial_block_size
+                       : hpb_Arena_DefaultOptions.initial_block_size;
+  size_t n = first_block_overhead + HPB_ALIGN_MALLOC(initial);
+  if (options->max_block_size && n > options->max_block_size) {
+    n = HPB_MAX(HPB_ALIGN_DOWN(options->max_block_size, HPB_MALLOC_ALIGN),
+                first_block_overhead);
+  }
+  if (!alloc || n > UINT32_MAX || !(mem = hpb_malloc(alloc, n))) {
     return NULL;
   }
 
   a = HPB_PTR_AT(mem, n - sizeof(*a), hpb_Arena);
-  n -= sizeof(*a);
 
   a->block_alloc = hpb_Arena_MakeBlockAlloc(alloc, 0);
   hpb_Atomic_Init(&a->parent_or_count, _hpb_Arena_TaggedFromRefcount(1));
   hpb_Atomic_Init(&a->next, NULL);
   hpb_Atomic_Init(&a->tail, a);
   hpb_Atomic_Init(&a->blocks, NULL);
+  a->cleanups = NULL;
+  hpb_Arena_SetOptions(a, options);
+  hpb_Arena_InitStats(a);
+  a->head.ptr = NULL;
+  a->head.end = NULL;
 
-  hpb_Arena_AddBlock(a, mem, n);
+  hpb_Arena_AddBlock(a, mem, n - sizeof(*a));
+  hpb_Arena_AddSpace(a, n);
+  a->initial_ptr = a->head.ptr;
 
   return a;
 }
 
-hpb_Arena* hpb_Arena_Init(void* mem, size_t n, hpb_alloc* alloc) {
+hpb_Arena* hpb_Arena_InitWithOptions(void* mem, size_t n, hpb_alloc* alloc,
+                                     const hpb_ArenaOptions* options) {
   hpb_Arena* a;
 
+  if (!options) options = &hpb_Arena_DefaultOptions;
+
   if (n) {
     /* Align initial pointer up so that we return properly-aligned pointers. */
     void* aligned = (void*)HPB_ALIGN_UP((uintptr_t)mem, HPB_MALLOC_ALIGN);
@@ -190,7 +529,7 @@ hpb_Arena* hpb_Arena_Init(void* mem, size_t n, hpb_alloc* alloc) {
   n = HPB_ALIGN_DOWN(n, HPB_ALIGN_OF(hpb_Arena));
 
   if (HPB_UNLIKELY(n < sizeof(hpb_Arena))) {
-    return hpb_Arena_InitSlow(alloc);
+    return hpb_Arena_InitSlow(alloc, options);
   }
 
   a = HPB_PTR_AT(mem, n - sizeof(*a), hpb_Arena);
@@ -199,28 +538,59 @@ hpb_Arena* hpb_Arena_Init(void* mem, size_t n, hpb_alloc* alloc) {
   hpb_Atomic_Init(&a->next, NULL);
   hpb_Atomic_Init(&a->tail, a);
   hpb_Atomic_Init(&a->blocks, NULL);
+  a->cleanups = NULL;
   a->block_alloc = hpb_Arena_MakeBlockAlloc(alloc, 1);
+  hpb_Arena_SetOptions(a, options);
+  hpb_Arena_InitStats(a);
   a->head.ptr = mem;
   a->head.end = HPB_PTR_AT(mem, n - sizeof(*a), char);
+  a->initial_ptr = mem;
+  a->capacity = a->head.end - a->head.ptr;
 
   return a;
 }
 
+hpb_Arena* hpb_Arena_Init(void* mem, size_t n, hpb_alloc* alloc) {
+  return hpb_Arena_InitWithOptions(mem, n, alloc, NULL);
+}
+
+bool hpb_Arena_AddCleanup(hpb_Arena* a, void* context,
+                          hpb_CleanupFunc* func) {
+  _hpb_ArenaCleanup* cleanup = hpb_Arena_Malloc(a, sizeof(*cleanup));
+  if (!cleanup) return false;
+  cleanup->next = a->cleanups;
+  cleanup->func = func;
+  cleanup->context = context;
+  a->cleanups = cleanup;
+  return true;
+}
+
+static void hpb_Arena_RunCleanups(hpb_Arena* a) {
+  _hpb_ArenaCleanup* cleanup = a->cleanups;
+  a->cleanups = NULL;
+  while (cleanup != NULL) {
+    cleanup->func(cleanup->context);
+    cleanup = cleanup->next;
+  }
+}
+
 static void arena_dofree(hpb_Arena* a) {
   HPB_ASSERT(_hpb_Arena_RefCountFromTagged(a->parent_or_count) == 1);
 
+  // Run every cleanup before freeing any block, since a cleanup's context may
+  // have been allocated from any of the fused arenas.
+  for (hpb_Arena* i = a; i != NULL;
+       i = hpb_Atomic_Load(&i->next, memory_order_acquire)) {
+    hpb_Arena_RunCleanups(i);
+  }
+
   while (a != NULL) {
     // Load first since arena itself is likely from one of its blocks.
     hpb_Arena* next_arena =
         (hpb_Arena*)hpb_Atomic_Load(&a->next, memory_order_acquire);
-    hpb_alloc* block_alloc = hpb_Arena_BlockAlloc(a);
-    _hpb_MemBlock* block = hpb_Atomic_Load(&a->blocks, memory_order_acquire);
-    while (block != NULL) {
-      // Load first since we are deleting block.
-      _hpb_MemBlock* next_block =
-          hpb_Atomic_Load(&block->next, memory_order_acquire);
-      hpb_free(block_alloc, block);
-      block = next_block;
+    if (!hpb_ArenaPool_Put(a)) {
+      hpb_Arena_ReportStats(a);
+      hpb_Arena_FreeBlocks(a);
     }
     a = next_arena;
   }
@@ -255,6 +625,145 @@ retry:
   goto retry;
 }
 
+// Whether the arena has ever been fused with another arena.  A fused arena
+// stays in the fused list even after the other arenas have been freed.
+static bool hpb_Arena_IsFused(hpb_Arena* a) {
+  return hpb_Atomic_Load(&a->parent_or_count, memory_order_relaxed) !=
+             _hpb_Arena_TaggedFromRefcount(1) ||
+         hpb_Atomic_Load(&a->next, memory_order_relaxed) != NULL;
+}
+
+bool hpb_Arena_Reset(hpb_Arena* a, size_t max_retained) {
+  // Only an arena that has never been fused owns all of its memory.  Once
+  // fused, its blocks may hold allocations made through the other arenas (and
+  // vice versa), even after those arenas have been freed.
+  if (hpb_Arena_IsFused(a)) return false;
+  hpb_Arena_DoReset(a, max_retained);
+  return true;
+}
+
+static void hpb_Arena_DoReset(hpb_Arena* a, size_t max_retained) {
+  hpb_Arena_ReportStats(a);
+  hpb_Arena_RunCleanups(a);
+
+  hpb_alloc* block_alloc = hpb_Arena_BlockAlloc(a);
+  _hpb_MemBlock* home = NULL;  // The block holding `a` itself, if malloc'd.
+  _hpb_MemBlock* keep = NULL;  // The largest block we may retain.
+  _hpb_MemBlock* block = hpb_Atomic_Load(&a->blocks, memory_order_relaxed);
+
+  // hpb_Arena_AllocBlock() never goes back to a listed block, so a block is
+  // only worth keeping if allocation restarts from it, which it does when it
+  // has more room than the initial region.
+  size_t initial_size = (char*)a - a->initial_ptr;
+  for (_hpb_MemBlock* b = block; b != NULL;
+       b = hpb_Atomic_Load(&b->next, memory_order_relaxed)) {
+    if (HPB_PTR_AT(b, b->size, hpb_Arena) == a) {
+      home = b;
+    } else if (b->size <= max_retained &&
+               b->size - memblock_reserve > initial_size &&
+               (!keep || b->size > keep->size)) {
+      keep = b;
+    }
+  }
+
+  while (block != NULL) {
+    // Load first since we are deleting block.
+    _hpb_MemBlock* next_block =
+        hpb_Atomic_Load(&block->next, memory_order_relaxed);
+    if (block != home && block != keep) hpb_free(block_alloc, block);
+    block = next_block;
+  }
+
+  // The retained block goes first so that hpb_Arena_AllocBlock() keeps growing
+  // from its size.
+  _hpb_MemBlock* blocks = home;
+  if (home) hpb_Atomic_Store(&home->next, NULL, memory_order_relaxed);
+  if (keep) {
+    hpb_Atomic_Store(&keep->next, blocks, memory_order_relaxed);
+    blocks = keep;
+  }
+  hpb_Atomic_Store(&a->blocks, blocks, memory_order_release);
+
+  a->space_allocated = 0;
+  a->block_count = 0;
+  if (home) {
+    a->space_allocated += home->size + sizeof(hpb_Arena);
+    a->block_count++;
+  }
+  if (keep) {
+    a->space_allocated += keep->size;
+    a->block_count++;
+  }
+  a->wasted = 0;
+  a->slow_malloc_count = 0;
+
+  if (keep) {
+    a->head.ptr = HPB_PTR_AT(keep, memblock_reserve, char);
+    a->head.end = HPB_PTR_AT(keep, keep->size, char);
+  } else {
+    a->head.ptr = a->initial_ptr;
+    a->head.end = (char*)a;
+  }
+
+  a->capacity = a->head.end - a->head.ptr;
+
+  // Like hpb_Arena_Init(), never poison memory provided by the caller, since
+  // nothing would unpoison it when the arena is freed.
+  if (!(hpb_Arena_HasInitialBlock(a) && a->head.ptr == a->initial_ptr)) {
+    HPB_POISON_MEMORY_REGION(a->head.ptr, a->head.end - a->head.ptr);
+  }
+}
+
+void hpb_Arena_Mark(hpb_Arena* a, hpb_ArenaMark* mark) {
+  mark->head = a->head;
+  mark->blocks = hpb_Atomic_Load(&a->blocks, memory_order_relaxed);
+  mark->cleanups = a->cleanups;
+  mark->capacity = a->capacity;
+  mark->wasted = a->wasted;
+  mark->space_allocated = a->space_allocated;
+  mark->block_count = a->block_count;
+  mark->fused = hpb_Arena_IsFused(a);
+}
+
+bool hpb_Arena_Rollback(hpb_Arena* a, const hpb_ArenaMark* mark) {
+  if (!mark->fused && hpb_Arena_IsFused(a)) return false;
+
+  // Cleanups registered since the mark live in blocks we are about to free, so
+  // run them first.
+  _hpb_ArenaCleanup* cleanup = a->cleanups;
+  a->cleanups = mark->cleanups;
+  while (cleanup != mark->cleanups) {
+    cleanup->func(cleanup->context);
+    cleanup = cleanup->next;
+  }
+
+  // New blocks are pushed onto the front of the list, so the blocks allocated
+  // since the mark are exactly the ones before the block current at the mark.
+  hpb_alloc* block_alloc = hpb_Arena_BlockAlloc(a);
+  _hpb_MemBlock* block = hpb_Atomic_Load(&a->blocks, memory_order_relaxed);
+  while (block != mark->blocks) {
+    // Load first since we are deleting block.
+    _hpb_MemBlock* next_block =
+        hpb_Atomic_Load(&block->next, memory_order_relaxed);
+    hpb_free(block_alloc, block);
+    block = next_block;
+  }
+  hpb_Atomic_Store(&a->blocks, block, memory_order_release);
+
+  a->head = mark->head;
+  a->capacity = mark->capacity;
+  a->wasted = mark->wasted;
+  a->space_allocated = mark->space_allocated;
+  a->block_count = mark->block_count;
+
+  // Like hpb_Arena_Reset(), never poison memory provided by the caller.
+  if (!(hpb_Arena_HasInitialBlock(a) && a->head.ptr >= a->initial_ptr &&
+        a->head.ptr <= (char*)a)) {
+    HPB_POISON_MEMORY_REGION(a->head.ptr, a->head.end - a->head.ptr);
+  }
+  return true;
+}
+
 static void _hpb_Arena_DoFuseArenaLists(hpb_Arena* const parent,
                                         hpb_Arena* child) {
   hpb_Arena* parent_tail = hpb_Atomic_Load(&parent->tail, memory_order_relaxed);
@@ -365,6 +874,7 @@ bool hpb_Arena_Fuse(hpb_Arena* a1, hpb_Arena* a2) {
   while (true) {
     hpb_Arena* new_root = _hpb_Arena_DoFuse(a1, a2, &ref_delta);
     if (new_root != NULL && _hpb_Arena_FixupRefs(new_root, ref_delta)) {
+      hpb_Atomic_Add(&a1->fuse_count, 1, memory_order_relaxed);
       return true;
     }
   }
@@ -62,14 +62,158 @@ typedef struct {
 extern "C" {
 #endif
 
+// Controls how an arena sizes the blocks it allocates from its hpb_alloc.
+// Zero-initialized fields select the defaults.
+typedef struct {
+  // Usable size of the first block.  Defaults to 256.
+  size_t initial_block_size;
+
+  // Each new block is this many times as large as the previous one.  Defaults
+  // to 2; 1 gives blocks of constant size.
+  uint32_t growth_factor;
+
+  // Upper bound on the size of a block, including its header, which bounds
+  // how much memory a large arena can overshoot by.  A single allocation that
+  // does not fit still gets a block of its own.  Defaults to unbounded.
+  size_t max_block_size;
+} hpb_ArenaOptions;
+
 // Creates an arena from the given initial block (if any -- n may be 0).
 // Additional blocks will be allocated from |alloc|.  If |alloc| is NULL, this
 // is a fixed-size arena and cannot grow.
 HPB_API hpb_Arena* hpb_Arena_Init(void* mem, size_t n, hpb_alloc* alloc);
 
+// Like hpb_Arena_Init(), with a custom block growth policy.  |options| may be
+// NULL for the defaults.
+HPB_API hpb_Arena* hpb_Arena_InitWithOptions(void* mem, size_t n,
+                                             hpb_alloc* alloc,
+                                             const hpb_ArenaOptions* options);
+
 HPB_API void hpb_Arena_Free(hpb_Arena* a);
 HPB_API bool hpb_Arena_Fuse(hpb_Arena* a, hpb_Arena* b);
 
+typedef void hpb_CleanupFunc(void* context);
+
+// Registers |func| to be called with |context| once the arena's memory is
+// released: when the arena and every arena fused with it have been freed, or
+// when the arena is reset.  Cleanups run in reverse order of registration,
+// before any memory of the fused arenas is returned to the allocator.
+//
+// This ties the lifetime of external memory to the arena, e.g. an input
+// buffer that messages alias with kHpb_DecodeOption_AliasString, where |func|
+// unmaps the buffer or drops a reference to it.  Returns false, without
+// registering |func|, if the arena is out of memory.
+HPB_API bool hpb_Arena_AddCleanup(hpb_Arena* a, void* context,
+                                  hpb_CleanupFunc* func);
+
+// Discards every allocation made from the arena so that its memory can be
+// reused, which is much cheaper than freeing the arena and creating a new one.
+// The initial block (if any) is kept, along with the largest other block whose
+// size does not exceed |max_retained|, if it is larger than the initial block;
+// allocation then restarts from that block.  All other blocks are returned to
+// the allocator.  Pass SIZE_MAX to keep the largest block, or 0 to keep none.
+// Cleanups registered with hpb_Arena_AddCleanup() are run first.
+//
+// An arena that has been fused with another arena cannot be reset, even if
+// the other arena has since been freed; this returns false and leaves the
+// arena untouched.
+HPB_API bool hpb_Arena_Reset(hpb_Arena* a, size_t max_retained);
+
+// A position in an arena, recorded by hpb_Arena_Mark().  The fields are
+// private to the arena implementation.
+typedef struct {
+  _hpb_ArenaHead head;
+  void* blocks;
+  void* cleanups;
+  size_t capacity;
+  size_t wasted;
+  size_t space_allocated;
+  uint32_t block_count;
+  bool fused;
+} hpb_ArenaMark;
+
+// Records the current position of the arena in |mark|, so that every
+// allocation made after it can later be discarded with hpb_Arena_Rollback().
+// This is useful for speculative parsing: decode into the arena, and roll back
+// instead of freeing the arena if the result is thrown away.
+HPB_API void hpb_Arena_Mark(hpb_Arena* a, hpb_ArenaMark* mark);
+
+// Discards every allocation made from the arena since |mark| was recorded:
+// cleanups registered since then are run, blocks allocated since then are
+// returned to the allocator, and allocation resumes where it was at the mark.
+// Marks recorded after |mark| become invalid, and so does |mark| itself once
+// the arena is reset.
+//
+// The arena must not be fused with another arena between the mark and the
+// rollback, since the arenas fused with it could then hold references into the
+// discarded memory.  If the arena was not fused when |mark| was recorded, this
+// is checked: this returns false and leaves the arena untouched.
+HPB_API bool hpb_Arena_Rollback(hpb_Arena* a, const hpb_ArenaMark* mark);
+
+typedef struct {
+  // Bytes handed out by the arena, including alignment padding.
+  size_t bytes_allocated;
+
+  // Bytes left unused at the end of blocks the arena has moved past.
+  size_t bytes_wasted;
+
+  // Bytes currently obtained from the block allocator, and the most there has
+  // been at any one time.
+  size_t space_allocated;
+  size_t peak_space_allocated;
+
+  size_t block_count;        // Blocks currently owned by the arena.
+  size_t fuse_count;         // Successful hpb_Arena_Fuse() calls.
+  size_t slow_malloc_count;  // Allocations that did not fit the block.
+} hpb_ArenaStats;
+
+// Returns statistics for the arena, summed over all arenas fused with it.
+// The counters are maintained outside of the allocation fast path, so this is
+// cheap to call.  Except for peak_space_allocated, statistics start over when
+// the arena is reset.  Like allocation, this must not race with other uses of
+// the arenas involved.
+HPB_API void hpb_Arena_GetStats(hpb_Arena* a, hpb_ArenaStats* stats);
+
+// Process-wide arena statistics, gathered by sampling.  When |period| is
+// non-zero, one out of every |period| arenas created from then on is sampled,
+// and its statistics are added to process-wide totals when it is freed or
+// reset.  Sampling is off by default.
+HPB_API void hpb_ArenaSampler_SetPeriod(uint32_t period);
+
+// Fills |stats| with the totals collected by sampling so far and returns the
+// number of samples they are summed over.
+HPB_API size_t hpb_ArenaSampler_GetStats(hpb_ArenaStats* stats);
+
+// A block allocator that pools arenas per thread, for programs that create and
+// free many short-lived arenas.  When an arena created from it without an
+// initial block is freed, it is reset (see hpb_Arena_Reset()) and kept in a
+// cache of the freeing thread, as long as the cache stays under its size
+// limit.  Creating such an arena takes the most recently cached arena of the
+// calling thread, if any, so that neither creating nor freeing it touches
+// malloc().  Arenas fused together are cached separately.
+//
+// A reused arena keeps the blocks it retained, so its first block may be
+// larger than hpb_ArenaOptions.initial_block_size asks for.
+extern hpb_alloc hpb_alloc_arena_pool;
+
+// Sets the number of bytes of blocks that each thread may cache for
+// hpb_alloc_arena_pool.  Defaults to 256 KiB; 0 disables caching.  Lowering
+// the limit does not shrink caches that are already above it.
+HPB_API void hpb_ArenaPool_SetMaxBytes(size_t max_bytes);
+
+// Frees every arena in the calling thread's cache.  This happens
+// automatically when a thread exits, so it is only needed to release the
+// memory of a thread that stops using pooled arenas but keeps running.
+HPB_API void hpb_ArenaPool_Flush(void);
+
+// Sets the block allocator used by hpb_Arena_New(), hpb_alloc_global by
+// default.  Passing &hpb_alloc_arena_pool routes all such arenas through the
+// per-thread pools.  This must not race with hpb_Arena_New(), so call it
+// during startup.
+HPB_API void hpb_Arena_SetDefaultAlloc(hpb_alloc* alloc);
+
+extern hpb_alloc* _hpb_Arena_DefaultAlloc;
+
 void* _hpb_Arena_SlowMalloc(hpb_Arena* a, size_t size);
 size_t hpb_Arena_SpaceAllocated(hpb_Arena* arena);
 uint32_t hpb_Arena_DebugRefCount(hpb_Arena* arena);
@@ -140,7 +284,7 @@ HPB_API_INLINE void* hpb_Arena_Realloc(hpb_Arena* a, void* ptr, size_t oldsize,
 }
 
 HPB_API_INLINE hpb_Arena* hpb_Arena_New(void) {
-  return hpb_Arena_Init(NULL, 0, &hpb_alloc_global);
+  return hpb_Arena_Init(NULL, 0, _hpb_Arena_DefaultAlloc);
 }
 
 #ifdef __cplusplus
@@ -31,6 +31,8 @@
 #ifndef HPB_MEM_ARENA_HPP_
 #define HPB_MEM_ARENA_HPP_
 
+#include <stdint.h>
+
 #include <memory>
 
 #include "hpb/mem/arena.h"
@@ -49,6 +51,24 @@ class Arena {
 
   void Fuse(Arena& other) { hpb_Arena_Fuse(ptr(), other.ptr()); }
 
+  bool Reset(size_t max_retained = SIZE_MAX) {
+    return hpb_Arena_Reset(ptr(), max_retained);
+  }
+
+  hpb_ArenaMark Mark() {
+    hpb_ArenaMark mark;
+    hpb_Arena_Mark(ptr(), &mark);
+    return mark;
+  }
+
+  bool Rollback(const hpb_ArenaMark& mark) {
+    return hpb_Arena_Rollback(ptr(), &mark);
+  }
+
+  bool AddCleanup(void* context, hpb_CleanupFunc* func) {
+    return hpb_Arena_AddCleanup(ptr(), context, func);
+  }
+
  protected:
   std::unique_ptr<hpb_Arena, decltype(&hpb_Arena_Free)> ptr_;
 };
@@ -83,6 +83,488 @@ TEST(ArenaTest, FuseWithInitialBlock) {
   for (int i = 0; i < size; ++i) hpb_Arena_Free(arenas[i]);
 }
 
+// Counts the blocks that are live at any time.
+struct CountingAlloc {
+  hpb_alloc alloc;
+  int live = 0;
+  int mallocs = 0;
+};
+
+extern "C" void* CountingAllocFunc(hpb_alloc* alloc, void* ptr,
+                                   size_t oldsize, size_t size) {
+  CountingAlloc* counting = reinterpret_cast<CountingAlloc*>(alloc);
+  if (size == 0) {
+    counting->live--;
+  } else if (ptr == nullptr) {
+    counting->live++;
+    counting->mallocs++;
+  }
+  return hpb_alloc_global.func(alloc, ptr, oldsize, size);
+}
+
+TEST(ArenaTest, Reset) {
+  CountingAlloc counting;
+  counting.alloc.func = &CountingAllocFunc;
+  hpb_Arena* arena = hpb_Arena_Init(nullptr, 0, &counting.alloc);
+  size_t initial = hpb_Arena_SpaceAllocated(arena);
+
+  for (int i = 0; i < 100; i++) hpb_Arena_Malloc(arena, 1000);
+  EXPECT_GT(counting.live, 2);
+
+  // Keeps the first block and the largest one.
+  EXPECT_TRUE(hpb_Arena_Reset(arena, SIZE_MAX));
+  EXPECT_EQ(2, counting.live);
+  size_t retained = hpb_Arena_SpaceAllocated(arena);
+  EXPECT_GT(retained, 50000);
+
+  // The retained block is reused without touching the allocator.
+  int mallocs = counting.mallocs;
+  for (int i = 0; i < 50; i++) {
+    void* mem = hpb_Arena_Malloc(arena, 1000);
+    ASSERT_NE(nullptr, mem);
+    memset(mem, 0, 1000);
+  }
+  EXPECT_EQ(mallocs, counting.mallocs);
+  EXPECT_EQ(retained, hpb_Arena_SpaceAllocated(arena));
+
+  // A block larger than the retention limit is not kept.
+  EXPECT_TRUE(hpb_Arena_Reset(arena, 1000));
+  EXPECT_EQ(1, counting.live);
+  EXPECT_EQ(initial, hpb_Arena_SpaceAllocated(arena));
+
+  hpb_Arena_Free(arena);
+  EXPECT_EQ(0, counting.live);
+}
+
+TEST(ArenaTest, ResetWithInitialBlock) {
+  char buf[1024];
+  CountingAlloc counting;
+  counting.alloc.func = &CountingAllocFunc;
+  hpb_Arena* arena = hpb_Arena_Init(buf, sizeof(buf), &counting.alloc);
+  char* first = static_cast<char*>(hpb_Arena_Malloc(arena, 16));
+  EXPECT_TRUE(first >= buf && first < buf + sizeof(buf));
+  for (int i = 0; i < 100; i++) hpb_Arena_Malloc(arena, 1000);
+
+  // Allocations come from the initial block again after a reset.
+  EXPECT_TRUE(hpb_Arena_Reset(arena, 0));
+  EXPECT_EQ(0, counting.live);
+  EXPECT_EQ(first, hpb_Arena_Malloc(arena, 16));
+
+  hpb_Arena_Free(arena);
+}
+
+TEST(ArenaTest, ResetWithLargeInitialBlock) {
+  std::vector<char> buf(16384);
+  CountingAlloc counting;
+  counting.alloc.func = &CountingAllocFunc;
+  hpb_Arena* arena = hpb_Arena_Init(buf.data(), buf.size(), &counting.alloc);
+  for (int i = 0; i < 20; i++) hpb_Arena_Malloc(arena, 1000);
+  EXPECT_GT(counting.live, 0);
+
+  // Blocks smaller than the initial block would never be allocated from
+  // again, so none are kept.
+  EXPECT_TRUE(hpb_Arena_Reset(arena, SIZE_MAX));
+  EXPECT_EQ(0, counting.live);
+
+  hpb_Arena_Free(arena);
+}
+
+TEST(ArenaTest, ResetFused) {
+  hpb_Arena* arena1 = hpb_Arena_New();
+  hpb_Arena* arena2 = hpb_Arena_New();
+  EXPECT_TRUE(hpb_Arena_Reset(arena1, SIZE_MAX));
+
+  EXPECT_TRUE(hpb_Arena_Fuse(arena1, arena2));
+  EXPECT_FALSE(hpb_Arena_Reset(arena1, SIZE_MAX));
+  EXPECT_FALSE(hpb_Arena_Reset(arena2, SIZE_MAX));
+
+  // Still fused in memory after the other arena is freed.
+  hpb_Arena_Free(arena2);
+  EXPECT_FALSE(hpb_Arena_Reset(arena1, SIZE_MAX));
+  hpb_Arena_Free(arena1);
+}
+
+// An external buffer with a reference count, released by arena cleanups.
+struct SharedBuffer {
+  int refs = 1;
+  std::vector<int>* released;
+  int id;
+};
+
+extern "C" void UnrefSharedBuffer(void* context) {
+  SharedBuffer* buf = static_cast<SharedBuffer*>(context);
+  if (--buf->refs == 0) buf->released->push_back(buf->id);
+}
+
+TEST(ArenaTest, Cleanup) {
+  std::vector<int> released;
+  SharedBuffer bufs[3] = {{1, &released, 0}, {1, &released, 1},
+                          {1, &released, 2}};
+  hpb_Arena* arena = hpb_Arena_New();
+  for (SharedBuffer& buf : bufs) {
+    EXPECT_TRUE(hpb_Arena_AddCleanup(arena, &buf, &UnrefSharedBuffer));
+  }
+  EXPECT_TRUE(released.empty());
+  hpb_Arena_Free(arena);
+  EXPECT_THAT(released, testing::ElementsAre(2, 1, 0));
+}
+
+TEST(ArenaTest, CleanupFused) {
+  std::vector<int> released;
+  SharedBuffer buf = {2, &released, 7};
+  hpb_Arena* arena1 = hpb_Arena_New();
+  hpb_Arena* arena2 = hpb_Arena_New();
+  hpb_Arena* arena3 = hpb_Arena_New();
+  EXPECT_TRUE(hpb_Arena_AddCleanup(arena1, &buf, &UnrefSharedBuffer));
+  EXPECT_TRUE(hpb_Arena_AddCleanup(arena3, &buf, &UnrefSharedBuffer));
+  EXPECT_TRUE(hpb_Arena_Fuse(arena1, arena2));
+  EXPECT_TRUE(hpb_Arena_Fuse(arena2, arena3));
+
+  // The context lives in one of the fused arenas, and must still be valid
+  // when every cleanup runs.
+  SharedBuffer* inner =
+      static_cast<SharedBuffer*>(hpb_Arena_Malloc(arena2, sizeof(buf)));
+  *inner = {1, &released, 8};
+  EXPECT_TRUE(hpb_Arena_AddCleanup(arena1, inner, &UnrefSharedBuffer));
+
+  hpb_Arena_Free(arena1);
+  hpb_Arena_Free(arena3);
+  EXPECT_TRUE(released.empty());
+  hpb_Arena_Free(arena2);
+  EXPECT_THAT(released, testing::UnorderedElementsAre(7, 8));
+}
+
+TEST(ArenaTest, CleanupOnReset) {
+  std::vector<int> released;
+  SharedBuffer buf = {1, &released, 3};
+  hpb_Arena* arena = hpb_Arena_New();
+  EXPECT_TRUE(hpb_Arena_AddCleanup(arena, &buf, &UnrefSharedBuffer));
+  EXPECT_TRUE(hpb_Arena_Reset(arena, SIZE_MAX));
+  EXPECT_THAT(released, testing::ElementsAre(3));
+  hpb_Arena_Free(arena);
+  EXPECT_THAT(released, testing::ElementsAre(3));
+}
+
+TEST(ArenaTest, CleanupOutOfMemory) {
+  std::vector<int> released;
+  SharedBuffer buf = {1, &released, 4};
+  char mem[1024];
+  hpb_Arena* arena = hpb_Arena_Init(mem, sizeof(mem), nullptr);
+  while (hpb_Arena_Malloc(arena, 16)) {
+  }
+  EXPECT_FALSE(hpb_Arena_AddCleanup(arena, &buf, &UnrefSharedBuffer));
+  hpb_Arena_Free(arena);
+  EXPECT_TRUE(released.empty());
+}
+
+TEST(ArenaTest, Rollback) {
+  CountingAlloc counting;
+  counting.alloc.func = &CountingAllocFunc;
+  hpb_Arena* arena = hpb_Arena_Init(nullptr, 0, &counting.alloc);
+  hpb_Arena_Malloc(arena, 16);
+  hpb_ArenaStats before;
+  hpb_Arena_GetStats(arena, &before);
+  int live = counting.live;
+
+  hpb_ArenaMark mark;
+  hpb_Arena_Mark(arena, &mark);
+  char* next = static_cast<char*>(hpb_Arena_Malloc(arena, 16));
+  for (int i = 0; i < 100; i++) hpb_Arena_Malloc(arena, 1000);
+  EXPECT_GT(counting.live, live);
+
+  // Every block allocated after the mark is released, and allocation resumes
+  // from the same position.
+  EXPECT_TRUE(hpb_Arena_Rollback(arena, &mark));
+  EXPECT_EQ(live, counting.live);
+  hpb_ArenaStats after;
+  hpb_Arena_GetStats(arena, &after);
+  EXPECT_EQ(before.bytes_allocated, after.bytes_allocated);
+  EXPECT_EQ(before.space_allocated, after.space_allocated);
+  EXPECT_EQ(before.block_count, after.block_count);
+  EXPECT_EQ(next, hpb_Arena_Malloc(arena, 16));
+
+  // A mark can be rolled back to repeatedly.
+  for (int i = 0; i < 100; i++) hpb_Arena_Malloc(arena, 1000);
+  EXPECT_TRUE(hpb_Arena_Rollback(arena, &mark));
+  EXPECT_EQ(live, counting.live);
+
+  hpb_Arena_Free(arena);
+  EXPECT_EQ(0, counting.live);
+}
+
+TEST(ArenaTest, RollbackCleanups) {
+  std::vector<int> released;
+  SharedBuffer bufs[2] = {{1, &released, 0}, {1, &released, 1}};
+  char mem[1024];
+  hpb_Arena* arena = hpb_Arena_Init(mem, sizeof(mem), &hpb_alloc_global);
+  EXPECT_TRUE(hpb_Arena_AddCleanup(arena, &bufs[0], &UnrefSharedBuffer));
+  hpb_ArenaMark mark;
+  hpb_Arena_Mark(arena, &mark);
+  EXPECT_TRUE(hpb_Arena_AddCleanup(arena, &bufs[1], &UnrefSharedBuffer));
+  for (int i = 0; i < 10; i++) hpb_Arena_Malloc(arena, 1000);
+
+  // Only the cleanup registered after the mark runs.
+  EXPECT_TRUE(hpb_Arena_Rollback(arena, &mark));
+  EXPECT_THAT(released, testing::ElementsAre(1));
+  hpb_Arena_Free(arena);
+  EXPECT_THAT(released, testing::ElementsAre(1, 0));
+}
+
+TEST(ArenaTest, RollbackFused) {
+  hpb_Arena* arena1 = hpb_Arena_New();
+  hpb_Arena* arena2 = hpb_Arena_New();
+  hpb_ArenaMark mark;
+  hpb_Arena_Mark(arena1, &mark);
+  hpb_Arena_Malloc(arena1, 1000);
+  EXPECT_TRUE(hpb_Arena_Fuse(arena1, arena2));
+  EXPECT_FALSE(hpb_Arena_Rollback(arena1, &mark));
+
+  // Arenas that were already fused at the mark can be rolled back.
+  hpb_Arena_Mark(arena2, &mark);
+  hpb_Arena_Malloc(arena2, 1000);
+  EXPECT_TRUE(hpb_Arena_Rollback(arena2, &mark));
+
+  hpb_Arena_Free(arena1);
+  hpb_Arena_Free(arena2);
+}
+
+// Records the size of every block allocated.
+struct RecordingAlloc {
+  hpb_alloc alloc;
+  hpb_alloc* delegate;
+  std::vector<size_t> sizes;
+};
+
+extern "C" void* RecordingAllocFunc(hpb_alloc* alloc, void* ptr,
+                                    size_t oldsize, size_t size) {
+  RecordingAlloc* recording = reinterpret_cast<RecordingAlloc*>(alloc);
+  if (ptr == nullptr && size != 0) recording->sizes.push_back(size);
+  return recording->delegate->func(recording->delegate, ptr, oldsize, size);
+}
+
+TEST(ArenaTest, GrowthOptions) {
+  RecordingAlloc recording;
+  recording.alloc.func = &RecordingAllocFunc;
+  recording.delegate = &hpb_alloc_global;
+  hpb_ArenaOptions options = {};
+  options.initial_block_size = 4096;
+  options.growth_factor = 4;
+  options.max_block_size = 100000;
+  hpb_Arena* arena =
+      hpb_Arena_InitWithOptions(nullptr, 0, &recording.alloc, &options);
+  for (int i = 0; i < 1000; i++) hpb_Arena_Malloc(arena, 1000);
+  hpb_Arena_Malloc(arena, 500000);
+  hpb_Arena_Malloc(arena, 1000);
+
+  ASSERT_GT(recording.sizes.size(), 4);
+  EXPECT_GT(recording.sizes[0], 4096);
+  EXPECT_LT(recording.sizes[0], 8192);
+  EXPECT_GT(recording.sizes[1], recording.sizes[0] * 3);
+  size_t n = recording.sizes.size();
+  for (size_t i = 0; i < n; i++) {
+    if (i == n - 2) {
+      // The oversized allocation gets a block of its own.
+      EXPECT_GT(recording.sizes[i], 500000);
+      EXPECT_LT(recording.sizes[i], 501000);
+    } else {
+      EXPECT_LE(recording.sizes[i], 100000);
+    }
+  }
+  EXPECT_EQ(100000, recording.sizes[n - 1]);
+  hpb_Arena_Free(arena);
+}
+
+TEST(ArenaTest, ConstantGrowth) {
+  RecordingAlloc recording;
+  recording.alloc.func = &RecordingAllocFunc;
+  recording.delegate = &hpb_alloc_global;
+  char buf[512];
+  hpb_ArenaOptions options = {};
+  options.initial_block_size = 8192;
+  options.growth_factor = 1;
+  hpb_Arena* arena =
+      hpb_Arena_InitWithOptions(buf, sizeof(buf), &recording.alloc, &options);
+  for (int i = 0; i < 100; i++) hpb_Arena_Malloc(arena, 1000);
+  ASSERT_GT(recording.sizes.size(), 5);
+  for (size_t size : recording.sizes) EXPECT_EQ(recording.sizes[0], size);
+  hpb_Arena_Free(arena);
+}
+
+TEST(ArenaTest, HugePageAlloc) {
+  RecordingAlloc recording;
+  recording.alloc.func = &RecordingAllocFunc;
+  recording.delegate = &hpb_alloc_hugepage;
+  hpb_ArenaOptions options = {};
+  options.max_block_size = HPB_HUGEPAGE_SIZE;
+  hpb_Arena* arena =
+      hpb_Arena_InitWithOptions(nullptr, 0, &recording.alloc, &options);
+  for (int i = 0; i < 10000; i++) {
+    char* mem = static_cast<char*>(hpb_Arena_Malloc(arena, 1000));
+    ASSERT_NE(nullptr, mem);
+    memset(mem, i, 1000);
+  }
+  EXPECT_EQ(HPB_HUGEPAGE_SIZE, recording.sizes.back());
+  hpb_Arena_Free(arena);
+
+  void* block = hpb_malloc(&hpb_alloc_hugepage, HPB_HUGEPAGE_SIZE);
+  ASSERT_NE(nullptr, block);
+#if defined(__linux__)
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(block) % HPB_HUGEPAGE_SIZE);
+#endif
+  block = hpb_realloc(&hpb_alloc_hugepage, block, HPB_HUGEPAGE_SIZE,
+                      HPB_HUGEPAGE_SIZE + 1);
+  ASSERT_NE(nullptr, block);
+  hpb_free(&hpb_alloc_hugepage, block);
+}
+
+TEST(ArenaTest, Pool) {
+  hpb_ArenaPool_Flush();
+  hpb_Arena* arena = hpb_Arena_Init(nullptr, 0, &hpb_alloc_arena_pool);
+  for (int i = 0; i < 10; i++) hpb_Arena_Malloc(arena, 1000);
+  hpb_Arena_Free(arena);
+
+  // The freed arena is reused with its largest block, and starts out empty.
+  hpb_Arena* reused = hpb_Arena_Init(nullptr, 0, &hpb_alloc_arena_pool);
+  EXPECT_EQ(arena, reused);
+  hpb_ArenaStats stats;
+  hpb_Arena_GetStats(reused, &stats);
+  EXPECT_EQ(0, stats.bytes_allocated);
+  EXPECT_EQ(2, stats.block_count);
+  EXPECT_EQ(0, stats.fuse_count);
+  EXPECT_EQ(stats.space_allocated, stats.peak_space_allocated);
+
+  // Fused arenas are each cached once they are all freed.
+  hpb_Arena* other = hpb_Arena_Init(nullptr, 0, &hpb_alloc_arena_pool);
+  EXPECT_TRUE(hpb_Arena_Fuse(reused, other));
+  hpb_Arena_Free(reused);
+  hpb_Arena_Free(other);
+  hpb_Arena* a1 = hpb_Arena_Init(nullptr, 0, &hpb_alloc_arena_pool);
+  hpb_Arena* a2 = hpb_Arena_Init(nullptr, 0, &hpb_alloc_arena_pool);
+  EXPECT_EQ(1, hpb_Arena_DebugRefCount(a1));
+  EXPECT_EQ(1, hpb_Arena_DebugRefCount(a2));
+  EXPECT_TRUE(hpb_Arena_Reset(a1, SIZE_MAX));
+  EXPECT_TRUE(hpb_Arena_Reset(a2, SIZE_MAX));
+  hpb_Arena_Free(a1);
+  hpb_Arena_Free(a2);
+  hpb_ArenaPool_Flush();
+}
+
+TEST(ArenaTest, PoolMaxBytes) {
+  hpb_ArenaPool_Flush();
+  hpb_ArenaPool_SetMaxBytes(4096);
+  hpb_Arena* arena = hpb_Arena_Init(nullptr, 0, &hpb_alloc_arena_pool);
+  hpb_Arena_Malloc(arena, 100000);
+  hpb_Arena_Free(arena);
+
+  // The large block did not fit in the cache.
+  hpb_Arena* reused = hpb_Arena_Init(nullptr, 0, &hpb_alloc_arena_pool);
+  EXPECT_EQ(arena, reused);
+  EXPECT_LT(hpb_Arena_SpaceAllocated(reused), 4096);
+  hpb_Arena_Free(reused);
+
+  hpb_ArenaPool_SetMaxBytes(0);
+  hpb_ArenaPool_Flush();
+  arena = hpb_Arena_Init(nullptr, 0, &hpb_alloc_arena_pool);
+  hpb_Arena_Free(arena);
+  hpb_ArenaPool_SetMaxBytes(256 * 1024);
+  hpb_ArenaPool_Flush();
+}
+
+TEST(ArenaTest, PoolPerThread) {
+  hpb_ArenaPool_Flush();
+  hpb_Arena_SetDefaultAlloc(&hpb_alloc_arena_pool);
+  hpb_Arena* arena = hpb_Arena_New();
+
+  // An arena freed on another thread goes to that thread's cache.
+  std::thread t([arena] {
+    hpb_Arena_Free(arena);
+    EXPECT_EQ(arena, hpb_Arena_New());
+    hpb_Arena_Free(arena);
+    hpb_ArenaPool_Flush();
+  });
+  t.join();
+
+  hpb_Arena* mine = hpb_Arena_New();
+  hpb_Arena_Free(mine);
+  EXPECT_EQ(mine, hpb_Arena_New());
+  hpb_Arena_Free(mine);
+  hpb_ArenaPool_Flush();
+  hpb_Arena_SetDefaultAlloc(&hpb_alloc_global);
+}
+
+TEST(ArenaTest, PoolThreadExit) {
+  // A thread's cache is freed when it exits, which leak checkers verify.
+  for (int i = 0; i < 4; i++) {
+    std::thread t([] {
+      hpb_Arena* arena = hpb_Arena_Init(nullptr, 0, &hpb_alloc_arena_pool);
+      for (int j = 0; j < 10; j++) hpb_Arena_Malloc(arena, 1000);
+      hpb_Arena_Free(arena);
+    });
+    t.join();
+  }
+}
+
+TEST(ArenaTest, Stats) {
+  hpb_Arena* arena = hpb_Arena_New();
+  hpb_ArenaStats stats;
+  hpb_Arena_GetStats(arena, &stats);
+  EXPECT_EQ(0, stats.bytes_allocated);
+  EXPECT_EQ(1, stats.block_count);
+  EXPECT_GT(stats.space_allocated, 0);
+
+  size_t requested = 0;
+  for (int i = 1; i < 200; i++) {
+    hpb_Arena_Malloc(arena, i * 8);
+    requested += HPB_ALIGN_MALLOC(i * 8) + HPB_ASAN_GUARD_SIZE;
+  }
+  hpb_Arena_GetStats(arena, &stats);
+  EXPECT_EQ(requested, stats.bytes_allocated);
+  EXPECT_GT(stats.block_count, 1);
+  EXPECT_GT(stats.slow_malloc_count, 0);
+  EXPECT_EQ(stats.space_allocated, stats.peak_space_allocated);
+  size_t peak = stats.peak_space_allocated;
+
+  EXPECT_TRUE(hpb_Arena_Reset(arena, 0));
+  hpb_Arena_GetStats(arena, &stats);
+  EXPECT_EQ(0, stats.bytes_allocated);
+  EXPECT_EQ(0, stats.bytes_wasted);
+  EXPECT_EQ(1, stats.block_count);
+  EXPECT_LT(stats.space_allocated, peak);
+  EXPECT_EQ(peak, stats.peak_space_allocated);
+
+  hpb_Arena* other = hpb_Arena_New();
+  hpb_Arena_Malloc(other, 100);
+  EXPECT_TRUE(hpb_Arena_Fuse(arena, other));
+  hpb_Arena_GetStats(other, &stats);
+  EXPECT_EQ(1, stats.fuse_count);
+  EXPECT_EQ(2, stats.block_count);
+  EXPECT_EQ(HPB_ALIGN_MALLOC(100) + HPB_ASAN_GUARD_SIZE, stats.bytes_allocated);
+
+  hpb_Arena_Free(arena);
+  hpb_Arena_Free(other);
+}
+
+TEST(ArenaTest, Sampler) {
+  hpb_ArenaStats before;
+  size_t samples_before = hpb_ArenaSampler_GetStats(&before);
+
+  hpb_ArenaSampler_SetPeriod(1);
+  hpb_Arena* sampled = hpb_Arena_New();
+  hpb_ArenaSampler_SetPeriod(0);
+  hpb_Arena* unsampled = hpb_Arena_New();
+  hpb_Arena_Malloc(sampled, 1000);
+  hpb_Arena_Malloc(unsampled, 1000);
+  hpb_Arena_Free(sampled);
+  hpb_Arena_Free(unsampled);
+
+  hpb_ArenaStats after;
+  EXPECT_EQ(samples_before + 1, hpb_ArenaSampler_GetStats(&after));
+  EXPECT_EQ(
+      before.bytes_allocated + HPB_ALIGN_MALLOC(1000) + HPB_ASAN_GUARD_SIZE,
+      after.bytes_allocated);
+  EXPECT_EQ(before.slow_malloc_count + 1, after.slow_malloc_count);
+}
+
 class Environment {
  public:
   ~Environment() {
@@ -32,11 +32,13 @@
 #define HPB_MEM_INTERNAL_ARENA_H_
 
 #include "hpb/mem/arena.h"
+#include "hpb/port/atomic.h"
 
 // Must be last.
 #include "hpb/port/def.inc"
 
 typedef struct _hpb_MemBlock _hpb_MemBlock;
+typedef struct _hpb_ArenaCleanup _hpb_ArenaCleanup;
 
 struct hpb_Arena {
   _hpb_ArenaHead head;
@@ -65,6 +67,30 @@ struct hpb_Arena {
   // Linked list of blocks to free/cleanup.  Atomic only for the benefit of
   // hpb_Arena_SpaceAllocated().
   HPB_ATOMIC(_hpb_MemBlock*) blocks;
+
+  // Functions registered with hpb_Arena_AddCleanup(), most recent first.
+  _hpb_ArenaCleanup* cleanups;
+
+  // Start of the free space in the block that holds this hpb_Arena (either the
+  // initial block or the first malloc'd block).  That space runs up to the
+  // hpb_Arena itself and is reused by hpb_Arena_Reset().
+  char* initial_ptr;
+
+  // Block growth policy, from hpb_ArenaOptions.  Sizes include the block
+  // header.
+  uint32_t initial_block_size;
+  uint32_t growth_factor;
+  uint32_t max_block_size;  // 0 if unbounded.
+
+  // Statistics for hpb_Arena_GetStats(), only updated off the fast path.
+  size_t capacity;  // Usable bytes of every block `head` has pointed into.
+  size_t wasted;    // Bytes left unused in blocks `head` has moved past.
+  size_t space_allocated;
+  size_t peak_space_allocated;
+  uint32_t block_count;
+  uint32_t slow_malloc_count;
+  HPB_ATOMIC(uint32_t) fuse_count;
+  bool sampled;  // Whether hpb_ArenaSampler collects this arena's stats.
 };
 
 HPB_INLINE bool _hpb_Arena_IsTaggedRefcount(uintptr_t parent_or_count) {
@@ -112,6 +138,40 @@ HPB_INLINE bool hpb_Arena_HasInitialBlock(hpb_Arena* arena) {
   return arena->block_alloc & 0x1;
 }
 
+// Sets up `des` as a temporary copy of `src` that can allocate, but not fuse
+// or free, including with the block growth policy and statistics of `src`.
+// Used by the decoder, which allocates through a copy of the arena on its own
+// stack.
+HPB_INLINE void _hpb_Arena_SwapIn(hpb_Arena* des, const hpb_Arena* src) {
+  _hpb_MemBlock* blocks = hpb_Atomic_Load(&src->blocks, memory_order_relaxed);
+  des->head = src->head;
+  des->block_alloc = src->block_alloc;
+  hpb_Atomic_Init(&des->blocks, blocks);
+  des->initial_block_size = src->initial_block_size;
+  des->growth_factor = src->growth_factor;
+  des->max_block_size = src->max_block_size;
+  des->capacity = src->capacity;
+  des->wasted = src->wasted;
+  des->space_allocated = src->space_allocated;
+  des->peak_space_allocated = src->peak_space_allocated;
+  des->block_count = src->block_count;
+  des->slow_malloc_count = src->slow_malloc_count;
+}
+
+// Hands the memory allocated through `src`, set up by _hpb_Arena_SwapIn(),
+// back to `des`.
+HPB_INLINE void _hpb_Arena_SwapOut(hpb_Arena* des, const hpb_Arena* src) {
+  _hpb_MemBlock* blocks = hpb_Atomic_Load(&src->blocks, memory_order_relaxed);
+  des->head = src->head;
+  hpb_Atomic_Store(&des->blocks, blocks, memory_order_relaxed);
+  des->capacity = src->capacity;
+  des->wasted = src->wasted;
+  des->space_allocated = src->space_allocated;
+  des->peak_space_allocated = src->peak_space_allocated;
+  des->block_count = src->block_count;
+  des->slow_malloc_count = src->slow_malloc_count;
+}
+
 #include "hpb/port/undef.inc"
 
 #endif  // HPB_MEM_INTERNAL_ARENA_H_
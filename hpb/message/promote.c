@@ -198,6 +198,20 @@ hpb_DecodeStatus hpb_Message_PromoteMessage(hpb_Message* parent,
   return ret;
 }
 
+hpb_DecodeStatus hpb_Message_GetOrPromoteMessage(
+    hpb_Message* parent, const hpb_MiniTable* mini_table,
+    const hpb_MiniTableField* field, int decode_options, hpb_Arena* arena,
+    hpb_Message** sub) {
+  hpb_TaggedMessagePtr tagged =
+      hpb_Message_GetTaggedMessagePtr(parent, field, NULL);
+  if (!hpb_TaggedMessagePtr_IsEmpty(tagged)) {
+    *sub = _hpb_TaggedMessagePtr_GetMessage(tagged);
+    return kHpb_DecodeStatus_Ok;
+  }
+  return hpb_Message_PromoteMessage(parent, mini_table, field, decode_options,
+                                    arena, sub);
+}
+
 hpb_DecodeStatus hpb_Array_PromoteMessages(hpb_Array* arr,
                                            const hpb_MiniTable* mini_table,
                                            int decode_options,
@@ -119,6 +119,15 @@ hpb_DecodeStatus hpb_Message_PromoteMessage(hpb_Message* parent,
                                             hpb_Arena* arena,
                                             hpb_Message** promoted);
 
+// Returns the message field `field` of `parent` in `*sub`, promoting it first
+// if it is "empty" (for example because it was decoded with
+// kHpb_DecodeOption_LazySubMessages).  `*sub` is set to NULL if the field is
+// not present.  `field` must have previously been linked.
+hpb_DecodeStatus hpb_Message_GetOrPromoteMessage(
+    hpb_Message* parent, const hpb_MiniTable* mini_table,
+    const hpb_MiniTableField* field, int decode_options, hpb_Arena* arena,
+    hpb_Message** sub);
+
 // Promotes any "empty" messages in this array to a message of the correct type
 // `mini_table`.  This function should only be called for arrays of messages.
 //
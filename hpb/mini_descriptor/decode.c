@@ -37,6 +37,7 @@
 #include "hpb/mem/arena.h"
 #include "hpb/mini_descriptor/internal/base92.h"
 #include "hpb/mini_descriptor/internal/decoder.h"
+#include "hpb/mini_descriptor/internal/fast_table.h"
 #include "hpb/mini_descriptor/internal/modifiers.h"
 #include "hpb/mini_descriptor/internal/wire_constants.h"
 
@@ -734,6 +735,11 @@ static hpb_MiniTable* hpb_MtDecoder_DoBuildMiniTableWithBuf(
       hpb_MtDecoder_AssignHasbits(decoder);
       hpb_MtDecoder_SortLayoutItems(decoder);
       hpb_MtDecoder_AssignOffsets(decoder);
+      if (decoder->platform == kHpb_MiniTablePlatform_Native) {
+        decoder->table =
+            _hpb_MiniTable_BuildFastTable(decoder->table, decoder->arena);
+        hpb_MdDecoder_CheckOutOfMemory(&decoder->base, decoder->table);
+      }
       break;
 
     case kHpb_EncodedVersion_MessageSetV1:
@@ -144,6 +144,37 @@ TEST_P(MiniTableTest, Skips) {
   EXPECT_EQ(0, table->required_count);
 }
 
+TEST_P(MiniTableTest, FindSparseFields) {
+  hpb::Arena arena;
+  hpb::MtDataEncoder e;
+  ASSERT_TRUE(e.StartMessage(0));
+  std::vector<uint32_t> field_numbers = {1, 2, 3};
+  for (uint32_t i = 0; i < 200; i++) field_numbers.push_back(1000 + 3 * i);
+  field_numbers.push_back(1 << 20);
+  field_numbers.push_back((1 << 29) - 1);
+  for (uint32_t n : field_numbers) {
+    ASSERT_TRUE(e.PutField(kHpb_FieldType_Int32, n, 0));
+  }
+  hpb::Status status;
+  hpb_MiniTable* table = _hpb_MiniTable_Build(
+      e.data().data(), e.data().size(), GetParam(), arena.ptr(), status.ptr());
+  ASSERT_NE(nullptr, table);
+  EXPECT_EQ(3, table->dense_below);
+
+  for (size_t i = 0; i < field_numbers.size(); i++) {
+    EXPECT_EQ(&table->fields[i],
+              hpb_MiniTable_FindFieldByNumber(table, field_numbers[i]));
+  }
+  absl::flat_hash_set<uint32_t> present(field_numbers.begin(),
+                                        field_numbers.end());
+  for (uint32_t n = 0; n < 1700; n++) {
+    if (present.contains(n)) continue;
+    EXPECT_EQ(nullptr, hpb_MiniTable_FindFieldByNumber(table, n)) << n;
+  }
+  EXPECT_EQ(nullptr, hpb_MiniTable_FindFieldByNumber(table, (1 << 20) + 1));
+  EXPECT_EQ(nullptr, hpb_MiniTable_FindFieldByNumber(table, 1 << 29));
+}
+
 TEST_P(MiniTableTest, AllScalarTypesOneof) {
   hpb::Arena arena;
   hpb::MtDataEncoder e;
@@ -0,0 +1,475 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "hpb/mini_descriptor/internal/fast_table.h"
+
+#include <string.h>
+
+#include "hpb/base/descriptor_constants.h"
+#include "hpb/wire/decode_fast.h"
+#include "hpb/wire/types.h"
+
+// Must be last.
+#include "hpb/port/def.inc"
+
+#if HPB_FASTTABLE
+
+// The fast decoder indexes its slots with bits 3 and up of the tag, loaded as
+// a little-endian 16-bit integer.  Tables of up to 32 slots only look at the
+// first tag byte.  Wider tables also take the low bits of the second byte,
+// which hold the next bits of the field number for two-byte tags but belong to
+// the payload for one-byte tags, so one-byte tags are repeated in every slot
+// that differs only in those bits.
+#define kHpb_FastTable_NarrowSize 32
+#define kHpb_FastTable_MaxSize 128
+
+typedef enum {
+  kHpb_FastCard_Scalar = 0,
+  kHpb_FastCard_Oneof = 1,
+  kHpb_FastCard_Repeated = 2,
+  kHpb_FastCard_Packed = 3,
+} hpb_FastCard;
+
+typedef enum {
+  kHpb_FastType_Bool = 0,
+  kHpb_FastType_Varint32 = 1,
+  kHpb_FastType_Varint64 = 2,
+  kHpb_FastType_ZigZag32 = 3,
+  kHpb_FastType_ZigZag64 = 4,
+  kHpb_FastType_Fixed32 = 5,
+  kHpb_FastType_Fixed64 = 6,
+  kHpb_FastType_String = 7,
+  kHpb_FastType_Bytes = 8,
+  kHpb_FastType_Message = 9,
+  kHpb_FastType_ClosedEnum = 10,
+} hpb_FastType;
+
+// Lookup tables for the parsers declared in decode_fast.h, indexed by
+// [card][type][tagbytes - 1].
+
+#define F(card, type, valbytes) \
+  {&hpb_p##card##type##valbytes##_1bt, &hpb_p##card##type##valbytes##_2bt}
+
+#define TYPES(card)                                                        \
+  {                                                                        \
+    F(card, b, 1), F(card, v, 4), F(card, v, 8), F(card, z, 4),            \
+        F(card, z, 8), F(card, f, 4), F(card, f, 8)                        \
+  }
+
+static _hpb_FieldParser* const kHpb_FastPrimitiveParsers[4][7][2] = {
+    TYPES(s),
+    TYPES(o),
+    TYPES(r),
+    TYPES(p),
+};
+
+#undef F
+#undef TYPES
+
+#define F(card, type) {&hpb_p##card##type##_1bt, &hpb_p##card##type##_2bt}
+#define TYPES(card) \
+  { F(card, s), F(card, b) }
+
+static _hpb_FieldParser* const kHpb_FastStringParsers[3][2][2] = {
+    TYPES(s),
+    TYPES(o),
+    TYPES(r),
+};
+
+#undef F
+#undef TYPES
+
+// Sub-messages are linked after the table is built, so their size is not
+// known yet and we always have to use the unbounded allocation ceiling.
+#define F(card) {&hpb_p##card##m_1bt_maxmaxb, &hpb_p##card##m_2bt_maxmaxb}
+
+static _hpb_FieldParser* const kHpb_FastMessageParsers[3][2] = {
+    F(s),
+    F(o),
+    F(r),
+};
+
+#undef F
+
+#define F(card) {&hpb_p##card##e4_1bt, &hpb_p##card##e4_2bt}
+
+static _hpb_FieldParser* const kHpb_FastEnumParsers[3][2] = {
+    F(s),
+    F(o),
+    F(r),
+};
+
+#undef F
+
+typedef enum {
+  kHpb_FastMapKind_Varint = 0,
+  kHpb_FastMapKind_String = 1,
+  kHpb_FastMapKind_Message = 2,
+} hpb_FastMapKind;
+
+#define F(key, val) {&hpb_pm##key##val##_1bt, &hpb_pm##key##val##_2bt}
+
+// Indexed by [key kind][value kind][tagbytes - 1].
+static _hpb_FieldParser* const kHpb_FastMapParsers[2][3][2] = {
+    {F(v, v), F(v, s), F(v, m)},
+    {F(s, v), F(s, s), F(s, m)},
+};
+
+#undef F
+
+// Returns the hpb_FastMapKind of a map key or value, or -1 if the fast map
+// parsers cannot handle it.
+static int hpb_FastTable_MapKind(const hpb_MiniTableField* f) {
+  switch (f->HPB_PRIVATE(descriptortype)) {
+    case kHpb_FieldType_Int32:
+    case kHpb_FieldType_Int64:
+    case kHpb_FieldType_UInt32:
+    case kHpb_FieldType_UInt64:
+      return kHpb_FastMapKind_Varint;
+    case kHpb_FieldType_String:
+    case kHpb_FieldType_Bytes:
+      return kHpb_FastMapKind_String;
+    case kHpb_FieldType_Message:
+      return kHpb_FastMapKind_Message;
+    default:
+      return -1;
+  }
+}
+
+static int hpb_FastTable_WireType(const hpb_MiniTableField* f) {
+  if (f->mode & kHpb_LabelFlags_IsPacked) return kHpb_WireType_Delimited;
+  switch (f->HPB_PRIVATE(descriptortype)) {
+    case kHpb_FieldType_Double:
+    case kHpb_FieldType_Fixed64:
+    case kHpb_FieldType_SFixed64:
+      return kHpb_WireType_64Bit;
+    case kHpb_FieldType_Float:
+    case kHpb_FieldType_Fixed32:
+    case kHpb_FieldType_SFixed32:
+      return kHpb_WireType_32Bit;
+    case kHpb_FieldType_Int64:
+    case kHpb_FieldType_UInt64:
+    case kHpb_FieldType_Int32:
+    case kHpb_FieldType_Bool:
+    case kHpb_FieldType_UInt32:
+    case kHpb_FieldType_Enum:
+    case kHpb_FieldType_SInt32:
+    case kHpb_FieldType_SInt64:
+      return kHpb_WireType_Varint;
+    case kHpb_FieldType_Group:
+      return kHpb_WireType_StartGroup;
+    case kHpb_FieldType_Message:
+    case kHpb_FieldType_String:
+    case kHpb_FieldType_Bytes:
+      return kHpb_WireType_Delimited;
+  }
+  HPB_UNREACHABLE();
+}
+
+// Returns the tag for `f` encoded as a varint and loaded as a little-endian
+// integer, or 0 if it does not fit in two bytes.
+static uint16_t hpb_FastTable_EncodedTag(const hpb_MiniTableField* f) {
+  uint32_t tag = (f->number << 3) | hpb_FastTable_WireType(f);
+  if (tag < 0x80) return tag;
+  if (tag >= (1 << 14)) return 0;
+  return (uint16_t)((tag & 0x7f) | 0x80 | ((tag >> 7) << 8));
+}
+
+static bool hpb_FastTable_TryFillEntry(const hpb_MiniTable* table,
+                                       const hpb_MiniTableField* f,
+                                       uint16_t tag,
+                                       _hpb_FastTable_Entry* ent) {
+  int type;
+  switch (f->HPB_PRIVATE(descriptortype)) {
+    case kHpb_FieldType_Bool:
+      type = kHpb_FastType_Bool;
+      break;
+    case kHpb_FieldType_Int32:
+    case kHpb_FieldType_UInt32:
+      // Open enums are stored as kHpb_FieldType_Int32.
+      type = kHpb_FastType_Varint32;
+      break;
+    case kHpb_FieldType_Int64:
+    case kHpb_FieldType_UInt64:
+      type = kHpb_FastType_Varint64;
+      break;
+    case kHpb_FieldType_Fixed32:
+    case kHpb_FieldType_SFixed32:
+    case kHpb_FieldType_Float:
+      type = kHpb_FastType_Fixed32;
+      break;
+    case kHpb_FieldType_Fixed64:
+    case kHpb_FieldType_SFixed64:
+    case kHpb_FieldType_Double:
+      type = kHpb_FastType_Fixed64;
+      break;
+    case kHpb_FieldType_SInt32:
+      type = kHpb_FastType_ZigZag32;
+      break;
+    case kHpb_FieldType_SInt64:
+      type = kHpb_FastType_ZigZag64;
+      break;
+    case kHpb_FieldType_String:
+      type = kHpb_FastType_String;
+      break;
+    case kHpb_FieldType_Bytes:
+      type = kHpb_FastType_Bytes;
+      break;
+    case kHpb_FieldType_Message:
+      type = kHpb_FastType_Message;
+      break;
+    case kHpb_FieldType_Enum:
+      // Open enums are stored as kHpb_FieldType_Int32, so this is closed.
+      type = kHpb_FastType_ClosedEnum;
+      break;
+    default:
+      // Groups are unsupported.
+      return false;
+  }
+
+  int card;
+  switch (hpb_FieldMode_Get(f)) {
+    case kHpb_FieldMode_Map: {
+      // Maps only become maps when their entry is linked, which is when the
+      // key and value types are known.
+      if (f->HPB_PRIVATE(submsg_index) > 0xff) return false;
+      const hpb_MiniTable* entry =
+          table->subs[f->HPB_PRIVATE(submsg_index)].submsg;
+      if (!entry || entry->field_count != 2) return false;
+      int key_kind = hpb_FastTable_MapKind(&entry->fields[0]);
+      int val_kind = hpb_FastTable_MapKind(&entry->fields[1]);
+      if (key_kind < 0 || key_kind == kHpb_FastMapKind_Message) return false;
+      if (val_kind < 0) return false;
+      ent->field_data = (uint64_t)f->offset << 48 |
+                        (uint64_t)63 << 24 |  // No hasbit.
+                        (uint64_t)f->HPB_PRIVATE(submsg_index) << 16 | tag;
+      ent->field_parser =
+          kHpb_FastMapParsers[key_kind][val_kind][tag > 0xff ? 1 : 0];
+      return true;
+    }
+    case kHpb_FieldMode_Array:
+      card = (f->mode & kHpb_LabelFlags_IsPacked) ? kHpb_FastCard_Packed
+                                                  : kHpb_FastCard_Repeated;
+      break;
+    case kHpb_FieldMode_Scalar:
+      card = f->presence < 0 ? kHpb_FastCard_Oneof : kHpb_FastCard_Scalar;
+      break;
+    default:
+      HPB_UNREACHABLE();
+  }
+
+  // Data is:
+  //
+  //                  48                32                16                 0
+  // |--------|--------|--------|--------|--------|--------|--------|--------|
+  // |   offset (16)   |case offset (16) |presence| submsg |  exp. tag (16)  |
+  // |--------|--------|--------|--------|--------|--------|--------|--------|
+  //
+  // - |presence| is either hasbit index or field number for oneofs.
+  uint64_t data = (uint64_t)f->offset << 48 | tag;
+
+  if (card == kHpb_FastCard_Oneof) {
+    uint64_t case_offset = ~f->presence;
+    if (case_offset > 0xffff || f->number > 0xff) return false;
+    data |= (uint64_t)f->number << 24;
+    data |= case_offset << 32;
+  } else {
+    uint64_t hasbit_index = 63;  // No hasbit (set a high, unused bit).
+    if (f->presence) {
+      hasbit_index = f->presence;
+      if (hasbit_index > 31) return false;
+    }
+    data |= hasbit_index << 24;
+  }
+
+  const int tagbytes = tag > 0xff ? 2 : 1;
+  _hpb_FieldParser* parser;
+  if (type == kHpb_FastType_ClosedEnum) {
+    // Packed closed enums would have to move invalid values out of the middle
+    // of the array.
+    if (card == kHpb_FastCard_Packed) return false;
+    uint64_t idx = f->HPB_PRIVATE(submsg_index);
+    if (idx > 0xff) return false;
+    data |= idx << 16;
+    parser = kHpb_FastEnumParsers[card][tagbytes - 1];
+  } else if (type == kHpb_FastType_Message) {
+    if (card == kHpb_FastCard_Packed) return false;
+    uint64_t idx = f->HPB_PRIVATE(submsg_index);
+    if (idx > 0xff) return false;
+    data |= idx << 16;
+    parser = kHpb_FastMessageParsers[card][tagbytes - 1];
+  } else if (type >= kHpb_FastType_String) {
+    if (card == kHpb_FastCard_Packed) return false;
+    parser = kHpb_FastStringParsers[card][type - kHpb_FastType_String]
+                                   [tagbytes - 1];
+  } else {
+    parser = kHpb_FastPrimitiveParsers[card][type][tagbytes - 1];
+  }
+
+  ent->field_data = data;
+  ent->field_parser = parser;
+  return true;
+}
+
+static bool hpb_FastTable_IsRequired(const hpb_MiniTable* t,
+                                     const hpb_MiniTableField* f) {
+  return f->presence > 0 && f->presence <= t->required_count;
+}
+
+// Assigns fast parsers to slots in a table of at most `max_size` slots and
+// returns the number of fields that got one.  Tables of up to 32 slots are
+// only as large as the highest slot in use, wider ones are always full size.
+// `*eligible` is set to the number of fields that a table without collisions
+// would have placed.
+static size_t hpb_FastTable_Fill(const hpb_MiniTable* table, size_t max_size,
+                                 _hpb_FastTable_Entry* entries, size_t* size,
+                                 size_t* eligible) {
+  size_t placed = 0;
+  *size = 0;
+  *eligible = 0;
+
+  if (max_size > kHpb_FastTable_NarrowSize) {
+    for (size_t j = 0; j < max_size; j++) {
+      entries[j].field_data = 0;
+      entries[j].field_parser = &_hpb_FastDecoder_DecodeGeneric;
+    }
+    *size = max_size;
+  }
+
+  // Two passes give the hotness order used by hpbc: required fields first,
+  // then everything else, each by field number (`fields` is sorted).
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < table->field_count; i++) {
+      const hpb_MiniTableField* f = &table->fields[i];
+      if (hpb_FastTable_IsRequired(table, f) != (pass == 0)) continue;
+
+      uint16_t tag = hpb_FastTable_EncodedTag(f);
+      if (!tag) continue;  // Tag must fit within a two-byte varint.
+      size_t slot = (tag >> 3) & (max_size - 1);
+
+      _hpb_FastTable_Entry ent;
+      if (!hpb_FastTable_TryFillEntry(table, f, tag, &ent)) continue;
+      (*eligible)++;
+
+      while (slot >= *size) {
+        size_t new_size = *size ? *size * 2 : 1;
+        for (size_t j = *size; j < new_size; j++) {
+          entries[j].field_data = 0;
+          entries[j].field_parser = &_hpb_FastDecoder_DecodeGeneric;
+        }
+        *size = new_size;
+      }
+
+      // A hotter field already filled one of the slots.
+      size_t step = tag < 0x80 ? kHpb_FastTable_NarrowSize : *size;
+      bool taken = false;
+      for (size_t j = slot; j < *size; j += step) {
+        taken |= entries[j].field_parser != &_hpb_FastDecoder_DecodeGeneric;
+      }
+      if (taken) continue;
+
+      for (; slot < *size; slot += step) entries[slot] = ent;
+      placed++;
+    }
+  }
+
+  return placed;
+}
+
+hpb_MiniTable* _hpb_MiniTable_BuildFastTable(hpb_MiniTable* table,
+                                             hpb_Arena* arena) {
+  _hpb_FastTable_Entry entries[kHpb_FastTable_MaxSize];
+  _hpb_FastTable_Entry wide_entries[kHpb_FastTable_MaxSize];
+  size_t size;
+  size_t eligible;
+  size_t placed = hpb_FastTable_Fill(table, kHpb_FastTable_NarrowSize,
+                                     entries, &size, &eligible);
+
+  // Fields whose tags collide in the narrow table fall back to the generic
+  // decoder.  A wider table is only worth its memory if it gives more of them
+  // a slot, so take the smallest one that does best.
+  for (size_t max_size = kHpb_FastTable_NarrowSize * 2;
+       placed < eligible && max_size <= kHpb_FastTable_MaxSize;
+       max_size *= 2) {
+    size_t wide_size;
+    size_t wide_placed = hpb_FastTable_Fill(table, max_size, wide_entries,
+                                            &wide_size, &eligible);
+    if (wide_placed > placed) {
+      memcpy(entries, wide_entries, wide_size * sizeof(*entries));
+      size = wide_size;
+      placed = wide_placed;
+    }
+  }
+
+  if (!size) return table;
+
+  hpb_MiniTable* ret = hpb_Arena_Realloc(
+      arena, table, sizeof(*table), sizeof(*table) + size * sizeof(*entries));
+  if (!ret) return NULL;
+  memcpy(ret->fasttable, entries, size * sizeof(*entries));
+  ret->table_mask = (size - 1) << 3;
+  return ret;
+}
+
+void _hpb_MiniTable_UpdateFastTableEntry(hpb_MiniTable* table,
+                                         const hpb_MiniTableField* field) {
+  if (table->table_mask == (uint16_t)-1) return;
+  uint16_t tag = hpb_FastTable_EncodedTag(field);
+  if (!tag) return;
+  _hpb_FastTable_Entry ent;
+  if (!hpb_FastTable_TryFillEntry(table, field, tag, &ent)) {
+    ent.field_data = 0;
+    ent.field_parser = &_hpb_FastDecoder_DecodeGeneric;
+  }
+  size_t size = (table->table_mask >> 3) + 1;
+  size_t slot = (tag & table->table_mask) >> 3;
+  size_t step = tag < 0x80 ? kHpb_FastTable_NarrowSize : size;
+  for (; slot < size; slot += step) {
+    // The slot may belong to a hotter field with a colliding tag.
+    if ((uint16_t)table->fasttable[slot].field_data != tag) return;
+    table->fasttable[slot] = ent;
+  }
+}
+
+#else  // !HPB_FASTTABLE
+
+hpb_MiniTable* _hpb_MiniTable_BuildFastTable(hpb_MiniTable* table,
+                                             hpb_Arena* arena) {
+  HPB_UNUSED(arena);
+  return table;
+}
+
+void _hpb_MiniTable_UpdateFastTableEntry(hpb_MiniTable* table,
+                                         const hpb_MiniTableField* field) {
+  HPB_UNUSED(table);
+  HPB_UNUSED(field);
+}
+
+#endif  // HPB_FASTTABLE
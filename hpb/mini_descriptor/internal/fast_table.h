@@ -0,0 +1,74 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef HPB_MINI_DESCRIPTOR_INTERNAL_FAST_TABLE_H_
+#define HPB_MINI_DESCRIPTOR_INTERNAL_FAST_TABLE_H_
+
+#include "hpb/mem/arena.h"
+#include "hpb/mini_table/field.h"
+#include "hpb/mini_table/message.h"
+
+// Must be last.
+#include "hpb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Runtime equivalent of the fast decode table that hpbc emits for generated
+// MiniTables.  Fields are assigned slots in hotness order (required fields
+// first, then by field number); fields that the fast parsers cannot handle
+// (groups, packed closed enums, large offsets/hasbits, etc.) are left to the
+// generic decoder.
+//
+// `table` must have been allocated from `arena` with sizeof(hpb_MiniTable)
+// bytes; it is grown with hpb_Arena_Realloc() to make room for the fasttable
+// entries, which is free if it is still the arena's last allocation.  Returns
+// the (possibly moved) table, or NULL on allocation failure.  If fasttable
+// support is not compiled in, `table` is returned unchanged with
+// `table_mask == -1`.
+hpb_MiniTable* _hpb_MiniTable_BuildFastTable(hpb_MiniTable* table,
+                                             hpb_Arena* arena);
+
+// Picks a new parser for the fasttable slot owned by `field` (if any), falling
+// back to the generic parser if no fast one applies.  Must be called whenever
+// `field` changes in a way that the entry chosen by
+// _hpb_MiniTable_BuildFastTable() can no longer handle, eg. when a repeated
+// message field is linked to a map entry.
+void _hpb_MiniTable_UpdateFastTableEntry(hpb_MiniTable* table,
+                                         const hpb_MiniTableField* field);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "hpb/port/undef.inc"
+
+#endif  // HPB_MINI_DESCRIPTOR_INTERNAL_FAST_TABLE_H_
@@ -30,6 +30,8 @@
 
 #include "hpb/mini_descriptor/link.h"
 
+#include "hpb/mini_descriptor/internal/fast_table.h"
+
 // Must be last.
 #include "hpb/port/def.inc"
 
@@ -67,6 +69,8 @@ bool hpb_MiniTable_SetSubMessage(hpb_MiniTable* table,
   // this function repeatedly.
   // HPB_ASSERT(table_sub->submsg == &_kHpb_MiniTable_Empty);
   table_sub->submsg = sub;
+  // The parser chosen for a repeated field does not fit a map.
+  if (sub_is_map) _hpb_MiniTable_UpdateFastTableEntry(table, field);
   return true;
 }
 
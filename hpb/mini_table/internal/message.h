@@ -74,7 +74,7 @@ struct hpb_MiniTable {
   uint16_t field_count;
   uint8_t ext;  // hpb_ExtMode, declared as uint8_t so sizeof(ext) == 1
   uint8_t dense_below;
-  uint8_t table_mask;
+  uint16_t table_mask;
   uint8_t required_count;  // Required fields have the lowest hasbits.
 
   // To statically initialize the tables of variable length, we need a flexible
@@ -90,6 +90,26 @@ extern "C" {
 // A MiniTable for an empty message, used for unlinked sub-messages.
 extern const struct hpb_MiniTable _kHpb_MiniTable_Empty;
 
+// Returns the field numbered `number` among the fields that are not indexed
+// directly (those at or above `dense_below`), or NULL if there is none.
+//
+// Fields are sorted by number, so this is a binary search.  The loop runs a
+// fixed number of times for a given table and its only data-dependent choice
+// is a select, which compilers emit as a conditional move, so out-of-order and
+// sparse field numbers do not cost branch mispredictions.
+HPB_INLINE const struct hpb_MiniTableField* _hpb_MiniTable_FindSparseField(
+    const struct hpb_MiniTable* t, uint32_t number) {
+  const struct hpb_MiniTableField* base = &t->fields[t->dense_below];
+  size_t n = t->field_count - t->dense_below;
+  if (n == 0) return NULL;
+  while (n > 1) {
+    size_t half = n / 2;
+    base = base[half - 1].number < number ? base + half : base;
+    n -= half;
+  }
+  return base->number == number ? base : NULL;
+}
+
 // Computes a bitmask in which the |l->required_count| lowest bits are set,
 // except that we skip the lowest bit (because hpb never uses hasbit 0).
 //
@@ -49,22 +49,7 @@ const hpb_MiniTableField* hpb_MiniTable_FindFieldByNumber(
   }
 
   // Slow case: binary search
-  int lo = t->dense_below;
-  int hi = t->field_count - 1;
-  while (lo <= hi) {
-    int mid = (lo + hi) / 2;
-    uint32_t num = t->fields[mid].number;
-    if (num < number) {
-      lo = mid + 1;
-      continue;
-    }
-    if (num > number) {
-      hi = mid - 1;
-      continue;
-    }
-    return &t->fields[mid];
-  }
-  return NULL;
+  return _hpb_MiniTable_FindSparseField(t, number);
 }
 
 static bool hpb_MiniTable_Is_Oneof(const hpb_MiniTableField* f) {
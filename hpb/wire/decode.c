@@ -44,6 +44,8 @@
 #include "hpb/wire/eps_copy_input_stream.h"
 #include "hpb/wire/internal/common.h"
 #include "hpb/wire/internal/decode.h"
+#include "hpb/wire/internal/field_mask.h"
+#include "hpb/wire/internal/packed_varint.h"
 #include "hpb/wire/internal/swap.h"
 #include "hpb/wire/reader.h"
 
@@ -121,6 +123,18 @@ static bool _hpb_Decoder_Reserve(hpb_Decoder* d, hpb_Array* arr, size_t elem) {
   return need_realloc;
 }
 
+// Like _hpb_Decoder_Reserve(), but an empty array is sized exactly.  Arrays
+// that already hold elements from an earlier occurrence of the field keep
+// growing by doubling, so that many small occurrences stay linear.
+static void _hpb_Decoder_ReservePacked(hpb_Decoder* d, hpb_Array* arr,
+                                       size_t elem) {
+  if (arr->capacity - arr->size >= elem) return;
+  bool ok = arr->size == 0
+                ? _hpb_array_realloc_exact(arr, elem, &d->arena)
+                : _hpb_array_realloc(arr, arr->size + elem, &d->arena);
+  if (!ok) _hpb_Decoder_ErrorJmp(d, kHpb_DecodeStatus_OutOfMemory);
+}
+
 typedef struct {
   const char* ptr;
   uint64_t val;
@@ -267,11 +281,64 @@ static hpb_Message* _hpb_Decoder_ReuseSubMessage(
   return promoted;
 }
 
+// Sub-messages are decoded lazily if requested, unless a field mask has to be
+// applied to them.
+HPB_FORCEINLINE
+static bool _hpb_Decoder_IsLazy(hpb_Decoder* d,
+                                const hpb_MiniTableField* field) {
+  return HPB_UNLIKELY(d->options & kHpb_DecodeOption_LazySubMessages) &&
+         field->HPB_PRIVATE(descriptortype) == kHpb_FieldType_Message &&
+         !(field->mode & kHpb_LabelFlags_IsExtension) && !d->mask;
+}
+
+// Stores the `size` bytes of a sub-message at `ptr` unparsed, as the unknown
+// data of an empty message.  If `target` already holds an empty message, the
+// bytes are appended to it, which has the same effect as merging.
+static const char* _hpb_Decoder_DecodeLazySubMessage(
+    hpb_Decoder* d, const char* ptr, hpb_TaggedMessagePtr* target, int size) {
+  hpb_Message* empty;
+  if (*target) {
+    empty = _hpb_TaggedMessagePtr_GetEmptyMessage(*target);
+  } else {
+    empty = _hpb_Message_New(&_kHpb_MiniTable_Empty, &d->arena);
+    if (!empty) _hpb_Decoder_ErrorJmp(d, kHpb_DecodeStatus_OutOfMemory);
+    hpb_TaggedMessagePtr tagged = _hpb_TaggedMessagePtr_Pack(empty, true);
+    memcpy(target, &tagged, sizeof(tagged));
+  }
+
+  const char* start = ptr;
+  if (hpb_EpsCopyInputStream_CheckDataSizeAvailable(&d->input, ptr, size)) {
+    ptr += size;
+  } else {
+    // As for unknown fields, data that extends past the current buffer of a
+    // streaming input is preserved piecewise as the buffers are flipped.
+    d->unknown = start;
+    d->unknown_msg = empty;
+    ptr = _hpb_EpsCopyInputStream_SkipFallback(&d->input, ptr, size,
+                                               _hpb_Decoder_BufferFlipCallback);
+    if (!ptr) _hpb_Decoder_ErrorJmp(d, kHpb_DecodeStatus_Malformed);
+    start = d->unknown;
+    d->unknown = NULL;
+  }
+  if (!_hpb_Message_AddUnknown(empty, start, ptr - start, &d->arena)) {
+    _hpb_Decoder_ErrorJmp(d, kHpb_DecodeStatus_OutOfMemory);
+  }
+  return ptr;
+}
+
 static const char* _hpb_Decoder_ReadString(hpb_Decoder* d, const char* ptr,
-                                           int size, hpb_StringView* str) {
+                                           int size, hpb_StringView* str,
+                                           bool validate_utf8) {
   const char* str_ptr = ptr;
   ptr = hpb_EpsCopyInputStream_ReadString(&d->input, &str_ptr, size, &d->arena);
-  if (!ptr) _hpb_Decoder_ErrorJmp(d, kHpb_DecodeStatus_OutOfMemory);
+  if (!ptr) {
+    _hpb_Decoder_ErrorJmp(d, hpb_EpsCopyInputStream_IsError(&d->input)
+                                 ? kHpb_DecodeStatus_Malformed
+                                 : kHpb_DecodeStatus_OutOfMemory);
+  }
+  // Validate after reading, since the data may not have been contiguous in
+  // the input if it came from a stream.
+  if (validate_utf8) _hpb_Decoder_VerifyUtf8(d, str_ptr, size);
   str->data = str_ptr;
   str->size = size;
   return ptr;
@@ -415,10 +482,9 @@ static const char* _hpb_Decoder_DecodeFixedPacked(
   _hpb_Decoder_Reserve(d, arr, count);
   void* mem = HPB_PTR_AT(_hpb_array_ptr(arr), arr->size << lg2, void);
   arr->size += count;
-  // Note: if/when the decoder supports multi-buffer input, we will need to
-  // handle buffer seams here.
   if (_hpb_IsLittleEndian()) {
     ptr = hpb_EpsCopyInputStream_Copy(&d->input, ptr, mem, val->size);
+    if (!ptr) _hpb_Decoder_ErrorJmp(d, kHpb_DecodeStatus_Malformed);
   } else {
     int delta = hpb_EpsCopyInputStream_PushLimit(&d->input, ptr, val->size);
     char* dst = mem;
@@ -443,9 +509,33 @@ static const char* _hpb_Decoder_DecodeVarintPacked(
     hpb_Decoder* d, const char* ptr, hpb_Array* arr, wireval* val,
     const hpb_MiniTableField* field, int lg2) {
   int scale = 1 << lg2;
+  int type = field->HPB_PRIVATE(descriptortype);
+  bool zigzag = type == kHpb_FieldType_SInt32 || type == kHpb_FieldType_SInt64;
+  // Every byte without a continuation bit ends one element, so if the whole
+  // field is in the current buffer the array can be reserved for, once.
+  bool sized = hpb_EpsCopyInputStream_CheckDataSizeAvailable(&d->input, ptr,
+                                                             val->size);
+  if (sized) {
+    _hpb_Decoder_ReservePacked(
+        d, arr, _hpb_WireReader_CountVarints(ptr, ptr + val->size));
+  }
   int saved_limit = hpb_EpsCopyInputStream_PushLimit(&d->input, ptr, val->size);
   char* out = HPB_PTR_AT(_hpb_array_ptr(arr), arr->size << lg2, void);
   while (!_hpb_Decoder_IsDone(d, &ptr)) {
+#if HPB_PACKED_VARINT_SIMD
+    // Decode whole blocks of varints while they are available in the current
+    // buffer, then fall back to one varint at a time for the rest.
+    size_t count;
+    if (!sized && _hpb_Decoder_Reserve(d, arr, 16)) {
+      out = HPB_PTR_AT(_hpb_array_ptr(arr), arr->size << lg2, void);
+    }
+    ptr = _hpb_WireReader_ReadPackedVarints(ptr, d->input.limit_ptr, out,
+                                            arr->capacity - arr->size, scale,
+                                            zigzag, &count);
+    arr->size += count;
+    out += count << lg2;
+    if (count) continue;
+#endif
     wireval elem;
     ptr = _hpb_Decoder_DecodeVarint(d, ptr, &elem.uint64_val);
     _hpb_Decoder_Munge(field->HPB_PRIVATE(descriptortype), &elem);
@@ -527,7 +617,8 @@ static const char* _hpb_Decoder_DecodeToArray(hpb_Decoder* d, const char* ptr,
   void* mem;
 
   if (arr) {
-    _hpb_Decoder_Reserve(d, arr, 1);
+    // Packed fields reserve room for all of their elements themselves.
+    if (op < OP_FIXPCK_LG2(2)) _hpb_Decoder_Reserve(d, arr, 1);
   } else {
     arr = _hpb_Decoder_CreateArray(d, field);
     *arrp = arr;
@@ -543,18 +634,22 @@ static const char* _hpb_Decoder_DecodeToArray(hpb_Decoder* d, const char* ptr,
       memcpy(mem, val, 1 << op);
       return ptr;
     case kHpb_DecodeOp_String:
-      _hpb_Decoder_VerifyUtf8(d, ptr, val->size);
-      /* Fallthrough. */
     case kHpb_DecodeOp_Bytes: {
       /* Append bytes. */
       hpb_StringView* str = (hpb_StringView*)_hpb_array_ptr(arr) + arr->size;
       arr->size++;
-      return _hpb_Decoder_ReadString(d, ptr, val->size, str);
+      return _hpb_Decoder_ReadString(d, ptr, val->size, str,
+                                     op == kHpb_DecodeOp_String);
     }
     case kHpb_DecodeOp_SubMessage: {
       /* Append submessage / group. */
       hpb_TaggedMessagePtr* target = HPB_PTR_AT(
           _hpb_array_ptr(arr), arr->size * sizeof(void*), hpb_TaggedMessagePtr);
+      if (_hpb_Decoder_IsLazy(d, field)) {
+        *target = 0;
+        arr->size++;
+        return _hpb_Decoder_DecodeLazySubMessage(d, ptr, target, val->size);
+      }
       hpb_Message* submsg = _hpb_Decoder_NewSubMessage(d, subs, field, target);
       arr->size++;
       if (HPB_UNLIKELY(field->HPB_PRIVATE(descriptortype) ==
@@ -709,6 +804,10 @@ static const char* _hpb_Decoder_DecodeToSubMessage(
     case kHpb_DecodeOp_SubMessage: {
       hpb_TaggedMessagePtr* submsgp = mem;
       hpb_Message* submsg;
+      if (_hpb_Decoder_IsLazy(d, field) &&
+          (!*submsgp || hpb_TaggedMessagePtr_IsEmpty(*submsgp))) {
+        return _hpb_Decoder_DecodeLazySubMessage(d, ptr, submsgp, val->size);
+      }
       if (*submsgp) {
         submsg = _hpb_Decoder_ReuseSubMessage(d, subs, field, submsgp);
       } else {
@@ -723,10 +822,9 @@ static const char* _hpb_Decoder_DecodeToSubMessage(
       break;
     }
     case kHpb_DecodeOp_String:
-      _hpb_Decoder_VerifyUtf8(d, ptr, val->size);
-      /* Fallthrough. */
     case kHpb_DecodeOp_Bytes:
-      return _hpb_Decoder_ReadString(d, ptr, val->size, mem);
+      return _hpb_Decoder_ReadString(d, ptr, val->size, mem,
+                                     op == kHpb_DecodeOp_String);
     case kHpb_DecodeOp_Scalar8Byte:
       memcpy(mem, val, 8);
       break;
@@ -766,7 +864,9 @@ static bool _hpb_Decoder_TryFastDispatch(hpb_Decoder* d, const char** ptr,
                                          hpb_Message* msg,
                                          const hpb_MiniTable* layout) {
 #if HPB_FASTTABLE
-  if (layout && layout->table_mask != (unsigned char)-1) {
+  // The fast parser does not know about field masks or lazy sub-messages.
+  if (layout && layout->table_mask != (uint16_t)-1 && !d->mask &&
+      !(d->options & kHpb_DecodeOption_LazySubMessages)) {
     uint16_t tag = _hpb_FastDecoder_LoadTag(*ptr);
     intptr_t table = decode_totable(layout);
     *ptr = _hpb_FastDecoder_TagDispatch(d, *ptr, msg, table, 0, tag);
@@ -892,7 +992,15 @@ static const char* hpb_Decoder_DecodeMessageSetItem(
         uint32_t size;
         ptr = hpb_Decoder_DecodeSize(d, ptr, &size);
         const char* data = ptr;
-        ptr += size;
+        if (HPB_UNLIKELY(d->input.stream)) {
+          // Stream buffers do not outlive the next buffer flip, and the
+          // payload may span several of them, so take a copy.
+          hpb_StringView payload;
+          ptr = _hpb_Decoder_ReadString(d, ptr, size, &payload, false);
+          data = payload.data;
+        } else {
+          ptr += size;
+        }
         if (state_mask & kHpb_HavePayload) break;  // Ignore dup.
         state_mask |= kHpb_HavePayload;
         if (state_mask & kHpb_HaveId) {
@@ -928,19 +1036,20 @@ static const hpb_MiniTableField* _hpb_Decoder_FindField(hpb_Decoder* d,
   }
 
   if (t->dense_below < t->field_count) {
-    /* Linear search non-dense fields. Resume scanning from last_field_index
-     * since fields are usually in order. */
+    /* Fields usually arrive in order, so first try the field that matched last
+     * time (repeated fields) and the one after it, then search. */
     size_t last = *last_field_index;
-    for (idx = last; idx < t->field_count; idx++) {
+    for (idx = last; idx < last + 2 && idx < t->field_count; idx++) {
       if (t->fields[idx].number == field_number) {
         goto found;
       }
     }
 
-    for (idx = t->dense_below; idx < last; idx++) {
-      if (t->fields[idx].number == field_number) {
-        goto found;
-      }
+    const hpb_MiniTableField* f =
+        _hpb_MiniTable_FindSparseField(t, field_number);
+    if (f) {
+      idx = f - t->fields;
+      goto found;
     }
   }
 
@@ -1225,6 +1334,17 @@ static const char* _hpb_Decoder_DecodeUnknownField(hpb_Decoder* d,
       ptr = _hpb_Decoder_DecodeUnknownGroup(d, ptr, field_number);
       start = d->unknown;
       d->unknown = NULL;
+    } else if (wire_type == kHpb_WireType_Delimited &&
+               HPB_UNLIKELY(!hpb_EpsCopyInputStream_CheckDataSizeAvailable(
+                   &d->input, ptr - val.size, val.size))) {
+      // The data extends past the current buffer of a streaming input, so it
+      // is preserved piecewise as the buffers are flipped.
+      d->unknown = start;
+      d->unknown_msg = msg;
+      ptr = _hpb_EpsCopyInputStream_SkipFallback(
+          &d->input, ptr - val.size, val.size, _hpb_Decoder_BufferFlipCallback);
+      start = d->unknown;
+      d->unknown = NULL;
     }
     if (!_hpb_Message_AddUnknown(msg, start, ptr - start, &d->arena)) {
       _hpb_Decoder_ErrorJmp(d, kHpb_DecodeStatus_OutOfMemory);
@@ -1245,6 +1365,8 @@ static const char* _hpb_Decoder_DecodeMessage(hpb_Decoder* d, const char* ptr,
   // The first time we want to skip fast dispatch, because we may have just been
   // invoked by the fast parser to handle a case that it bailed on.
   if (!_hpb_Decoder_IsDone(d, &ptr)) goto nofast;
+  // IsDone() must not be called again after the end of a streaming input.
+  goto done;
 #endif
 
   while (!_hpb_Decoder_IsDone(d, &ptr)) {
@@ -1280,6 +1402,19 @@ static const char* _hpb_Decoder_DecodeMessage(hpb_Decoder* d, const char* ptr,
     }
 
     field = _hpb_Decoder_FindField(d, layout, field_number, &last_field_index);
+
+    const hpb_FieldMask* mask = d->mask;
+    if (HPB_UNLIKELY(mask)) {
+      // Fields outside of the mask are skipped without being stored anywhere,
+      // not even as unknown fields.
+      const hpb_FieldMask* submask;
+      if (!layout || !_hpb_FieldMask_Select(mask, field, &submask)) {
+        ptr = hpb_Decoder_SkipField(d, ptr, tag);
+        continue;
+      }
+      d->mask = submask;
+    }
+
     ptr = _hpb_Decoder_DecodeWireValue(d, ptr, layout, field, wire_type, &val,
                                        &op);
 
@@ -1296,8 +1431,12 @@ static const char* _hpb_Decoder_DecodeMessage(hpb_Decoder* d, const char* ptr,
           break;
       }
     }
+    d->mask = mask;
   }
 
+#if HPB_FASTTABLE
+done:
+#endif
   return HPB_UNLIKELY(layout && layout->required_count)
              ? _hpb_Decoder_CheckRequired(d, ptr, msg, layout)
              : ptr;
@@ -1330,6 +1469,12 @@ const char* _hpb_Decoder_IsDoneFallback(hpb_EpsCopyInputStream* e,
       e, ptr, overrun, _hpb_Decoder_BufferFlipCallback);
 }
 
+// Hands the memory allocated by the decoder back to `arena`.
+static void _hpb_Decoder_ReturnArena(hpb_Decoder* const decoder,
+                                     hpb_Arena* const arena) {
+  _hpb_Arena_SwapOut(arena, &decoder->arena);
+}
+
 static hpb_DecodeStatus hpb_Decoder_Decode(hpb_Decoder* const decoder,
                                            const char* const buf,
                                            void* const msg,
@@ -1341,43 +1486,150 @@ static hpb_DecodeStatus hpb_Decoder_Decode(hpb_Decoder* const decoder,
     HPB_ASSERT(decoder->status != kHpb_DecodeStatus_Ok);
   }
 
-  _hpb_MemBlock* blocks =
-      hpb_Atomic_Load(&decoder->arena.blocks, memory_order_relaxed);
-  arena->head = decoder->arena.head;
-  hpb_Atomic_Store(&arena->blocks, blocks, memory_order_relaxed);
+  _hpb_Decoder_ReturnArena(decoder, arena);
   return decoder->status;
 }
 
+// Resets the state of a single parse.
+static void _hpb_Decoder_Reset(hpb_Decoder* const decoder, int options) {
+  unsigned depth = (unsigned)options >> 16;
+
+  decoder->unknown = NULL;
+  decoder->depth = depth ? depth : kHpb_WireFormat_DefaultDepthLimit;
+  decoder->end_group = DECODE_NOGROUP;
+  decoder->missing_required = false;
+  decoder->mask = NULL;
+  decoder->status = kHpb_DecodeStatus_Ok;
+}
+
+// Initializes everything but `decoder->input`.
+static void _hpb_Decoder_Init(hpb_Decoder* const decoder,
+                              const hpb_ExtensionRegistry* extreg, int options,
+                              hpb_Arena* arena) {
+  decoder->extreg = extreg;
+  decoder->options = (uint16_t)options;
+  _hpb_Decoder_Reset(decoder, options);
+
+  // Violating the encapsulation of the arena for performance reasons.
+  // This is a temporary arena that we swap into and swap out of when we are
+  // done.  The temporary arena only needs to be able to handle allocation,
+  // not fuse or free, so it does not need many of the members to be initialized
+  // (particularly parent_or_count).
+  _hpb_Arena_SwapIn(&decoder->arena, arena);
+}
+
 hpb_DecodeStatus hpb_Decode(const char* buf, size_t size, void* msg,
                             const hpb_MiniTable* l,
                             const hpb_ExtensionRegistry* extreg, int options,
                             hpb_Arena* arena) {
   hpb_Decoder decoder;
-  unsigned depth = (unsigned)options >> 16;
 
   hpb_EpsCopyInputStream_Init(&decoder.input, &buf, size,
                               options & kHpb_DecodeOption_AliasString);
+  _hpb_Decoder_Init(&decoder, extreg, options, arena);
 
-  decoder.extreg = extreg;
-  decoder.unknown = NULL;
-  decoder.depth = depth ? depth : kHpb_WireFormat_DefaultDepthLimit;
-  decoder.end_group = DECODE_NOGROUP;
-  decoder.options = (uint16_t)options;
-  decoder.missing_required = false;
-  decoder.status = kHpb_DecodeStatus_Ok;
+  return hpb_Decoder_Decode(&decoder, buf, msg, l, arena);
+}
 
-  // Violating the encapsulation of the arena for performance reasons.
-  // This is a temporary arena that we swap into and swap out of when we are
-  // done.  The temporary arena only needs to be able to handle allocation,
-  // not fuse or free, so it does not need many of the members to be initialized
-  // (particularly parent_or_count).
-  _hpb_MemBlock* blocks = hpb_Atomic_Load(&arena->blocks, memory_order_relaxed);
-  decoder.arena.head = arena->head;
-  decoder.arena.block_alloc = arena->block_alloc;
-  hpb_Atomic_Init(&decoder.arena.blocks, blocks);
+hpb_DecodeStatus hpb_DecodeWithMask(const char* buf, size_t size, void* msg,
+                                    const hpb_MiniTable* l,
+                                    const hpb_FieldMask* mask,
+                                    const hpb_ExtensionRegistry* extreg,
+                                    int options, hpb_Arena* arena) {
+  hpb_Decoder decoder;
+
+  HPB_ASSERT(mask->table == l);
+  hpb_EpsCopyInputStream_Init(&decoder.input, &buf, size,
+                              options & kHpb_DecodeOption_AliasString);
+  _hpb_Decoder_Init(&decoder, extreg, options, arena);
+  decoder.mask = mask;
 
   return hpb_Decoder_Decode(&decoder, buf, msg, l, arena);
 }
 
+// Decodes `n` messages laid out `stride` bytes apart in `mem`.  Kept apart
+// from hpb_DecodeBatch() so that nothing but `i` lives across longjmp().
+static void _hpb_Decoder_DecodeBatch(hpb_Decoder* const decoder,
+                                     const hpb_StringView* bufs, size_t n,
+                                     char* mem, size_t stride,
+                                     hpb_Message** out, const hpb_MiniTable* l,
+                                     int options, hpb_DecodeStatus* statuses) {
+  // A single setjmp() serves the whole batch: an error ends the message being
+  // decoded and the loop resumes with the next one.  `i` lives across
+  // longjmp(), so it must be volatile.
+  volatile size_t i = 0;
+  if (HPB_SETJMP(decoder->err) != 0) {
+    HPB_ASSERT(decoder->status != kHpb_DecodeStatus_Ok);
+    statuses[i] = decoder->status;
+    i++;
+  }
+  for (; i < n; i++) {
+    const char* buf = bufs[i].data;
+    hpb_Message* msg = (hpb_Message*)(mem + i * stride +
+                                      sizeof(hpb_Message_Internal));
+    out[i] = msg;
+    hpb_EpsCopyInputStream_Init(&decoder->input, &buf, bufs[i].size,
+                                options & kHpb_DecodeOption_AliasString);
+    _hpb_Decoder_Reset(decoder, options);
+    statuses[i] = _hpb_Decoder_DecodeTop(decoder, buf, msg, l);
+  }
+}
+
+size_t hpb_DecodeBatch(const hpb_StringView* bufs, size_t n,
+                       hpb_Message** out, const hpb_MiniTable* l,
+                       const hpb_ExtensionRegistry* extreg, int options,
+                       hpb_Arena* arena, hpb_DecodeStatus* statuses) {
+  if (n == 0) return 0;
+
+  // Lay the messages out back to back, as separate calls to
+  // _hpb_Message_New() would if nothing else was allocated in between.
+  size_t stride = HPB_ALIGN_MALLOC(hpb_msg_sizeof(l));
+  char* mem = n <= SIZE_MAX / stride ? hpb_Arena_Malloc(arena, n * stride)
+                                     : NULL;
+  if (!mem) {
+    for (size_t i = 0; i < n; i++) {
+      out[i] = NULL;
+      statuses[i] = kHpb_DecodeStatus_OutOfMemory;
+    }
+    return 0;
+  }
+  memset(mem, 0, n * stride);
+
+  hpb_Decoder decoder;
+  _hpb_Decoder_Init(&decoder, extreg, options, arena);
+  _hpb_Decoder_DecodeBatch(&decoder, bufs, n, mem, stride, out, l, options,
+                           statuses);
+  _hpb_Decoder_ReturnArena(&decoder, arena);
+
+  size_t ok = 0;
+  for (size_t i = 0; i < n; i++) ok += statuses[i] == kHpb_DecodeStatus_Ok;
+  return ok;
+}
+
+hpb_DecodeStatus hpb_DecodeStream(hpb_ZeroCopyInputStream* stream, void* msg,
+                                  const hpb_MiniTable* l,
+                                  const hpb_ExtensionRegistry* extreg,
+                                  int options, hpb_Arena* arena) {
+  hpb_Decoder decoder;
+  hpb_Status status;
+  const char* buf;
+
+  if (!hpb_EpsCopyInputStream_InitStream(&decoder.input, &buf, stream,
+                                         &status)) {
+    return kHpb_DecodeStatus_Malformed;
+  }
+  _hpb_Decoder_Init(&decoder, extreg, options, arena);
+
+  hpb_DecodeStatus ret = hpb_Decoder_Decode(&decoder, buf, msg, l, arena);
+
+  // The parse can only stop short of the end of the stream if the message
+  // exceeded the 2GB limit.
+  if (ret == kHpb_DecodeStatus_Ok &&
+      !hpb_EpsCopyInputStream_IsStreamEof(&decoder.input)) {
+    ret = kHpb_DecodeStatus_Malformed;
+  }
+  return ret;
+}
+
 #undef OP_FIXPCK_LG2
 #undef OP_VARPCK_LG2
@@ -33,9 +33,12 @@
 #ifndef HPB_WIRE_DECODE_H_
 #define HPB_WIRE_DECODE_H_
 
+#include "hpb/base/string_view.h"
+#include "hpb/io/zero_copy_input_stream.h"
 #include "hpb/mem/arena.h"
 #include "hpb/message/message.h"
 #include "hpb/mini_table/extension_registry.h"
+#include "hpb/wire/field_mask.h"
 #include "hpb/wire/types.h"
 
 // Must be last.
@@ -47,7 +50,8 @@ extern "C" {
 
 enum {
   /* If set, strings will alias the input buffer instead of copying into the
-   * arena. */
+   * arena.  The input must then outlive the arena; hpb_Arena_AddCleanup() can
+   * release it when the arena is freed. */
   kHpb_DecodeOption_AliasString = 1,
 
   /* If set, the parse will return failure if any message is missing any
@@ -103,6 +107,18 @@ enum {
    *    be created by the parser or the message-copying logic in message/copy.h.
    */
   kHpb_DecodeOption_ExperimentalAllowUnlinked = 4,
+
+  /* If set, length-delimited sub-message fields (singular or repeated, but
+   * not maps, groups or extensions) are not parsed.  Their bytes are copied
+   * verbatim into an "empty" message as described above, to be parsed only
+   * when the field is promoted with the interfaces in message/promote.h.
+   * hpb_Encode() writes such messages back out unchanged, so a message that
+   * only forwards most of its nested payloads never has to parse them.
+   *
+   * The same rules as for kHpb_DecodeOption_ExperimentalAllowUnlinked apply,
+   * and kHpb_DecodeOption_CheckRequired does not look inside messages that
+   * have not been promoted yet. */
+  kHpb_DecodeOption_LazySubMessages = 8,
 };
 
 HPB_INLINE uint32_t hpb_DecodeOptions_MaxDepth(uint16_t depth) {
@@ -143,6 +159,61 @@ HPB_API hpb_DecodeStatus hpb_Decode(const char* buf, size_t size,
                                     const hpb_ExtensionRegistry* extreg,
                                     int options, hpb_Arena* arena);
 
+// Like hpb_Decode(), but only parses the fields selected by `mask`, which must
+// have been created for `l`.  All other fields, including extensions and
+// unknown fields, are skipped over without allocating anything for them.
+// Fields left out of the mask count as missing for
+// kHpb_DecodeOption_CheckRequired.
+HPB_API hpb_DecodeStatus hpb_DecodeWithMask(const char* buf, size_t size,
+                                            hpb_Message* msg,
+                                            const hpb_MiniTable* l,
+                                            const hpb_FieldMask* mask,
+                                            const hpb_ExtensionRegistry* extreg,
+                                            int options, hpb_Arena* arena);
+
+// Decodes each of the `n` buffers in `bufs` into a new message of type `l`,
+// stored in `out[i]`, with its status in `statuses[i]`.  This gives the same
+// results as calling hpb_Decode() on each buffer, but sets up the decoder only
+// once and allocates all of the messages in one block, which matters for
+// batches of small messages.  A message whose status is not
+// kHpb_DecodeStatus_Ok may be partially populated, like the message passed to
+// a failed hpb_Decode().  Returns the number of messages decoded successfully.
+HPB_API size_t hpb_DecodeBatch(const hpb_StringView* bufs, size_t n,
+                               hpb_Message** out, const hpb_MiniTable* l,
+                               const hpb_ExtensionRegistry* extreg,
+                               int options, hpb_Arena* arena,
+                               hpb_DecodeStatus* statuses);
+
+// Like hpb_Decode(), but reads the input incrementally from `stream` until it
+// reports EOF, so the serialized message never needs to be contiguous in
+// memory.  kHpb_DecodeOption_AliasString is ignored, since buffers returned by
+// the stream are not stable.  An error from `stream` is reported as
+// kHpb_DecodeStatus_Malformed.
+HPB_API hpb_DecodeStatus hpb_DecodeStream(hpb_ZeroCopyInputStream* stream,
+                                          hpb_Message* msg,
+                                          const hpb_MiniTable* l,
+                                          const hpb_ExtensionRegistry* extreg,
+                                          int options, hpb_Arena* arena);
+
+// Returns the status hpb_Decode() would return for `buf` when decoding into a
+// new message of type `l`, without building the message.  The input is
+// checked in the same way (wire format, UTF-8, depth limit, required fields
+// if kHpb_DecodeOption_CheckRequired is set, closed enum values, unlinked
+// sub-messages), but nothing is allocated, so no arena is needed and the only
+// possible errors are the ones caused by the input.
+//
+// kHpb_DecodeOption_LazySubMessages is ignored: sub-messages are always
+// checked, so a payload it would let through can still be reported as
+// malformed here.  A sub-message that occurs more than once is checked for
+// required fields one occurrence at a time.  The results are those of the
+// generic parser; when fasttables are enabled, hpb_Decode() can report a
+// different error for a corrupt payload, and rejects varints whose tenth byte
+// is greater than 1.
+HPB_API hpb_DecodeStatus hpb_Validate(const char* buf, size_t size,
+                                      const hpb_MiniTable* l,
+                                      const hpb_ExtensionRegistry* extreg,
+                                      int options);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -41,7 +41,11 @@
 #include "hpb/wire/decode_fast.h"
 
 #include "hpb/collections/internal/array.h"
+#include "hpb/collections/internal/map.h"
+#include "hpb/message/internal/map_entry.h"
+#include "hpb/mini_table/internal/enum.h"
 #include "hpb/wire/internal/decode.h"
+#include "hpb/wire/internal/packed_varint.h"
 
 // Must be last.
 #include "hpb/port/def.inc"
@@ -69,11 +73,26 @@ typedef enum {
   CARD_p = 3  /* Packed Repeated */
 } hpb_card;
 
+HPB_FORCEINLINE
+static const char* fastdecode_done(hpb_Decoder* d, const char* ptr,
+                                   hpb_Message* msg, intptr_t table,
+                                   uint64_t hasbits) {
+  *(uint32_t*)msg |= hasbits;  // Sync hasbits.
+  const hpb_MiniTable* l = decode_totablep(table);
+  return HPB_UNLIKELY(l->required_count)
+             ? _hpb_Decoder_CheckRequired(d, ptr, msg, l)
+             : ptr;
+}
+
 HPB_NOINLINE
 static const char* fastdecode_isdonefallback(HPB_PARSE_PARAMS) {
   int overrun = data;
   ptr = _hpb_EpsCopyInputStream_IsDoneFallbackInline(
       &d->input, ptr, overrun, _hpb_Decoder_BufferFlipCallback);
+  if (HPB_UNLIKELY(!ptr)) {
+    // Clean end of a streaming input (errors do not return here).
+    return fastdecode_done(d, ptr, msg, table, hasbits);
+  }
   data = _hpb_FastDecoder_LoadTag(ptr);
   HPB_MUSTTAIL return _hpb_FastDecoder_TagDispatch(HPB_PARSE_ARGS);
 }
@@ -83,11 +102,7 @@ static const char* fastdecode_dispatch(HPB_PARSE_PARAMS) {
   int overrun;
   switch (hpb_EpsCopyInputStream_IsDoneStatus(&d->input, ptr, &overrun)) {
     case kHpb_IsDoneStatus_Done:
-      *(uint32_t*)msg |= hasbits;  // Sync hasbits.
-      const hpb_MiniTable* l = decode_totablep(table);
-      return HPB_UNLIKELY(l->required_count)
-                 ? _hpb_Decoder_CheckRequired(d, ptr, msg, l)
-                 : ptr;
+      return fastdecode_done(d, ptr, msg, table, hasbits);
     case kHpb_IsDoneStatus_NotDone:
       break;
     case kHpb_IsDoneStatus_NeedFallback:
@@ -158,6 +173,9 @@ static const char* fastdecode_delimited(
     }
     int delta = hpb_EpsCopyInputStream_PushLimit(&d->input, ptr, len);
     ptr = func(&d->input, ptr, ctx);
+    // The limit cannot be popped after an error, or after a sub-message that
+    // stopped early at an END_GROUP tag; both are reported by the caller.
+    if (HPB_UNLIKELY(!ptr || d->end_group != DECODE_NOGROUP)) return NULL;
     hpb_EpsCopyInputStream_PopLimit(&d->input, ptr, delta);
   }
   return ptr;
@@ -201,6 +219,29 @@ static void* fastdecode_resizearr(hpb_Decoder* d, void* dst,
   return dst;
 }
 
+// An empty array is sized exactly; one that already holds elements from an
+// earlier occurrence of the field keeps growing by doubling.
+static char* fastdecode_reservearr_slow(hpb_Decoder* d, hpb_Array* arr,
+                                       size_t size, size_t count) {
+  bool ok = size == 0 ? _hpb_array_realloc_exact(arr, count, &d->arena)
+                      : _hpb_array_realloc(arr, size + count, &d->arena);
+  if (!ok) _hpb_FastDecoder_ErrorJmp(d, kHpb_DecodeStatus_OutOfMemory);
+  return _hpb_array_ptr(arr);
+}
+
+// Grows the array so that at least `count` elements fit from `dst` on.
+HPB_FORCEINLINE
+static void* fastdecode_reservearr(hpb_Decoder* d, void* dst,
+                                   fastdecode_arr* farr, int valbytes,
+                                   size_t count) {
+  char* begin = _hpb_array_ptr(farr->arr);
+  size_t size = (size_t)((char*)dst - begin) / valbytes;
+  if (HPB_LIKELY(farr->arr->capacity - size >= count)) return dst;
+  begin = fastdecode_reservearr_slow(d, farr->arr, size, count);
+  farr->end = begin + farr->arr->capacity * valbytes;
+  return begin + size * valbytes;
+}
+
 HPB_FORCEINLINE
 static bool fastdecode_tagmatch(uint32_t tag, uint64_t data, int tagbytes) {
   if (tagbytes == 1) {
@@ -385,7 +426,7 @@ done:
         data = ret.tag;                                                        \
         HPB_MUSTTAIL return _hpb_FastDecoder_TagDispatch(HPB_PARSE_ARGS);      \
       case FD_NEXT_ATLIMIT:                                                    \
-        return ptr;                                                            \
+        return fastdecode_done(d, ptr, msg, table, hasbits);                   \
     }                                                                          \
   }                                                                            \
                                                                                \
@@ -406,6 +447,14 @@ static const char* fastdecode_topackedvarint(hpb_EpsCopyInputStream* e,
   void* dst = data->dst;
   uint64_t val;
 
+  // Every byte without a continuation bit ends one element, so make room for
+  // all of the elements in the current buffer (including its slop bytes) at
+  // once.
+  const char* avail_end =
+      e->end + HPB_MIN(e->limit, kHpb_EpsCopyInputStream_SlopBytes);
+  dst = fastdecode_reservearr(d, dst, &data->farr, data->valbytes,
+                              _hpb_WireReader_CountVarints(ptr, avail_end));
+
   while (!_hpb_Decoder_IsDone(d, &ptr)) {
     dst = fastdecode_resizearr(d, dst, &data->farr, data->valbytes);
     ptr = fastdecode_varint64(ptr, &val);
@@ -495,6 +544,92 @@ TAGBYTES(p)
 #undef FASTDECODE_PACKEDVARINT
 #undef FASTDECODE_VARINT
 
+/* closed enum fields *********************************************************/
+
+// Only values covered by the enum's 64-bit mask are checked here.  Anything
+// else, including values that belong in the unknown fields, goes to the
+// generic parser, which starts over at the tag of the offending value.
+#define FASTDECODE_ENUM(d, ptr, msg, table, hasbits, data, tagbytes, card)    \
+  uint64_t val;                                                               \
+  void* dst;                                                                  \
+  fastdecode_arr farr;                                                        \
+  const char* next;                                                           \
+                                                                              \
+  if (HPB_UNLIKELY(!fastdecode_checktag(data, tagbytes))) {                   \
+    RETURN_GENERIC("enum field tag mismatch\n");                              \
+  }                                                                           \
+                                                                              \
+  const hpb_MiniTableEnum* e =                                                \
+      decode_totablep(table)->subs[(data >> 16) & 0xff].subenum;              \
+  if (HPB_UNLIKELY(!e)) {                                                     \
+    RETURN_GENERIC("enum is not linked\n");                                   \
+  }                                                                           \
+                                                                              \
+  if (card == CARD_r) {                                                       \
+    dst = fastdecode_getfield(d, ptr, msg, &data, &hasbits, &farr, 4, card);  \
+    if (HPB_UNLIKELY(!dst)) {                                                 \
+      RETURN_GENERIC("need array resize\n");                                  \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  again:                                                                      \
+  if (card == CARD_r) {                                                       \
+    dst = fastdecode_resizearr(d, dst, &farr, 4);                             \
+  }                                                                           \
+                                                                              \
+  next = fastdecode_varint64(ptr + tagbytes, &val);                           \
+  if (next == NULL) _hpb_FastDecoder_ErrorJmp(d, kHpb_DecodeStatus_Malformed); \
+  if (HPB_UNLIKELY(_hpb_MiniTable_CheckEnumValueFast(e, (uint32_t)val) !=     \
+                   _kHpb_FastEnumCheck_ValueIsInEnum)) {                      \
+    if (card == CARD_r) fastdecode_commitarr(dst, &farr, 4);                  \
+    RETURN_GENERIC("enum value needs the slow check\n");                      \
+  }                                                                           \
+                                                                              \
+  if (card != CARD_r) {                                                       \
+    dst = fastdecode_getfield(d, ptr, msg, &data, &hasbits, &farr, 4, card);  \
+  }                                                                           \
+  ptr = next;                                                                 \
+  memcpy(dst, &val, 4);                                                       \
+                                                                              \
+  if (card == CARD_r) {                                                       \
+    fastdecode_nextret ret =                                                  \
+        fastdecode_nextrepeated(d, dst, &ptr, &farr, data, tagbytes, 4);      \
+    switch (ret.next) {                                                       \
+      case FD_NEXT_SAMEFIELD:                                                 \
+        dst = ret.dst;                                                        \
+        goto again;                                                           \
+      case FD_NEXT_OTHERFIELD:                                                \
+        data = ret.tag;                                                       \
+        HPB_MUSTTAIL return _hpb_FastDecoder_TagDispatch(HPB_PARSE_ARGS);     \
+      case FD_NEXT_ATLIMIT:                                                   \
+        return fastdecode_done(d, ptr, msg, table, hasbits);                  \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  HPB_MUSTTAIL return fastdecode_dispatch(HPB_PARSE_ARGS);
+
+/* Generate all combinations:
+ * {s,o,r} x {1bt,2bt} */
+
+#define F(card, tagbytes)                                              \
+  HPB_NOINLINE                                                         \
+  const char* hpb_p##card##e4_##tagbytes##bt(HPB_PARSE_PARAMS) {       \
+    FASTDECODE_ENUM(d, ptr, msg, table, hasbits, data, tagbytes,       \
+                    CARD_##card);                                      \
+  }
+
+#define TAGBYTES(card) \
+  F(card, 1)           \
+  F(card, 2)
+
+TAGBYTES(s)
+TAGBYTES(o)
+TAGBYTES(r)
+
+#undef F
+#undef TAGBYTES
+#undef FASTDECODE_ENUM
+
 /* fixed fields ***************************************************************/
 
 #define FASTDECODE_UNPACKEDFIXED(d, ptr, msg, table, hasbits, data, tagbytes, \
@@ -532,7 +667,7 @@ TAGBYTES(p)
         data = ret.tag;                                                       \
         HPB_MUSTTAIL return _hpb_FastDecoder_TagDispatch(HPB_PARSE_ARGS);     \
       case FD_NEXT_ATLIMIT:                                                   \
-        return ptr;                                                           \
+        return fastdecode_done(d, ptr, msg, table, hasbits);                  \
     }                                                                         \
   }                                                                           \
                                                                               \
@@ -542,6 +677,7 @@ TAGBYTES(p)
                                valbytes, unpacked)                          \
   FASTDECODE_CHECKPACKED(tagbytes, CARD_r, unpacked)                        \
                                                                             \
+  const char* field_start = ptr;                                            \
   ptr += tagbytes;                                                          \
   int size = (uint8_t)ptr[0];                                               \
   ptr++;                                                                    \
@@ -552,6 +688,11 @@ TAGBYTES(p)
   if (HPB_UNLIKELY(!hpb_EpsCopyInputStream_CheckDataSizeAvailable(          \
                        &d->input, ptr, size) ||                             \
                    (size % valbytes) != 0)) {                               \
+    if (d->input.stream && (size % valbytes) == 0) {                        \
+      /* Data spans the buffers of a streaming input. */                    \
+      ptr = field_start;                                                    \
+      RETURN_GENERIC("packed data spans buffers\n");                        \
+    }                                                                       \
     _hpb_FastDecoder_ErrorJmp(d, kHpb_DecodeStatus_Malformed);              \
   }                                                                         \
                                                                             \
@@ -649,7 +790,11 @@ static const char* fastdecode_verifyutf8(hpb_Decoder* d, const char* ptr,
                                                                                \
   const char* s_ptr = ptr;                                                     \
   ptr = hpb_EpsCopyInputStream_ReadString(&d->input, &s_ptr, size, &d->arena); \
-  if (!ptr) _hpb_FastDecoder_ErrorJmp(d, kHpb_DecodeStatus_OutOfMemory);       \
+  if (!ptr) {                                                                  \
+    _hpb_FastDecoder_ErrorJmp(d, hpb_EpsCopyInputStream_IsError(&d->input)     \
+                                     ? kHpb_DecodeStatus_Malformed             \
+                                     : kHpb_DecodeStatus_OutOfMemory);         \
+  }                                                                            \
   dst->data = s_ptr;                                                           \
   dst->size = size;                                                            \
                                                                                \
@@ -719,6 +864,7 @@ static void fastdecode_docopy(hpb_Decoder* d, const char* ptr, uint32_t size,
   if (HPB_LIKELY(size <= 15 - tagbytes)) {                                     \
     if (arena_has < 16) goto longstr;                                          \
     d->arena.head.ptr += 16;                                                   \
+    HPB_UNPOISON_MEMORY_REGION(buf, 16);                                       \
     memcpy(buf, ptr - tagbytes - 1, 16);                                       \
     dst->data = buf + tagbytes + 1;                                            \
   } else if (HPB_LIKELY(size <= 32)) {                                         \
@@ -751,7 +897,7 @@ static void fastdecode_docopy(hpb_Decoder* d, const char* ptr, uint32_t size,
         data = ret.tag;                                                        \
         HPB_MUSTTAIL return _hpb_FastDecoder_TagDispatch(HPB_PARSE_ARGS);      \
       case FD_NEXT_ATLIMIT:                                                    \
-        return ptr;                                                            \
+        return fastdecode_done(d, ptr, msg, table, hasbits);                   \
     }                                                                          \
   }                                                                            \
                                                                                \
@@ -803,6 +949,9 @@ static void fastdecode_docopy(hpb_Decoder* d, const char* ptr, uint32_t size,
                                                                               \
   if (HPB_UNLIKELY(                                                           \
           !hpb_EpsCopyInputStream_AliasingAvailable(&d->input, ptr, size))) { \
+    if (card == CARD_r) {                                                     \
+      fastdecode_commitarr(dst + 1, &farr, sizeof(hpb_StringView));           \
+    }                                                                         \
     ptr--;                                                                    \
     if (validate_utf8) {                                                      \
       return fastdecode_longstring_utf8(d, ptr, msg, table, hasbits,          \
@@ -833,7 +982,7 @@ static void fastdecode_docopy(hpb_Decoder* d, const char* ptr, uint32_t size,
         data = ret.tag;                                                       \
         HPB_MUSTTAIL return _hpb_FastDecoder_TagDispatch(HPB_PARSE_ARGS);     \
       case FD_NEXT_ATLIMIT:                                                   \
-        return ptr;                                                           \
+        return fastdecode_done(d, ptr, msg, table, hasbits);                  \
     }                                                                         \
   }                                                                           \
                                                                               \
@@ -937,7 +1086,7 @@ static const char* fastdecode_tosubmsg(hpb_EpsCopyInputStream* e,
   fastdecode_submsgdata submsg = {decode_totable(subtablep)};             \
   fastdecode_arr farr;                                                    \
                                                                           \
-  if (subtablep->table_mask == (uint8_t)-1) {                             \
+  if (subtablep->table_mask == (uint16_t)-1) {                            \
     RETURN_GENERIC("submessage doesn't have fast tables.");               \
   }                                                                       \
                                                                           \
@@ -980,7 +1129,7 @@ static const char* fastdecode_tosubmsg(hpb_EpsCopyInputStream* e,
         HPB_MUSTTAIL return _hpb_FastDecoder_TagDispatch(HPB_PARSE_ARGS); \
       case FD_NEXT_ATLIMIT:                                               \
         d->depth++;                                                       \
-        return ptr;                                                       \
+        return fastdecode_done(d, ptr, msg, table, hasbits);              \
     }                                                                     \
   }                                                                       \
                                                                           \
@@ -1014,4 +1163,222 @@ TAGBYTES(r)
 #undef F
 #undef FASTDECODE_SUBMSG
 
+/* map fields *****************************************************************/
+
+typedef enum {
+  FD_MAP_VARINT,
+  FD_MAP_STRING,
+  FD_MAP_MESSAGE,
+} fastdecode_mapkind;
+
+// Reads a length prefix and checks that the data it announces ends by `end`.
+HPB_FORCEINLINE
+static const char* fastdecode_mapsize(const char* ptr, const char* end,
+                                      int* size) {
+  *size = (uint8_t)*ptr++;
+  if (*size & 0x80) {
+    ptr = fastdecode_longsize(ptr, size);
+    if (!ptr) return NULL;
+  }
+  return *size <= end - ptr ? ptr : NULL;
+}
+
+// Reads a map key or value of the given kind into `out`.  Returns NULL for
+// anything the generic parser has to look at, without side effects other
+// than arena allocations.
+HPB_FORCEINLINE
+static const char* fastdecode_mapfield(hpb_Decoder* d, const char* ptr,
+                                       const char* end,
+                                       const hpb_MiniTable* entry,
+                                       const hpb_MiniTableField* f,
+                                       fastdecode_mapkind kind, bool is_key,
+                                       void* out) {
+  switch (kind) {
+    case FD_MAP_VARINT: {
+      uint64_t val;
+      ptr = fastdecode_varint64(ptr, &val);
+      if (!ptr || ptr > end) return NULL;
+      memcpy(out, &val, sizeof(val));
+      return ptr;
+    }
+    case FD_MAP_STRING: {
+      int size;
+      ptr = fastdecode_mapsize(ptr, end, &size);
+      if (!ptr) return NULL;
+      hpb_StringView* str = out;
+      str->data = ptr;
+      str->size = size;
+      if (is_key) {
+        // Keys are copied into the map.
+        ptr += size;
+      } else {
+        ptr = hpb_EpsCopyInputStream_ReadString(&d->input, &str->data, size,
+                                                &d->arena);
+        if (!ptr) return NULL;
+      }
+      if (f->HPB_PRIVATE(descriptortype) == kHpb_FieldType_String &&
+          !_hpb_Decoder_VerifyUtf8Inline(str->data, str->size)) {
+        return NULL;
+      }
+      return ptr;
+    }
+    case FD_MAP_MESSAGE: {
+      const hpb_MiniTable* subl =
+          entry->subs[f->HPB_PRIVATE(submsg_index)].submsg;
+      int size;
+      if (subl->table_mask == (uint16_t)-1) return NULL;
+      if (!fastdecode_mapsize(ptr, end, &size)) return NULL;
+      if (--d->depth < 0) {
+        _hpb_FastDecoder_ErrorJmp(d, kHpb_DecodeStatus_MaxDepthExceeded);
+      }
+      fastdecode_submsgdata submsg = {decode_totable(subl),
+                                      decode_newmsg_ceil(d, subl, -1)};
+      ptr = fastdecode_delimited(d, ptr, fastdecode_tosubmsg, &submsg);
+      if (HPB_UNLIKELY(ptr == NULL || d->end_group != DECODE_NOGROUP)) {
+        _hpb_FastDecoder_ErrorJmp(d, kHpb_DecodeStatus_Malformed);
+      }
+      d->depth++;
+      *(hpb_value*)out = hpb_value_ptr(submsg.msg);
+      return ptr;
+    }
+  }
+  HPB_UNREACHABLE();
+}
+
+HPB_FORCEINLINE
+static uint8_t fastdecode_maptag(int number, fastdecode_mapkind kind) {
+  int wire_type =
+      kind == FD_MAP_VARINT ? kHpb_WireType_Varint : kHpb_WireType_Delimited;
+  return (number << 3) | wire_type;
+}
+
+// Parses the map entry in [ptr, end) into `ent`.  Only a key and a value, each
+// at most once and in either order, are handled here.
+HPB_FORCEINLINE
+static const char* fastdecode_mapentry(hpb_Decoder* d, const char* ptr,
+                                       const char* end,
+                                       const hpb_MiniTable* entry,
+                                       fastdecode_mapkind key_kind,
+                                       fastdecode_mapkind val_kind,
+                                       hpb_MapEntryData* ent) {
+  const uint8_t key_tag = fastdecode_maptag(1, key_kind);
+  const uint8_t val_tag = fastdecode_maptag(2, val_kind);
+  bool has_key = false;
+  bool has_val = false;
+
+  memset(ent, 0, sizeof(*ent));
+  // The entry is a level of its own, as in the generic parser, so that both
+  // report kHpb_DecodeStatus_MaxDepthExceeded at the same depth.
+  if (--d->depth < 0) {
+    _hpb_FastDecoder_ErrorJmp(d, kHpb_DecodeStatus_MaxDepthExceeded);
+  }
+  while (ptr < end) {
+    uint8_t tag = *ptr++;
+    if (tag == key_tag && !has_key) {
+      ptr = fastdecode_mapfield(d, ptr, end, entry, &entry->fields[0],
+                                key_kind, true, &ent->k);
+      has_key = true;
+    } else if (tag == val_tag && !has_val) {
+      ptr = fastdecode_mapfield(d, ptr, end, entry, &entry->fields[1],
+                                val_kind, false, &ent->v);
+      has_val = true;
+    } else {
+      ptr = NULL;
+    }
+    if (!ptr) break;
+  }
+  d->depth++;
+  if (!ptr) return NULL;
+
+  if (val_kind == FD_MAP_MESSAGE && !has_val) {
+    const hpb_MiniTable* subl =
+        entry->subs[entry->fields[1].HPB_PRIVATE(submsg_index)].submsg;
+    ent->v.val = hpb_value_ptr(decode_newmsg_ceil(d, subl, -1));
+  }
+  return ptr;
+}
+
+// Entries that are not entirely in the current buffer, or that hold anything
+// besides a key and a value (unknown fields, groups, bad UTF-8, etc.), are left
+// to the generic parser.  It starts over at the tag of the entry, which is
+// safe because nothing has been stored in the map yet.
+#define FASTDECODE_MAP(d, ptr, msg, table, hasbits, data, tagbytes, key_kind, \
+                       val_kind)                                              \
+  if (HPB_UNLIKELY(!fastdecode_checktag(data, tagbytes))) {                   \
+    RETURN_GENERIC("map field tag mismatch\n");                               \
+  }                                                                           \
+                                                                              \
+  const hpb_MiniTable* entry =                                                \
+      decode_totablep(table)->subs[(data >> 16) & 0xff].submsg;               \
+  hpb_Map** map_p = fastdecode_fieldmem(msg, data);                           \
+  uint32_t tag = _hpb_FastDecoder_LoadTag(ptr);                               \
+                                                                              \
+  again:                                                                      \
+  {                                                                           \
+    const char* p = ptr + tagbytes;                                           \
+    int size = (uint8_t)*p++;                                                 \
+    if (HPB_UNLIKELY(size & 0x80)) {                                          \
+      p = fastdecode_longsize(p, &size);                                      \
+      if (!p) RETURN_GENERIC("bad map entry size\n");                         \
+    }                                                                         \
+    if (HPB_UNLIKELY(!hpb_EpsCopyInputStream_CheckSubMessageSizeAvailable(    \
+            &d->input, p, size))) {                                           \
+      RETURN_GENERIC("map entry is not in the current buffer\n");             \
+    }                                                                         \
+                                                                              \
+    hpb_MapEntryData ent;                                                     \
+    p = fastdecode_mapentry(d, p, p + size, entry, key_kind, val_kind, &ent); \
+    if (HPB_UNLIKELY(!p)) RETURN_GENERIC("map entry needs generic parser\n"); \
+                                                                              \
+    if (HPB_UNLIKELY(!*map_p)) *map_p = _hpb_Decoder_CreateMap(d, entry);     \
+    hpb_Map* map = *map_p;                                                    \
+    if (_hpb_Map_Insert(map, &ent.k, map->key_size, &ent.v, map->val_size,    \
+                        &d->arena) == kHpb_MapInsertStatus_OutOfMemory) {     \
+      _hpb_FastDecoder_ErrorJmp(d, kHpb_DecodeStatus_OutOfMemory);            \
+    }                                                                         \
+    ptr = p;                                                                  \
+  }                                                                           \
+                                                                              \
+  /* ptr is NULL after the clean end of a streaming input. */               \
+  if (_hpb_Decoder_IsDone(d, &ptr)) {                                         \
+    return fastdecode_done(d, ptr, msg, table, hasbits);                      \
+  }                                                                           \
+  data = _hpb_FastDecoder_LoadTag(ptr);                                       \
+  if (fastdecode_tagmatch(data, tag, tagbytes)) goto again;                   \
+  HPB_MUSTTAIL return _hpb_FastDecoder_TagDispatch(HPB_PARSE_ARGS);
+
+/* Generate all combinations:
+ * {v,s} x {v,s,m} x {1bt,2bt} */
+
+#define v_MAPKIND FD_MAP_VARINT
+#define s_MAPKIND FD_MAP_STRING
+#define m_MAPKIND FD_MAP_MESSAGE
+
+#define F(key, val, tagbytes)                                            \
+  HPB_NOINLINE                                                           \
+  const char* hpb_pm##key##val##_##tagbytes##bt(HPB_PARSE_PARAMS) {      \
+    FASTDECODE_MAP(d, ptr, msg, table, hasbits, data, tagbytes,          \
+                   key##_MAPKIND, val##_MAPKIND);                        \
+  }
+
+#define VALS(key, tagbytes) \
+  F(key, v, tagbytes)       \
+  F(key, s, tagbytes)       \
+  F(key, m, tagbytes)
+
+#define TAGBYTES(key) \
+  VALS(key, 1)        \
+  VALS(key, 2)
+
+TAGBYTES(v)
+TAGBYTES(s)
+
+#undef v_MAPKIND
+#undef s_MAPKIND
+#undef m_MAPKIND
+#undef F
+#undef VALS
+#undef TAGBYTES
+#undef FASTDECODE_MAP
+
 #endif /* HPB_FASTTABLE */
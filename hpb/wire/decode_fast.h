@@ -45,6 +45,7 @@
 //   - 'o' for oneof
 //   - 'r' for non-packed repeated
 //   - 'p' for packed repeated
+//   - 'm' for map
 //
 // In position 3 (type):
 //   - 'b1' for bool
@@ -54,10 +55,15 @@
 //   - 'z8' for zig-zag-encoded 8-byte varint
 //   - 'f4' for 4-byte fixed
 //   - 'f8' for 8-byte fixed
+//   - 'e4' for closed enum
 //   - 'm' for sub-message
 //   - 's' for string (validate UTF-8)
 //   - 'b' for bytes
 //
+// For maps, position 3 is the key type followed by the value type, each of
+// them 'v' for a plain varint (int32, int64, uint32, uint64 or open enum), 's'
+// for string or bytes, or 'm' for sub-message (values only).
+//
 // In position 4 (tag length):
 //   - '1' for one-byte tags (field numbers 1-15)
 //   - '2' for two-byte tags (field numbers 16-2048)
@@ -135,6 +141,22 @@ TAGBYTES(r)
 #undef F
 #undef TAGBYTES
 
+/* closed enum fields *********************************************************/
+
+#define F(card, tagbytes) \
+  const char* hpb_p##card##e4_##tagbytes##bt(HPB_PARSE_PARAMS);
+
+#define TAGBYTES(card) \
+  F(card, 1)           \
+  F(card, 2)
+
+TAGBYTES(s)
+TAGBYTES(o)
+TAGBYTES(r)
+
+#undef F
+#undef TAGBYTES
+
 /* sub-message fields *********************************************************/
 
 #define F(card, tagbytes, size_ceil, ceil_arg) \
@@ -159,6 +181,27 @@ TAGBYTES(r)
 #undef SIZES
 #undef F
 
+/* map fields *****************************************************************/
+
+#define F(key, val, tagbytes) \
+  const char* hpb_pm##key##val##_##tagbytes##bt(HPB_PARSE_PARAMS);
+
+#define VALS(key, tagbytes) \
+  F(key, v, tagbytes)       \
+  F(key, s, tagbytes)       \
+  F(key, m, tagbytes)
+
+#define TAGBYTES(key) \
+  VALS(key, 1)        \
+  VALS(key, 2)
+
+TAGBYTES(v)
+TAGBYTES(s)
+
+#undef TAGBYTES
+#undef VALS
+#undef F
+
 #undef HPB_PARSE_PARAMS
 
 #ifdef __cplusplus
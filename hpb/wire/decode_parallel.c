@@ -0,0 +1,346 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "hpb/wire/decode_parallel.h"
+
+#include <string.h>
+
+#include "hpb/base/string_view.h"
+#include "hpb/collections/internal/array.h"
+#include "hpb/message/accessors.h"
+#include "hpb/message/message.h"
+#include "hpb/mini_table/internal/field.h"
+#include "hpb/mini_table/internal/message.h"
+#include "hpb/wire/eps_copy_input_stream.h"
+#include "hpb/wire/internal/swap.h"
+#include "hpb/wire/reader.h"
+
+// Must be last.
+#include "hpb/port/def.inc"
+
+// A growable array of hpb_StringView in the scratch arena.
+typedef struct {
+  hpb_StringView* data;
+  size_t size;
+  size_t capacity;
+} hpb_SpanList;
+
+static bool hpb_SpanList_Push(hpb_SpanList* list, const char* begin,
+                              const char* end, hpb_Arena* arena) {
+  if (list->size == list->capacity) {
+    size_t capacity = list->capacity ? list->capacity * 2 : 64;
+    void* data = hpb_Arena_Realloc(arena, list->data,
+                                   list->capacity * sizeof(*list->data),
+                                   capacity * sizeof(*list->data));
+    if (!data) return false;
+    list->data = data;
+    list->capacity = capacity;
+  }
+  list->data[list->size++] = hpb_StringView_FromDataAndSize(begin, end - begin);
+  return true;
+}
+
+typedef enum {
+  kHpb_ScanStatus_Ok,
+  kHpb_ScanStatus_Malformed,
+  kHpb_ScanStatus_OutOfMemory,
+} hpb_ScanStatus;
+
+// Splits the top level of `buf` into the payloads of the elements of field
+// `number` and the runs of other fields between them.
+static hpb_ScanStatus hpb_ParallelDecoder_Scan(const char* buf, size_t size,
+                                               uint32_t number,
+                                               hpb_SpanList* elems,
+                                               hpb_SpanList* runs,
+                                               hpb_Arena* scratch) {
+  hpb_EpsCopyInputStream stream;
+  const char* ptr = buf;
+  const char* run = NULL;  // Start of the current run, if any.
+  hpb_EpsCopyInputStream_Init(&stream, &ptr, size, true);
+  while (!hpb_EpsCopyInputStream_IsDone(&stream, &ptr)) {
+    const char* start = hpb_EpsCopyInputStream_GetAliasedPtr(&stream, ptr);
+    uint32_t tag;
+    ptr = hpb_WireReader_ReadTag(ptr, &tag);
+    if (!ptr) return kHpb_ScanStatus_Malformed;
+    uint32_t wire_type = hpb_WireReader_GetWireType(tag);
+    if (hpb_WireReader_GetFieldNumber(tag) == number &&
+        wire_type == kHpb_WireType_Delimited) {
+      int elem_size;
+      ptr = hpb_WireReader_ReadSize(ptr, &elem_size);
+      if (!ptr || !hpb_EpsCopyInputStream_CheckSize(&stream, ptr, elem_size)) {
+        return kHpb_ScanStatus_Malformed;
+      }
+      const char* elem = hpb_EpsCopyInputStream_GetAliasedPtr(&stream, ptr);
+      if ((run && !hpb_SpanList_Push(runs, run, start, scratch)) ||
+          !hpb_SpanList_Push(elems, elem, elem + elem_size, scratch)) {
+        return kHpb_ScanStatus_OutOfMemory;
+      }
+      run = NULL;
+      ptr = hpb_EpsCopyInputStream_Skip(&stream, ptr, elem_size);
+    } else {
+      if (wire_type == kHpb_WireType_EndGroup) return kHpb_ScanStatus_Malformed;
+      if (!run) run = start;
+      ptr = hpb_WireReader_SkipValue(ptr, tag, &stream);
+    }
+    if (!ptr) return kHpb_ScanStatus_Malformed;
+  }
+  if (hpb_EpsCopyInputStream_IsError(&stream)) {
+    return kHpb_ScanStatus_Malformed;
+  }
+  if (run && !hpb_SpanList_Push(runs, run, buf + size, scratch)) {
+    return kHpb_ScanStatus_OutOfMemory;
+  }
+  return kHpb_ScanStatus_Ok;
+}
+
+typedef struct {
+  // Task 0 decodes the other fields into the message.
+  hpb_StringView rest;
+  hpb_Message* msg;
+  const hpb_MiniTable* l;
+  int options;
+  hpb_Arena* arena;
+  hpb_DecodeStatus rest_status;
+
+  // Task i > 0 decodes elements [bounds[i - 1], bounds[i]) into arenas[i - 1].
+  const hpb_SpanList* elems;
+  const size_t* bounds;
+  hpb_Arena** arenas;
+  const hpb_MiniTable* sub;
+  int elem_options;
+  const hpb_ExtensionRegistry* extreg;
+  hpb_Message** out;
+  hpb_DecodeStatus* statuses;
+} hpb_ParallelDecoder;
+
+static void hpb_ParallelDecoder_RunTask(void* arg, size_t i) {
+  hpb_ParallelDecoder* p = arg;
+  if (i == 0) {
+    p->rest_status = hpb_Decode(p->rest.data, p->rest.size, p->msg, p->l,
+                                p->extreg, p->options, p->arena);
+    return;
+  }
+  size_t begin = p->bounds[i - 1];
+  size_t end = p->bounds[i];
+  hpb_DecodeBatch(p->elems->data + begin, end - begin, p->out + begin, p->sub,
+                  p->extreg, p->elem_options, p->arenas[i - 1],
+                  p->statuses + begin);
+}
+
+// Joins the runs of other fields into one buffer, so that they are decoded as
+// one message, as they would be by hpb_Decode().  With aliasing, the buffer
+// has to live as long as the message.
+static bool hpb_ParallelDecoder_JoinRuns(hpb_ParallelDecoder* p,
+                                         const hpb_SpanList* runs,
+                                         hpb_Arena* scratch) {
+  if (runs->size <= 1) {
+    p->rest = runs->size ? runs->data[0] : hpb_StringView_FromString("");
+    return true;
+  }
+  size_t size = 0;
+  for (size_t i = 0; i < runs->size; i++) size += runs->data[i].size;
+  hpb_Arena* a =
+      p->options & kHpb_DecodeOption_AliasString ? p->arena : scratch;
+  char* buf = hpb_Arena_Malloc(a, size);
+  if (!buf) return false;
+  char* ptr = buf;
+  for (size_t i = 0; i < runs->size; i++) {
+    memcpy(ptr, runs->data[i].data, runs->data[i].size);
+    ptr += runs->data[i].size;
+  }
+  p->rest = hpb_StringView_FromDataAndSize(buf, size);
+  return true;
+}
+
+// Returns the start of the first run that fails to decode on its own.  Only
+// called after an error, to find out whether it came before an element's.
+static const char* hpb_ParallelDecoder_FindRunError(hpb_ParallelDecoder* p,
+                                                    const hpb_SpanList* runs,
+                                                    hpb_Arena* scratch) {
+  hpb_Message* msg = hpb_Message_New(p->l, scratch);
+  int options = p->options & ~kHpb_DecodeOption_CheckRequired;
+  for (size_t i = 0; msg && i < runs->size; i++) {
+    if (hpb_Decode(runs->data[i].data, runs->data[i].size, msg, p->l,
+                   p->extreg, options, scratch) != kHpb_DecodeStatus_Ok) {
+      return runs->data[i].data;
+    }
+  }
+  return NULL;
+}
+
+// Splits the elements into `parts` ranges of about the same number of bytes.
+static void hpb_ParallelDecoder_Partition(const hpb_SpanList* elems,
+                                          size_t parts, size_t* bounds) {
+  size_t total = 0;
+  for (size_t i = 0; i < elems->size; i++) total += elems->data[i].size + 1;
+  size_t seen = 0;
+  size_t part = 0;
+  bounds[0] = 0;
+  for (size_t i = 0; i < elems->size && part + 1 < parts; i++) {
+    seen += elems->data[i].size + 1;
+    // Ends the part once it has its share, `total / parts` bytes per part.
+    if (seen * parts >= total * (part + 1)) bounds[++part] = i + 1;
+  }
+  while (part < parts) bounds[++part] = elems->size;
+}
+
+static bool hpb_ParallelDecoder_IsError(hpb_DecodeStatus status) {
+  return status != kHpb_DecodeStatus_Ok &&
+         status != kHpb_DecodeStatus_MissingRequired;
+}
+
+static hpb_DecodeStatus hpb_ParallelDecoder_Decode(
+    hpb_ParallelDecoder* p, const hpb_MiniTableField* field,
+    const hpb_SpanList* runs, size_t parts, const hpb_DecodeExecutor* executor,
+    hpb_Arena* scratch) {
+  size_t n = p->elems->size;
+  size_t* bounds = hpb_Arena_Malloc(scratch, (parts + 1) * sizeof(*bounds));
+  p->out = hpb_Arena_Malloc(scratch, n * sizeof(*p->out));
+  p->statuses = hpb_Arena_Malloc(scratch, n * sizeof(*p->statuses));
+  if (!bounds || !p->out || !p->statuses ||
+      !hpb_ParallelDecoder_JoinRuns(p, runs, scratch)) {
+    return kHpb_DecodeStatus_OutOfMemory;
+  }
+  hpb_ParallelDecoder_Partition(p->elems, parts, bounds);
+  p->bounds = bounds;
+
+  executor->parallel_for(executor->ctx, parts + 1, hpb_ParallelDecoder_RunTask,
+                         p);
+
+  // Report the error that hpb_Decode() would have stopped at: the first one
+  // in the input.
+  bool missing_required =
+      p->rest_status == kHpb_DecodeStatus_MissingRequired;
+  for (size_t i = 0; i < n; i++) {
+    hpb_DecodeStatus status = p->statuses[i];
+    if (hpb_ParallelDecoder_IsError(status)) {
+      if (hpb_ParallelDecoder_IsError(p->rest_status)) {
+        const char* run_error =
+            hpb_ParallelDecoder_FindRunError(p, runs, scratch);
+        if (run_error && run_error < p->elems->data[i].data) break;
+      }
+      return status;
+    }
+    missing_required |= status == kHpb_DecodeStatus_MissingRequired;
+  }
+  if (hpb_ParallelDecoder_IsError(p->rest_status)) return p->rest_status;
+
+  hpb_Array* arr = hpb_Message_GetOrCreateMutableArray(p->msg, field, p->arena);
+  size_t old_size = arr ? arr->size : 0;
+  if (!arr || !_hpb_Array_ResizeUninitialized(arr, old_size + n, p->arena)) {
+    return kHpb_DecodeStatus_OutOfMemory;
+  }
+  memcpy((hpb_Message**)_hpb_array_ptr(arr) + old_size, p->out,
+         n * sizeof(*p->out));
+  return missing_required ? kHpb_DecodeStatus_MissingRequired
+                          : kHpb_DecodeStatus_Ok;
+}
+
+// Creates an arena for each part, fused with `arena`.  Returns the number of
+// arenas created, which is less than `parts` if one could not be created or
+// fused; `*fused` tells which.
+static size_t hpb_ParallelDecoder_NewArenas(hpb_Arena* arena,
+                                            hpb_Arena** arenas, size_t parts,
+                                            bool* fused) {
+  size_t count = 0;
+  *fused = true;
+  while (count < parts) {
+    hpb_Arena* a = hpb_Arena_New();
+    if (!a) break;
+    arenas[count++] = a;
+    if (!hpb_Arena_Fuse(arena, a)) {
+      *fused = false;
+      break;
+    }
+  }
+  return count;
+}
+
+hpb_DecodeStatus hpb_DecodeParallel(const char* buf, size_t size,
+                                    hpb_Message* msg, const hpb_MiniTable* l,
+                                    const hpb_MiniTableField* field,
+                                    const hpb_ExtensionRegistry* extreg,
+                                    int options, hpb_Arena* arena,
+                                    const hpb_DecodeExecutor* executor) {
+  unsigned depth = (unsigned)options >> 16;
+  if (!depth) depth = kHpb_WireFormat_DefaultDepthLimit;
+  if (!executor || executor->concurrency < 2 || depth < 2 ||
+      (options & kHpb_DecodeOption_LazySubMessages) || field < l->fields ||
+      field >= l->fields + l->field_count ||
+      hpb_FieldMode_Get(field) != kHpb_FieldMode_Array ||
+      hpb_MiniTableField_Type(field) != kHpb_FieldType_Message ||
+      !hpb_MiniTable_MessageFieldIsLinked(l, field)) {
+    return hpb_Decode(buf, size, msg, l, extreg, options, arena);
+  }
+
+  hpb_Arena* scratch = hpb_Arena_New();
+  if (!scratch) return kHpb_DecodeStatus_OutOfMemory;
+  hpb_SpanList elems = {NULL, 0, 0};
+  hpb_SpanList runs = {NULL, 0, 0};
+  hpb_ScanStatus scan = hpb_ParallelDecoder_Scan(buf, size, field->number,
+                                                 &elems, &runs, scratch);
+  size_t parts = executor->concurrency;
+  if (parts > elems.size) parts = elems.size;
+
+  hpb_DecodeStatus status = kHpb_DecodeStatus_OutOfMemory;
+  hpb_Arena** arenas = NULL;
+  size_t arena_count = 0;
+  if (scan == kHpb_ScanStatus_Malformed ||
+      (scan == kHpb_ScanStatus_Ok && !parts)) {
+    // Let the decoder report the error, or decode the message as usual.
+    status = hpb_Decode(buf, size, msg, l, extreg, options, arena);
+  } else if (scan == kHpb_ScanStatus_Ok &&
+             (arenas = hpb_Arena_Malloc(scratch, parts * sizeof(*arenas)))) {
+    bool fused;
+    arena_count = hpb_ParallelDecoder_NewArenas(arena, arenas, parts, &fused);
+    if (!fused) {
+      status = hpb_Decode(buf, size, msg, l, extreg, options, arena);
+    } else if (arena_count == parts) {
+      hpb_ParallelDecoder p = {
+          .msg = msg,
+          .l = l,
+          .options = options,
+          .arena = arena,
+          .elems = &elems,
+          .arenas = arenas,
+          .sub = hpb_MiniTable_GetSubMessageTable(l, field),
+          .elem_options = hpb_DecodeOptions_MaxDepth(depth - 1) |
+                          (options & 0xffff),
+          .extreg = extreg,
+      };
+      status = hpb_ParallelDecoder_Decode(&p, field, &runs, parts, executor,
+                                          scratch);
+    }
+  }
+
+  for (size_t i = 0; i < arena_count; i++) hpb_Arena_Free(arenas[i]);
+  hpb_Arena_Free(scratch);
+  return status;
+}
@@ -0,0 +1,97 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// hpb_DecodeParallel: decoding one large repeated field on several threads.
+
+#ifndef HPB_WIRE_DECODE_PARALLEL_H_
+#define HPB_WIRE_DECODE_PARALLEL_H_
+
+#include <stddef.h>
+
+#include "hpb/mem/arena.h"
+#include "hpb/message/types.h"
+#include "hpb/mini_table/extension_registry.h"
+#include "hpb/mini_table/field.h"
+#include "hpb/mini_table/message.h"
+#include "hpb/wire/decode.h"
+
+// Must be last.
+#include "hpb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Calls `task(arg, i)` once for every `i` in [0, n), possibly concurrently,
+// and returns once all of the calls have returned.
+typedef void hpb_ParallelFor_func(void* ctx, size_t n,
+                                  void (*task)(void* arg, size_t i),
+                                  void* arg);
+
+// A caller-supplied thread pool.
+typedef struct {
+  hpb_ParallelFor_func* parallel_for;
+  void* ctx;
+  size_t concurrency;  // How many tasks the pool runs at once.
+} hpb_DecodeExecutor;
+
+// Like hpb_Decode(), but splits the elements of the repeated message field
+// `field` of `l` into one range per thread of `executor` and decodes the
+// ranges in parallel, which pays off for messages that are mostly one big
+// repeated field, like a table of rows.
+//
+// A quick pass over the top-level fields of `buf` finds the elements first.
+// Each range is decoded into an arena of its own that is then fused with
+// `arena`, so `arena` must be able to fuse: it cannot have been created with
+// an initial block.  The other top-level fields are decoded in order while
+// the ranges are.
+//
+// The status is the same as that of hpb_Decode(), and so is `msg` when the
+// status is kHpb_DecodeStatus_Ok or kHpb_DecodeStatus_MissingRequired.
+// After an error, `msg` may hold more or fewer of the fields than
+// hpb_Decode() would have left in it.
+//
+// Falls back to a plain hpb_Decode() when the executor has a concurrency
+// below 2, `arena` cannot fuse, `field` is not a linked repeated message
+// field of `l`, the input has no elements of `field` or is malformed at the
+// top level, or `options` asks for lazy sub-messages or a depth limit
+// below 2.
+HPB_API hpb_DecodeStatus hpb_DecodeParallel(
+    const char* buf, size_t size, hpb_Message* msg, const hpb_MiniTable* l,
+    const hpb_MiniTableField* field, const hpb_ExtensionRegistry* extreg,
+    int options, hpb_Arena* arena, const hpb_DecodeExecutor* executor);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "hpb/port/undef.inc"
+
+#endif /* HPB_WIRE_DECODE_PARALLEL_H_ */
@@ -0,0 +1,355 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "hpb/wire/decode_parallel.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "hpb/base/status.hpp"
+#include "hpb/collections/array.h"
+#include "hpb/mem/arena.hpp"
+#include "hpb/message/accessors.h"
+#include "hpb/message/message.h"
+#include "hpb/mini_descriptor/decode.h"
+#include "hpb/mini_descriptor/internal/encode.hpp"
+#include "hpb/mini_descriptor/internal/modifiers.h"
+#include "hpb/mini_table/message.h"
+#include "hpb/wire/encode.h"
+#include "hpb/wire/types.h"
+
+// Must be last.
+#include "hpb/port/def.inc"
+
+namespace {
+
+// message Row {
+//   required int32 id = 1;
+//   string name = 2;
+//   repeated int64 vals = 3 [packed = true];
+//   Row child = 4;
+// }
+//
+// message Table {
+//   required int32 version = 1;
+//   string title = 2;
+//   repeated Row rows = 3;
+//   int32 count = 4;
+// }
+struct Tables {
+  hpb_MiniTable* row;
+  hpb_MiniTable* table;
+  const hpb_MiniTableField* rows;
+};
+
+Tables BuildTables(hpb_Arena* arena) {
+  hpb::Status status;
+  hpb::MtDataEncoder e;
+  e.StartMessage(kHpb_MessageModifier_ValidateUtf8);
+  e.PutField(kHpb_FieldType_Int32, 1, kHpb_FieldModifier_IsRequired);
+  e.PutField(kHpb_FieldType_String, 2, 0);
+  e.PutField(kHpb_FieldType_Int64, 3,
+             kHpb_FieldModifier_IsRepeated | kHpb_FieldModifier_IsPacked);
+  e.PutField(kHpb_FieldType_Message, 4, 0);
+  hpb_MiniTable* row = hpb_MiniTable_Build(e.data().data(), e.data().size(),
+                                           arena, status.ptr());
+  EXPECT_NE(row, nullptr);
+  EXPECT_TRUE(hpb_MiniTable_SetSubMessage(
+      row,
+      const_cast<hpb_MiniTableField*>(hpb_MiniTable_FindFieldByNumber(row, 4)),
+      row));
+
+  hpb::MtDataEncoder t;
+  t.StartMessage(kHpb_MessageModifier_ValidateUtf8);
+  t.PutField(kHpb_FieldType_Int32, 1, kHpb_FieldModifier_IsRequired);
+  t.PutField(kHpb_FieldType_String, 2, 0);
+  t.PutField(kHpb_FieldType_Message, 3, kHpb_FieldModifier_IsRepeated);
+  t.PutField(kHpb_FieldType_Int32, 4, 0);
+  hpb_MiniTable* table = hpb_MiniTable_Build(t.data().data(), t.data().size(),
+                                             arena, status.ptr());
+  EXPECT_NE(table, nullptr);
+  const hpb_MiniTableField* rows = hpb_MiniTable_FindFieldByNumber(table, 3);
+  EXPECT_TRUE(hpb_MiniTable_SetSubMessage(
+      table, const_cast<hpb_MiniTableField*>(rows), row));
+  return {row, table, rows};
+}
+
+void PutVarint(std::string* out, uint64_t val) {
+  do {
+    uint8_t byte = val & 0x7f;
+    val >>= 7;
+    if (val) byte |= 0x80;
+    out->push_back(byte);
+  } while (val);
+}
+
+void PutTag(std::string* out, uint32_t num, hpb_WireType type) {
+  PutVarint(out, (num << 3) | type);
+}
+
+void PutDelimited(std::string* out, uint32_t num, const std::string& data) {
+  PutTag(out, num, kHpb_WireType_Delimited);
+  PutVarint(out, data.size());
+  out->append(data);
+}
+
+std::string Row(int id, bool with_child) {
+  std::string ret;
+  PutTag(&ret, 1, kHpb_WireType_Varint);
+  PutVarint(&ret, id);
+  PutDelimited(&ret, 2, "row" + std::to_string(id));
+  std::string vals;
+  for (int i = 0; i < id % 17; i++) PutVarint(&vals, (uint64_t)id << i);
+  PutDelimited(&ret, 3, vals);
+  if (with_child) PutDelimited(&ret, 4, Row(id + 1, false));
+  return ret;
+}
+
+// Rows interleaved with the other fields, including unknown ones.
+std::string Payload(int rows) {
+  std::string ret;
+  PutTag(&ret, 1, kHpb_WireType_Varint);
+  PutVarint(&ret, 7);
+  for (int i = 0; i < rows; i++) {
+    PutDelimited(&ret, 3, Row(i, i % 3 == 0));
+    if (i % 50 == 10) {
+      PutDelimited(&ret, 2, "title" + std::to_string(i));
+      PutTag(&ret, 4, kHpb_WireType_Varint);
+      PutVarint(&ret, i);
+      PutTag(&ret, 99, kHpb_WireType_Varint);
+      PutVarint(&ret, i);
+    }
+  }
+  // The row field, with the wrong wire type, is an unknown field.
+  PutTag(&ret, 3, kHpb_WireType_Varint);
+  PutVarint(&ret, 5);
+  return ret;
+}
+
+// Runs every task on a thread of its own.
+void ParallelFor(void* ctx, size_t n, void (*task)(void* arg, size_t i),
+                 void* arg) {
+  (*static_cast<std::atomic<size_t>*>(ctx))++;
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < n; i++) threads.emplace_back(task, arg, i);
+  for (std::thread& t : threads) t.join();
+}
+
+struct Result {
+  hpb_DecodeStatus status;
+  std::string serialized;
+
+  bool operator==(const Result& other) const {
+    return status == other.status && serialized == other.serialized;
+  }
+};
+
+Result Reserialize(hpb_DecodeStatus status, const hpb_Message* msg,
+                   const hpb_MiniTable* table, hpb_Arena* arena) {
+  Result ret = {status, ""};
+  if (status != kHpb_DecodeStatus_Ok &&
+      status != kHpb_DecodeStatus_MissingRequired) {
+    return ret;
+  }
+  char* buf;
+  size_t size;
+  EXPECT_EQ(kHpb_EncodeStatus_Ok,
+            hpb_Encode(msg, table, 0, arena, &buf, &size));
+  ret.serialized.assign(buf, size);
+  return ret;
+}
+
+Result Decode(const Tables& t, const std::string& data, int options) {
+  hpb::Arena arena;
+  hpb_Message* msg = hpb_Message_New(t.table, arena.ptr());
+  hpb_DecodeStatus status = hpb_Decode(data.data(), data.size(), msg, t.table,
+                                       nullptr, options, arena.ptr());
+  return Reserialize(status, msg, t.table, arena.ptr());
+}
+
+Result DecodeParallel(const Tables& t, const std::string& data, int options,
+                      const hpb_DecodeExecutor* executor) {
+  hpb::Arena arena;
+  hpb_Message* msg = hpb_Message_New(t.table, arena.ptr());
+  hpb_DecodeStatus status =
+      hpb_DecodeParallel(data.data(), data.size(), msg, t.table, t.rows,
+                         nullptr, options, arena.ptr(), executor);
+  return Reserialize(status, msg, t.table, arena.ptr());
+}
+
+TEST(DecodeParallelTest, MatchesDecode) {
+  hpb::Arena arena;
+  Tables t = BuildTables(arena.ptr());
+  std::atomic<size_t> calls{0};
+  for (size_t concurrency : {2, 3, 8}) {
+    SCOPED_TRACE(concurrency);
+    hpb_DecodeExecutor executor = {ParallelFor, &calls, concurrency};
+    for (int rows : {1, 2, 5, 300}) {
+      SCOPED_TRACE(rows);
+      std::string payload = Payload(rows);
+      for (int options : {0, (int)kHpb_DecodeOption_AliasString,
+                          (int)kHpb_DecodeOption_CheckRequired}) {
+        Result expected = Decode(t, payload, options);
+        EXPECT_EQ(kHpb_DecodeStatus_Ok, expected.status);
+        EXPECT_EQ(expected, DecodeParallel(t, payload, options, &executor));
+      }
+    }
+  }
+  EXPECT_EQ(3 * 4 * 3, calls.load());
+}
+
+TEST(DecodeParallelTest, AppendsToExistingRows) {
+  hpb::Arena arena;
+  Tables t = BuildTables(arena.ptr());
+  std::atomic<size_t> calls{0};
+  hpb_DecodeExecutor executor = {ParallelFor, &calls, 4};
+  std::string payload = Payload(20);
+  hpb_Message* msg = hpb_Message_New(t.table, arena.ptr());
+  ASSERT_EQ(kHpb_DecodeStatus_Ok,
+            hpb_DecodeParallel(payload.data(), payload.size(), msg, t.table,
+                               t.rows, nullptr, 0, arena.ptr(), &executor));
+  ASSERT_EQ(kHpb_DecodeStatus_Ok,
+            hpb_DecodeParallel(payload.data(), payload.size(), msg, t.table,
+                               t.rows, nullptr, 0, arena.ptr(), &executor));
+  const hpb_Array* arr = hpb_Message_GetArray(msg, t.rows);
+  ASSERT_NE(arr, nullptr);
+  ASSERT_EQ(40, hpb_Array_Size(arr));
+  const hpb_MiniTableField* id = hpb_MiniTable_FindFieldByNumber(t.row, 1);
+  for (size_t i = 0; i < 40; i++) {
+    EXPECT_EQ((int)(i % 20),
+              hpb_Message_GetInt32(hpb_Array_Get(arr, i).msg_val, id, -1));
+  }
+}
+
+TEST(DecodeParallelTest, MissingRequired) {
+  hpb::Arena arena;
+  Tables t = BuildTables(arena.ptr());
+  std::atomic<size_t> calls{0};
+  hpb_DecodeExecutor executor = {ParallelFor, &calls, 4};
+  int options = kHpb_DecodeOption_CheckRequired;
+
+  // A row without an id.
+  std::string payload = Payload(30);
+  PutDelimited(&payload, 3, "");
+  Result expected = Decode(t, payload, options);
+  EXPECT_EQ(kHpb_DecodeStatus_MissingRequired, expected.status);
+  EXPECT_EQ(expected, DecodeParallel(t, payload, options, &executor));
+
+  // A table without a version.
+  payload.clear();
+  for (int i = 0; i < 30; i++) PutDelimited(&payload, 3, Row(i, true));
+  expected = Decode(t, payload, options);
+  EXPECT_EQ(kHpb_DecodeStatus_MissingRequired, expected.status);
+  EXPECT_EQ(expected, DecodeParallel(t, payload, options, &executor));
+  EXPECT_EQ(kHpb_DecodeStatus_Ok,
+            DecodeParallel(t, payload, 0, &executor).status);
+}
+
+TEST(DecodeParallelTest, ErrorsMatchDecode) {
+  hpb::Arena arena;
+  Tables t = BuildTables(arena.ptr());
+  std::atomic<size_t> calls{0};
+  hpb_DecodeExecutor executor = {ParallelFor, &calls, 3};
+  std::string payload = Payload(60);
+
+  // Errors inside the rows, in the other fields, and at the top level.
+  for (size_t i = 0; i < payload.size(); i += 3) {
+    SCOPED_TRACE(i);
+    std::string truncated = payload.substr(0, i);
+    EXPECT_EQ(Decode(t, truncated, 0),
+              DecodeParallel(t, truncated, 0, &executor));
+    for (uint8_t flip : {0x80, 0xff}) {
+      std::string corrupt = payload;
+      corrupt[i] ^= flip;
+      for (int options : {0, (int)kHpb_DecodeOption_CheckRequired}) {
+        EXPECT_EQ(Decode(t, corrupt, options),
+                  DecodeParallel(t, corrupt, options, &executor));
+      }
+    }
+  }
+
+  // An error in a row and a later one in the other fields, and the reverse.
+  std::string bad_row;
+  PutDelimited(&bad_row, 3, std::string(1, '\x80'));
+  std::string bad_title;
+  PutDelimited(&bad_title, 2, "\xff");
+  std::string good = Payload(10);
+  for (const std::string& bad : {good + bad_row + good + bad_title,
+                                 good + bad_title + good + bad_row}) {
+    Result expected = Decode(t, bad, 0);
+    EXPECT_NE(kHpb_DecodeStatus_Ok, expected.status);
+    EXPECT_EQ(expected, DecodeParallel(t, bad, 0, &executor));
+  }
+}
+
+TEST(DecodeParallelTest, FallsBack) {
+  hpb::Arena arena;
+  Tables t = BuildTables(arena.ptr());
+  std::atomic<size_t> calls{0};
+  hpb_DecodeExecutor executor = {ParallelFor, &calls, 4};
+  hpb_DecodeExecutor serial = {ParallelFor, &calls, 1};
+  std::string payload = Payload(40);
+  Result expected = Decode(t, payload, 0);
+
+  EXPECT_EQ(expected, DecodeParallel(t, payload, 0, nullptr));
+  EXPECT_EQ(expected, DecodeParallel(t, payload, 0, &serial));
+  // Without any rows there is nothing to split.
+  EXPECT_EQ(Decode(t, Payload(0), 0),
+            DecodeParallel(t, Payload(0), 0, &executor));
+
+  // An arena with an initial block cannot be fused with the workers' arenas.
+  char block[4096];
+  hpb_Arena* fixed = hpb_Arena_Init(block, sizeof(block), &hpb_alloc_global);
+  hpb_Message* msg = hpb_Message_New(t.table, fixed);
+  hpb_DecodeStatus status =
+      hpb_DecodeParallel(payload.data(), payload.size(), msg, t.table, t.rows,
+                         nullptr, 0, fixed, &executor);
+  EXPECT_EQ(expected, Reserialize(status, msg, t.table, fixed));
+  hpb_Arena_Free(fixed);
+
+  // The field has to be a repeated message field.
+  EXPECT_EQ(expected, [&] {
+    hpb::Arena a;
+    hpb_Message* m = hpb_Message_New(t.table, a.ptr());
+    hpb_DecodeStatus s = hpb_DecodeParallel(
+        payload.data(), payload.size(), m, t.table,
+        hpb_MiniTable_FindFieldByNumber(t.table, 4), nullptr, 0, a.ptr(),
+        &executor);
+    return Reserialize(s, m, t.table, a.ptr());
+  }());
+  EXPECT_EQ(0, calls.load());
+}
+
+}  // namespace
@@ -0,0 +1,1230 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+
+#include "hpb/wire/decode.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "hpb/base/status.hpp"
+#include "hpb/collections/array.h"
+#include "hpb/collections/internal/array.h"
+#include "hpb/collections/map.h"
+#include "hpb/io/chunked_input_stream.h"
+#include "hpb/mem/arena.hpp"
+#include "hpb/message/accessors.h"
+#include "hpb/message/promote.h"
+#include "hpb/mini_descriptor/build_enum.h"
+#include "hpb/mini_descriptor/decode.h"
+#include "hpb/mini_descriptor/internal/encode.hpp"
+#include "hpb/mini_descriptor/internal/modifiers.h"
+#include "hpb/mini_descriptor/link.h"
+#include "hpb/wire/encode.h"
+#include "hpb/wire/field_mask.h"
+
+// Must be last
+#include "hpb/port/def.inc"
+
+namespace {
+
+// message M {
+//   int32 i = 1;
+//   string s = 2;
+//   repeated fixed32 f = 3 [packed = true];
+//   repeated int64 v = 4 [packed = true];
+//   M sub = 5;
+//   repeated bytes b = 6;
+//   repeated M subs = 7;
+// }
+hpb_MiniTable* BuildMiniTable(hpb_Arena* arena) {
+  hpb::MtDataEncoder e;
+  e.StartMessage(kHpb_MessageModifier_ValidateUtf8);
+  e.PutField(kHpb_FieldType_Int32, 1, 0);
+  e.PutField(kHpb_FieldType_String, 2, 0);
+  e.PutField(kHpb_FieldType_Fixed32, 3,
+             kHpb_FieldModifier_IsRepeated | kHpb_FieldModifier_IsPacked);
+  e.PutField(kHpb_FieldType_Int64, 4,
+             kHpb_FieldModifier_IsRepeated | kHpb_FieldModifier_IsPacked);
+  e.PutField(kHpb_FieldType_Message, 5, 0);
+  e.PutField(kHpb_FieldType_Bytes, 6, kHpb_FieldModifier_IsRepeated);
+  e.PutField(kHpb_FieldType_Message, 7, kHpb_FieldModifier_IsRepeated);
+
+  hpb::Status status;
+  hpb_MiniTable* table = hpb_MiniTable_Build(e.data().data(), e.data().size(),
+                                             arena, status.ptr());
+  EXPECT_NE(table, nullptr);
+  for (uint32_t num : {5, 7}) {
+    hpb_MiniTableField* field = const_cast<hpb_MiniTableField*>(
+        hpb_MiniTable_FindFieldByNumber(table, num));
+    EXPECT_TRUE(hpb_MiniTable_SetSubMessage(table, field, table));
+  }
+  return table;
+}
+
+void PutVarint(std::string* out, uint64_t val) {
+  do {
+    uint8_t byte = val & 0x7f;
+    val >>= 7;
+    if (val) byte |= 0x80;
+    out->push_back(byte);
+  } while (val);
+}
+
+void PutTag(std::string* out, uint32_t num, hpb_WireType type) {
+  PutVarint(out, (num << 3) | type);
+}
+
+void PutDelimited(std::string* out, uint32_t num, const std::string& data) {
+  PutTag(out, num, kHpb_WireType_Delimited);
+  PutVarint(out, data.size());
+  out->append(data);
+}
+
+std::string SubMessage(int n) {
+  std::string ret;
+  PutTag(&ret, 1, kHpb_WireType_Varint);
+  PutVarint(&ret, n);
+  PutDelimited(&ret, 2, "sub" + std::to_string(n));
+  PutDelimited(&ret, 6, std::string(n * 37, 'b'));
+  return ret;
+}
+
+std::string Payload() {
+  std::string ret;
+  PutTag(&ret, 1, kHpb_WireType_Varint);
+  PutVarint(&ret, 150);
+  PutDelimited(&ret, 2, std::string(40, 's'));
+
+  std::string fixed;
+  for (uint32_t i = 0; i < 20; i++) fixed.append((const char*)&i, 4);
+  PutDelimited(&ret, 3, fixed);
+
+  std::string varints;
+  for (int i = 0; i < 50; i++) PutVarint(&varints, (uint64_t)1 << i);
+  PutDelimited(&ret, 4, varints);
+
+  PutDelimited(&ret, 5, SubMessage(8));
+
+  // Unknown fields, including a group with an unknown delimited field.
+  PutDelimited(&ret, 100, std::string(200, 'u'));
+  PutTag(&ret, 101, kHpb_WireType_StartGroup);
+  PutDelimited(&ret, 1, std::string(100, 'g'));
+  PutTag(&ret, 2, kHpb_WireType_Varint);
+  PutVarint(&ret, 1234567);
+  PutTag(&ret, 101, kHpb_WireType_EndGroup);
+
+  for (int i = 1; i <= 3; i++) PutDelimited(&ret, 7, SubMessage(i));
+  PutDelimited(&ret, 6, "bytes");
+  return ret;
+}
+
+struct DecodeResult {
+  hpb_DecodeStatus status;
+  std::string serialized;
+};
+
+DecodeResult Reserialize(hpb_DecodeStatus status, const hpb_Message* msg,
+                         const hpb_MiniTable* table, hpb_Arena* arena) {
+  DecodeResult ret = {status, ""};
+  if (status != kHpb_DecodeStatus_Ok) return ret;
+  char* buf;
+  size_t size;
+  EXPECT_EQ(kHpb_EncodeStatus_Ok,
+            hpb_Encode(msg, table, 0, arena, &buf, &size));
+  ret.serialized.assign(buf, size);
+  return ret;
+}
+
+DecodeResult DecodeFlat(const std::string& data, const hpb_MiniTable* table) {
+  hpb::Arena arena;
+  hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+  hpb_DecodeStatus status = hpb_Decode(data.data(), data.size(), msg, table,
+                                       nullptr, 0, arena.ptr());
+  return Reserialize(status, msg, table, arena.ptr());
+}
+
+DecodeResult DecodeChunked(const std::string& data, size_t chunk,
+                           const hpb_MiniTable* table) {
+  hpb::Arena arena;
+  hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+  hpb_ZeroCopyInputStream* stream =
+      hpb_ChunkedInputStream_New(data.data(), data.size(), chunk, arena.ptr());
+  hpb_DecodeStatus status =
+      hpb_DecodeStream(stream, msg, table, nullptr, 0, arena.ptr());
+  return Reserialize(status, msg, table, arena.ptr());
+}
+
+const size_t kChunkSizes[] = {1, 2, 3, 7, 15, 16, 17, 31, 64, 1000};
+
+TEST(DecodeStreamTest, MatchesFlatDecode) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  std::string payload = Payload();
+  DecodeResult flat = DecodeFlat(payload, table);
+  ASSERT_EQ(kHpb_DecodeStatus_Ok, flat.status);
+  EXPECT_EQ(payload.size(), flat.serialized.size());
+
+  for (size_t chunk : kChunkSizes) {
+    SCOPED_TRACE(chunk);
+    DecodeResult streamed = DecodeChunked(payload, chunk, table);
+    EXPECT_EQ(kHpb_DecodeStatus_Ok, streamed.status);
+    EXPECT_EQ(flat.serialized, streamed.serialized);
+  }
+}
+
+TEST(DecodeStreamTest, Empty) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  DecodeResult streamed = DecodeChunked("", 16, table);
+  EXPECT_EQ(kHpb_DecodeStatus_Ok, streamed.status);
+  EXPECT_EQ("", streamed.serialized);
+}
+
+TEST(DecodeStreamTest, TruncatedInputMatchesFlatDecode) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  std::string payload = Payload();
+
+  for (size_t len = 0; len < payload.size(); len++) {
+    SCOPED_TRACE(len);
+    std::string truncated = payload.substr(0, len);
+    DecodeResult flat = DecodeFlat(truncated, table);
+    for (size_t chunk : {1, 5, 16, 20}) {
+      SCOPED_TRACE(chunk);
+      DecodeResult streamed = DecodeChunked(truncated, chunk, table);
+      EXPECT_EQ(flat.status, streamed.status);
+      EXPECT_EQ(flat.serialized, streamed.serialized);
+    }
+  }
+}
+
+TEST(DecodeStreamTest, BadUtf8) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  std::string payload;
+  PutDelimited(&payload, 2, std::string(30, 'x') + "\xff" + "yy");
+  for (size_t chunk : kChunkSizes) {
+    SCOPED_TRACE(chunk);
+    EXPECT_EQ(kHpb_DecodeStatus_BadUtf8,
+              DecodeChunked(payload, chunk, table).status);
+  }
+}
+
+TEST(DecodeTest, EndGroupInSubMessage) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  // An END_GROUP tag ends a length-delimited sub-message early, for both short
+  // sub-messages and ones with a multi-byte length.
+  for (size_t size : {10, 200}) {
+    SCOPED_TRACE(size);
+    std::string sub;
+    PutDelimited(&sub, 6, std::string(size, 'b'));
+    PutTag(&sub, 13, kHpb_WireType_EndGroup);
+    PutDelimited(&sub, 6, "more");
+    std::string payload;
+    PutDelimited(&payload, 5, sub);
+    hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+    EXPECT_EQ(kHpb_DecodeStatus_Malformed,
+              hpb_Decode(payload.data(), payload.size(), msg, table, nullptr,
+                         0, arena.ptr()));
+  }
+}
+
+// Records the size of every block an arena allocates.
+struct RecordingAlloc {
+  hpb_alloc alloc;
+  std::vector<size_t> sizes;
+};
+
+void* RecordingAllocFunc(hpb_alloc* alloc, void* ptr, size_t oldsize,
+                         size_t size) {
+  RecordingAlloc* recording = reinterpret_cast<RecordingAlloc*>(alloc);
+  if (ptr == nullptr && size != 0) recording->sizes.push_back(size);
+  return hpb_alloc_global.func(&hpb_alloc_global, ptr, oldsize, size);
+}
+
+std::string ManyStrings() {
+  std::string payload;
+  for (int i = 0; i < 2000; i++) {
+    PutDelimited(&payload, 6, std::string(100, 'b'));
+  }
+  return payload;
+}
+
+TEST(DecodeTest, ArenaOptions) {
+  hpb::Arena table_arena;
+  hpb_MiniTable* table = BuildMiniTable(table_arena.ptr());
+  std::string payload = ManyStrings();
+
+  // Blocks allocated while decoding follow the arena's growth policy.
+  RecordingAlloc recording;
+  recording.alloc.func = &RecordingAllocFunc;
+  hpb_ArenaOptions options = {};
+  options.initial_block_size = 1024;
+  options.growth_factor = 2;
+  options.max_block_size = 64 * 1024;
+  hpb_Arena* arena =
+      hpb_Arena_InitWithOptions(nullptr, 0, &recording.alloc, &options);
+  hpb_Message* msg = hpb_Message_New(table, arena);
+  EXPECT_EQ(kHpb_DecodeStatus_Ok,
+            hpb_Decode(payload.data(), payload.size(), msg, table, nullptr, 0,
+                       arena));
+  EXPECT_LT(recording.sizes.size(), 20);
+  for (size_t size : recording.sizes) EXPECT_LE(size, 64 * 1024);
+  hpb_Arena_Free(arena);
+}
+
+TEST(DecodeTest, ArenaStats) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  std::string payload = ManyStrings();
+  hpb_ArenaStats before;
+  hpb_Arena_GetStats(arena.ptr(), &before);
+
+  // Blocks allocated while decoding are accounted for in the arena's stats.
+  hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+  EXPECT_EQ(kHpb_DecodeStatus_Ok,
+            hpb_Decode(payload.data(), payload.size(), msg, table, nullptr, 0,
+                       arena.ptr()));
+  hpb_ArenaStats stats;
+  hpb_Arena_GetStats(arena.ptr(), &stats);
+  EXPECT_GT(stats.bytes_allocated, before.bytes_allocated + 2000 * 100);
+  EXPECT_LT(stats.bytes_allocated, stats.space_allocated);
+  EXPECT_GT(stats.block_count, before.block_count);
+  EXPECT_GT(stats.slow_malloc_count, before.slow_malloc_count);
+  EXPECT_GT(stats.space_allocated, 2000 * 100);
+  EXPECT_EQ(stats.space_allocated, stats.peak_space_allocated);
+}
+
+TEST(DecodeBatchTest, MatchesSingleDecode) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  // Errors, including ones raised deep inside a sub-message, only affect the
+  // message they occur in.
+  std::vector<std::string> payloads;
+  std::string payload = Payload();
+  for (size_t len = 0; len <= payload.size(); len += 7) {
+    payloads.push_back(payload.substr(0, len));
+  }
+  payloads.push_back(payload);
+  std::string bad_utf8;
+  PutDelimited(&bad_utf8, 2, "\xff");
+  payloads.push_back(bad_utf8);
+  std::string end_group;
+  PutTag(&end_group, 13, kHpb_WireType_EndGroup);
+  std::string nested;
+  PutDelimited(&nested, 5, end_group);
+  payloads.push_back(nested);
+  payloads.push_back(SubMessage(3));
+
+  std::vector<hpb_StringView> bufs;
+  for (const std::string& p : payloads) {
+    bufs.push_back(hpb_StringView_FromDataAndSize(p.data(), p.size()));
+  }
+  size_t n = bufs.size();
+  std::vector<hpb_Message*> msgs(n);
+  std::vector<hpb_DecodeStatus> statuses(n);
+  size_t ok = hpb_DecodeBatch(bufs.data(), n, msgs.data(), table, nullptr, 0,
+                              arena.ptr(), statuses.data());
+
+  size_t expected_ok = 0;
+  for (size_t i = 0; i < n; i++) {
+    SCOPED_TRACE(i);
+    DecodeResult single = DecodeFlat(payloads[i], table);
+    DecodeResult batch =
+        Reserialize(statuses[i], msgs[i], table, arena.ptr());
+    EXPECT_EQ(single.status, batch.status);
+    EXPECT_EQ(single.serialized, batch.serialized);
+    expected_ok += single.status == kHpb_DecodeStatus_Ok;
+  }
+  EXPECT_EQ(expected_ok, ok);
+  EXPECT_LT(ok, n);
+  EXPECT_EQ(kHpb_DecodeStatus_BadUtf8, statuses[n - 3]);
+  EXPECT_EQ(kHpb_DecodeStatus_Malformed, statuses[n - 2]);
+  EXPECT_EQ(kHpb_DecodeStatus_Ok, statuses[n - 1]);
+}
+
+TEST(DecodeBatchTest, Contiguous) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  std::string payload = SubMessage(1);
+  std::vector<hpb_StringView> bufs(
+      100, hpb_StringView_FromDataAndSize(payload.data(), payload.size()));
+  std::vector<hpb_Message*> msgs(bufs.size());
+  std::vector<hpb_DecodeStatus> statuses(bufs.size());
+  EXPECT_EQ(bufs.size(),
+            hpb_DecodeBatch(bufs.data(), bufs.size(), msgs.data(), table,
+                            nullptr, 0, arena.ptr(), statuses.data()));
+  ptrdiff_t stride = (char*)msgs[1] - (char*)msgs[0];
+  EXPECT_GE(stride, (ptrdiff_t)table->size);
+  for (size_t i = 1; i < msgs.size(); i++) {
+    EXPECT_EQ(stride, (char*)msgs[i] - (char*)msgs[i - 1]);
+    EXPECT_EQ(1, hpb_Message_GetInt32(
+                     msgs[i], hpb_MiniTable_FindFieldByNumber(table, 1), 0));
+  }
+}
+
+TEST(DecodeBatchTest, Empty) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  EXPECT_EQ(0, hpb_DecodeBatch(nullptr, 0, nullptr, table, nullptr, 0,
+                               arena.ptr(), nullptr));
+}
+
+DecodeResult DecodeMasked(const std::string& data, const hpb_MiniTable* table,
+                          const hpb_FieldMask* mask) {
+  hpb::Arena arena;
+  hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+  hpb_DecodeStatus status = hpb_DecodeWithMask(
+      data.data(), data.size(), msg, table, mask, nullptr, 0, arena.ptr());
+  return Reserialize(status, msg, table, arena.ptr());
+}
+
+TEST(DecodeWithMaskTest, SelectsFields) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  hpb_FieldMask* mask = hpb_FieldMask_New(table, arena.ptr());
+  const uint32_t i[] = {1};
+  const uint32_t sub_i[] = {5, 1};
+  const uint32_t subs[] = {7};
+  ASSERT_TRUE(hpb_FieldMask_AddPath(mask, i, 1, arena.ptr()));
+  ASSERT_TRUE(hpb_FieldMask_AddPath(mask, sub_i, 2, arena.ptr()));
+  ASSERT_TRUE(hpb_FieldMask_AddPath(mask, subs, 1, arena.ptr()));
+
+  std::string expected;
+  PutTag(&expected, 1, kHpb_WireType_Varint);
+  PutVarint(&expected, 150);
+  std::string sub;
+  PutTag(&sub, 1, kHpb_WireType_Varint);
+  PutVarint(&sub, 8);
+  PutDelimited(&expected, 5, sub);
+  for (int n = 1; n <= 3; n++) PutDelimited(&expected, 7, SubMessage(n));
+
+  DecodeResult masked = DecodeMasked(Payload(), table, mask);
+  EXPECT_EQ(kHpb_DecodeStatus_Ok, masked.status);
+  EXPECT_EQ(expected, masked.serialized);
+}
+
+TEST(DecodeWithMaskTest, EmptyMaskSkipsEverything) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  hpb_FieldMask* mask = hpb_FieldMask_New(table, arena.ptr());
+  DecodeResult masked = DecodeMasked(Payload(), table, mask);
+  EXPECT_EQ(kHpb_DecodeStatus_Ok, masked.status);
+  EXPECT_EQ("", masked.serialized);
+}
+
+TEST(DecodeWithMaskTest, WholeFieldWins) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  hpb_FieldMask* mask = hpb_FieldMask_New(table, arena.ptr());
+  const uint32_t sub_i[] = {5, 1};
+  const uint32_t sub[] = {5};
+  ASSERT_TRUE(hpb_FieldMask_AddPath(mask, sub_i, 2, arena.ptr()));
+  ASSERT_TRUE(hpb_FieldMask_AddPath(mask, sub, 1, arena.ptr()));
+  ASSERT_TRUE(hpb_FieldMask_AddPath(mask, sub_i, 2, arena.ptr()));
+
+  std::string expected;
+  PutDelimited(&expected, 5, SubMessage(8));
+  EXPECT_EQ(expected, DecodeMasked(Payload(), table, mask).serialized);
+}
+
+TEST(DecodeWithMaskTest, BadPaths) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  hpb_FieldMask* mask = hpb_FieldMask_New(table, arena.ptr());
+  const uint32_t unknown[] = {99};
+  const uint32_t through_scalar[] = {1, 1};
+  const uint32_t unknown_sub[] = {5, 99};
+  EXPECT_FALSE(hpb_FieldMask_AddPath(mask, unknown, 1, arena.ptr()));
+  EXPECT_FALSE(hpb_FieldMask_AddPath(mask, through_scalar, 2, arena.ptr()));
+  EXPECT_FALSE(hpb_FieldMask_AddPath(mask, unknown_sub, 2, arena.ptr()));
+}
+
+TEST(DecodeWithMaskTest, TruncatedInput) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  hpb_FieldMask* mask = hpb_FieldMask_New(table, arena.ptr());
+  const uint32_t subs[] = {7, 2};
+  ASSERT_TRUE(hpb_FieldMask_AddPath(mask, subs, 2, arena.ptr()));
+  std::string payload = Payload();
+  for (size_t len = 0; len < payload.size(); len++) {
+    SCOPED_TRACE(len);
+    std::string truncated = payload.substr(0, len);
+    hpb_DecodeStatus status = DecodeFlat(truncated, table).status;
+    EXPECT_EQ(status, DecodeMasked(truncated, table, mask).status);
+  }
+}
+
+TEST(LazySubMessageTest, ReencodesOriginalBytes) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  std::string payload = Payload();
+  hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+  ASSERT_EQ(kHpb_DecodeStatus_Ok,
+            hpb_Decode(payload.data(), payload.size(), msg, table, nullptr,
+                       kHpb_DecodeOption_LazySubMessages, arena.ptr()));
+
+  const hpb_MiniTableField* sub = hpb_MiniTable_FindFieldByNumber(table, 5);
+  EXPECT_TRUE(hpb_Message_HasField(msg, sub));
+  EXPECT_TRUE(hpb_TaggedMessagePtr_IsEmpty(
+      hpb_Message_GetTaggedMessagePtr(msg, sub, nullptr)));
+
+  for (int options : {0, (int)kHpb_EncodeOption_SkipUnknown}) {
+    SCOPED_TRACE(options);
+    hpb_Message* flat = hpb_Message_New(table, arena.ptr());
+    ASSERT_EQ(kHpb_DecodeStatus_Ok,
+              hpb_Decode(payload.data(), payload.size(), flat, table, nullptr,
+                         0, arena.ptr()));
+    char* buf;
+    size_t size;
+    ASSERT_EQ(kHpb_EncodeStatus_Ok,
+              hpb_Encode(flat, table, options, arena.ptr(), &buf, &size));
+    std::string expected(buf, size);
+    ASSERT_EQ(kHpb_EncodeStatus_Ok,
+              hpb_Encode(msg, table, options, arena.ptr(), &buf, &size));
+    EXPECT_EQ(expected, std::string(buf, size));
+    size_t encoded_size;
+    ASSERT_EQ(kHpb_EncodeStatus_Ok,
+              hpb_EncodedSize(msg, table, options, &encoded_size));
+    EXPECT_EQ(expected.size(), encoded_size);
+  }
+}
+
+TEST(LazySubMessageTest, PromoteOnAccess) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  std::string payload = Payload();
+  // A second occurrence of field 5 is merged into the first.
+  std::string more;
+  PutTag(&more, 1, kHpb_WireType_Varint);
+  PutVarint(&more, 9);
+  PutDelimited(&payload, 5, more);
+
+  hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+  ASSERT_EQ(kHpb_DecodeStatus_Ok,
+            hpb_Decode(payload.data(), payload.size(), msg, table, nullptr,
+                       kHpb_DecodeOption_LazySubMessages, arena.ptr()));
+
+  const hpb_MiniTableField* i = hpb_MiniTable_FindFieldByNumber(table, 1);
+  const hpb_MiniTableField* s = hpb_MiniTable_FindFieldByNumber(table, 2);
+  const hpb_MiniTableField* sub_field =
+      hpb_MiniTable_FindFieldByNumber(table, 5);
+  hpb_Message* sub;
+  ASSERT_EQ(kHpb_DecodeStatus_Ok,
+            hpb_Message_GetOrPromoteMessage(msg, table, sub_field, 0,
+                                            arena.ptr(), &sub));
+  ASSERT_NE(nullptr, sub);
+  EXPECT_FALSE(hpb_TaggedMessagePtr_IsEmpty(
+      hpb_Message_GetTaggedMessagePtr(msg, sub_field, nullptr)));
+  EXPECT_EQ(sub, hpb_Message_GetMessage(msg, sub_field, nullptr));
+  EXPECT_EQ(9, hpb_Message_GetInt32(sub, i, 0));
+  hpb_StringView str = hpb_Message_GetString(sub, s, hpb_StringView());
+  EXPECT_EQ("sub8", std::string(str.data, str.size));
+
+  hpb_Message* again;
+  ASSERT_EQ(kHpb_DecodeStatus_Ok,
+            hpb_Message_GetOrPromoteMessage(msg, table, sub_field, 0,
+                                            arena.ptr(), &again));
+  EXPECT_EQ(sub, again);
+
+  const hpb_MiniTableField* subs_field =
+      hpb_MiniTable_FindFieldByNumber(table, 7);
+  hpb_Array* arr = hpb_Message_GetMutableArray(msg, subs_field);
+  ASSERT_EQ(3, hpb_Array_Size(arr));
+  EXPECT_TRUE(
+      hpb_TaggedMessagePtr_IsEmpty(hpb_Array_Get(arr, 0).tagged_msg_val));
+  ASSERT_EQ(kHpb_DecodeStatus_Ok,
+            hpb_Array_PromoteMessages(arr, table, 0, arena.ptr()));
+  for (size_t n = 0; n < 3; n++) {
+    hpb_TaggedMessagePtr tagged = hpb_Array_Get(arr, n).tagged_msg_val;
+    ASSERT_FALSE(hpb_TaggedMessagePtr_IsEmpty(tagged));
+    const hpb_Message* elem = hpb_TaggedMessagePtr_GetNonEmptyMessage(tagged);
+    EXPECT_EQ(n + 1, hpb_Message_GetInt32(elem, i, 0));
+  }
+}
+
+TEST(LazySubMessageTest, Streamed) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  std::string payload = Payload();
+  DecodeResult flat = DecodeFlat(payload, table);
+  for (size_t chunk : kChunkSizes) {
+    SCOPED_TRACE(chunk);
+    hpb::Arena msg_arena;
+    hpb_Message* msg = hpb_Message_New(table, msg_arena.ptr());
+    hpb_ZeroCopyInputStream* stream = hpb_ChunkedInputStream_New(
+        payload.data(), payload.size(), chunk, msg_arena.ptr());
+    DecodeResult lazy = Reserialize(
+        hpb_DecodeStream(stream, msg, table, nullptr,
+                         kHpb_DecodeOption_LazySubMessages, msg_arena.ptr()),
+        msg, table, msg_arena.ptr());
+    EXPECT_EQ(kHpb_DecodeStatus_Ok, lazy.status);
+    EXPECT_EQ(flat.serialized, lazy.serialized);
+  }
+}
+
+TEST(LazySubMessageTest, Truncated) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  std::string payload;
+  PutDelimited(&payload, 5, SubMessage(8));
+  for (size_t len = 1; len < payload.size(); len++) {
+    SCOPED_TRACE(len);
+    hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+    EXPECT_EQ(kHpb_DecodeStatus_Malformed,
+              hpb_Decode(payload.data(), len, msg, table, nullptr,
+                         kHpb_DecodeOption_LazySubMessages, arena.ptr()));
+  }
+}
+
+// message P {
+//   repeated int32 i32 = 1;
+//   repeated int64 i64 = 2;
+//   repeated sint32 s32 = 3;
+//   repeated sint64 s64 = 4;
+//   repeated bool b = 5;
+//   repeated uint64 u64 = 6;
+// }
+hpb_MiniTable* BuildPackedMiniTable(hpb_Arena* arena) {
+  hpb::MtDataEncoder e;
+  e.StartMessage(0);
+  uint64_t mod = kHpb_FieldModifier_IsRepeated | kHpb_FieldModifier_IsPacked;
+  e.PutField(kHpb_FieldType_Int32, 1, mod);
+  e.PutField(kHpb_FieldType_Int64, 2, mod);
+  e.PutField(kHpb_FieldType_SInt32, 3, mod);
+  e.PutField(kHpb_FieldType_SInt64, 4, mod);
+  e.PutField(kHpb_FieldType_Bool, 5, mod);
+  e.PutField(kHpb_FieldType_UInt64, 6, mod);
+  hpb::Status status;
+  hpb_MiniTable* table = hpb_MiniTable_Build(e.data().data(), e.data().size(),
+                                             arena, status.ptr());
+  EXPECT_NE(table, nullptr);
+  return table;
+}
+
+// Values of every varint length from 1 to 10 bytes, in runs of varying length
+// so that varints straddle 16-byte block boundaries.
+std::vector<uint64_t> PackedValues(size_t n) {
+  std::vector<uint64_t> ret;
+  uint64_t x = 0x9e3779b97f4a7c15;
+  for (size_t i = 0; i < n; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    int bits = (i / 3) % 65;
+    ret.push_back(bits == 64 ? x : x & ((UINT64_C(1) << bits) - 1));
+  }
+  return ret;
+}
+
+TEST(PackedVarintTest, AllTypes) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildPackedMiniTable(arena.ptr());
+  for (size_t n : {1, 15, 16, 17, 100, 5000}) {
+    SCOPED_TRACE(n);
+    std::vector<uint64_t> values = PackedValues(n);
+    std::string varints;
+    for (uint64_t v : values) PutVarint(&varints, v);
+    // A run of single-byte varints.
+    for (int i = 0; i < 40; i++) varints.push_back(i & 1);
+    std::string payload;
+    for (uint32_t num = 1; num <= 6; num++) {
+      PutDelimited(&payload, num, varints);
+    }
+
+    for (size_t chunk : {(size_t)0, (size_t)7, (size_t)64}) {
+      SCOPED_TRACE(chunk);
+      hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+      hpb_DecodeStatus status;
+      if (chunk) {
+        hpb_ZeroCopyInputStream* stream = hpb_ChunkedInputStream_New(
+            payload.data(), payload.size(), chunk, arena.ptr());
+        status = hpb_DecodeStream(stream, msg, table, nullptr, 0, arena.ptr());
+      } else {
+        status = hpb_Decode(payload.data(), payload.size(), msg, table,
+                            nullptr, 0, arena.ptr());
+      }
+      ASSERT_EQ(kHpb_DecodeStatus_Ok, status);
+
+      auto get = [&](uint32_t num) {
+        const hpb_MiniTableField* f =
+            hpb_MiniTable_FindFieldByNumber(table, num);
+        return hpb_Message_GetArray(msg, f);
+      };
+      for (uint32_t num = 1; num <= 6; num++) {
+        ASSERT_EQ(n + 40, hpb_Array_Size(get(num)));
+        // The elements were counted up front, so the array was sized exactly.
+        if (!chunk) {
+          EXPECT_EQ(n + 40, get(num)->capacity);
+        }
+      }
+      for (size_t i = 0; i < n + 40; i++) {
+        uint64_t v = i < n ? values[i] : (i - n) & 1;
+        ASSERT_EQ((int32_t)v, hpb_Array_Get(get(1), i).int32_val) << i;
+        ASSERT_EQ((int64_t)v, hpb_Array_Get(get(2), i).int64_val) << i;
+        uint32_t v32 = (uint32_t)v;
+        ASSERT_EQ((int32_t)((v32 >> 1) ^ -(int32_t)(v32 & 1)),
+                  hpb_Array_Get(get(3), i).int32_val)
+            << i;
+        ASSERT_EQ((int64_t)((v >> 1) ^ -(int64_t)(v & 1)),
+                  hpb_Array_Get(get(4), i).int64_val)
+            << i;
+        ASSERT_EQ(v != 0, hpb_Array_Get(get(5), i).bool_val) << i;
+        ASSERT_EQ(v, hpb_Array_Get(get(6), i).uint64_val) << i;
+      }
+    }
+  }
+}
+
+// Many short occurrences of two interleaved fields, which keep each other
+// from growing in place.  Each array is sized exactly for its first
+// occurrence only, and then grows by doubling.
+TEST(PackedVarintTest, ManyOccurrences) {
+  hpb::Arena table_arena;
+  hpb_MiniTable* table = BuildPackedMiniTable(table_arena.ptr());
+  const size_t kOccurrences = 10000;
+  std::string varints;
+  for (uint64_t v : {1, 300, 70000}) PutVarint(&varints, v);
+  std::string payload;
+  for (size_t i = 0; i < kOccurrences; i++) {
+    PutDelimited(&payload, 1, varints);
+    PutDelimited(&payload, 2, varints);
+  }
+
+  for (size_t chunk : {(size_t)0, (size_t)64}) {
+    SCOPED_TRACE(chunk);
+    hpb::Arena arena;
+    hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+    hpb_DecodeStatus status;
+    if (chunk) {
+      hpb_ZeroCopyInputStream* stream = hpb_ChunkedInputStream_New(
+          payload.data(), payload.size(), chunk, arena.ptr());
+      status = hpb_DecodeStream(stream, msg, table, nullptr, 0, arena.ptr());
+    } else {
+      status = hpb_Decode(payload.data(), payload.size(), msg, table, nullptr,
+                          0, arena.ptr());
+    }
+    ASSERT_EQ(kHpb_DecodeStatus_Ok, status);
+
+    size_t bytes = 0;
+    for (uint32_t num = 1; num <= 2; num++) {
+      const hpb_Array* arr =
+          hpb_Message_GetArray(msg, hpb_MiniTable_FindFieldByNumber(table, num));
+      ASSERT_EQ(3 * kOccurrences, hpb_Array_Size(arr));
+      EXPECT_LT(arr->capacity, 2 * hpb_Array_Size(arr));
+      for (size_t i = 0; i < hpb_Array_Size(arr); i += 3) {
+        hpb_MessageValue v = hpb_Array_Get(arr, i + 2);
+        ASSERT_EQ(70000, num == 1 ? v.int32_val : v.int64_val) << i;
+      }
+      bytes += arr->capacity << _hpb_Array_ElementSizeLg2(arr);
+    }
+    // Doubling allocates at most twice the final capacity for each array.
+    EXPECT_LT(hpb_Arena_SpaceAllocated(arena.ptr()), 3 * bytes + 65536);
+  }
+}
+
+TEST(PackedVarintTest, Malformed) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildPackedMiniTable(arena.ptr());
+  std::string varints;
+  for (int i = 0; i < 20; i++) PutVarint(&varints, 300);
+  // An 11-byte varint, then a varint truncated by the end of the field.
+  std::string overlong = varints + std::string(10, '\x80') + '\x01';
+  std::string truncated = varints + std::string(20, '\x80');
+  for (const std::string& bad : {overlong, truncated}) {
+    std::string payload;
+    PutDelimited(&payload, 2, bad);
+    hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+    EXPECT_EQ(kHpb_DecodeStatus_Malformed,
+              hpb_Decode(payload.data(), payload.size(), msg, table, nullptr,
+                         0, arena.ptr()));
+  }
+}
+
+// Fields numbered far above the dense range, arriving in and out of order.
+TEST(SparseFieldTest, AnyOrder) {
+  hpb::Arena arena;
+  hpb::MtDataEncoder e;
+  e.StartMessage(0);
+  std::vector<uint32_t> numbers;
+  for (uint32_t i = 0; i < 50; i++) numbers.push_back(1000 + 7 * i);
+  for (uint32_t n : numbers) e.PutField(kHpb_FieldType_Int32, n, 0);
+  hpb::Status status;
+  hpb_MiniTable* table = hpb_MiniTable_Build(e.data().data(), e.data().size(),
+                                             arena.ptr(), status.ptr());
+  ASSERT_NE(nullptr, table);
+
+  std::vector<uint32_t> reversed(numbers.rbegin(), numbers.rend());
+  std::vector<uint32_t> strided;
+  for (size_t i = 0; i < 7; i++) {
+    for (size_t j = i; j < numbers.size(); j += 7) {
+      strided.push_back(numbers[j]);
+    }
+  }
+  for (const auto& order : {numbers, reversed, strided}) {
+    std::string payload;
+    for (uint32_t n : order) {
+      PutTag(&payload, n, kHpb_WireType_Varint);
+      PutVarint(&payload, n * 3);
+    }
+    // An unknown field in the sparse range.
+    PutTag(&payload, 1001, kHpb_WireType_Varint);
+    PutVarint(&payload, 1);
+    hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+    ASSERT_EQ(kHpb_DecodeStatus_Ok,
+              hpb_Decode(payload.data(), payload.size(), msg, table, nullptr,
+                         0, arena.ptr()));
+    for (uint32_t n : numbers) {
+      const hpb_MiniTableField* f = hpb_MiniTable_FindFieldByNumber(table, n);
+      EXPECT_EQ(n * 3, hpb_Message_GetInt32(msg, f, 0)) << n;
+    }
+    size_t len;
+    hpb_Message_GetUnknown(msg, &len);
+    EXPECT_EQ(3, len);
+  }
+}
+
+TEST(BuiltFastTableTest, HasFastTable) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  EXPECT_EQ(HPB_FASTTABLE, table->table_mask != (uint16_t)-1);
+}
+
+// Repeated strings too long to alias inline leave the fast path mid-run; the
+// elements decoded before them must be kept.
+TEST(BuiltFastTableTest, AliasedLongRepeatedStrings) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  std::string payload;
+  for (int i = 0; i < 6; i++) {
+    PutDelimited(&payload, 6, std::string(i % 2 ? 800 : 10, 'a' + i));
+  }
+  hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+  ASSERT_EQ(kHpb_DecodeStatus_Ok,
+            hpb_Decode(payload.data(), payload.size(), msg, table, nullptr,
+                       kHpb_DecodeOption_AliasString, arena.ptr()));
+  const hpb_Array* arr =
+      hpb_Message_GetArray(msg, hpb_MiniTable_FindFieldByNumber(table, 6));
+  ASSERT_NE(nullptr, arr);
+  ASSERT_EQ(6, hpb_Array_Size(arr));
+  for (int i = 0; i < 6; i++) {
+    hpb_StringView val = hpb_Array_Get(arr, i).str_val;
+    EXPECT_EQ(std::string(i % 2 ? 800 : 10, 'a' + i),
+              std::string(val.data, val.size));
+  }
+}
+
+// Fields 16 and up collide in a 32-slot table whenever their numbers agree in
+// the low four bits, so messages with many of them get a wider table.
+TEST(BuiltFastTableTest, WideTable) {
+  for (int count : {40, 79}) {
+    hpb::Arena arena;
+    hpb::MtDataEncoder e;
+    e.StartMessage(0);
+    for (int i = 1; i <= count; i++) {
+      e.PutField(kHpb_FieldType_Int32, i, kHpb_FieldModifier_IsProto3Singular);
+    }
+    hpb::Status status;
+    hpb_MiniTable* table = hpb_MiniTable_Build(
+        e.data().data(), e.data().size(), arena.ptr(), status.ptr());
+    ASSERT_NE(nullptr, table);
+#if HPB_FASTTABLE
+    EXPECT_EQ((count > 47 ? 127 : 63) << 3, table->table_mask);
+#endif
+
+    // Values of two bytes or more put payload bits where one-byte tags are
+    // indexed with bits of the following byte.
+    std::string payload;
+    for (int i = count; i >= 1; i--) {
+      PutTag(&payload, i, kHpb_WireType_Varint);
+      PutVarint(&payload, i * 1000 + 3);
+    }
+    hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+    ASSERT_EQ(kHpb_DecodeStatus_Ok,
+              hpb_Decode(payload.data(), payload.size(), msg, table, nullptr,
+                         0, arena.ptr()));
+    for (int i = 1; i <= count; i++) {
+      const hpb_MiniTableField* f = hpb_MiniTable_FindFieldByNumber(table, i);
+      EXPECT_EQ(i * 1000 + 3, hpb_Message_GetInt32(msg, f, 0)) << i;
+    }
+  }
+}
+
+// Required fields are hotter, so the two-byte tags of fields 16-40 are placed
+// before the one-byte tags of fields 1-15 and their copies in a wide table.
+// Every field must keep all of its slots.
+TEST(BuiltFastTableTest, WideTableRequiredTwoByteTags) {
+  hpb::Arena arena;
+  hpb::MtDataEncoder e;
+  e.StartMessage(0);
+  for (uint32_t i = 1; i <= 40; i++) {
+    e.PutField(kHpb_FieldType_Int32, i,
+               i < 16 ? kHpb_FieldModifier_IsProto3Singular
+                      : kHpb_FieldModifier_IsRequired);
+  }
+  hpb::Status status;
+  hpb_MiniTable* table = hpb_MiniTable_Build(e.data().data(), e.data().size(),
+                                             arena.ptr(), status.ptr());
+  ASSERT_NE(nullptr, table);
+#if HPB_FASTTABLE
+  ASSERT_EQ(63 << 3, table->table_mask);
+  for (uint32_t i = 1; i <= 40; i++) {
+    uint32_t tag = i << 3;
+    uint16_t encoded = tag < 0x80 ? tag : (tag & 0x7f) | 0x80 | (tag >> 7) << 8;
+    size_t step = tag < 0x80 ? 32 : 64;
+    for (size_t slot = (encoded >> 3) & 63; slot < 64; slot += step) {
+      EXPECT_EQ(encoded, (uint16_t)table->fasttable[slot].field_data)
+          << i << " " << slot;
+    }
+  }
+#endif
+
+  std::string payload;
+  for (uint32_t i = 40; i >= 1; i--) {
+    PutTag(&payload, i, kHpb_WireType_Varint);
+    PutVarint(&payload, i * 1000 + 3);
+  }
+  hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+  ASSERT_EQ(kHpb_DecodeStatus_Ok,
+            hpb_Decode(payload.data(), payload.size(), msg, table, nullptr,
+                       kHpb_DecodeOption_CheckRequired, arena.ptr()));
+  for (uint32_t i = 1; i <= 40; i++) {
+    const hpb_MiniTableField* f = hpb_MiniTable_FindFieldByNumber(table, i);
+    EXPECT_EQ(i * 1000 + 3, hpb_Message_GetInt32(msg, f, 0)) << i;
+  }
+}
+
+// A repeated message field that is later linked to a map entry must not keep
+// its (repeated) fasttable entry.
+TEST(BuiltFastTableTest, MapFieldLinkedAfterBuild) {
+  hpb::Arena arena;
+  hpb::MtDataEncoder e;
+  e.StartMessage(0);
+  e.PutField(kHpb_FieldType_Message, 1, kHpb_FieldModifier_IsRepeated);
+  hpb::Status status;
+  hpb_MiniTable* table = hpb_MiniTable_Build(e.data().data(), e.data().size(),
+                                             arena.ptr(), status.ptr());
+  ASSERT_NE(nullptr, table);
+
+  hpb::MtDataEncoder map_e;
+  map_e.EncodeMap(kHpb_FieldType_Int32, kHpb_FieldType_Int32, 0, 0);
+  hpb_MiniTable* entry = hpb_MiniTable_Build(
+      map_e.data().data(), map_e.data().size(), arena.ptr(), status.ptr());
+  ASSERT_NE(nullptr, entry);
+
+  hpb_MiniTableField* field = const_cast<hpb_MiniTableField*>(
+      hpb_MiniTable_FindFieldByNumber(table, 1));
+  ASSERT_TRUE(hpb_MiniTable_SetSubMessage(table, field, entry));
+
+  std::string payload;
+  for (int i = 1; i <= 3; i++) {
+    std::string kv;
+    PutTag(&kv, 1, kHpb_WireType_Varint);
+    PutVarint(&kv, i);
+    PutTag(&kv, 2, kHpb_WireType_Varint);
+    PutVarint(&kv, i * 10);
+    PutDelimited(&payload, 1, kv);
+  }
+
+  hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+  ASSERT_EQ(kHpb_DecodeStatus_Ok,
+            hpb_Decode(payload.data(), payload.size(), msg, table, nullptr, 0,
+                       arena.ptr()));
+  const hpb_Map* map = hpb_Message_GetMap(msg, field);
+  ASSERT_NE(nullptr, map);
+  EXPECT_EQ(3, hpb_Map_Size(map));
+}
+
+// message E {
+//   optional Enum e = 1;
+//   repeated Enum r = 2;
+// }
+// enum Enum { ZERO = 0; ONE = 1; TWO = 2; BIG = 100; }
+TEST(BuiltFastTableTest, ClosedEnum) {
+  hpb::Arena arena;
+  hpb::MtDataEncoder e;
+  e.StartMessage(0);
+  e.PutField(kHpb_FieldType_Enum, 1, kHpb_FieldModifier_IsClosedEnum);
+  e.PutField(kHpb_FieldType_Enum, 2,
+             kHpb_FieldModifier_IsClosedEnum | kHpb_FieldModifier_IsRepeated);
+  hpb::Status status;
+  hpb_MiniTable* table = hpb_MiniTable_Build(e.data().data(), e.data().size(),
+                                             arena.ptr(), status.ptr());
+  ASSERT_NE(nullptr, table);
+
+  hpb::MtDataEncoder enum_e;
+  enum_e.StartEnum();
+  for (uint32_t v : {0, 1, 2, 100}) enum_e.PutEnumValue(v);
+  enum_e.EndEnum();
+  hpb_MiniTableEnum* enum_table = hpb_MiniTableEnum_Build(
+      enum_e.data().data(), enum_e.data().size(), arena.ptr(), status.ptr());
+  ASSERT_NE(nullptr, enum_table);
+  for (uint32_t num : {1, 2}) {
+    hpb_MiniTableField* f = const_cast<hpb_MiniTableField*>(
+        hpb_MiniTable_FindFieldByNumber(table, num));
+    ASSERT_TRUE(hpb_MiniTable_SetSubEnum(table, f, enum_table));
+  }
+#if HPB_FASTTABLE
+  EXPECT_NE(0, table->fasttable[1].field_data);
+  EXPECT_NE(0, table->fasttable[2].field_data);
+#endif
+
+  // 5 is not in the enum and goes to the unknown fields; 100 is in the enum
+  // but too large for the fast check.
+  std::string payload;
+  PutTag(&payload, 1, kHpb_WireType_Varint);
+  PutVarint(&payload, 2);
+  for (uint64_t v : {1, 2, 5, 100, 2}) {
+    PutTag(&payload, 2, kHpb_WireType_Varint);
+    PutVarint(&payload, v);
+  }
+  hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+  ASSERT_EQ(kHpb_DecodeStatus_Ok,
+            hpb_Decode(payload.data(), payload.size(), msg, table, nullptr, 0,
+                       arena.ptr()));
+
+  EXPECT_EQ(2, hpb_Message_GetInt32(
+                   msg, hpb_MiniTable_FindFieldByNumber(table, 1), 0));
+  const hpb_Array* arr =
+      hpb_Message_GetArray(msg, hpb_MiniTable_FindFieldByNumber(table, 2));
+  ASSERT_NE(nullptr, arr);
+  std::vector<int32_t> got;
+  for (size_t i = 0; i < hpb_Array_Size(arr); i++) {
+    got.push_back(hpb_Array_Get(arr, i).int32_val);
+  }
+  EXPECT_EQ((std::vector<int32_t>{1, 2, 100, 2}), got);
+
+  std::string unknown;
+  PutTag(&unknown, 2, kHpb_WireType_Varint);
+  PutVarint(&unknown, 5);
+  size_t len;
+  const char* ptr = hpb_Message_GetUnknown(msg, &len);
+  EXPECT_EQ(unknown, std::string(ptr, len));
+}
+
+// message Map {
+//   map<string, string> ss = 1;
+//   map<int64, int32> vv = 2;
+//   map<string, V> sm = 3;
+//   map<int32, V> vm = 4;
+// }
+// message V { optional int32 x = 1; }
+TEST(BuiltFastTableTest, Maps) {
+  hpb::Arena arena;
+  hpb::Status status;
+  auto build = [&](const hpb::MtDataEncoder& e) {
+    hpb_MiniTable* ret = hpb_MiniTable_Build(e.data().data(), e.data().size(),
+                                             arena.ptr(), status.ptr());
+    EXPECT_NE(nullptr, ret);
+    return ret;
+  };
+
+  hpb::MtDataEncoder e;
+  e.StartMessage(0);
+  for (uint32_t num = 1; num <= 4; num++) {
+    e.PutField(kHpb_FieldType_Message, num, kHpb_FieldModifier_IsRepeated);
+  }
+  hpb_MiniTable* table = build(e);
+
+  hpb::MtDataEncoder v_e;
+  v_e.StartMessage(0);
+  v_e.PutField(kHpb_FieldType_Int32, 1, 0);
+  hpb_MiniTable* v_table = build(v_e);
+
+  const hpb_FieldType kTypes[][2] = {
+      {kHpb_FieldType_String, kHpb_FieldType_String},
+      {kHpb_FieldType_Int64, kHpb_FieldType_Int32},
+      {kHpb_FieldType_String, kHpb_FieldType_Message},
+      {kHpb_FieldType_Int32, kHpb_FieldType_Message},
+  };
+  hpb_MiniTableField* fields[4];
+  for (uint32_t num = 1; num <= 4; num++) {
+    hpb::MtDataEncoder map_e;
+    map_e.EncodeMap(kTypes[num - 1][0], kTypes[num - 1][1], 0, 0);
+    hpb_MiniTable* entry = build(map_e);
+    if (kTypes[num - 1][1] == kHpb_FieldType_Message) {
+      ASSERT_TRUE(hpb_MiniTable_SetSubMessage(
+          entry, const_cast<hpb_MiniTableField*>(&entry->fields[1]),
+          v_table));
+    }
+    fields[num - 1] = const_cast<hpb_MiniTableField*>(
+        hpb_MiniTable_FindFieldByNumber(table, num));
+    ASSERT_TRUE(hpb_MiniTable_SetSubMessage(table, fields[num - 1], entry));
+#if HPB_FASTTABLE
+    EXPECT_NE(0, table->fasttable[num].field_data) << num;
+#endif
+  }
+
+  auto str = [](uint32_t num, const std::string& s) {
+    std::string ret;
+    PutDelimited(&ret, num, s);
+    return ret;
+  };
+  auto varint = [](uint32_t num, uint64_t v) {
+    std::string ret;
+    PutTag(&ret, num, kHpb_WireType_Varint);
+    PutVarint(&ret, v);
+    return ret;
+  };
+  auto v_msg = [&](uint32_t num, int32_t x) { return str(num, varint(1, x)); };
+
+  std::string payload;
+  PutDelimited(&payload, 1, str(1, "a") + str(2, "x"));
+  PutDelimited(&payload, 1, str(2, "y") + str(1, "b"));  // Value first.
+  PutDelimited(&payload, 1, str(1, "c"));                 // No value.
+  PutDelimited(&payload, 1, str(1, "a") + str(2, "z"));  // Overwrites "a".
+  PutDelimited(&payload, 2, varint(1, -5) + varint(2, 7));
+  PutDelimited(&payload, 2, varint(2, 8));  // No key.
+  // The generic parser moves entries with unknown fields to the unknown
+  // fields of the map's message.
+  std::string unknown;
+  PutDelimited(&unknown, 2, varint(1, 9) + varint(2, 10) + varint(3, 1));
+  payload += unknown;
+  PutDelimited(&payload, 3, str(1, std::string(300, 'k')) + v_msg(2, 11));
+  PutDelimited(&payload, 3, str(1, "n"));  // No value.
+  PutDelimited(&payload, 4, varint(1, 12) + v_msg(2, 13));
+  PutDelimited(&payload, 4, v_msg(2, 14) + varint(1, 15));
+
+  for (size_t chunk : {(size_t)0, (size_t)5, (size_t)64}) {
+    SCOPED_TRACE(chunk);
+    hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+    hpb_DecodeStatus decode_status;
+    if (chunk) {
+      hpb_ZeroCopyInputStream* stream = hpb_ChunkedInputStream_New(
+          payload.data(), payload.size(), chunk, arena.ptr());
+      decode_status =
+          hpb_DecodeStream(stream, msg, table, nullptr, 0, arena.ptr());
+    } else {
+      decode_status = hpb_Decode(payload.data(), payload.size(), msg, table,
+                                 nullptr, 0, arena.ptr());
+    }
+    ASSERT_EQ(kHpb_DecodeStatus_Ok, decode_status);
+
+    auto get = [&](int i, hpb_MessageValue key) {
+      const hpb_Map* map = hpb_Message_GetMap(msg, fields[i]);
+      hpb_MessageValue val;
+      EXPECT_NE(nullptr, map);
+      EXPECT_TRUE(map && hpb_Map_Get(map, key, &val));
+      return val;
+    };
+    auto skey = [](const std::string& s) {
+      hpb_MessageValue key;
+      key.str_val = hpb_StringView_FromDataAndSize(s.data(), s.size());
+      return key;
+    };
+    auto to_string = [](hpb_MessageValue val) {
+      return std::string(val.str_val.data, val.str_val.size);
+    };
+    auto x = [&](hpb_MessageValue val) {
+      return hpb_Message_GetInt32(
+          val.msg_val, hpb_MiniTable_FindFieldByNumber(v_table, 1), -1);
+    };
+
+    EXPECT_EQ(3, hpb_Map_Size(hpb_Message_GetMap(msg, fields[0])));
+    EXPECT_EQ("z", to_string(get(0, skey("a"))));
+    EXPECT_EQ("y", to_string(get(0, skey("b"))));
+    EXPECT_EQ("", to_string(get(0, skey("c"))));
+
+    hpb_MessageValue key;
+    EXPECT_EQ(2, hpb_Map_Size(hpb_Message_GetMap(msg, fields[1])));
+    key.int64_val = -5;
+    EXPECT_EQ(7, get(1, key).int32_val);
+    key.int64_val = 0;
+    EXPECT_EQ(8, get(1, key).int32_val);
+    size_t len;
+    const char* ptr = hpb_Message_GetUnknown(msg, &len);
+    EXPECT_EQ(unknown, std::string(ptr, len));
+
+    EXPECT_EQ(2, hpb_Map_Size(hpb_Message_GetMap(msg, fields[2])));
+    EXPECT_EQ(11, x(get(2, skey(std::string(300, 'k')))));
+    EXPECT_EQ(-1, x(get(2, skey("n"))));  // Empty message.
+
+    EXPECT_EQ(2, hpb_Map_Size(hpb_Message_GetMap(msg, fields[3])));
+    key.int32_val = 12;
+    EXPECT_EQ(13, x(get(3, key)));
+    key.int32_val = 15;
+    EXPECT_EQ(14, x(get(3, key)));
+  }
+}
+
+// message M { map<int32, M> m = 1; }
+TEST(BuiltFastTableTest, MapDepthLimit) {
+  hpb::Arena arena;
+  hpb::Status status;
+  auto build = [&](bool fast) {
+    hpb::MtDataEncoder e;
+    e.StartMessage(0);
+    e.PutField(kHpb_FieldType_Message, 1, kHpb_FieldModifier_IsRepeated);
+    hpb_MiniTable* table = hpb_MiniTable_Build(e.data().data(), e.data().size(),
+                                               arena.ptr(), status.ptr());
+    hpb::MtDataEncoder map_e;
+    map_e.EncodeMap(kHpb_FieldType_Int32, kHpb_FieldType_Message, 0, 0);
+    hpb_MiniTable* entry = hpb_MiniTable_Build(
+        map_e.data().data(), map_e.data().size(), arena.ptr(), status.ptr());
+    EXPECT_TRUE(hpb_MiniTable_SetSubMessage(
+        entry, const_cast<hpb_MiniTableField*>(&entry->fields[1]), table));
+    EXPECT_TRUE(hpb_MiniTable_SetSubMessage(
+        table, const_cast<hpb_MiniTableField*>(&table->fields[0]), entry));
+    if (!fast) {
+      table->table_mask = (uint16_t)-1;
+      entry->table_mask = (uint16_t)-1;
+    }
+    return table;
+  };
+  const hpb_MiniTable* fast = build(true);
+  const hpb_MiniTable* generic = build(false);
+
+  // Each level of nesting is an entry and a message value: two levels of
+  // depth for the generic parser.
+  std::string payload;
+  for (int levels = 1; levels <= 4; levels++) {
+    std::string kv;
+    PutTag(&kv, 1, kHpb_WireType_Varint);
+    PutVarint(&kv, levels);
+    PutDelimited(&kv, 2, payload);
+    payload.clear();
+    PutDelimited(&payload, 1, kv);
+
+    for (int depth = 1; depth <= 10; depth++) {
+      auto decode = [&](const hpb_MiniTable* table) {
+        hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+        return hpb_Decode(payload.data(), payload.size(), msg, table, nullptr,
+                          hpb_DecodeOptions_MaxDepth(depth), arena.ptr());
+      };
+      hpb_DecodeStatus expected = 2 * levels <= depth
+                                      ? kHpb_DecodeStatus_Ok
+                                      : kHpb_DecodeStatus_MaxDepthExceeded;
+      EXPECT_EQ(expected, decode(generic)) << levels << " " << depth;
+      EXPECT_EQ(expected, decode(fast)) << levels << " " << depth;
+    }
+  }
+}
+
+}  // namespace
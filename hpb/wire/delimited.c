@@ -0,0 +1,304 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "hpb/wire/delimited.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "hpb/message/message.h"
+
+// Must be last.
+#include "hpb/port/def.inc"
+
+// Presents the next `remaining` bytes of the underlying stream as a stream of
+// their own that ends where the record does.
+typedef struct {
+  hpb_ZeroCopyInputStream base;
+  hpb_ZeroCopyInputStream* stream;
+  size_t remaining;   // Bytes of the record not yet returned.
+  size_t excess;      // Bytes past the record in the last underlying buffer.
+  size_t byte_count;  // Bytes returned, net of backups.
+} hpb_RecordStream;
+
+static const void* hpb_RecordStream_Next(hpb_ZeroCopyInputStream* z,
+                                         size_t* count, hpb_Status* status) {
+  hpb_RecordStream* s = (hpb_RecordStream*)z;
+  *count = 0;
+  if (s->remaining == 0) return NULL;
+  size_t size;
+  const void* out = hpb_ZeroCopyInputStream_Next(s->stream, &size, status);
+  if (!out) return NULL;
+  if (size > s->remaining) {
+    // The underlying stream is only backed up when the record is done with
+    // it, since BackUp() must directly follow Next().
+    s->excess = size - s->remaining;
+    size = s->remaining;
+  }
+  s->remaining -= size;
+  s->byte_count += size;
+  *count = size;
+  return out;
+}
+
+static void hpb_RecordStream_BackUp(hpb_ZeroCopyInputStream* z, size_t count) {
+  hpb_RecordStream* s = (hpb_RecordStream*)z;
+  hpb_ZeroCopyInputStream_BackUp(s->stream, count + s->excess);
+  s->excess = 0;
+  s->remaining += count;
+  s->byte_count -= count;
+}
+
+static bool hpb_RecordStream_Skip(hpb_ZeroCopyInputStream* z, size_t count) {
+  hpb_RecordStream* s = (hpb_RecordStream*)z;
+  size_t n = HPB_MIN(count, s->remaining);
+  if (n && !hpb_ZeroCopyInputStream_Skip(s->stream, n)) {
+    s->remaining = 0;
+    return false;
+  }
+  s->remaining -= n;
+  s->byte_count += n;
+  return n == count;
+}
+
+static size_t hpb_RecordStream_ByteCount(const hpb_ZeroCopyInputStream* z) {
+  const hpb_RecordStream* s = (const hpb_RecordStream*)z;
+  return s->byte_count;
+}
+
+static const _hpb_ZeroCopyInputStream_VTable hpb_RecordStream_vtable = {
+    hpb_RecordStream_Next,
+    hpb_RecordStream_BackUp,
+    hpb_RecordStream_Skip,
+    hpb_RecordStream_ByteCount,
+};
+
+struct hpb_DelimitedReader {
+  hpb_ZeroCopyInputStream* stream;
+  const hpb_MiniTable* l;
+  const hpb_ExtensionRegistry* extreg;
+  int options;
+  bool done;               // At EOF or after an error.
+  hpb_DecodeStatus error;  // What to report once done.
+  hpb_Arena* arena;        // Holds the current record.
+  hpb_RecordStream record;
+};
+
+hpb_DelimitedReader* hpb_DelimitedReader_New(
+    hpb_ZeroCopyInputStream* stream, const hpb_MiniTable* l,
+    const hpb_ExtensionRegistry* extreg, int options, hpb_Arena* arena) {
+  hpb_DelimitedReader* r = hpb_Arena_Malloc(arena, sizeof(*r));
+  if (!r) return NULL;
+  r->arena = hpb_Arena_New();
+  if (!r->arena) return NULL;
+  r->stream = stream;
+  r->l = l;
+  r->extreg = extreg;
+  r->options = options & ~kHpb_DecodeOption_AliasString;
+  r->done = false;
+  r->error = kHpb_DecodeStatus_Ok;
+  r->record.base.vtable = &hpb_RecordStream_vtable;
+  r->record.stream = stream;
+  return r;
+}
+
+// Gets rid of the previous record, keeping the memory it used.
+static bool hpb_DelimitedReader_ResetArena(hpb_DelimitedReader* r) {
+  if (hpb_Arena_Reset(r->arena, SIZE_MAX)) return true;
+  // The caller fused the arena with another one.
+  hpb_Arena_Free(r->arena);
+  r->arena = hpb_Arena_New();
+  return r->arena != NULL;
+}
+
+static hpb_DecodeStatus hpb_DelimitedReader_Decode(hpb_DelimitedReader* r,
+                                                   hpb_Message* msg,
+                                                   const char* buf,
+                                                   size_t size, size_t len) {
+  if (len <= size) {
+    // Fast path: the whole record is in the buffer we already have.
+    hpb_DecodeStatus ret =
+        hpb_Decode(buf, len, msg, r->l, r->extreg, r->options, r->arena);
+    hpb_ZeroCopyInputStream_BackUp(r->stream, size - len);
+    return ret;
+  }
+
+  hpb_ZeroCopyInputStream_BackUp(r->stream, size);
+  r->record.remaining = len;
+  r->record.excess = 0;
+  r->record.byte_count = 0;
+  hpb_DecodeStatus ret = hpb_DecodeStream(&r->record.base, msg, r->l,
+                                          r->extreg, r->options, r->arena);
+  if (r->record.excess) {
+    hpb_ZeroCopyInputStream_BackUp(r->stream, r->record.excess);
+  }
+  if (ret != kHpb_DecodeStatus_Ok) return ret;
+  // The stream ended before the record did.
+  if (r->record.remaining) return kHpb_DecodeStatus_Malformed;
+  return ret;
+}
+
+static hpb_Message* hpb_DelimitedReader_Stop(hpb_DelimitedReader* r,
+                                             hpb_DecodeStatus* status,
+                                             hpb_DecodeStatus error) {
+  r->done = true;
+  r->error = error;
+  *status = error;
+  return NULL;
+}
+
+hpb_Message* hpb_DelimitedReader_Next(hpb_DelimitedReader* r,
+                                      hpb_DecodeStatus* status) {
+  if (r->done) return hpb_DelimitedReader_Stop(r, status, r->error);
+  if (!hpb_DelimitedReader_ResetArena(r)) {
+    return hpb_DelimitedReader_Stop(r, status, kHpb_DecodeStatus_OutOfMemory);
+  }
+
+  hpb_Status stream_status;
+  hpb_Status_Clear(&stream_status);
+  size_t size;
+  const char* buf =
+      hpb_ZeroCopyInputStream_Next(r->stream, &size, &stream_status);
+  if (!buf) {
+    return hpb_DelimitedReader_Stop(r, status,
+                                    hpb_Status_IsOk(&stream_status)
+                                        ? kHpb_DecodeStatus_Ok
+                                        : kHpb_DecodeStatus_Malformed);
+  }
+
+  // The length prefix may be split across buffers.  Records are limited to
+  // 2GB like messages are, so the prefix is at most five bytes.
+  uint64_t len = 0;
+  for (int shift = 0;; shift += 7) {
+    if (size == 0) {
+      buf = hpb_ZeroCopyInputStream_Next(r->stream, &size, &stream_status);
+      if (!buf) {
+        return hpb_DelimitedReader_Stop(r, status,
+                                        kHpb_DecodeStatus_Malformed);
+      }
+    }
+    uint8_t byte = *buf++;
+    size--;
+    len |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) break;
+    if (shift == 28) {
+      return hpb_DelimitedReader_Stop(r, status, kHpb_DecodeStatus_Malformed);
+    }
+  }
+  if (len > INT32_MAX) {
+    return hpb_DelimitedReader_Stop(r, status, kHpb_DecodeStatus_Malformed);
+  }
+
+  hpb_Message* msg = hpb_Message_New(r->l, r->arena);
+  if (!msg) {
+    return hpb_DelimitedReader_Stop(r, status, kHpb_DecodeStatus_OutOfMemory);
+  }
+  *status = hpb_DelimitedReader_Decode(r, msg, buf, size, len);
+  if (*status != kHpb_DecodeStatus_Ok) {
+    return hpb_DelimitedReader_Stop(r, status, *status);
+  }
+  return msg;
+}
+
+hpb_Arena* hpb_DelimitedReader_Arena(hpb_DelimitedReader* r) {
+  return r->arena;
+}
+
+void hpb_DelimitedReader_Free(hpb_DelimitedReader* r) {
+  if (r->arena) hpb_Arena_Free(r->arena);
+  r->arena = NULL;
+}
+
+struct hpb_DelimitedWriter {
+  hpb_ZeroCopyOutputStream* stream;
+  int options;
+  hpb_Arena* arena;  // Holds the sub-message sizes of the current record.
+};
+
+hpb_DelimitedWriter* hpb_DelimitedWriter_New(hpb_ZeroCopyOutputStream* stream,
+                                             int options, hpb_Arena* arena) {
+  hpb_DelimitedWriter* w = hpb_Arena_Malloc(arena, sizeof(*w));
+  if (!w) return NULL;
+  w->arena = hpb_Arena_New();
+  if (!w->arena) return NULL;
+  w->stream = stream;
+  w->options = options;
+  return w;
+}
+
+// Copies `size` bytes to the stream, which may take more than one buffer.
+static bool hpb_DelimitedWriter_Put(hpb_DelimitedWriter* w, const char* data,
+                                    size_t size, hpb_Status* status) {
+  while (size) {
+    size_t avail;
+    char* buf = hpb_ZeroCopyOutputStream_Next(w->stream, &avail, status);
+    if (!buf) return false;
+    size_t n = HPB_MIN(avail, size);
+    memcpy(buf, data, n);
+    data += n;
+    size -= n;
+    if (n < avail) hpb_ZeroCopyOutputStream_BackUp(w->stream, avail - n);
+  }
+  return true;
+}
+
+hpb_EncodeStatus hpb_DelimitedWriter_Write(hpb_DelimitedWriter* w,
+                                           const void* msg,
+                                           const hpb_MiniTable* l,
+                                           hpb_Status* status) {
+  // The arena is never fused, so this cannot fail.
+  hpb_Arena_Reset(w->arena, SIZE_MAX);
+
+  hpb_EncodedSizes sizes;
+  hpb_EncodeStatus ret =
+      hpb_EncodedSizes_Compute(msg, l, w->options, w->arena, &sizes);
+  if (ret != kHpb_EncodeStatus_Ok) return ret;
+
+  char prefix[10];
+  size_t prefix_size = 0;
+  uint64_t len = sizes.size;
+  do {
+    uint8_t byte = len & 0x7f;
+    len >>= 7;
+    if (len) byte |= 0x80;
+    prefix[prefix_size++] = byte;
+  } while (len);
+  if (!hpb_DelimitedWriter_Put(w, prefix, prefix_size, status)) {
+    return kHpb_EncodeStatus_WriteFailed;
+  }
+
+  size_t written;
+  return hpb_EncodeToStream(msg, l, &sizes, w->stream, status, &written);
+}
+
+void hpb_DelimitedWriter_Free(hpb_DelimitedWriter* w) {
+  if (w->arena) hpb_Arena_Free(w->arena);
+  w->arena = NULL;
+}
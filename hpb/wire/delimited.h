@@ -0,0 +1,112 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Streams of varint-length-prefixed messages, the format written by
+// protobuf's writeDelimitedTo() and SerializeDelimitedToZeroCopyStream().
+
+#ifndef HPB_WIRE_DELIMITED_H_
+#define HPB_WIRE_DELIMITED_H_
+
+#include "hpb/base/status.h"
+#include "hpb/io/zero_copy_input_stream.h"
+#include "hpb/io/zero_copy_output_stream.h"
+#include "hpb/mem/arena.h"
+#include "hpb/message/types.h"
+#include "hpb/mini_table/extension_registry.h"
+#include "hpb/mini_table/message.h"
+#include "hpb/wire/decode.h"
+#include "hpb/wire/encode.h"
+
+// Must be last.
+#include "hpb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct hpb_DelimitedReader hpb_DelimitedReader;
+
+// Creates a reader for the messages of type `l` in `stream`.  The reader is
+// allocated from `arena`, but decodes each record into an arena of its own
+// that is reset before the next record is read, so memory use stays bounded
+// by the largest record no matter how long the stream is.  That arena is
+// released by hpb_DelimitedReader_Free(), which must be called before `arena`
+// is freed.  Returns NULL if out of memory.
+//
+// kHpb_DecodeOption_AliasString is ignored, since buffers returned by the
+// stream are not stable.
+HPB_API hpb_DelimitedReader* hpb_DelimitedReader_New(
+    hpb_ZeroCopyInputStream* stream, const hpb_MiniTable* l,
+    const hpb_ExtensionRegistry* extreg, int options, hpb_Arena* arena);
+
+// Decodes the next record.  The message (and anything allocated from
+// hpb_DelimitedReader_Arena()) is valid until the next call.  At the end of the
+// stream, returns NULL with `*status` set to kHpb_DecodeStatus_Ok.  On error
+// returns NULL with `*status` set to the error; a length prefix or record cut
+// off by the end of the stream, or an error from the stream, is reported as
+// kHpb_DecodeStatus_Malformed.  Reading cannot continue after an error.
+//
+// Records that lie within a single buffer returned by the stream are decoded
+// in place; others are decoded from the stream without being gathered first.
+HPB_API hpb_Message* hpb_DelimitedReader_Next(hpb_DelimitedReader* r,
+                                              hpb_DecodeStatus* status);
+
+// The arena holding the current record.
+HPB_API hpb_Arena* hpb_DelimitedReader_Arena(hpb_DelimitedReader* r);
+
+HPB_API void hpb_DelimitedReader_Free(hpb_DelimitedReader* r);
+
+typedef struct hpb_DelimitedWriter hpb_DelimitedWriter;
+
+// Creates a writer that appends records to `stream` using the given encode
+// options.  Like the reader, it keeps scratch memory in an arena of its own
+// that is released by hpb_DelimitedWriter_Free().  Returns NULL if out of
+// memory.
+HPB_API hpb_DelimitedWriter* hpb_DelimitedWriter_New(
+    hpb_ZeroCopyOutputStream* stream, int options, hpb_Arena* arena);
+
+// Writes `msg` with a varint length prefix.  The message is serialized straight
+// into the stream's buffers.  An error from the stream is reported in `status`
+// and as kHpb_EncodeStatus_WriteFailed, after which the stream may hold a
+// partial record.
+HPB_API hpb_EncodeStatus hpb_DelimitedWriter_Write(hpb_DelimitedWriter* w,
+                                                   const void* msg,
+                                                   const hpb_MiniTable* l,
+                                                   hpb_Status* status);
+
+HPB_API void hpb_DelimitedWriter_Free(hpb_DelimitedWriter* w);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "hpb/port/undef.inc"
+
+#endif  // HPB_WIRE_DELIMITED_H_
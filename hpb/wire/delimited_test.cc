@@ -0,0 +1,228 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "hpb/wire/delimited.h"
+
+#include <string.h>
+
+#include <string>
+#include <utility>
+
+#include "gtest/gtest.h"
+#include "hpb/base/status.hpp"
+#include "hpb/io/chunked_input_stream.h"
+#include "hpb/io/chunked_output_stream.h"
+#include "hpb/mem/arena.hpp"
+#include "hpb/message/accessors.h"
+#include "hpb/mini_descriptor/decode.h"
+#include "hpb/mini_descriptor/internal/encode.hpp"
+#include "hpb/mini_descriptor/internal/modifiers.h"
+
+namespace {
+
+// message M {
+//   optional int32 i = 1;
+//   optional string s = 2;
+// }
+hpb_MiniTable* BuildMiniTable(hpb_Arena* arena) {
+  hpb::MtDataEncoder e;
+  e.StartMessage(0);
+  e.PutField(kHpb_FieldType_Int32, 1, 0);
+  e.PutField(kHpb_FieldType_String, 2, 0);
+  hpb::Status status;
+  hpb_MiniTable* table = hpb_MiniTable_Build(e.data().data(), e.data().size(),
+                                             arena, status.ptr());
+  EXPECT_NE(nullptr, table);
+  return table;
+}
+
+// Record sizes cover empty messages, one-byte prefixes and multi-byte ones.
+std::string RecordString(int i) {
+  return std::string((i * 37) % 400, 'a' + i % 26);
+}
+
+class DelimitedTest : public testing::Test {
+ protected:
+  DelimitedTest() : table_(BuildMiniTable(arena_.ptr())) {}
+
+  // Writes `count` records through `chunk`-sized output buffers.
+  std::string Write(int count, size_t chunk) {
+    std::string out(count * 500, '\0');
+    hpb_ZeroCopyOutputStream* stream = hpb_ChunkedOutputStream_New(
+        out.data(), out.size(), chunk, arena_.ptr());
+    hpb_DelimitedWriter* w = hpb_DelimitedWriter_New(stream, 0, arena_.ptr());
+    for (int i = 0; i < count; i++) {
+      hpb_Message* msg = hpb_Message_New(table_, arena_.ptr());
+      if (i % 5) {
+        hpb_Message_SetInt32(msg, Field(1), i, nullptr);
+        std::string s = RecordString(i);
+        char* buf =
+            static_cast<char*>(hpb_Arena_Malloc(arena_.ptr(), s.size()));
+        memcpy(buf, s.data(), s.size());
+        hpb_Message_SetString(msg, Field(2),
+                              hpb_StringView_FromDataAndSize(buf, s.size()),
+                              nullptr);
+      }
+      hpb::Status status;
+      EXPECT_EQ(kHpb_EncodeStatus_Ok,
+                hpb_DelimitedWriter_Write(w, msg, table_, status.ptr()));
+    }
+    hpb_DelimitedWriter_Free(w);
+    out.resize(hpb_ZeroCopyOutputStream_ByteCount(stream));
+    return out;
+  }
+
+  // Reads records from `data` through `chunk`-sized input buffers until the
+  // reader stops, checking their contents.  Returns the number of records
+  // read and the final status.
+  std::pair<int, hpb_DecodeStatus> Read(const std::string& data,
+                                        size_t chunk) {
+    hpb_ZeroCopyInputStream* stream = hpb_ChunkedInputStream_New(
+        data.data(), data.size(), chunk, arena_.ptr());
+    hpb_DelimitedReader* r =
+        hpb_DelimitedReader_New(stream, table_, nullptr, 0, arena_.ptr());
+    int count = 0;
+    hpb_DecodeStatus status;
+    while (hpb_Message* msg = hpb_DelimitedReader_Next(r, &status)) {
+      EXPECT_EQ(kHpb_DecodeStatus_Ok, status);
+      if (count % 5) {
+        EXPECT_EQ(count, hpb_Message_GetInt32(msg, Field(1), -1));
+        hpb_StringView s =
+            hpb_Message_GetString(msg, Field(2), hpb_StringView());
+        EXPECT_EQ(RecordString(count), std::string(s.data, s.size));
+      } else {
+        EXPECT_FALSE(hpb_Message_HasField(msg, Field(1)));
+      }
+      count++;
+    }
+    // The reader stays at the end.
+    hpb_DecodeStatus again;
+    EXPECT_EQ(nullptr, hpb_DelimitedReader_Next(r, &again));
+    EXPECT_EQ(status, again);
+    hpb_DelimitedReader_Free(r);
+    return {count, status};
+  }
+
+  const hpb_MiniTableField* Field(uint32_t number) {
+    return hpb_MiniTable_FindFieldByNumber(table_, number);
+  }
+
+  hpb::Arena arena_;
+  hpb_MiniTable* table_;
+};
+
+TEST_F(DelimitedTest, RoundTrip) {
+  for (size_t out_chunk : {1, 7, 64, 4096}) {
+    std::string data = Write(50, out_chunk);
+    for (size_t in_chunk : {1, 7, 64, 4096, 1 << 20}) {
+      SCOPED_TRACE(testing::Message() << out_chunk << " " << in_chunk);
+      auto [count, status] = Read(data, in_chunk);
+      EXPECT_EQ(50, count);
+      EXPECT_EQ(kHpb_DecodeStatus_Ok, status);
+    }
+  }
+}
+
+TEST_F(DelimitedTest, Empty) {
+  auto [count, status] = Read("", 64);
+  EXPECT_EQ(0, count);
+  EXPECT_EQ(kHpb_DecodeStatus_Ok, status);
+}
+
+TEST_F(DelimitedTest, Truncated) {
+  // The last record is 227 bytes long, so its length prefix takes two bytes.
+  std::string data = Write(7, 4096);
+  std::string six = Write(6, 4096);
+  for (size_t in_chunk : {1, 7, 4096}) {
+    SCOPED_TRACE(in_chunk);
+    // Cut at a record boundary.
+    auto [count, status] = Read(six, in_chunk);
+    EXPECT_EQ(6, count);
+    EXPECT_EQ(kHpb_DecodeStatus_Ok, status);
+
+    // Cut within the length prefix of the last record, right after it, at a
+    // field boundary, and in the middle of a field.
+    for (size_t cut :
+         {six.size() + 1, six.size() + 2, six.size() + 4, data.size() - 1}) {
+      SCOPED_TRACE(cut);
+      auto [count, status] = Read(data.substr(0, cut), in_chunk);
+      EXPECT_EQ(6, count);
+      EXPECT_EQ(kHpb_DecodeStatus_Malformed, status);
+    }
+  }
+}
+
+TEST_F(DelimitedTest, Malformed) {
+  std::string data = Write(2, 4096);
+  // A record holding a truncated varint field.
+  data += std::string("\x02\x08\x80", 3);
+  data += Write(1, 4096);
+  auto [count, status] = Read(data, 4096);
+  EXPECT_EQ(2, count);
+  EXPECT_EQ(kHpb_DecodeStatus_Malformed, status);
+
+  // An overlong length prefix.
+  auto [count2, status2] = Read(std::string(6, '\xff'), 4096);
+  EXPECT_EQ(0, count2);
+  EXPECT_EQ(kHpb_DecodeStatus_Malformed, status2);
+}
+
+TEST_F(DelimitedTest, BadUtf8) {
+  hpb::MtDataEncoder e;
+  e.StartMessage(kHpb_MessageModifier_ValidateUtf8);
+  e.PutField(kHpb_FieldType_Int32, 1, 0);
+  e.PutField(kHpb_FieldType_String, 2, 0);
+  hpb::Status mt_status;
+  hpb_MiniTable* table = hpb_MiniTable_Build(
+      e.data().data(), e.data().size(), arena_.ptr(), mt_status.ptr());
+  ASSERT_NE(nullptr, table);
+
+  // A record holding a 20-byte string field that is not valid UTF-8, followed
+  // by a 100-byte unknown field, so that the error is found before the end of
+  // the record has been read.
+  std::string record = "\x12\x14" + std::string(19, 'a') + "\xff" +
+                       "\x7a\x64" + std::string(100, 'u');
+  std::string data = static_cast<char>(record.size()) + record;
+
+  // The status is the same whether or not the record is split across buffers.
+  for (size_t in_chunk : {1, 7, 4096}) {
+    SCOPED_TRACE(in_chunk);
+    hpb_ZeroCopyInputStream* stream = hpb_ChunkedInputStream_New(
+        data.data(), data.size(), in_chunk, arena_.ptr());
+    hpb_DelimitedReader* r =
+        hpb_DelimitedReader_New(stream, table, nullptr, 0, arena_.ptr());
+    hpb_DecodeStatus status;
+    EXPECT_EQ(nullptr, hpb_DelimitedReader_Next(r, &status));
+    EXPECT_EQ(kHpb_DecodeStatus_BadUtf8, status);
+    hpb_DelimitedReader_Free(r);
+  }
+}
+
+}  // namespace
@@ -40,13 +40,12 @@
 #include "hpb/message/internal/extension.h"
 #include "hpb/mini_table/sub.h"
 #include "hpb/wire/internal/common.h"
+#include "hpb/wire/internal/encode.h"
 #include "hpb/wire/internal/swap.h"
 
 // Must be last.
 #include "hpb/port/def.inc"
 
-#define HPB_PB_VARINT_MAX_LEN 10
-
 HPB_NOINLINE
 static size_t encode_varint64(uint64_t val, char* buf) {
   size_t i = 0;
@@ -59,13 +58,6 @@ static size_t encode_varint64(uint64_t val, char* buf) {
   return i;
 }
 
-static uint32_t encode_zz32(int32_t n) {
-  return ((uint32_t)n << 1) ^ (n >> 31);
-}
-static uint64_t encode_zz64(int64_t n) {
-  return ((uint64_t)n << 1) ^ (n >> 63);
-}
-
 typedef struct {
   hpb_EncodeStatus status;
   jmp_buf err;
@@ -74,6 +66,14 @@ typedef struct {
   int options;
   int depth;
   _hpb_mapsorter sorter;
+
+  // Only used by hpb_EncodeToChunks(); chunk_size is 0 otherwise.  The output
+  // is collected back to front in `chunks`, and `sealed` counts the bytes held
+  // there.  The current chunk is [ptr, limit) and is not in the list yet.
+  size_t chunk_size;
+  size_t sealed;
+  hpb_StringView* chunks;
+  size_t chunk_count, chunk_cap;
 } hpb_encstate;
 
 static size_t hpb_roundup_pow2(size_t bytes) {
@@ -90,8 +90,51 @@ HPB_NORETURN static void encode_err(hpb_encstate* e, hpb_EncodeStatus s) {
   HPB_LONGJMP(e->err, 1);
 }
 
+// The number of bytes written so far.
+HPB_FORCEINLINE
+static size_t encode_written(const hpb_encstate* e) {
+  return e->sealed + (size_t)(e->limit - e->ptr);
+}
+
+static void encode_pushchunk(hpb_encstate* e, const char* data, size_t size) {
+  if (e->chunk_count == e->chunk_cap) {
+    size_t old_bytes = e->chunk_cap * sizeof(*e->chunks);
+    size_t new_cap = e->chunk_cap ? e->chunk_cap * 2 : 16;
+    hpb_StringView* chunks = hpb_Arena_Realloc(
+        e->arena, e->chunks, old_bytes, new_cap * sizeof(*e->chunks));
+    if (!chunks) encode_err(e, kHpb_EncodeStatus_OutOfMemory);
+    e->chunks = chunks;
+    e->chunk_cap = new_cap;
+  }
+  e->chunks[e->chunk_count++] = hpb_StringView_FromDataAndSize(data, size);
+  e->sealed += size;
+}
+
+// Moves the bytes written to the current chunk into the chunk list.
+static void encode_sealchunk(hpb_encstate* e) {
+  if (e->ptr == e->limit) return;
+  encode_pushchunk(e, e->ptr, e->limit - e->ptr);
+  e->limit = e->ptr;
+}
+
+// Seals the current chunk and starts a new one with `bytes` reserved.  The
+// chunk size is never smaller than any single reservation that reaches here.
+static void encode_newchunk(hpb_encstate* e, size_t bytes) {
+  HPB_ASSERT(bytes <= e->chunk_size);
+  encode_sealchunk(e);
+  e->buf = hpb_Arena_Malloc(e->arena, e->chunk_size);
+  if (!e->buf) encode_err(e, kHpb_EncodeStatus_OutOfMemory);
+  e->limit = e->buf + e->chunk_size;
+  e->ptr = e->limit - bytes;
+}
+
 HPB_NOINLINE
 static void encode_growbuffer(hpb_encstate* e, size_t bytes) {
+  if (e->chunk_size) {
+    encode_newchunk(e, bytes);
+    return;
+  }
+
   size_t old_size = e->limit - e->buf;
   size_t new_size = hpb_roundup_pow2(bytes + (e->limit - e->ptr));
   char* new_buf = hpb_Arena_Realloc(e->arena, e->buf, old_size, new_size);
@@ -131,6 +174,44 @@ static void encode_bytes(hpb_encstate* e, const void* data, size_t len) {
   memcpy(e->ptr, data, len);
 }
 
+HPB_NOINLINE
+static void encode_chunkedbytes(hpb_encstate* e, const char* data,
+                                size_t len) {
+  if (len == 0) return;
+
+  // Large data gets a chunk of its own that points at it.
+  if (len >= e->chunk_size / 2) {
+    encode_sealchunk(e);
+    encode_pushchunk(e, data, len);
+    return;
+  }
+
+  // Otherwise the end of the data fills the current chunk and the rest
+  // starts a new one, which always has room for it.
+  size_t avail = e->ptr - e->buf;
+  if (len > avail) {
+    len -= avail;
+    if (avail) {
+      e->ptr = e->buf;
+      memcpy(e->ptr, data + len, avail);
+    }
+    encode_newchunk(e, 0);
+  }
+  e->ptr -= len;
+  memcpy(e->ptr, data, len);
+}
+
+/* Writes string, bytes and other bulk data, which in chunked mode may be
+ * split across chunks or referenced in place rather than copied. */
+HPB_FORCEINLINE
+static void encode_bigbytes(hpb_encstate* e, const void* data, size_t len) {
+  if (e->chunk_size) {
+    encode_chunkedbytes(e, data, len);
+  } else {
+    encode_bytes(e, data, len);
+  }
+}
+
 static void encode_fixed64(hpb_encstate* e, uint64_t val) {
   val = _hpb_BigEndian_Swap64(val);
   encode_bytes(e, &val, sizeof(uint64_t));
@@ -208,7 +289,7 @@ static void encode_fixedarray(hpb_encstate* e, const hpb_Array* arr,
       ptr -= elem_size;
     }
   } else {
-    encode_bytes(e, data, bytes);
+    encode_bigbytes(e, data, bytes);
   }
 }
 
@@ -260,13 +341,13 @@ static void encode_scalar(hpb_encstate* e, const void* _field_mem,
     case kHpb_FieldType_Bool:
       CASE(bool, varint, kHpb_WireType_Varint, val);
     case kHpb_FieldType_SInt32:
-      CASE(int32_t, varint, kHpb_WireType_Varint, encode_zz32(val));
+      CASE(int32_t, varint, kHpb_WireType_Varint, _hpb_Encoder_ZigZag32(val));
     case kHpb_FieldType_SInt64:
-      CASE(int64_t, varint, kHpb_WireType_Varint, encode_zz64(val));
+      CASE(int64_t, varint, kHpb_WireType_Varint, _hpb_Encoder_ZigZag64(val));
     case kHpb_FieldType_String:
     case kHpb_FieldType_Bytes: {
       hpb_StringView view = *(hpb_StringView*)field_mem;
-      encode_bytes(e, view.data, view.size);
+      encode_bigbytes(e, view.data, view.size);
       encode_varint(e, view.size);
       wire_type = kHpb_WireType_Delimited;
       break;
@@ -312,7 +393,7 @@ static void encode_array(hpb_encstate* e, const hpb_Message* msg,
                          const hpb_MiniTableField* f) {
   const hpb_Array* arr = *HPB_PTR_AT(msg, f->offset, hpb_Array*);
   bool packed = f->mode & kHpb_LabelFlags_IsPacked;
-  size_t pre_len = e->limit - e->ptr;
+  size_t pre_len = encode_written(e);
 
   if (arr == NULL || arr->size == 0) {
     return;
@@ -359,16 +440,16 @@ static void encode_array(hpb_encstate* e, const hpb_Message* msg,
     case kHpb_FieldType_Bool:
       VARINT_CASE(bool, *ptr);
     case kHpb_FieldType_SInt32:
-      VARINT_CASE(int32_t, encode_zz32(*ptr));
+      VARINT_CASE(int32_t, _hpb_Encoder_ZigZag32(*ptr));
     case kHpb_FieldType_SInt64:
-      VARINT_CASE(int64_t, encode_zz64(*ptr));
+      VARINT_CASE(int64_t, _hpb_Encoder_ZigZag64(*ptr));
     case kHpb_FieldType_String:
     case kHpb_FieldType_Bytes: {
       const hpb_StringView* start = _hpb_array_constptr(arr);
       const hpb_StringView* ptr = start + arr->size;
       do {
         ptr--;
-        encode_bytes(e, ptr->data, ptr->size);
+        encode_bigbytes(e, ptr->data, ptr->size);
         encode_varint(e, ptr->size);
         encode_tag(e, f->number, kHpb_WireType_Delimited);
       } while (ptr != start);
@@ -408,7 +489,7 @@ static void encode_array(hpb_encstate* e, const hpb_Message* msg,
 #undef VARINT_CASE
 
   if (packed) {
-    encode_varint(e, e->limit - e->ptr - pre_len);
+    encode_varint(e, encode_written(e) - pre_len);
     encode_tag(e, f->number, kHpb_WireType_Delimited);
   }
 }
@@ -418,11 +499,11 @@ static void encode_mapentry(hpb_encstate* e, uint32_t number,
                             const hpb_MapEntry* ent) {
   const hpb_MiniTableField* key_field = &layout->fields[0];
   const hpb_MiniTableField* val_field = &layout->fields[1];
-  size_t pre_len = e->limit - e->ptr;
+  size_t pre_len = encode_written(e);
   size_t size;
   encode_scalar(e, &ent->data.v, layout->subs, val_field);
   encode_scalar(e, &ent->data.k, layout->subs, key_field);
-  size = (e->limit - e->ptr) - pre_len;
+  size = encode_written(e) - pre_len;
   encode_varint(e, size);
   encode_tag(e, number, kHpb_WireType_Delimited);
 }
@@ -447,56 +528,16 @@ static void encode_map(hpb_encstate* e, const hpb_Message* msg,
     }
     _hpb_mapsorter_popmap(&e->sorter, &sorted);
   } else {
-    intptr_t iter = HPB_STRTABLE_BEGIN;
-    hpb_StringView key;
-    hpb_value val;
-    while (hpb_strtable_next2(&map->table, &key, &val, &iter)) {
+    size_t iter = kHpb_Map_Begin;
+    const hpb_tabent* tabent;
+    while ((tabent = _hpb_map_next(map, &iter))) {
       hpb_MapEntry ent;
-      _hpb_map_fromkey(key, &ent.data.k, map->key_size);
-      _hpb_map_fromvalue(val, &ent.data.v, map->val_size);
+      _hpb_Encoder_GetMapEntry(map, tabent, &ent);
       encode_mapentry(e, f->number, layout, &ent);
     }
   }
 }
 
-static bool encode_shouldencode(hpb_encstate* e, const hpb_Message* msg,
-                                const hpb_MiniTableSub* subs,
-                                const hpb_MiniTableField* f) {
-  if (f->presence == 0) {
-    /* Proto3 presence or map/array. */
-    const void* mem = HPB_PTR_AT(msg, f->offset, void);
-    switch (_hpb_MiniTableField_GetRep(f)) {
-      case kHpb_FieldRep_1Byte: {
-        char ch;
-        memcpy(&ch, mem, 1);
-        return ch != 0;
-      }
-      case kHpb_FieldRep_4Byte: {
-        uint32_t u32;
-        memcpy(&u32, mem, 4);
-        return u32 != 0;
-      }
-      case kHpb_FieldRep_8Byte: {
-        uint64_t u64;
-        memcpy(&u64, mem, 8);
-        return u64 != 0;
-      }
-      case kHpb_FieldRep_StringView: {
-        const hpb_StringView* str = (const hpb_StringView*)mem;
-        return str->size != 0;
-      }
-      default:
-        HPB_UNREACHABLE();
-    }
-  } else if (f->presence > 0) {
-    /* Proto2 presence: hasbit. */
-    return _hpb_hasbit_field(msg, f);
-  } else {
-    /* Field is in a oneof. */
-    return _hpb_getoneofcase_field(msg, f) == f->number;
-  }
-}
-
 static void encode_field(hpb_encstate* e, const hpb_Message* msg,
                          const hpb_MiniTableSub* subs,
                          const hpb_MiniTableField* field) {
@@ -538,7 +579,7 @@ static void encode_ext(hpb_encstate* e, const hpb_Message_Extension* ext,
 
 static void encode_message(hpb_encstate* e, const hpb_Message* msg,
                            const hpb_MiniTable* m, size_t* size) {
-  size_t pre_len = e->limit - e->ptr;
+  size_t pre_len = encode_written(e);
 
   if ((e->options & kHpb_EncodeOption_CheckRequired) && m->required_count) {
     uint64_t msg_head;
@@ -549,12 +590,15 @@ static void encode_message(hpb_encstate* e, const hpb_Message* msg,
     }
   }
 
-  if ((e->options & kHpb_EncodeOption_SkipUnknown) == 0) {
+  // The payload of an empty message is held as unknown data, so it is kept
+  // even when skipping unknown fields.
+  if ((e->options & kHpb_EncodeOption_SkipUnknown) == 0 ||
+      m == &_kHpb_MiniTable_Empty) {
     size_t unknown_size;
     const char* unknown = hpb_Message_GetUnknown(msg, &unknown_size);
 
     if (unknown) {
-      encode_bytes(e, unknown, unknown_size);
+      encode_bigbytes(e, unknown, unknown_size);
     }
   }
 
@@ -586,13 +630,13 @@ static void encode_message(hpb_encstate* e, const hpb_Message* msg,
     const hpb_MiniTableField* first = &m->fields[0];
     while (f != first) {
       f--;
-      if (encode_shouldencode(e, msg, m->subs, f)) {
+      if (_hpb_Encoder_ShouldEncode(msg, f)) {
         encode_field(e, msg, m->subs, f);
       }
     }
   }
 
-  *size = (e->limit - e->ptr) - pre_len;
+  *size = encode_written(e) - pre_len;
 }
 
 static hpb_EncodeStatus hpb_Encoder_Encode(hpb_encstate* const encoder,
@@ -624,20 +668,89 @@ static hpb_EncodeStatus hpb_Encoder_Encode(hpb_encstate* const encoder,
   return encoder->status;
 }
 
+static void hpb_Encoder_Init(hpb_encstate* e, int options, hpb_Arena* arena) {
+  unsigned depth = (unsigned)options >> 16;
+
+  e->status = kHpb_EncodeStatus_Ok;
+  e->arena = arena;
+  e->buf = NULL;
+  e->limit = NULL;
+  e->ptr = NULL;
+  e->depth = depth ? depth : kHpb_WireFormat_DefaultDepthLimit;
+  e->options = options;
+  e->chunk_size = 0;
+  e->sealed = 0;
+  e->chunks = NULL;
+  e->chunk_count = 0;
+  e->chunk_cap = 0;
+  _hpb_mapsorter_init(&e->sorter);
+}
+
 hpb_EncodeStatus hpb_Encode(const void* msg, const hpb_MiniTable* l,
                             int options, hpb_Arena* arena, char** buf,
                             size_t* size) {
   hpb_encstate e;
-  unsigned depth = (unsigned)options >> 16;
+  hpb_Encoder_Init(&e, options, arena);
+  return hpb_Encoder_Encode(&e, msg, l, buf, size);
+}
 
-  e.status = kHpb_EncodeStatus_Ok;
-  e.arena = arena;
-  e.buf = NULL;
-  e.limit = NULL;
-  e.ptr = NULL;
-  e.depth = depth ? depth : kHpb_WireFormat_DefaultDepthLimit;
-  e.options = options;
-  _hpb_mapsorter_init(&e.sorter);
+hpb_EncodeStatus hpb_EncodeWithSizes(const void* msg, const hpb_MiniTable* l,
+                                     const hpb_EncodedSizes* sizes,
+                                     hpb_Arena* arena, char** buf,
+                                     size_t* size) {
+  hpb_encstate e;
+  hpb_Encoder_Init(&e, sizes->options, arena);
+
+  // Allocate the whole output up front so that the encoder never has to grow
+  // (and copy) its buffer.  If the message was modified after the sizes were
+  // computed, encode_reserve() will still grow the buffer as needed.
+  if (sizes->size) {
+    e.buf = hpb_Arena_Malloc(arena, sizes->size);
+    if (!e.buf) {
+      *buf = NULL;
+      *size = 0;
+      return kHpb_EncodeStatus_OutOfMemory;
+    }
+    e.limit = e.buf + sizes->size;
+    e.ptr = e.limit;
+  }
 
   return hpb_Encoder_Encode(&e, msg, l, buf, size);
 }
+
+hpb_EncodeStatus hpb_EncodeToChunks(const void* msg, const hpb_MiniTable* l,
+                                    int options, size_t chunk_size,
+                                    hpb_Arena* arena, hpb_StringView** chunks,
+                                    size_t* chunk_count, size_t* size) {
+  hpb_encstate e;
+  hpb_Encoder_Init(&e, options, arena);
+  if (chunk_size == 0) chunk_size = kHpb_EncodeChunk_DefaultSize;
+  if (chunk_size < kHpb_EncodeChunk_MinSize) {
+    chunk_size = kHpb_EncodeChunk_MinSize;
+  }
+  e.chunk_size = chunk_size;
+
+  if (HPB_SETJMP(e.err) == 0) {
+    size_t msg_size;
+    encode_message(&e, msg, l, &msg_size);
+    encode_sealchunk(&e);
+
+    // The chunks were collected back to front.
+    for (size_t i = 0, j = e.chunk_count; i + 1 < j; i++, j--) {
+      hpb_StringView tmp = e.chunks[i];
+      e.chunks[i] = e.chunks[j - 1];
+      e.chunks[j - 1] = tmp;
+    }
+    *chunks = e.chunks;
+    *chunk_count = e.chunk_count;
+    *size = e.sealed;
+  } else {
+    HPB_ASSERT(e.status != kHpb_EncodeStatus_Ok);
+    *chunks = NULL;
+    *chunk_count = 0;
+    *size = 0;
+  }
+
+  _hpb_mapsorter_destroy(&e.sorter);
+  return e.status;
+}
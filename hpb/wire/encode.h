@@ -33,6 +33,8 @@
 #ifndef HPB_WIRE_ENCODE_H_
 #define HPB_WIRE_ENCODE_H_
 
+#include "hpb/base/string_view.h"
+#include "hpb/io/zero_copy_output_stream.h"
 #include "hpb/message/message.h"
 #include "hpb/wire/types.h"
 
@@ -66,6 +68,10 @@ typedef enum {
 
   // kHpb_EncodeOption_CheckRequired failed but the parse otherwise succeeded.
   kHpb_EncodeStatus_MissingRequired = 3,
+
+  // The output buffer was too small, the output stream failed, or the message
+  // no longer matches the sizes it is being encoded with.
+  kHpb_EncodeStatus_WriteFailed = 4,
 } hpb_EncodeStatus;
 
 HPB_INLINE uint32_t hpb_EncodeOptions_MaxDepth(uint16_t depth) {
@@ -87,6 +93,92 @@ HPB_API hpb_EncodeStatus hpb_Encode(const void* msg, const hpb_MiniTable* l,
                                     int options, hpb_Arena* arena, char** buf,
                                     size_t* size);
 
+// Computes the exact number of bytes hpb_Encode() would produce for `msg`
+// with the given options, without serializing it.  Fails with the same status
+// hpb_Encode() would.
+HPB_API hpb_EncodeStatus hpb_EncodedSize(const void* msg,
+                                         const hpb_MiniTable* l, int options,
+                                         size_t* size);
+
+// Cached sizes of a message and of all its length-delimited sub-messages.
+typedef struct {
+  size_t size;  // Total encoded size of the message.
+
+  // The payload size (excluding tag and length prefix) of every
+  // length-delimited sub-message, map entry, and MessageSet item, listed in
+  // the order they appear in the encoded output.  Parents precede their
+  // children.  Groups have no entry, but their contents do.
+  const size_t* submsg_sizes;
+  size_t submsg_count;
+
+  int options;  // The options the sizes were computed with.
+} hpb_EncodedSizes;
+
+// Like hpb_EncodedSize(), but also records the size of every sub-message.
+// The sizes are allocated from `arena` and are only valid as long as `msg` is
+// not modified.
+HPB_API hpb_EncodeStatus hpb_EncodedSizes_Compute(const void* msg,
+                                                  const hpb_MiniTable* l,
+                                                  int options,
+                                                  hpb_Arena* arena,
+                                                  hpb_EncodedSizes* sizes);
+
+// Like hpb_Encode(), using sizes previously computed for `msg` by
+// hpb_EncodedSizes_Compute() to allocate the output buffer exactly once.
+HPB_API hpb_EncodeStatus hpb_EncodeWithSizes(const void* msg,
+                                             const hpb_MiniTable* l,
+                                             const hpb_EncodedSizes* sizes,
+                                             hpb_Arena* arena, char** buf,
+                                             size_t* size);
+
+// Serializes `msg` front to back into `buf`, which must have room for at least
+// `sizes->size` bytes.  `sizes` must have been computed by a successful call to
+// hpb_EncodedSizes_Compute() for `msg`, which must not have been modified
+// since; the encode options are taken from `sizes`.  No memory is allocated
+// except by kHpb_EncodeOption_Deterministic, which sorts maps.  On success
+// `*written` is set to `sizes->size`.
+HPB_API hpb_EncodeStatus hpb_EncodeToBuffer(const void* msg,
+                                            const hpb_MiniTable* l,
+                                            const hpb_EncodedSizes* sizes,
+                                            char* buf, size_t size,
+                                            size_t* written);
+
+// Like hpb_EncodeToBuffer(), but writes to `stream`, calling BackUp() on the
+// unused part of the last buffer it obtained.  An error from `stream` is
+// reported in `status` and as kHpb_EncodeStatus_WriteFailed.  `*written` is
+// set to the number of bytes written to the stream, even on failure.
+HPB_API hpb_EncodeStatus hpb_EncodeToStream(const void* msg,
+                                            const hpb_MiniTable* l,
+                                            const hpb_EncodedSizes* sizes,
+                                            hpb_ZeroCopyOutputStream* stream,
+                                            hpb_Status* status,
+                                            size_t* written);
+
+enum {
+  kHpb_EncodeChunk_DefaultSize = 16384,
+  kHpb_EncodeChunk_MinSize = 64,
+};
+
+// Like hpb_Encode(), but writes the output into a list of chunks allocated
+// from `arena` instead of a single buffer, so the output is never reallocated
+// or copied as it grows.  Concatenated in order, the `*chunk_count` chunks in
+// `*chunks` hold exactly the bytes hpb_Encode() would produce, and can be
+// passed to writev() or similar as they are.
+//
+// Strings, bytes, unknown fields and packed fixed arrays of at least
+// `chunk_size / 2` bytes are not copied: each becomes a chunk of its own, of
+// whatever size, that points into `msg`, so `msg` must outlive the chunks.
+// All other chunks hold copied bytes and are at most `chunk_size` bytes (0
+// selects kHpb_EncodeChunk_DefaultSize; smaller values are raised to
+// kHpb_EncodeChunk_MinSize).
+HPB_API hpb_EncodeStatus hpb_EncodeToChunks(const void* msg,
+                                            const hpb_MiniTable* l,
+                                            int options, size_t chunk_size,
+                                            hpb_Arena* arena,
+                                            hpb_StringView** chunks,
+                                            size_t* chunk_count,
+                                            size_t* size);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -0,0 +1,556 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// A front-to-back encoder.  Unlike hpb_Encode(), which writes backwards into a
+// growing arena buffer so that it never needs to know a sub-message's length
+// before writing it, this writes straight into caller-owned memory and takes
+// every length prefix from a size cache built by hpb_EncodedSizes_Compute().
+//
+// The traversal order here must match encoded_size.c exactly, since the size
+// cache is consumed in the order it was filled.
+
+#include <string.h>
+
+#include "hpb/collections/internal/array.h"
+#include "hpb/collections/internal/map_sorter.h"
+#include "hpb/message/internal/accessors.h"
+#include "hpb/message/internal/extension.h"
+#include "hpb/mini_table/sub.h"
+#include "hpb/wire/encode.h"
+#include "hpb/wire/internal/common.h"
+#include "hpb/wire/internal/encode.h"
+#include "hpb/wire/internal/swap.h"
+
+// Must be last.
+#include "hpb/port/def.inc"
+
+typedef struct {
+  hpb_EncodeStatus status;
+  jmp_buf err;
+  char *ptr, *end;
+  hpb_ZeroCopyOutputStream* stream;  // NULL when writing to a flat buffer.
+  hpb_Status* stream_status;
+  const size_t* sizes;
+  size_t sizes_idx, sizes_count;
+  int options;
+  _hpb_mapsorter sorter;
+} hpb_fwdstate;
+
+HPB_NORETURN static void fwd_err(hpb_fwdstate* f, hpb_EncodeStatus status) {
+  HPB_ASSERT(status != kHpb_EncodeStatus_Ok);
+  f->status = status;
+  HPB_LONGJMP(f->err, 1);
+}
+
+// Called when the current buffer is full: fetches the next one from the
+// stream.
+HPB_NOINLINE static void fwd_nextbuffer(hpb_fwdstate* f) {
+  HPB_ASSERT(f->ptr == f->end);
+  if (!f->stream) fwd_err(f, kHpb_EncodeStatus_WriteFailed);
+  size_t count;
+  char* buf = hpb_ZeroCopyOutputStream_Next(f->stream, &count,
+                                            f->stream_status);
+  if (!buf) fwd_err(f, kHpb_EncodeStatus_WriteFailed);
+  f->ptr = buf;
+  f->end = buf + count;
+}
+
+static void fwd_bytes(hpb_fwdstate* f, const void* data, size_t len) {
+  const char* src = data;
+  while (len) {
+    if (f->ptr == f->end) fwd_nextbuffer(f);
+    size_t n = HPB_MIN(len, (size_t)(f->end - f->ptr));
+    memcpy(f->ptr, src, n);
+    f->ptr += n;
+    src += n;
+    len -= n;
+  }
+}
+
+HPB_FORCEINLINE
+static void fwd_varint(hpb_fwdstate* f, uint64_t val) {
+  if (HPB_LIKELY(f->end - f->ptr >= HPB_PB_VARINT_MAX_LEN)) {
+    while (val >= 0x80) {
+      *f->ptr++ = (char)(val | 0x80);
+      val >>= 7;
+    }
+    *f->ptr++ = (char)val;
+  } else {
+    char buf[HPB_PB_VARINT_MAX_LEN];
+    char* ptr = buf;
+    while (val >= 0x80) {
+      *ptr++ = (char)(val | 0x80);
+      val >>= 7;
+    }
+    *ptr++ = (char)val;
+    fwd_bytes(f, buf, ptr - buf);
+  }
+}
+
+static void fwd_fixed64(hpb_fwdstate* f, uint64_t val) {
+  val = _hpb_BigEndian_Swap64(val);
+  fwd_bytes(f, &val, sizeof(uint64_t));
+}
+
+static void fwd_fixed32(hpb_fwdstate* f, uint32_t val) {
+  val = _hpb_BigEndian_Swap32(val);
+  fwd_bytes(f, &val, sizeof(uint32_t));
+}
+
+static void fwd_tag(hpb_fwdstate* f, uint32_t field_number,
+                    uint8_t wire_type) {
+  fwd_varint(f, (field_number << 3) | wire_type);
+}
+
+// Writes the length prefix of the next sub-message from the size cache.
+static void fwd_cachedsize(hpb_fwdstate* f) {
+  if (HPB_UNLIKELY(f->sizes_idx == f->sizes_count)) {
+    // The message changed since its sizes were computed.
+    fwd_err(f, kHpb_EncodeStatus_WriteFailed);
+  }
+  fwd_varint(f, f->sizes[f->sizes_idx++]);
+}
+
+static void fwd_message(hpb_fwdstate* f, const hpb_Message* msg,
+                        const hpb_MiniTable* m);
+
+static void fwd_TaggedMessagePtr(hpb_fwdstate* f, hpb_TaggedMessagePtr tagged,
+                                 const hpb_MiniTable* m) {
+  if (hpb_TaggedMessagePtr_IsEmpty(tagged)) {
+    m = &_kHpb_MiniTable_Empty;
+  }
+  fwd_message(f, _hpb_TaggedMessagePtr_GetMessage(tagged), m);
+}
+
+static void fwd_submsg(hpb_fwdstate* f, hpb_TaggedMessagePtr submsg,
+                       const hpb_MiniTable* subm, uint32_t number) {
+  fwd_tag(f, number, kHpb_WireType_Delimited);
+  fwd_cachedsize(f);
+  fwd_TaggedMessagePtr(f, submsg, subm);
+}
+
+static void fwd_group(hpb_fwdstate* f, hpb_TaggedMessagePtr submsg,
+                      const hpb_MiniTable* subm, uint32_t number) {
+  fwd_tag(f, number, kHpb_WireType_StartGroup);
+  fwd_TaggedMessagePtr(f, submsg, subm);
+  fwd_tag(f, number, kHpb_WireType_EndGroup);
+}
+
+static void fwd_scalar(hpb_fwdstate* f, const void* field_mem,
+                       const hpb_MiniTableSub* subs,
+                       const hpb_MiniTableField* field) {
+  uint32_t number = field->number;
+
+  switch (field->HPB_PRIVATE(descriptortype)) {
+    case kHpb_FieldType_Double:
+    case kHpb_FieldType_SFixed64:
+    case kHpb_FieldType_Fixed64: {
+      uint64_t val;
+      memcpy(&val, field_mem, sizeof(val));
+      fwd_tag(f, number, kHpb_WireType_64Bit);
+      fwd_fixed64(f, val);
+      return;
+    }
+    case kHpb_FieldType_Float:
+    case kHpb_FieldType_Fixed32:
+    case kHpb_FieldType_SFixed32: {
+      uint32_t val;
+      memcpy(&val, field_mem, sizeof(val));
+      fwd_tag(f, number, kHpb_WireType_32Bit);
+      fwd_fixed32(f, val);
+      return;
+    }
+    case kHpb_FieldType_Int64:
+    case kHpb_FieldType_UInt64:
+      fwd_tag(f, number, kHpb_WireType_Varint);
+      fwd_varint(f, *(uint64_t*)field_mem);
+      return;
+    case kHpb_FieldType_UInt32:
+      fwd_tag(f, number, kHpb_WireType_Varint);
+      fwd_varint(f, *(uint32_t*)field_mem);
+      return;
+    case kHpb_FieldType_Int32:
+    case kHpb_FieldType_Enum:
+      fwd_tag(f, number, kHpb_WireType_Varint);
+      fwd_varint(f, (int64_t) * (int32_t*)field_mem);
+      return;
+    case kHpb_FieldType_Bool:
+      fwd_tag(f, number, kHpb_WireType_Varint);
+      fwd_varint(f, *(bool*)field_mem);
+      return;
+    case kHpb_FieldType_SInt32:
+      fwd_tag(f, number, kHpb_WireType_Varint);
+      fwd_varint(f, _hpb_Encoder_ZigZag32(*(int32_t*)field_mem));
+      return;
+    case kHpb_FieldType_SInt64:
+      fwd_tag(f, number, kHpb_WireType_Varint);
+      fwd_varint(f, _hpb_Encoder_ZigZag64(*(int64_t*)field_mem));
+      return;
+    case kHpb_FieldType_String:
+    case kHpb_FieldType_Bytes: {
+      hpb_StringView view = *(hpb_StringView*)field_mem;
+      fwd_tag(f, number, kHpb_WireType_Delimited);
+      fwd_varint(f, view.size);
+      fwd_bytes(f, view.data, view.size);
+      return;
+    }
+    case kHpb_FieldType_Group: {
+      hpb_TaggedMessagePtr submsg = *(hpb_TaggedMessagePtr*)field_mem;
+      if (submsg == 0) return;
+      fwd_group(f, submsg, subs[field->HPB_PRIVATE(submsg_index)].submsg,
+                number);
+      return;
+    }
+    case kHpb_FieldType_Message: {
+      hpb_TaggedMessagePtr submsg = *(hpb_TaggedMessagePtr*)field_mem;
+      if (submsg == 0) return;
+      fwd_submsg(f, submsg, subs[field->HPB_PRIVATE(submsg_index)].submsg,
+                 number);
+      return;
+    }
+    default:
+      HPB_UNREACHABLE();
+  }
+}
+
+static void fwd_fixedarray(hpb_fwdstate* f, const hpb_Array* arr,
+                           size_t elem_size, uint32_t tag) {
+  const char* ptr = _hpb_array_constptr(arr);
+  const char* end = ptr + arr->size * elem_size;
+
+  if (tag || !_hpb_IsLittleEndian()) {
+    for (; ptr != end; ptr += elem_size) {
+      if (tag) fwd_varint(f, tag);
+      if (elem_size == 4) {
+        uint32_t val;
+        memcpy(&val, ptr, sizeof(val));
+        fwd_fixed32(f, val);
+      } else {
+        HPB_ASSERT(elem_size == 8);
+        uint64_t val;
+        memcpy(&val, ptr, sizeof(val));
+        fwd_fixed64(f, val);
+      }
+    }
+  } else {
+    fwd_bytes(f, ptr, end - ptr);
+  }
+}
+
+static void fwd_array(hpb_fwdstate* f, const hpb_Message* msg,
+                      const hpb_MiniTableSub* subs,
+                      const hpb_MiniTableField* field) {
+  const hpb_Array* arr = *HPB_PTR_AT(msg, field->offset, hpb_Array*);
+  bool packed = field->mode & kHpb_LabelFlags_IsPacked;
+
+  if (arr == NULL || arr->size == 0) {
+    return;
+  }
+
+  uint32_t number = field->number;
+
+  // Packed arrays are preceded by the length of their payload, which is not
+  // part of the size cache.
+#define VARINT_CASE(ctype, encode)                                \
+  {                                                               \
+    const ctype* start = _hpb_array_constptr(arr);                \
+    const ctype* end = start + arr->size;                         \
+    const ctype* ptr;                                             \
+    uint32_t tag = 0;                                             \
+    if (packed) {                                                 \
+      size_t size = 0;                                            \
+      for (ptr = start; ptr != end; ptr++) {                      \
+        size += _hpb_Encoder_VarintSize(encode);                  \
+      }                                                           \
+      fwd_tag(f, number, kHpb_WireType_Delimited);                \
+      fwd_varint(f, size);                                        \
+    } else {                                                      \
+      tag = (number << 3) | kHpb_WireType_Varint;                 \
+    }                                                             \
+    for (ptr = start; ptr != end; ptr++) {                        \
+      if (tag) fwd_varint(f, tag);                                \
+      fwd_varint(f, encode);                                      \
+    }                                                             \
+  }                                                               \
+  return;
+
+#define FIXED_CASE(elem_size, wire_type)                          \
+  if (packed) {                                                   \
+    fwd_tag(f, number, kHpb_WireType_Delimited);                  \
+    fwd_varint(f, arr->size * elem_size);                         \
+    fwd_fixedarray(f, arr, elem_size, 0);                         \
+  } else {                                                        \
+    fwd_fixedarray(f, arr, elem_size, (number << 3) | wire_type); \
+  }                                                               \
+  return;
+
+  switch (field->HPB_PRIVATE(descriptortype)) {
+    case kHpb_FieldType_Double:
+    case kHpb_FieldType_SFixed64:
+    case kHpb_FieldType_Fixed64:
+      FIXED_CASE(8, kHpb_WireType_64Bit);
+    case kHpb_FieldType_Float:
+    case kHpb_FieldType_Fixed32:
+    case kHpb_FieldType_SFixed32:
+      FIXED_CASE(4, kHpb_WireType_32Bit);
+    case kHpb_FieldType_Int64:
+    case kHpb_FieldType_UInt64:
+      VARINT_CASE(uint64_t, *ptr);
+    case kHpb_FieldType_UInt32:
+      VARINT_CASE(uint32_t, *ptr);
+    case kHpb_FieldType_Int32:
+    case kHpb_FieldType_Enum:
+      VARINT_CASE(int32_t, (int64_t)*ptr);
+    case kHpb_FieldType_Bool:
+      VARINT_CASE(bool, *ptr);
+    case kHpb_FieldType_SInt32:
+      VARINT_CASE(int32_t, _hpb_Encoder_ZigZag32(*ptr));
+    case kHpb_FieldType_SInt64:
+      VARINT_CASE(int64_t, _hpb_Encoder_ZigZag64(*ptr));
+    case kHpb_FieldType_String:
+    case kHpb_FieldType_Bytes: {
+      const hpb_StringView* ptr = _hpb_array_constptr(arr);
+      const hpb_StringView* end = ptr + arr->size;
+      for (; ptr != end; ptr++) {
+        fwd_tag(f, number, kHpb_WireType_Delimited);
+        fwd_varint(f, ptr->size);
+        fwd_bytes(f, ptr->data, ptr->size);
+      }
+      return;
+    }
+    case kHpb_FieldType_Group: {
+      const hpb_TaggedMessagePtr* ptr = _hpb_array_constptr(arr);
+      const hpb_TaggedMessagePtr* end = ptr + arr->size;
+      const hpb_MiniTable* subm = subs[field->HPB_PRIVATE(submsg_index)].submsg;
+      for (; ptr != end; ptr++) fwd_group(f, *ptr, subm, number);
+      return;
+    }
+    case kHpb_FieldType_Message: {
+      const hpb_TaggedMessagePtr* ptr = _hpb_array_constptr(arr);
+      const hpb_TaggedMessagePtr* end = ptr + arr->size;
+      const hpb_MiniTable* subm = subs[field->HPB_PRIVATE(submsg_index)].submsg;
+      for (; ptr != end; ptr++) fwd_submsg(f, *ptr, subm, number);
+      return;
+    }
+    default:
+      HPB_UNREACHABLE();
+  }
+#undef VARINT_CASE
+#undef FIXED_CASE
+}
+
+static void fwd_mapentry(hpb_fwdstate* f, uint32_t number,
+                         const hpb_MiniTable* layout, const hpb_MapEntry* ent) {
+  fwd_tag(f, number, kHpb_WireType_Delimited);
+  fwd_cachedsize(f);
+  fwd_scalar(f, &ent->data.k, layout->subs, &layout->fields[0]);
+  fwd_scalar(f, &ent->data.v, layout->subs, &layout->fields[1]);
+}
+
+static void fwd_map(hpb_fwdstate* f, const hpb_Message* msg,
+                    const hpb_MiniTableSub* subs,
+                    const hpb_MiniTableField* field) {
+  const hpb_Map* map = *HPB_PTR_AT(msg, field->offset, const hpb_Map*);
+  const hpb_MiniTable* layout = subs[field->HPB_PRIVATE(submsg_index)].submsg;
+  HPB_ASSERT(layout->field_count == 2);
+  hpb_MapEntry ent;
+
+  if (map == NULL) return;
+
+  if (f->options & kHpb_EncodeOption_Deterministic) {
+    _hpb_sortedmap sorted;
+    if (!_hpb_mapsorter_pushmap(&f->sorter,
+                                layout->fields[0].HPB_PRIVATE(descriptortype),
+                                map, &sorted)) {
+      fwd_err(f, kHpb_EncodeStatus_OutOfMemory);
+    }
+    for (int i = sorted.end - 1; i >= sorted.start; i--) {
+      _hpb_Encoder_GetMapEntry(map, f->sorter.entries[i], &ent);
+      fwd_mapentry(f, field->number, layout, &ent);
+    }
+    _hpb_mapsorter_popmap(&f->sorter, &sorted);
+  } else {
+    size_t i = hpb_table_size(_hpb_Map_Table(map)) + 1;
+    while (i-- > 0) {
+      const hpb_tabent* tabent = _hpb_Map_EntryAt(map, i);
+      if (!tabent) continue;
+      _hpb_Encoder_GetMapEntry(map, tabent, &ent);
+      fwd_mapentry(f, field->number, layout, &ent);
+    }
+  }
+}
+
+static void fwd_field(hpb_fwdstate* f, const hpb_Message* msg,
+                      const hpb_MiniTableSub* subs,
+                      const hpb_MiniTableField* field) {
+  switch (hpb_FieldMode_Get(field)) {
+    case kHpb_FieldMode_Array:
+      fwd_array(f, msg, subs, field);
+      break;
+    case kHpb_FieldMode_Map:
+      fwd_map(f, msg, subs, field);
+      break;
+    case kHpb_FieldMode_Scalar:
+      fwd_scalar(f, HPB_PTR_AT(msg, field->offset, void), subs, field);
+      break;
+    default:
+      HPB_UNREACHABLE();
+  }
+}
+
+static void fwd_msgset_item(hpb_fwdstate* f,
+                            const hpb_Message_Extension* ext) {
+  fwd_tag(f, kHpb_MsgSet_Item, kHpb_WireType_StartGroup);
+  fwd_tag(f, kHpb_MsgSet_TypeId, kHpb_WireType_Varint);
+  fwd_varint(f, ext->ext->field.number);
+  fwd_tag(f, kHpb_MsgSet_Message, kHpb_WireType_Delimited);
+  fwd_cachedsize(f);
+  fwd_message(f, ext->data.ptr, ext->ext->sub.submsg);
+  fwd_tag(f, kHpb_MsgSet_Item, kHpb_WireType_EndGroup);
+}
+
+static void fwd_ext(hpb_fwdstate* f, const hpb_Message_Extension* ext,
+                    bool is_message_set) {
+  if (HPB_UNLIKELY(is_message_set)) {
+    fwd_msgset_item(f, ext);
+  } else {
+    fwd_field(f, &ext->data, &ext->ext->sub, &ext->ext->field);
+  }
+}
+
+static void fwd_message(hpb_fwdstate* f, const hpb_Message* msg,
+                        const hpb_MiniTable* m) {
+  // Required fields and the depth limit were already checked when the sizes
+  // were computed.
+  if (m->field_count) {
+    const hpb_MiniTableField* field = &m->fields[0];
+    const hpb_MiniTableField* end = &m->fields[m->field_count];
+    for (; field != end; field++) {
+      if (_hpb_Encoder_ShouldEncode(msg, field)) {
+        fwd_field(f, msg, m->subs, field);
+      }
+    }
+  }
+
+  if (m->ext != kHpb_ExtMode_NonExtendable) {
+    size_t ext_count;
+    const hpb_Message_Extension* ext = _hpb_Message_Getexts(msg, &ext_count);
+    if (ext_count) {
+      bool is_message_set = m->ext == kHpb_ExtMode_IsMessageSet;
+      if (f->options & kHpb_EncodeOption_Deterministic) {
+        _hpb_sortedmap sorted;
+        if (!_hpb_mapsorter_pushexts(&f->sorter, ext, ext_count, &sorted)) {
+          fwd_err(f, kHpb_EncodeStatus_OutOfMemory);
+        }
+        for (int i = sorted.end - 1; i >= sorted.start; i--) {
+          fwd_ext(f, f->sorter.entries[i], is_message_set);
+        }
+        _hpb_mapsorter_popmap(&f->sorter, &sorted);
+      } else {
+        for (size_t i = ext_count; i-- > 0;) {
+          fwd_ext(f, &ext[i], is_message_set);
+        }
+      }
+    }
+  }
+
+  // The payload of an empty message is held as unknown data, so it is kept
+  // even when skipping unknown fields.
+  if ((f->options & kHpb_EncodeOption_SkipUnknown) == 0 ||
+      m == &_kHpb_MiniTable_Empty) {
+    size_t unknown_size;
+    const char* unknown = hpb_Message_GetUnknown(msg, &unknown_size);
+    fwd_bytes(f, unknown, unknown_size);
+  }
+}
+
+static hpb_EncodeStatus hpb_Encoder_EncodeForward(hpb_fwdstate* const f,
+                                                  const void* const msg,
+                                                  const hpb_MiniTable* const l,
+                                                  const hpb_EncodedSizes* sizes,
+                                                  size_t* written) {
+  char* start = f->ptr;
+  size_t start_count =
+      f->stream ? hpb_ZeroCopyOutputStream_ByteCount(f->stream) : 0;
+
+  f->status = kHpb_EncodeStatus_Ok;
+  f->sizes = sizes->submsg_sizes;
+  f->sizes_idx = 0;
+  f->sizes_count = sizes->submsg_count;
+  f->options = sizes->options;
+  _hpb_mapsorter_init(&f->sorter);
+
+  if (HPB_SETJMP(f->err) == 0) {
+    fwd_message(f, msg, l);
+    if (f->sizes_idx != f->sizes_count) {
+      fwd_err(f, kHpb_EncodeStatus_WriteFailed);
+    }
+  }
+
+  if (f->stream) {
+    if (f->ptr) hpb_ZeroCopyOutputStream_BackUp(f->stream, f->end - f->ptr);
+    *written = hpb_ZeroCopyOutputStream_ByteCount(f->stream) - start_count;
+  } else {
+    *written = f->ptr - start;
+  }
+
+  _hpb_mapsorter_destroy(&f->sorter);
+  return f->status;
+}
+
+hpb_EncodeStatus hpb_EncodeToBuffer(const void* msg, const hpb_MiniTable* l,
+                                    const hpb_EncodedSizes* sizes, char* buf,
+                                    size_t size, size_t* written) {
+  if (size < sizes->size) {
+    *written = 0;
+    return kHpb_EncodeStatus_WriteFailed;
+  }
+
+  hpb_fwdstate f;
+  f.ptr = buf;
+  f.end = buf + size;
+  f.stream = NULL;
+  f.stream_status = NULL;
+  return hpb_Encoder_EncodeForward(&f, msg, l, sizes, written);
+}
+
+hpb_EncodeStatus hpb_EncodeToStream(const void* msg, const hpb_MiniTable* l,
+                                    const hpb_EncodedSizes* sizes,
+                                    hpb_ZeroCopyOutputStream* stream,
+                                    hpb_Status* status, size_t* written) {
+  hpb_fwdstate f;
+  f.ptr = NULL;
+  f.end = NULL;
+  f.stream = stream;
+  f.stream_status = status;
+  return hpb_Encoder_EncodeForward(&f, msg, l, sizes, written);
+}
+
+#include "hpb/port/undef.inc"
@@ -0,0 +1,421 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+
+#include "hpb/wire/decode.h"
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "hpb/base/status.hpp"
+#include "hpb/io/chunked_output_stream.h"
+#include "hpb/mem/arena.hpp"
+#include "hpb/mini_descriptor/decode.h"
+#include "hpb/mini_descriptor/internal/encode.hpp"
+#include "hpb/mini_descriptor/internal/modifiers.h"
+#include "hpb/mini_descriptor/link.h"
+#include "hpb/wire/decode.h"
+#include "hpb/wire/encode.h"
+
+// Must be last
+#include "hpb/port/def.inc"
+
+namespace {
+
+// message M {
+//   int32 i = 1;
+//   string s = 2;
+//   repeated sint64 v = 3 [packed = true];
+//   repeated fixed32 f = 4;
+//   M sub = 5;
+//   repeated bytes b = 6;
+//   repeated M subs = 7;
+//   map<int32, M> m = 8;
+//   map<string, int64> sm = 9;
+// }
+hpb_MiniTable* BuildMiniTable(hpb_Arena* arena) {
+  hpb::MtDataEncoder e;
+  e.StartMessage(0);
+  e.PutField(kHpb_FieldType_Int32, 1, 0);
+  e.PutField(kHpb_FieldType_String, 2, 0);
+  e.PutField(kHpb_FieldType_SInt64, 3,
+             kHpb_FieldModifier_IsRepeated | kHpb_FieldModifier_IsPacked);
+  e.PutField(kHpb_FieldType_Fixed32, 4, kHpb_FieldModifier_IsRepeated);
+  e.PutField(kHpb_FieldType_Message, 5, 0);
+  e.PutField(kHpb_FieldType_Bytes, 6, kHpb_FieldModifier_IsRepeated);
+  e.PutField(kHpb_FieldType_Message, 7, kHpb_FieldModifier_IsRepeated);
+  e.PutField(kHpb_FieldType_Message, 8, kHpb_FieldModifier_IsRepeated);
+  e.PutField(kHpb_FieldType_Message, 9, kHpb_FieldModifier_IsRepeated);
+
+  hpb::Status status;
+  hpb_MiniTable* table = hpb_MiniTable_Build(e.data().data(), e.data().size(),
+                                             arena, status.ptr());
+  EXPECT_NE(table, nullptr);
+
+  hpb::MtDataEncoder int_map;
+  int_map.EncodeMap(kHpb_FieldType_Int32, kHpb_FieldType_Message, 0, 0);
+  hpb_MiniTable* int_entry =
+      hpb_MiniTable_Build(int_map.data().data(), int_map.data().size(), arena,
+                          status.ptr());
+  EXPECT_NE(int_entry, nullptr);
+  EXPECT_TRUE(hpb_MiniTable_SetSubMessage(
+      int_entry,
+      const_cast<hpb_MiniTableField*>(
+          hpb_MiniTable_FindFieldByNumber(int_entry, 2)),
+      table));
+
+  hpb::MtDataEncoder str_map;
+  str_map.EncodeMap(kHpb_FieldType_String, kHpb_FieldType_Int64, 0, 0);
+  hpb_MiniTable* str_entry =
+      hpb_MiniTable_Build(str_map.data().data(), str_map.data().size(), arena,
+                          status.ptr());
+  EXPECT_NE(str_entry, nullptr);
+
+  auto field = [table](uint32_t num) {
+    return const_cast<hpb_MiniTableField*>(
+        hpb_MiniTable_FindFieldByNumber(table, num));
+  };
+  EXPECT_TRUE(hpb_MiniTable_SetSubMessage(table, field(5), table));
+  EXPECT_TRUE(hpb_MiniTable_SetSubMessage(table, field(7), table));
+  EXPECT_TRUE(hpb_MiniTable_SetSubMessage(table, field(8), int_entry));
+  EXPECT_TRUE(hpb_MiniTable_SetSubMessage(table, field(9), str_entry));
+  return table;
+}
+
+void PutVarint(std::string* out, uint64_t val) {
+  do {
+    uint8_t byte = val & 0x7f;
+    val >>= 7;
+    if (val) byte |= 0x80;
+    out->push_back(byte);
+  } while (val);
+}
+
+void PutTag(std::string* out, uint32_t num, hpb_WireType type) {
+  PutVarint(out, (num << 3) | type);
+}
+
+void PutDelimited(std::string* out, uint32_t num, const std::string& data) {
+  PutTag(out, num, kHpb_WireType_Delimited);
+  PutVarint(out, data.size());
+  out->append(data);
+}
+
+std::string Payload(int depth) {
+  std::string ret;
+  PutTag(&ret, 1, kHpb_WireType_Varint);
+  PutVarint(&ret, (uint64_t)-depth);
+  PutDelimited(&ret, 2, std::string(depth * 50, 's'));
+
+  std::string varints;
+  for (int i = 0; i < 40; i++) PutVarint(&varints, (uint64_t)1 << i);
+  PutDelimited(&ret, 3, varints);
+  for (uint32_t i = 0; i < 5; i++) {
+    PutTag(&ret, 4, kHpb_WireType_32Bit);
+    ret.append((const char*)&i, 4);
+  }
+  PutDelimited(&ret, 6, "bytes");
+  PutDelimited(&ret, 6, "");
+
+  // Unknown field.
+  PutDelimited(&ret, 100, std::string(30, 'u'));
+
+  if (depth == 0) return ret;
+
+  PutDelimited(&ret, 5, Payload(depth - 1));
+  for (int i = 0; i < 3; i++) PutDelimited(&ret, 7, Payload(depth - 1));
+  for (int i = 0; i < 10; i++) {
+    std::string entry;
+    PutTag(&entry, 1, kHpb_WireType_Varint);
+    PutVarint(&entry, i * 1000);
+    PutDelimited(&entry, 2, Payload(depth - 1));
+    PutDelimited(&ret, 8, entry);
+  }
+  for (int i = 0; i < 10; i++) {
+    std::string entry;
+    PutDelimited(&entry, 1, "key" + std::to_string(i));
+    PutTag(&entry, 2, kHpb_WireType_Varint);
+    PutVarint(&entry, i);
+    PutDelimited(&ret, 9, entry);
+  }
+  return ret;
+}
+
+uint64_t GetVarint(const char** ptr) {
+  uint64_t ret = 0;
+  for (int shift = 0;; shift += 7) {
+    uint8_t byte = *(*ptr)++;
+    ret |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) return ret;
+  }
+}
+
+// Walks an encoded M and collects the sizes of its sub-messages in pre-order,
+// which is the order hpb_EncodedSizes_Compute() records them in.
+void CollectSizes(const char* ptr, const char* end, bool map_entry,
+                  std::vector<size_t>* out) {
+  while (ptr < end) {
+    uint32_t tag = GetVarint(&ptr);
+    uint32_t num = tag >> 3;
+    switch (tag & 7) {
+      case kHpb_WireType_Varint:
+        GetVarint(&ptr);
+        break;
+      case kHpb_WireType_32Bit:
+        ptr += 4;
+        break;
+      case kHpb_WireType_64Bit:
+        ptr += 8;
+        break;
+      case kHpb_WireType_Delimited: {
+        size_t size = GetVarint(&ptr);
+        bool is_msg = map_entry ? num == 2 : (num == 5 || num == 7);
+        bool is_entry = !map_entry && (num == 8 || num == 9);
+        if (is_msg || is_entry) {
+          out->push_back(size);
+          if (num != 9) CollectSizes(ptr, ptr + size, is_entry, out);
+        }
+        ptr += size;
+        break;
+      }
+      default:
+        ADD_FAILURE() << "unexpected wire type";
+        return;
+    }
+  }
+}
+
+class EncodedSizeTest : public testing::TestWithParam<int> {};
+
+TEST_P(EncodedSizeTest, MatchesEncode) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+  std::string payload = Payload(3);
+  ASSERT_EQ(kHpb_DecodeStatus_Ok,
+            hpb_Decode(payload.data(), payload.size(), msg, table, nullptr, 0,
+                       arena.ptr()));
+
+  int options = GetParam();
+  char* buf;
+  size_t size;
+  ASSERT_EQ(kHpb_EncodeStatus_Ok,
+            hpb_Encode(msg, table, options, arena.ptr(), &buf, &size));
+  std::string encoded(buf, size);
+
+  size_t encoded_size;
+  ASSERT_EQ(kHpb_EncodeStatus_Ok,
+            hpb_EncodedSize(msg, table, options, &encoded_size));
+  EXPECT_EQ(encoded.size(), encoded_size);
+
+  hpb_EncodedSizes sizes;
+  ASSERT_EQ(kHpb_EncodeStatus_Ok,
+            hpb_EncodedSizes_Compute(msg, table, options, arena.ptr(), &sizes));
+  EXPECT_EQ(encoded.size(), sizes.size);
+
+  std::vector<size_t> expected;
+  CollectSizes(encoded.data(), encoded.data() + encoded.size(), false,
+               &expected);
+  std::vector<size_t> actual(sizes.submsg_sizes,
+                             sizes.submsg_sizes + sizes.submsg_count);
+  EXPECT_EQ(expected, actual);
+
+  ASSERT_EQ(kHpb_EncodeStatus_Ok,
+            hpb_EncodeWithSizes(msg, table, &sizes, arena.ptr(), &buf, &size));
+  EXPECT_EQ(encoded, std::string(buf, size));
+}
+
+TEST_P(EncodedSizeTest, EncodeForward) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+  std::string payload = Payload(3);
+  ASSERT_EQ(kHpb_DecodeStatus_Ok,
+            hpb_Decode(payload.data(), payload.size(), msg, table, nullptr, 0,
+                       arena.ptr()));
+
+  int options = GetParam();
+  char* buf;
+  size_t size;
+  ASSERT_EQ(kHpb_EncodeStatus_Ok,
+            hpb_Encode(msg, table, options, arena.ptr(), &buf, &size));
+  std::string encoded(buf, size);
+
+  hpb_EncodedSizes sizes;
+  ASSERT_EQ(kHpb_EncodeStatus_Ok,
+            hpb_EncodedSizes_Compute(msg, table, options, arena.ptr(), &sizes));
+
+  std::string out(encoded.size() + 10, '\0');
+  size_t written;
+  ASSERT_EQ(kHpb_EncodeStatus_Ok,
+            hpb_EncodeToBuffer(msg, table, &sizes, &out[0], out.size(),
+                               &written));
+  EXPECT_EQ(encoded, out.substr(0, written));
+
+  EXPECT_EQ(kHpb_EncodeStatus_WriteFailed,
+            hpb_EncodeToBuffer(msg, table, &sizes, &out[0],
+                               encoded.size() - 1, &written));
+
+  for (size_t limit : {1, 3, 16, 1000}) {
+    std::string streamed(encoded.size() + 10, '\0');
+    hpb_ZeroCopyOutputStream* stream = hpb_ChunkedOutputStream_New(
+        &streamed[0], streamed.size(), limit, arena.ptr());
+    hpb::Status status;
+    ASSERT_EQ(kHpb_EncodeStatus_Ok,
+              hpb_EncodeToStream(msg, table, &sizes, stream, status.ptr(),
+                                 &written));
+    EXPECT_EQ(encoded.size(), written);
+    EXPECT_EQ(encoded.size(), hpb_ZeroCopyOutputStream_ByteCount(stream));
+    EXPECT_EQ(encoded, streamed.substr(0, written)) << limit;
+  }
+
+  // A stream that runs out of space.
+  std::string small(encoded.size() / 2, '\0');
+  hpb_ZeroCopyOutputStream* stream =
+      hpb_ChunkedOutputStream_New(&small[0], small.size(), 7, arena.ptr());
+  hpb::Status status;
+  EXPECT_EQ(kHpb_EncodeStatus_WriteFailed,
+            hpb_EncodeToStream(msg, table, &sizes, stream, status.ptr(),
+                               &written));
+  EXPECT_EQ(small.size(), written);
+}
+
+std::string Concat(const hpb_StringView* chunks, size_t count) {
+  std::string ret;
+  for (size_t i = 0; i < count; i++) ret.append(chunks[i].data, chunks[i].size);
+  return ret;
+}
+
+TEST_P(EncodedSizeTest, EncodeToChunks) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+  std::string payload = Payload(3);
+  ASSERT_EQ(kHpb_DecodeStatus_Ok,
+            hpb_Decode(payload.data(), payload.size(), msg, table, nullptr, 0,
+                       arena.ptr()));
+
+  int options = GetParam();
+  char* buf;
+  size_t size;
+  ASSERT_EQ(kHpb_EncodeStatus_Ok,
+            hpb_Encode(msg, table, options, arena.ptr(), &buf, &size));
+  std::string encoded(buf, size);
+
+  for (size_t chunk_size : {0, 1, 64, 100, 1000, 1 << 20}) {
+    hpb_StringView* chunks;
+    size_t count;
+    ASSERT_EQ(kHpb_EncodeStatus_Ok,
+              hpb_EncodeToChunks(msg, table, options, chunk_size, arena.ptr(),
+                                 &chunks, &count, &size));
+    EXPECT_EQ(encoded.size(), size);
+    EXPECT_EQ(encoded, Concat(chunks, count)) << chunk_size;
+    for (size_t i = 0; i < count; i++) EXPECT_NE(0, chunks[i].size);
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Options, EncodedSizeTest,
+                         testing::Values(0, kHpb_EncodeOption_Deterministic,
+                                         kHpb_EncodeOption_SkipUnknown));
+
+TEST(EncodedSizeTest, Empty) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+  size_t size = 1;
+  EXPECT_EQ(kHpb_EncodeStatus_Ok, hpb_EncodedSize(msg, table, 0, &size));
+  EXPECT_EQ(0, size);
+}
+
+TEST(EncodedSizeTest, MaxDepth) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+  std::string payload = Payload(3);
+  ASSERT_EQ(kHpb_DecodeStatus_Ok,
+            hpb_Decode(payload.data(), payload.size(), msg, table, nullptr, 0,
+                       arena.ptr()));
+
+  size_t size;
+  EXPECT_EQ(kHpb_EncodeStatus_MaxDepthExceeded,
+            hpb_EncodedSize(msg, table, hpb_EncodeOptions_MaxDepth(2), &size));
+  EXPECT_EQ(kHpb_EncodeStatus_Ok,
+            hpb_EncodedSize(msg, table, hpb_EncodeOptions_MaxDepth(5), &size));
+}
+
+TEST(EncodeToChunksTest, Empty) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+  hpb_StringView* chunks;
+  size_t count = 1;
+  size_t size = 1;
+  EXPECT_EQ(kHpb_EncodeStatus_Ok,
+            hpb_EncodeToChunks(msg, table, 0, 0, arena.ptr(), &chunks, &count,
+                               &size));
+  EXPECT_EQ(0, count);
+  EXPECT_EQ(0, size);
+}
+
+TEST(EncodeToChunksTest, LargeStringsAreAliased) {
+  hpb::Arena arena;
+  hpb_MiniTable* table = BuildMiniTable(arena.ptr());
+  hpb_Message* msg = hpb_Message_New(table, arena.ptr());
+  std::string payload;
+  PutDelimited(&payload, 2, std::string(5000, 's'));
+  for (int i = 0; i < 3; i++) PutDelimited(&payload, 6, std::string(800, 'b'));
+  PutDelimited(&payload, 6, std::string(100, 'c'));
+  ASSERT_EQ(kHpb_DecodeStatus_Ok,
+            hpb_Decode(payload.data(), payload.size(), msg, table, nullptr,
+                       kHpb_DecodeOption_AliasString, arena.ptr()));
+
+  const size_t chunk_size = 256;
+  hpb_StringView* chunks;
+  size_t count;
+  size_t size;
+  ASSERT_EQ(kHpb_EncodeStatus_Ok,
+            hpb_EncodeToChunks(msg, table, 0, chunk_size, arena.ptr(),
+                               &chunks, &count, &size));
+  EXPECT_EQ(payload, Concat(chunks, count));
+
+  // The four large values point into the payload; everything else, including
+  // the short bytes value, was copied into chunks of at most `chunk_size`.
+  const char* begin = payload.data();
+  const char* end = begin + payload.size();
+  int aliased = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (chunks[i].data >= begin && chunks[i].data < end) {
+      aliased++;
+      EXPECT_GE(chunks[i].size, chunk_size / 2);
+    } else {
+      EXPECT_LE(chunks[i].size, chunk_size);
+    }
+  }
+  EXPECT_EQ(4, aliased);
+}
+
+}  // namespace
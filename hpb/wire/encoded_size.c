@@ -0,0 +1,489 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Computes the exact size of the output of hpb_Encode() without writing it.
+//
+// This mirrors the structure of encode.c; any change to what the encoder
+// emits must be reflected here.  The optional size cache records the length
+// of every length-delimited sub-message in the order the sub-messages appear
+// in the encoded output (parents before their children), which is the order
+// a front-to-back serializer needs them in.
+
+#include <string.h>
+
+#include "hpb/collections/internal/array.h"
+#include "hpb/collections/internal/map_sorter.h"
+#include "hpb/message/internal/accessors.h"
+#include "hpb/message/internal/extension.h"
+#include "hpb/mini_table/sub.h"
+#include "hpb/wire/encode.h"
+#include "hpb/wire/internal/common.h"
+#include "hpb/wire/internal/encode.h"
+#include "hpb/wire/internal/swap.h"
+
+// Must be last.
+#include "hpb/port/def.inc"
+
+typedef struct {
+  hpb_EncodeStatus status;
+  jmp_buf err;
+  hpb_Arena* arena;  // NULL if sub-message sizes are not being recorded.
+  size_t* sizes;
+  size_t count, cap;
+  int options;
+  int depth;
+  _hpb_mapsorter sorter;
+} hpb_sizestate;
+
+HPB_NORETURN static void size_err(hpb_sizestate* s, hpb_EncodeStatus status) {
+  HPB_ASSERT(status != kHpb_EncodeStatus_Ok);
+  s->status = status;
+  HPB_LONGJMP(s->err, 1);
+}
+
+static size_t size_tag(uint32_t field_number, uint8_t wire_type) {
+  return _hpb_Encoder_VarintSize((field_number << 3) | wire_type);
+}
+
+static size_t size_delimited(size_t len) {
+  return _hpb_Encoder_VarintSize(len) + len;
+}
+
+// Reserves a cache slot for a sub-message whose size is not known yet.  The
+// slot is taken before the sub-message's children so that the cache ends up
+// in output order.
+static size_t size_pushslot(hpb_sizestate* s) {
+  if (!s->arena) return 0;
+  if (s->count == s->cap) {
+    size_t new_cap = HPB_MAX(s->cap * 2, 16);
+    size_t* new_sizes = hpb_Arena_Realloc(s->arena, s->sizes,
+                                          s->cap * sizeof(*s->sizes),
+                                          new_cap * sizeof(*s->sizes));
+    if (!new_sizes) size_err(s, kHpb_EncodeStatus_OutOfMemory);
+    s->sizes = new_sizes;
+    s->cap = new_cap;
+  }
+  return s->count++;
+}
+
+static void size_setslot(hpb_sizestate* s, size_t slot, size_t size) {
+  if (s->arena) s->sizes[slot] = size;
+}
+
+static size_t size_message(hpb_sizestate* s, const hpb_Message* msg,
+                           const hpb_MiniTable* m);
+
+static size_t size_TaggedMessagePtr(hpb_sizestate* s,
+                                    hpb_TaggedMessagePtr tagged,
+                                    const hpb_MiniTable* m) {
+  if (hpb_TaggedMessagePtr_IsEmpty(tagged)) {
+    m = &_kHpb_MiniTable_Empty;
+  }
+  return size_message(s, _hpb_TaggedMessagePtr_GetMessage(tagged), m);
+}
+
+// Size of a length-delimited sub-message, including its length prefix but not
+// its tag.
+static size_t size_submsg(hpb_sizestate* s, hpb_TaggedMessagePtr submsg,
+                          const hpb_MiniTable* subm) {
+  size_t slot = size_pushslot(s);
+  size_t size = size_TaggedMessagePtr(s, submsg, subm);
+  size_setslot(s, slot, size);
+  return size_delimited(size);
+}
+
+static size_t size_group(hpb_sizestate* s, hpb_TaggedMessagePtr submsg,
+                         const hpb_MiniTable* subm, uint32_t number) {
+  return size_tag(number, kHpb_WireType_StartGroup) +
+         size_TaggedMessagePtr(s, submsg, subm) +
+         size_tag(number, kHpb_WireType_EndGroup);
+}
+
+static size_t size_scalar(hpb_sizestate* s, const void* field_mem,
+                          const hpb_MiniTableSub* subs,
+                          const hpb_MiniTableField* f) {
+  size_t size;
+  int wire_type;
+
+  switch (f->HPB_PRIVATE(descriptortype)) {
+    case kHpb_FieldType_Double:
+    case kHpb_FieldType_SFixed64:
+    case kHpb_FieldType_Fixed64:
+      size = 8;
+      wire_type = kHpb_WireType_64Bit;
+      break;
+    case kHpb_FieldType_Float:
+    case kHpb_FieldType_Fixed32:
+    case kHpb_FieldType_SFixed32:
+      size = 4;
+      wire_type = kHpb_WireType_32Bit;
+      break;
+    case kHpb_FieldType_Int64:
+    case kHpb_FieldType_UInt64:
+      size = _hpb_Encoder_VarintSize(*(uint64_t*)field_mem);
+      wire_type = kHpb_WireType_Varint;
+      break;
+    case kHpb_FieldType_UInt32:
+      size = _hpb_Encoder_VarintSize(*(uint32_t*)field_mem);
+      wire_type = kHpb_WireType_Varint;
+      break;
+    case kHpb_FieldType_Int32:
+    case kHpb_FieldType_Enum:
+      size = _hpb_Encoder_VarintSize((int64_t) * (int32_t*)field_mem);
+      wire_type = kHpb_WireType_Varint;
+      break;
+    case kHpb_FieldType_Bool:
+      size = 1;
+      wire_type = kHpb_WireType_Varint;
+      break;
+    case kHpb_FieldType_SInt32:
+      size = _hpb_Encoder_VarintSize(
+          _hpb_Encoder_ZigZag32(*(int32_t*)field_mem));
+      wire_type = kHpb_WireType_Varint;
+      break;
+    case kHpb_FieldType_SInt64:
+      size = _hpb_Encoder_VarintSize(
+          _hpb_Encoder_ZigZag64(*(int64_t*)field_mem));
+      wire_type = kHpb_WireType_Varint;
+      break;
+    case kHpb_FieldType_String:
+    case kHpb_FieldType_Bytes:
+      size = size_delimited(((hpb_StringView*)field_mem)->size);
+      wire_type = kHpb_WireType_Delimited;
+      break;
+    case kHpb_FieldType_Group: {
+      hpb_TaggedMessagePtr submsg = *(hpb_TaggedMessagePtr*)field_mem;
+      const hpb_MiniTable* subm = subs[f->HPB_PRIVATE(submsg_index)].submsg;
+      if (submsg == 0) return 0;
+      if (--s->depth == 0) size_err(s, kHpb_EncodeStatus_MaxDepthExceeded);
+      size = size_group(s, submsg, subm, f->number);
+      s->depth++;
+      return size;
+    }
+    case kHpb_FieldType_Message: {
+      hpb_TaggedMessagePtr submsg = *(hpb_TaggedMessagePtr*)field_mem;
+      const hpb_MiniTable* subm = subs[f->HPB_PRIVATE(submsg_index)].submsg;
+      if (submsg == 0) return 0;
+      if (--s->depth == 0) size_err(s, kHpb_EncodeStatus_MaxDepthExceeded);
+      size = size_submsg(s, submsg, subm);
+      wire_type = kHpb_WireType_Delimited;
+      s->depth++;
+      break;
+    }
+    default:
+      HPB_UNREACHABLE();
+  }
+
+  return size_tag(f->number, wire_type) + size;
+}
+
+static size_t size_array(hpb_sizestate* s, const hpb_Message* msg,
+                         const hpb_MiniTableSub* subs,
+                         const hpb_MiniTableField* f) {
+  const hpb_Array* arr = *HPB_PTR_AT(msg, f->offset, hpb_Array*);
+  bool packed = f->mode & kHpb_LabelFlags_IsPacked;
+  size_t size = 0;
+
+  if (arr == NULL || arr->size == 0) {
+    return 0;
+  }
+
+#define VARINT_CASE(ctype, encode)                                     \
+  {                                                                    \
+    const ctype* ptr = _hpb_array_constptr(arr);                       \
+    const ctype* end = ptr + arr->size;                                \
+    for (; ptr != end; ptr++) size += _hpb_Encoder_VarintSize(encode); \
+    wire_type = kHpb_WireType_Varint;                                  \
+  }                                                                    \
+  break;
+
+#define FIXED_CASE(elem_size, wtype) \
+  size = arr->size * elem_size;      \
+  wire_type = wtype;                 \
+  break;
+
+  int wire_type;
+  switch (f->HPB_PRIVATE(descriptortype)) {
+    case kHpb_FieldType_Double:
+    case kHpb_FieldType_SFixed64:
+    case kHpb_FieldType_Fixed64:
+      FIXED_CASE(8, kHpb_WireType_64Bit);
+    case kHpb_FieldType_Float:
+    case kHpb_FieldType_Fixed32:
+    case kHpb_FieldType_SFixed32:
+      FIXED_CASE(4, kHpb_WireType_32Bit);
+    case kHpb_FieldType_Int64:
+    case kHpb_FieldType_UInt64:
+      VARINT_CASE(uint64_t, *ptr);
+    case kHpb_FieldType_UInt32:
+      VARINT_CASE(uint32_t, *ptr);
+    case kHpb_FieldType_Int32:
+    case kHpb_FieldType_Enum:
+      VARINT_CASE(int32_t, (int64_t)*ptr);
+    case kHpb_FieldType_Bool:
+      VARINT_CASE(bool, *ptr);
+    case kHpb_FieldType_SInt32:
+      VARINT_CASE(int32_t, _hpb_Encoder_ZigZag32(*ptr));
+    case kHpb_FieldType_SInt64:
+      VARINT_CASE(int64_t, _hpb_Encoder_ZigZag64(*ptr));
+    case kHpb_FieldType_String:
+    case kHpb_FieldType_Bytes: {
+      const hpb_StringView* ptr = _hpb_array_constptr(arr);
+      const hpb_StringView* end = ptr + arr->size;
+      for (; ptr != end; ptr++) size += size_delimited(ptr->size);
+      return size + arr->size * size_tag(f->number, kHpb_WireType_Delimited);
+    }
+    case kHpb_FieldType_Group: {
+      const hpb_TaggedMessagePtr* ptr = _hpb_array_constptr(arr);
+      const hpb_TaggedMessagePtr* end = ptr + arr->size;
+      const hpb_MiniTable* subm = subs[f->HPB_PRIVATE(submsg_index)].submsg;
+      if (--s->depth == 0) size_err(s, kHpb_EncodeStatus_MaxDepthExceeded);
+      for (; ptr != end; ptr++) size += size_group(s, *ptr, subm, f->number);
+      s->depth++;
+      return size;
+    }
+    case kHpb_FieldType_Message: {
+      const hpb_TaggedMessagePtr* ptr = _hpb_array_constptr(arr);
+      const hpb_TaggedMessagePtr* end = ptr + arr->size;
+      const hpb_MiniTable* subm = subs[f->HPB_PRIVATE(submsg_index)].submsg;
+      if (--s->depth == 0) size_err(s, kHpb_EncodeStatus_MaxDepthExceeded);
+      for (; ptr != end; ptr++) size += size_submsg(s, *ptr, subm);
+      s->depth++;
+      return size + arr->size * size_tag(f->number, kHpb_WireType_Delimited);
+    }
+    default:
+      HPB_UNREACHABLE();
+  }
+#undef VARINT_CASE
+#undef FIXED_CASE
+
+  if (packed) {
+    return size_tag(f->number, kHpb_WireType_Delimited) + size_delimited(size);
+  }
+  return size + arr->size * size_tag(f->number, wire_type);
+}
+
+static size_t size_mapentry(hpb_sizestate* s, uint32_t number,
+                            const hpb_MiniTable* layout,
+                            const hpb_MapEntry* ent) {
+  const hpb_MiniTableField* key_field = &layout->fields[0];
+  const hpb_MiniTableField* val_field = &layout->fields[1];
+  size_t slot = size_pushslot(s);
+  size_t size = size_scalar(s, &ent->data.k, layout->subs, key_field) +
+                size_scalar(s, &ent->data.v, layout->subs, val_field);
+  size_setslot(s, slot, size);
+  return size_tag(number, kHpb_WireType_Delimited) + size_delimited(size);
+}
+
+static size_t size_map(hpb_sizestate* s, const hpb_Message* msg,
+                       const hpb_MiniTableSub* subs,
+                       const hpb_MiniTableField* f) {
+  const hpb_Map* map = *HPB_PTR_AT(msg, f->offset, const hpb_Map*);
+  const hpb_MiniTable* layout = subs[f->HPB_PRIVATE(submsg_index)].submsg;
+  HPB_ASSERT(layout->field_count == 2);
+  size_t size = 0;
+  hpb_MapEntry ent;
+
+  if (map == NULL) return 0;
+
+  // hpb_Encode() writes backwards, so entries appear in the output in the
+  // reverse of the order the encoder visits them.  The order only matters for
+  // the sizes recorded in the cache; the total does not depend on it.
+  if ((s->options & kHpb_EncodeOption_Deterministic) && s->arena) {
+    _hpb_sortedmap sorted;
+    if (!_hpb_mapsorter_pushmap(&s->sorter,
+                                layout->fields[0].HPB_PRIVATE(descriptortype),
+                                map, &sorted)) {
+      size_err(s, kHpb_EncodeStatus_OutOfMemory);
+    }
+    for (int i = sorted.end - 1; i >= sorted.start; i--) {
+      _hpb_Encoder_GetMapEntry(map, s->sorter.entries[i], &ent);
+      size += size_mapentry(s, f->number, layout, &ent);
+    }
+    _hpb_mapsorter_popmap(&s->sorter, &sorted);
+  } else {
+    size_t i = hpb_table_size(_hpb_Map_Table(map)) + 1;
+    while (i-- > 0) {
+      const hpb_tabent* tabent = _hpb_Map_EntryAt(map, i);
+      if (!tabent) continue;
+      _hpb_Encoder_GetMapEntry(map, tabent, &ent);
+      size += size_mapentry(s, f->number, layout, &ent);
+    }
+  }
+  return size;
+}
+
+static size_t size_field(hpb_sizestate* s, const hpb_Message* msg,
+                         const hpb_MiniTableSub* subs,
+                         const hpb_MiniTableField* field) {
+  switch (hpb_FieldMode_Get(field)) {
+    case kHpb_FieldMode_Array:
+      return size_array(s, msg, subs, field);
+    case kHpb_FieldMode_Map:
+      return size_map(s, msg, subs, field);
+    case kHpb_FieldMode_Scalar:
+      return size_scalar(s, HPB_PTR_AT(msg, field->offset, void), subs, field);
+    default:
+      HPB_UNREACHABLE();
+  }
+}
+
+static size_t size_msgset_item(hpb_sizestate* s,
+                               const hpb_Message_Extension* ext) {
+  size_t slot = size_pushslot(s);
+  size_t size = size_message(s, ext->data.ptr, ext->ext->sub.submsg);
+  size_setslot(s, slot, size);
+  return size_tag(kHpb_MsgSet_Item, kHpb_WireType_StartGroup) +
+         size_tag(kHpb_MsgSet_TypeId, kHpb_WireType_Varint) +
+         _hpb_Encoder_VarintSize(ext->ext->field.number) +
+         size_tag(kHpb_MsgSet_Message, kHpb_WireType_Delimited) +
+         size_delimited(size) +
+         size_tag(kHpb_MsgSet_Item, kHpb_WireType_EndGroup);
+}
+
+static size_t size_ext(hpb_sizestate* s, const hpb_Message_Extension* ext,
+                       bool is_message_set) {
+  if (HPB_UNLIKELY(is_message_set)) {
+    return size_msgset_item(s, ext);
+  } else {
+    return size_field(s, &ext->data, &ext->ext->sub, &ext->ext->field);
+  }
+}
+
+static size_t size_message(hpb_sizestate* s, const hpb_Message* msg,
+                           const hpb_MiniTable* m) {
+  size_t size = 0;
+
+  if ((s->options & kHpb_EncodeOption_CheckRequired) && m->required_count) {
+    uint64_t msg_head;
+    memcpy(&msg_head, msg, 8);
+    msg_head = _hpb_BigEndian_Swap64(msg_head);
+    if (hpb_MiniTable_requiredmask(m) & ~msg_head) {
+      size_err(s, kHpb_EncodeStatus_MissingRequired);
+    }
+  }
+
+  if (m->field_count) {
+    const hpb_MiniTableField* f = &m->fields[0];
+    const hpb_MiniTableField* end = &m->fields[m->field_count];
+    for (; f != end; f++) {
+      if (_hpb_Encoder_ShouldEncode(msg, f)) {
+        size += size_field(s, msg, m->subs, f);
+      }
+    }
+  }
+
+  if (m->ext != kHpb_ExtMode_NonExtendable) {
+    // As with map entries, extensions appear in the output in the reverse of
+    // the order the encoder visits them.
+    size_t ext_count;
+    const hpb_Message_Extension* ext = _hpb_Message_Getexts(msg, &ext_count);
+    if (ext_count) {
+      bool is_message_set = m->ext == kHpb_ExtMode_IsMessageSet;
+      if ((s->options & kHpb_EncodeOption_Deterministic) && s->arena) {
+        _hpb_sortedmap sorted;
+        if (!_hpb_mapsorter_pushexts(&s->sorter, ext, ext_count, &sorted)) {
+          size_err(s, kHpb_EncodeStatus_OutOfMemory);
+        }
+        for (int i = sorted.end - 1; i >= sorted.start; i--) {
+          size += size_ext(s, s->sorter.entries[i], is_message_set);
+        }
+        _hpb_mapsorter_popmap(&s->sorter, &sorted);
+      } else {
+        for (size_t i = ext_count; i-- > 0;) {
+          size += size_ext(s, &ext[i], is_message_set);
+        }
+      }
+    }
+  }
+
+  // The payload of an empty message is held as unknown data, so it is kept
+  // even when skipping unknown fields.
+  if ((s->options & kHpb_EncodeOption_SkipUnknown) == 0 ||
+      m == &_kHpb_MiniTable_Empty) {
+    size_t unknown_size;
+    hpb_Message_GetUnknown(msg, &unknown_size);
+    size += unknown_size;
+  }
+
+  return size;
+}
+
+static hpb_EncodeStatus hpb_Encoder_ComputeSize(hpb_sizestate* const s,
+                                                const void* const msg,
+                                                const hpb_MiniTable* const l,
+                                                size_t* const size) {
+  if (HPB_SETJMP(s->err) == 0) {
+    *size = size_message(s, msg, l);
+  } else {
+    HPB_ASSERT(s->status != kHpb_EncodeStatus_Ok);
+    *size = 0;
+  }
+
+  _hpb_mapsorter_destroy(&s->sorter);
+  return s->status;
+}
+
+static void hpb_Encoder_InitSizeState(hpb_sizestate* s, int options,
+                                      hpb_Arena* arena) {
+  unsigned depth = (unsigned)options >> 16;
+
+  s->status = kHpb_EncodeStatus_Ok;
+  s->arena = arena;
+  s->sizes = NULL;
+  s->count = 0;
+  s->cap = 0;
+  s->depth = depth ? depth : kHpb_WireFormat_DefaultDepthLimit;
+  s->options = options;
+  _hpb_mapsorter_init(&s->sorter);
+}
+
+hpb_EncodeStatus hpb_EncodedSize(const void* msg, const hpb_MiniTable* l,
+                                 int options, size_t* size) {
+  hpb_sizestate s;
+  hpb_Encoder_InitSizeState(&s, options, NULL);
+  return hpb_Encoder_ComputeSize(&s, msg, l, size);
+}
+
+hpb_EncodeStatus hpb_EncodedSizes_Compute(const void* msg,
+                                          const hpb_MiniTable* l, int options,
+                                          hpb_Arena* arena,
+                                          hpb_EncodedSizes* sizes) {
+  hpb_sizestate s;
+  HPB_ASSERT(arena);
+  hpb_Encoder_InitSizeState(&s, options, arena);
+  hpb_EncodeStatus status = hpb_Encoder_ComputeSize(&s, msg, l, &sizes->size);
+  sizes->submsg_sizes = s.sizes;
+  sizes->submsg_count = status == kHpb_EncodeStatus_Ok ? s.count : 0;
+  sizes->options = options;
+  return status;
+}
+
+#include "hpb/port/undef.inc"
@@ -30,8 +30,18 @@
 
 #include "hpb/wire/eps_copy_input_stream.h"
 
-static const char* _hpb_EpsCopyInputStream_NoOpCallback(
-    hpb_EpsCopyInputStream* e, const char* old_end, const char* new_start) {
+#include <limits.h>
+
+// Must be last.
+#include "hpb/port/def.inc"
+
+// Chunks larger than this are partially backed up into the stream, so that
+// buffer offsets always fit comfortably in an int.
+#define kHpb_EpsCopyInputStream_MaxChunk (1 << 30)
+
+const char* _hpb_EpsCopyInputStream_NoOpCallback(hpb_EpsCopyInputStream* e,
+                                                 const char* old_end,
+                                                 const char* new_start) {
   return new_start;
 }
 
@@ -40,3 +50,180 @@ const char* _hpb_EpsCopyInputStream_IsDoneFallbackNoCallback(
   return _hpb_EpsCopyInputStream_IsDoneFallbackInline(
       e, ptr, overrun, _hpb_EpsCopyInputStream_NoOpCallback);
 }
+
+// Moves a streaming input forward by one buffer.  The SlopBytes of data at
+// e->end always become the start of the next buffer, so a pointer that is
+// `overrun` bytes past the old e->end is `overrun - shift` bytes past the new
+// one, where `shift` is the return value.  Returns -1 on a stream error.
+//
+// `callback` sees the flip before the old buffer can be overwritten, with the
+// (at most SlopBytes past e->end) point in the old buffer at which reading
+// continues in the new one.
+static int _hpb_EpsCopyInputStream_Flip(
+    hpb_EpsCopyInputStream* e, int overrun,
+    hpb_EpsCopyInputStream_BufferFlipCallback* callback) {
+  const int slop = kHpb_EpsCopyInputStream_SlopBytes;
+  const int seam = HPB_MIN(overrun, slop);
+  HPB_ASSERT(!e->stream_eof);
+
+  if (e->next_chunk) {
+    // The data at e->end was copied from the front of next_chunk, so we can
+    // continue reading from next_chunk directly.
+    const char* chunk = e->next_chunk;
+    int shift = (int)e->next_chunk_size - slop;
+    callback(e, e->end + seam, chunk + seam);
+    e->end = chunk + shift;
+    e->next_chunk = NULL;
+    return shift;
+  }
+
+  callback(e, e->end + seam, e->patch + seam);
+  memmove(e->patch, e->end, slop);
+  e->end = e->patch + slop;
+
+  size_t size;
+  const char* chunk = hpb_ZeroCopyInputStream_Next(e->stream, &size, e->status);
+  if (!chunk) {
+    if (!hpb_Status_IsOk(e->status)) return -1;
+    memset(e->patch + slop, 0, slop);
+    e->stream_eof = true;
+    return slop;
+  }
+
+  if (size > kHpb_EpsCopyInputStream_MaxChunk) {
+    hpb_ZeroCopyInputStream_BackUp(e->stream,
+                                   size - kHpb_EpsCopyInputStream_MaxChunk);
+    size = kHpb_EpsCopyInputStream_MaxChunk;
+  }
+
+  if (size > (size_t)slop) {
+    // Copy just enough to cover the seam and switch to the chunk itself on
+    // the next flip.
+    memcpy(e->patch + slop, chunk, slop);
+    e->next_chunk = chunk;
+    e->next_chunk_size = size;
+    return slop;
+  }
+
+  // Small chunks are consumed entirely by the patch buffer.
+  memset(e->patch + slop, 0, slop);
+  memcpy(e->patch + slop, chunk, size);
+  e->end = e->patch + size;
+  return (int)size;
+}
+
+// Flips buffers until `*overrun` is no more than `max_overrun` or the stream is
+// exhausted.  Returns false on a stream error.
+static bool _hpb_EpsCopyInputStream_Advance(
+    hpb_EpsCopyInputStream* e, int* overrun, int max_overrun,
+    hpb_EpsCopyInputStream_BufferFlipCallback* callback) {
+  while (*overrun > max_overrun && !e->stream_eof) {
+    int shift = _hpb_EpsCopyInputStream_Flip(e, *overrun, callback);
+    if (shift < 0) return false;
+    *overrun -= shift;
+    e->limit -= shift;
+    e->stream_limit -= shift;
+  }
+  e->limit_ptr = e->end + HPB_MIN(0, e->limit);
+  return true;
+}
+
+bool hpb_EpsCopyInputStream_InitStream(hpb_EpsCopyInputStream* e,
+                                       const char** ptr,
+                                       hpb_ZeroCopyInputStream* stream,
+                                       hpb_Status* status) {
+  // Start from an empty buffer that ends SlopBytes before the stream does, and
+  // let the regular flipping logic fill the patch buffer.
+  int overrun = kHpb_EpsCopyInputStream_SlopBytes;
+  memset(e->patch, 0, sizeof(e->patch));
+  e->end = e->patch + kHpb_EpsCopyInputStream_SlopBytes;
+  e->limit = INT_MAX;
+  e->aliasing = kHpb_EpsCopyInputStream_NoAliasing;
+  e->error = false;
+  e->stream = stream;
+  e->status = status;
+  e->next_chunk = NULL;
+  e->next_chunk_size = 0;
+  e->stream_limit = INT_MAX;
+  e->stream_eof = false;
+  hpb_Status_Clear(status);
+  if (!_hpb_EpsCopyInputStream_Advance(e, &overrun, -1,
+                                       _hpb_EpsCopyInputStream_NoOpCallback)) {
+    e->error = true;
+    return false;
+  }
+  *ptr = e->end + overrun;
+  return true;
+}
+
+const char* _hpb_EpsCopyInputStream_IsDoneFallbackStream(
+    hpb_EpsCopyInputStream* e, const char* ptr, int overrun,
+    hpb_EpsCopyInputStream_BufferFlipCallback* callback) {
+  HPB_UNUSED(ptr);
+  if (overrun < e->limit &&
+      _hpb_EpsCopyInputStream_Advance(e, &overrun, -1, callback)) {
+    if (overrun < 0) {
+      HPB_ASSERT(e->end + overrun < e->limit_ptr);
+      return e->end + overrun;
+    }
+    if (overrun == 0 && e->limit == e->stream_limit) {
+      // Clean end of stream, outside of any pushed limit.
+      return callback(e, NULL, NULL);
+    }
+  }
+  e->error = true;
+  return callback(e, NULL, NULL);
+}
+
+const char* _hpb_EpsCopyInputStream_SkipFallback(
+    hpb_EpsCopyInputStream* e, const char* ptr, int size,
+    hpb_EpsCopyInputStream_BufferFlipCallback* callback) {
+  if (!e->stream || size < 0 ||
+      !hpb_EpsCopyInputStream_CheckSize(e, ptr, size)) {
+    return NULL;
+  }
+  int overrun = (int)(ptr - e->end) + size;
+  if (_hpb_EpsCopyInputStream_Advance(e, &overrun,
+                                      kHpb_EpsCopyInputStream_SlopBytes,
+                                      callback) &&
+      overrun <= (e->stream_eof ? 0 : kHpb_EpsCopyInputStream_SlopBytes)) {
+    return e->end + overrun;
+  }
+  e->error = true;
+  return callback(e, NULL, NULL);
+}
+
+const char* _hpb_EpsCopyInputStream_CopyFallback(hpb_EpsCopyInputStream* e,
+                                                 const char* ptr, void* to,
+                                                 int size) {
+  if (!e->stream || size < 0 ||
+      !hpb_EpsCopyInputStream_CheckSize(e, ptr, size)) {
+    return NULL;
+  }
+  char* dst = to;
+  int overrun = (int)(ptr - e->end);
+  while (true) {
+    int avail = -overrun;
+    if (!e->stream_eof) avail += kHpb_EpsCopyInputStream_SlopBytes;
+    if (size <= avail) break;
+    if (e->stream_eof) goto err;
+    if (avail > 0) {
+      memcpy(dst, e->end + overrun, avail);
+      dst += avail;
+      size -= avail;
+      overrun += avail;
+    }
+    if (!_hpb_EpsCopyInputStream_Advance(
+            e, &overrun, -1, _hpb_EpsCopyInputStream_NoOpCallback)) {
+      goto err;
+    }
+  }
+  memcpy(dst, e->end + overrun, size);
+  return e->end + overrun + size;
+
+err:
+  e->error = true;
+  return NULL;
+}
+
+#include "hpb/port/undef.inc"
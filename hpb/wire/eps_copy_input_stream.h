@@ -33,6 +33,8 @@
 
 #include <string.h>
 
+#include "hpb/base/status.h"
+#include "hpb/io/zero_copy_input_stream.h"
 #include "hpb/mem/arena.h"
 
 // Must be last.
@@ -63,6 +65,15 @@ typedef struct {
   int limit;              // Submessage limit relative to end
   bool error;             // To distinguish between EOF and error.
   char patch[kHpb_EpsCopyInputStream_SlopBytes * 2];
+
+  // The members below are only used when reading from a
+  // hpb_ZeroCopyInputStream (see hpb_EpsCopyInputStream_InitStream()).
+  hpb_ZeroCopyInputStream* stream;  // NULL when reading a flat buffer.
+  hpb_Status* status;               // Receives errors from `stream`.
+  const char* next_chunk;  // If non-NULL, its first SlopBytes are at end.
+  size_t next_chunk_size;
+  int stream_limit;  // Limit of the overall stream, relative to end.
+  bool stream_eof;   // `stream` has no more data beyond end.
 } hpb_EpsCopyInputStream;
 
 // Returns true if the stream is in the error state. A stream enters the error
@@ -100,6 +111,28 @@ HPB_INLINE void hpb_EpsCopyInputStream_Init(hpb_EpsCopyInputStream* e,
   }
   e->limit_ptr = e->end;
   e->error = false;
+  e->stream = NULL;
+}
+
+// Initializes a hpb_EpsCopyInputStream that reads its data incrementally from
+// `stream`, setting `*ptr` to the beginning of the data.  Aliasing is never
+// available, since buffers returned by `stream` only live until the next call
+// to hpb_ZeroCopyInputStream_Next().
+//
+// The end of the stream acts as the outermost limit.  It is reported by
+// hpb_EpsCopyInputStream_IsDone() as a NULL pointer with IsError() == false.
+// Streams longer than INT_MAX bytes cannot be read.
+//
+// Returns false if `stream` reported an error, which is stored in `status`.
+bool hpb_EpsCopyInputStream_InitStream(hpb_EpsCopyInputStream* e,
+                                       const char** ptr,
+                                       hpb_ZeroCopyInputStream* stream,
+                                       hpb_Status* status);
+
+// Returns true if the stream was initialized by InitStream() and all of its
+// data has been consumed.
+HPB_INLINE bool hpb_EpsCopyInputStream_IsStreamEof(hpb_EpsCopyInputStream* e) {
+  return e->stream && e->stream_eof;
 }
 
 typedef enum {
@@ -248,8 +281,8 @@ HPB_INLINE bool hpb_EpsCopyInputStream_AliasingEnabled(
 // alias into the region [ptr, size] in an input buffer.
 HPB_INLINE bool hpb_EpsCopyInputStream_AliasingAvailable(
     hpb_EpsCopyInputStream* e, const char* ptr, size_t size) {
-  // When EpsCopyInputStream supports streaming, this will need to become a
-  // runtime check.
+  // Streams created with InitStream() never enable aliasing, so this does not
+  // need to account for buffer seams.
   return hpb_EpsCopyInputStream_CheckDataSizeAvailable(e, ptr, size) &&
          e->aliasing >= kHpb_EpsCopyInputStream_NoDelta;
 }
@@ -284,11 +317,32 @@ HPB_INLINE const char* hpb_EpsCopyInputStream_ReadStringAliased(
   return ret;
 }
 
+const char* _hpb_EpsCopyInputStream_NoOpCallback(hpb_EpsCopyInputStream* e,
+                                                 const char* old_end,
+                                                 const char* new_start);
+
+// Slow path of hpb_EpsCopyInputStream_Skip(), for data that extends past the
+// current buffer of a stream.  `callback` is invoked at every buffer flip, as
+// with hpb_EpsCopyInputStream_IsDoneWithCallback().  Returns NULL for flat
+// buffers, and calls `callback(e, NULL, NULL)` if the stream ends early.
+const char* _hpb_EpsCopyInputStream_SkipFallback(
+    hpb_EpsCopyInputStream* e, const char* ptr, int size,
+    hpb_EpsCopyInputStream_BufferFlipCallback* callback);
+
+// Slow path of hpb_EpsCopyInputStream_Copy(), for data that extends past the
+// current buffer of a stream.  Returns NULL for flat buffers.
+const char* _hpb_EpsCopyInputStream_CopyFallback(hpb_EpsCopyInputStream* e,
+                                                 const char* ptr, void* to,
+                                                 int size);
+
 // Skips `size` bytes of data from the input and returns a pointer past the end.
 // Returns NULL on end of stream or error.
 HPB_INLINE const char* hpb_EpsCopyInputStream_Skip(hpb_EpsCopyInputStream* e,
                                                    const char* ptr, int size) {
-  if (!hpb_EpsCopyInputStream_CheckDataSizeAvailable(e, ptr, size)) return NULL;
+  if (!hpb_EpsCopyInputStream_CheckDataSizeAvailable(e, ptr, size)) {
+    return _hpb_EpsCopyInputStream_SkipFallback(
+        e, ptr, size, _hpb_EpsCopyInputStream_NoOpCallback);
+  }
   return ptr + size;
 }
 
@@ -297,7 +351,9 @@ HPB_INLINE const char* hpb_EpsCopyInputStream_Skip(hpb_EpsCopyInputStream* e,
 HPB_INLINE const char* hpb_EpsCopyInputStream_Copy(hpb_EpsCopyInputStream* e,
                                                    const char* ptr, void* to,
                                                    int size) {
-  if (!hpb_EpsCopyInputStream_CheckDataSizeAvailable(e, ptr, size)) return NULL;
+  if (!hpb_EpsCopyInputStream_CheckDataSizeAvailable(e, ptr, size)) {
+    return _hpb_EpsCopyInputStream_CopyFallback(e, ptr, to, size);
+  }
   memcpy(to, ptr, size);
   return ptr + size;
 }
@@ -316,7 +372,8 @@ HPB_INLINE const char* hpb_EpsCopyInputStream_ReadString(
     return hpb_EpsCopyInputStream_ReadStringAliased(e, ptr, size);
   } else {
     // We need to allocate and copy.
-    if (!hpb_EpsCopyInputStream_CheckDataSizeAvailable(e, *ptr, size)) {
+    if (!hpb_EpsCopyInputStream_CheckDataSizeAvailable(e, *ptr, size) &&
+        (!e->stream || !hpb_EpsCopyInputStream_CheckSize(e, *ptr, size))) {
       return NULL;
     }
     HPB_ASSERT(arena);
@@ -363,10 +420,17 @@ HPB_INLINE void hpb_EpsCopyInputStream_PopLimit(hpb_EpsCopyInputStream* e,
   _hpb_EpsCopyInputStream_CheckLimit(e);
 }
 
+const char* _hpb_EpsCopyInputStream_IsDoneFallbackStream(
+    hpb_EpsCopyInputStream* e, const char* ptr, int overrun,
+    hpb_EpsCopyInputStream_BufferFlipCallback* callback);
+
 HPB_INLINE const char* _hpb_EpsCopyInputStream_IsDoneFallbackInline(
     hpb_EpsCopyInputStream* e, const char* ptr, int overrun,
     hpb_EpsCopyInputStream_BufferFlipCallback* callback) {
-  if (overrun < e->limit) {
+  if (HPB_UNLIKELY(e->stream)) {
+    return _hpb_EpsCopyInputStream_IsDoneFallbackStream(e, ptr, overrun,
+                                                        callback);
+  } else if (overrun < e->limit) {
     // Need to copy remaining data into patch buffer.
     HPB_ASSERT(overrun < kHpb_EpsCopyInputStream_SlopBytes);
     const char* old_end = ptr;
@@ -0,0 +1,95 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "hpb/wire/field_mask.h"
+
+#include <string.h>
+
+#include "hpb/mini_table/field.h"
+#include "hpb/wire/internal/field_mask.h"
+
+// Must be last.
+#include "hpb/port/def.inc"
+
+hpb_FieldMask* hpb_FieldMask_New(const hpb_MiniTable* m, hpb_Arena* arena) {
+  size_t words = (m->field_count + 63) / 64;
+  size_t fields_size = HPB_MAX(words, 1) * sizeof(uint64_t);
+  size_t subs_size = HPB_MAX(m->field_count, 1) * sizeof(hpb_FieldMask*);
+  hpb_FieldMask* mask = hpb_Arena_Malloc(arena, sizeof(*mask));
+  if (!mask) return NULL;
+  mask->table = m;
+  mask->fields = hpb_Arena_Malloc(arena, fields_size);
+  mask->subs = hpb_Arena_Malloc(arena, subs_size);
+  if (!mask->fields || !mask->subs) return NULL;
+  memset(mask->fields, 0, fields_size);
+  memset(mask->subs, 0, subs_size);
+  return mask;
+}
+
+bool hpb_FieldMask_AddPath(hpb_FieldMask* mask, const uint32_t* path,
+                           size_t path_len, hpb_Arena* arena) {
+  if (path_len == 0) return false;
+
+  for (size_t i = 0; i < path_len; i++) {
+    const hpb_MiniTableField* field =
+        hpb_MiniTable_FindFieldByNumber(mask->table, path[i]);
+    if (!field) return false;
+    size_t idx = field - mask->table->fields;
+    uint64_t bit = 1ULL << (idx % 64);
+    bool selected = mask->fields[idx / 64] & bit;
+
+    if (i == path_len - 1) {
+      // Select the whole field, even if only parts of it were selected before.
+      mask->fields[idx / 64] |= bit;
+      mask->subs[idx] = NULL;
+      return true;
+    }
+
+    if (hpb_MiniTableField_CType(field) != kHpb_CType_Message) return false;
+    const hpb_MiniTable* sub =
+        hpb_MiniTable_GetSubMessageTable(mask->table, field);
+    if (!sub) return false;
+
+    // The whole field is already selected.
+    if (selected && !mask->subs[idx]) return true;
+
+    if (!selected) {
+      hpb_FieldMask* child = hpb_FieldMask_New(sub, arena);
+      if (!child) return false;
+      mask->fields[idx / 64] |= bit;
+      mask->subs[idx] = child;
+    }
+    mask = mask->subs[idx];
+  }
+
+  HPB_UNREACHABLE();
+}
+
+#include "hpb/port/undef.inc"
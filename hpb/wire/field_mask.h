@@ -0,0 +1,75 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// hpb_FieldMask: selects the fields that hpb_DecodeWithMask() parses.
+
+#ifndef HPB_WIRE_FIELD_MASK_H_
+#define HPB_WIRE_FIELD_MASK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hpb/mem/arena.h"
+#include "hpb/mini_table/message.h"
+
+// Must be last.
+#include "hpb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A field mask is a tree with one node per selected sub-message field, each
+// holding a bitset of the selected fields of its MiniTable.  A field selected
+// without naming any of its own fields is selected in its entirety.
+//
+// Map fields are treated as repeated entry messages, with the key as field 1
+// and the value as field 2.
+typedef struct hpb_FieldMask hpb_FieldMask;
+
+// Creates an empty mask for messages of type `m`, which selects no fields.
+HPB_API hpb_FieldMask* hpb_FieldMask_New(const hpb_MiniTable* m,
+                                         hpb_Arena* arena);
+
+// Selects the field reached by following the field numbers in `path` from
+// the mask's message type, for example {5, 2} to select field 2 of the
+// sub-message in field 5 (and nothing else of field 5).  Every field on the
+// path but the last must be a linked message or group field.  Returns false
+// if the path does not name such a field, or on allocation failure.
+HPB_API bool hpb_FieldMask_AddPath(hpb_FieldMask* mask, const uint32_t* path,
+                                   size_t path_len, hpb_Arena* arena);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "hpb/port/undef.inc"
+
+#endif /* HPB_WIRE_FIELD_MASK_H_ */
@@ -36,10 +36,12 @@
 #ifndef HPB_WIRE_INTERNAL_DECODE_H_
 #define HPB_WIRE_INTERNAL_DECODE_H_
 
+#include "hpb/collections/map.h"
 #include "hpb/mem/internal/arena.h"
 #include "hpb/message/internal/message.h"
 #include "hpb/wire/decode.h"
 #include "hpb/wire/eps_copy_input_stream.h"
+#include "hpb/wire/field_mask.h"
 #include "utf8_range.h"
 
 // Must be last.
@@ -56,6 +58,7 @@ typedef struct hpb_Decoder {
   uint32_t end_group;  // field number of END_GROUP tag, else DECODE_NOGROUP.
   uint16_t options;
   bool missing_required;
+  const hpb_FieldMask* mask;  // Fields to parse at this level, NULL for all.
   hpb_Arena arena;
   hpb_DecodeStatus status;
   jmp_buf err;
@@ -105,14 +108,24 @@ const char* _hpb_Decoder_CheckRequired(hpb_Decoder* d, const char* ptr,
                                        const hpb_Message* msg,
                                        const hpb_MiniTable* l);
 
-/* x86-64 pointers always have the high 16 bits matching. So we can shift
- * left 8 and right 8 without loss of information. */
+// Creates the map for a map field whose entries are described by `entry`.
+hpb_Map* _hpb_Decoder_CreateMap(hpb_Decoder* d, const hpb_MiniTable* entry);
+
+/* Packs the table pointer and its mask into one argument for the fasttable
+ * parsers.  This relies on user-space addresses fitting in 48 bits, as they do
+ * on x86-64 and aarch64 (the only targets with HPB_FASTTABLE_SUPPORTED), so
+ * that the top 16 bits of a pointer are free and we can shift left 16 and
+ * right 16 without loss of information.  Kernels with larger address spaces
+ * only hand out such addresses on request; tagged pointers (aarch64 TBI, MTE)
+ * are not supported. */
 HPB_INLINE intptr_t decode_totable(const hpb_MiniTable* tablep) {
-  return ((intptr_t)tablep << 8) | tablep->table_mask;
+  intptr_t ret = ((intptr_t)tablep << 16) | tablep->table_mask;
+  HPB_ASSERT((const hpb_MiniTable*)(ret >> 16) == tablep);
+  return ret;
 }
 
 HPB_INLINE const hpb_MiniTable* decode_totablep(intptr_t table) {
-  return (const hpb_MiniTable*)(table >> 8);
+  return (const hpb_MiniTable*)(table >> 16);
 }
 
 const char* _hpb_Decoder_IsDoneFallback(hpb_EpsCopyInputStream* e,
@@ -126,7 +139,13 @@ HPB_INLINE bool _hpb_Decoder_IsDone(hpb_Decoder* d, const char** ptr) {
 HPB_INLINE const char* _hpb_Decoder_BufferFlipCallback(
     hpb_EpsCopyInputStream* e, const char* old_end, const char* new_start) {
   hpb_Decoder* d = (hpb_Decoder*)e;
-  if (!old_end) _hpb_FastDecoder_ErrorJmp(d, kHpb_DecodeStatus_Malformed);
+  if (!old_end) {
+    // Either an error, or the clean end of a streaming input.
+    if (hpb_EpsCopyInputStream_IsError(e)) {
+      _hpb_FastDecoder_ErrorJmp(d, kHpb_DecodeStatus_Malformed);
+    }
+    return NULL;
+  }
 
   if (d->unknown) {
     if (!_hpb_Message_AddUnknown(d->unknown_msg, d->unknown,
@@ -144,7 +163,7 @@ const char* _hpb_FastDecoder_TagDispatch(hpb_Decoder* d, const char* ptr,
                                          hpb_Message* msg, intptr_t table,
                                          uint64_t hasbits, uint64_t tag) {
   const hpb_MiniTable* table_p = decode_totablep(table);
-  uint8_t mask = table;
+  uint16_t mask = table;
   uint64_t data;
   size_t idx = tag & mask;
   HPB_ASSUME((idx & 7) == 0);
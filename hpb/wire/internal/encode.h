@@ -0,0 +1,121 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Helpers shared by the encoders in hpb/wire/.
+
+#ifndef HPB_WIRE_INTERNAL_ENCODE_H_
+#define HPB_WIRE_INTERNAL_ENCODE_H_
+
+#include <string.h>
+
+#include "hpb/collections/internal/map.h"
+#include "hpb/message/internal/accessors.h"
+#include "hpb/message/internal/map_entry.h"
+
+// Must be last.
+#include "hpb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HPB_PB_VARINT_MAX_LEN 10
+
+HPB_INLINE uint32_t _hpb_Encoder_ZigZag32(int32_t n) {
+  return ((uint32_t)n << 1) ^ (n >> 31);
+}
+
+HPB_INLINE uint64_t _hpb_Encoder_ZigZag64(int64_t n) {
+  return ((uint64_t)n << 1) ^ (n >> 63);
+}
+
+HPB_INLINE size_t _hpb_Encoder_VarintSize(uint64_t val) {
+  size_t ret = 1;
+  while (val >= 0x80) {
+    val >>= 7;
+    ret++;
+  }
+  return ret;
+}
+
+// Returns true if `f` has a value in `msg` that must be serialized.
+HPB_INLINE bool _hpb_Encoder_ShouldEncode(const hpb_Message* msg,
+                                          const hpb_MiniTableField* f) {
+  if (f->presence == 0) {
+    /* Proto3 presence or map/array. */
+    const void* mem = HPB_PTR_AT(msg, f->offset, void);
+    switch (_hpb_MiniTableField_GetRep(f)) {
+      case kHpb_FieldRep_1Byte: {
+        char ch;
+        memcpy(&ch, mem, 1);
+        return ch != 0;
+      }
+      case kHpb_FieldRep_4Byte: {
+        uint32_t u32;
+        memcpy(&u32, mem, 4);
+        return u32 != 0;
+      }
+      case kHpb_FieldRep_8Byte: {
+        uint64_t u64;
+        memcpy(&u64, mem, 8);
+        return u64 != 0;
+      }
+      case kHpb_FieldRep_StringView: {
+        const hpb_StringView* str = (const hpb_StringView*)mem;
+        return str->size != 0;
+      }
+      default:
+        HPB_UNREACHABLE();
+    }
+  } else if (f->presence > 0) {
+    /* Proto2 presence: hasbit. */
+    return _hpb_hasbit_field(msg, f);
+  } else {
+    /* Field is in a oneof. */
+    return _hpb_getoneofcase_field(msg, f) == f->number;
+  }
+}
+
+// Unpacks the key and value stored in a map's table entry.
+HPB_INLINE void _hpb_Encoder_GetMapEntry(const hpb_Map* map,
+                                         const hpb_tabent* tabent,
+                                         hpb_MapEntry* ent) {
+  hpb_value val = {tabent->val.val};
+  _hpb_map_fromtabkey(tabent->key, &ent->data.k, map->key_size);
+  _hpb_map_fromvalue(val, &ent->data.v, map->val_size);
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "hpb/port/undef.inc"
+
+#endif /* HPB_WIRE_INTERNAL_ENCODE_H_ */
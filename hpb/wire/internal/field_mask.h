@@ -0,0 +1,75 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef HPB_WIRE_INTERNAL_FIELD_MASK_H_
+#define HPB_WIRE_INTERNAL_FIELD_MASK_H_
+
+#include "hpb/mini_table/message.h"
+#include "hpb/wire/field_mask.h"
+
+// Must be last.
+#include "hpb/port/def.inc"
+
+struct hpb_FieldMask {
+  const hpb_MiniTable* table;
+
+  // Bit i is set if table->fields[i] is selected.
+  uint64_t* fields;
+
+  // For each selected sub-message field, the mask for its sub-message, or NULL
+  // if the sub-message is selected in its entirety.
+  hpb_FieldMask** subs;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns true if `field` is selected by `mask`, and sets `*sub` to the mask
+// that applies to its value (NULL if there is none).
+HPB_INLINE bool _hpb_FieldMask_Select(const hpb_FieldMask* mask,
+                                      const hpb_MiniTableField* field,
+                                      const hpb_FieldMask** sub) {
+  const hpb_MiniTable* t = mask->table;
+  // Extensions and unknown fields are never selected.
+  if (field < t->fields || field >= t->fields + t->field_count) return false;
+  size_t idx = field - t->fields;
+  if (!(mask->fields[idx / 64] & (1ULL << (idx % 64)))) return false;
+  *sub = mask->subs[idx];
+  return true;
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "hpb/port/undef.inc"
+
+#endif /* HPB_WIRE_INTERNAL_FIELD_MASK_H_ */
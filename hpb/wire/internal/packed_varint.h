@@ -0,0 +1,243 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Block decoder and element counter for packed varint arrays.  A 16-byte
+// vector load and a movemask locate the terminating byte of every varint in
+// the block at once, after which each varint is extracted with a single
+// unaligned load and a few shifts, without a branch per byte.
+
+#ifndef HPB_WIRE_INTERNAL_PACKED_VARINT_H_
+#define HPB_WIRE_INTERNAL_PACKED_VARINT_H_
+
+#include <stdint.h>
+#include <string.h>
+
+// Must be last.
+#include "hpb/port/def.inc"
+
+// SSE2 and NEON are part of the x86-64 and AArch64 baselines, so the vector
+// path is chosen at compile time.  It relies on little-endian stores.
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define HPB_PACKED_VARINT_SIMD 1
+#elif defined(__GNUC__) && defined(__ARM_NEON) && defined(__aarch64__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+#define HPB_PACKED_VARINT_SIMD 1
+#else
+#define HPB_PACKED_VARINT_SIMD 0
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if HPB_PACKED_VARINT_SIMD
+
+// Returns a mask with bit i set if byte i of the 16 bytes at `p` has its
+// continuation bit set.
+HPB_FORCEINLINE static uint32_t _hpb_PackedVarint_ContinuationMask(
+    const char* p) {
+#if defined(__SSE2__)
+  return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p));
+#else
+  static const int8_t kShifts[16] = {0, 1, 2, 3, 4, 5, 6, 7,
+                                     0, 1, 2, 3, 4, 5, 6, 7};
+  uint8x16_t bits = vshlq_u8(vshrq_n_u8(vld1q_u8((const uint8_t*)p), 7),
+                             vld1q_s8(kShifts));
+  return vaddv_u8(vget_low_u8(bits)) |
+         ((uint32_t)vaddv_u8(vget_high_u8(bits)) << 8);
+#endif
+}
+
+// Gathers the 7-bit groups of a varint of `len` <= 8 bytes, whose bytes were
+// loaded little-endian into `word`.
+HPB_FORCEINLINE static uint64_t _hpb_PackedVarint_Compress(uint64_t word,
+                                                           int len) {
+  word &= UINT64_MAX >> (64 - len * 8);
+  word = (word & UINT64_C(0x007f007f007f007f)) |
+         ((word & UINT64_C(0x7f007f007f007f00)) >> 1);
+  // Short varints are by far the most common, so skip the later steps when
+  // they have nothing to do.
+  if (len <= 2) return word;
+  word = (word & UINT64_C(0x00003fff00003fff)) |
+         ((word & UINT64_C(0x3fff00003fff0000)) >> 2);
+  if (len <= 4) return word;
+  return (word & UINT64_C(0x000000000fffffff)) |
+         ((word & UINT64_C(0x0fffffff00000000)) >> 4);
+}
+
+HPB_FORCEINLINE static void _hpb_PackedVarint_Store(char* out, uint64_t val,
+                                                    int valbytes,
+                                                    bool zigzag) {
+  if (valbytes == 1) {
+    *out = val != 0;
+  } else if (valbytes == 4) {
+    uint32_t n = (uint32_t)val;
+    if (zigzag) n = (n >> 1) ^ -(int32_t)(n & 1);
+    memcpy(out, &n, 4);
+  } else {
+    if (zigzag) val = (val >> 1) ^ -(int64_t)(val & 1);
+    memcpy(out, &val, 8);
+  }
+}
+
+HPB_FORCEINLINE static const char* _hpb_PackedVarint_ReadBlocks(
+    const char* ptr, const char* end, char* out, size_t max, int valbytes,
+    bool zigzag, size_t* count) {
+  size_t n = 0;
+  while (end - ptr >= 16 && max - n >= 16) {
+    uint32_t cont = _hpb_PackedVarint_ContinuationMask(ptr);
+    if (cont == 0) {
+      // Sixteen single-byte varints.
+      for (int i = 0; i < 16; i++) {
+        _hpb_PackedVarint_Store(out, (uint8_t)ptr[i], valbytes, zigzag);
+        out += valbytes;
+      }
+      ptr += 16;
+      n += 16;
+      continue;
+    }
+
+    // Bit i of `stops` is set if a varint ends at byte i.  A run of ten
+    // continuation bits starts a varint that is longer than ten bytes, which
+    // is left for the caller to report.
+    uint32_t stops = ~cont & 0xffff;
+    uint32_t runs = cont & (cont >> 1);
+    runs &= runs >> 2;
+    runs &= runs >> 4;
+    runs &= runs >> 2;
+    if (runs) stops &= (1u << __builtin_ctz(runs)) - 1;
+    if (!stops) break;
+
+    int start = 0;
+    do {
+      int stop = __builtin_ctz(stops);
+      int len = stop + 1 - start;
+      uint64_t word;
+      memcpy(&word, ptr + start, 8);
+      uint64_t val;
+      if (HPB_LIKELY(len <= 8)) {
+        val = _hpb_PackedVarint_Compress(word, len);
+      } else {
+        val = _hpb_PackedVarint_Compress(word, 8) |
+              ((uint64_t)(ptr[start + 8] & 0x7f) << 56);
+        if (len == 10) {
+          uint8_t top = ptr[start + 9];
+          if (top > 1) break;  // Malformed, also left for the caller.
+          val |= (uint64_t)top << 63;
+        }
+      }
+      _hpb_PackedVarint_Store(out, val, valbytes, zigzag);
+      out += valbytes;
+      n++;
+      start = stop + 1;
+      stops &= stops - 1;
+    } while (stops);
+    ptr += start;
+    if (stops) break;
+  }
+  *count = n;
+  return ptr;
+}
+
+#endif  // HPB_PACKED_VARINT_SIMD
+
+// Decodes up to `max` consecutive varints from `ptr` into `out`, each stored
+// in `valbytes` (1 for bool, 4 or 8) bytes after zigzag decoding if `zigzag`.
+// Only varints that end before `end` are decoded, and at least 8 bytes past
+// `end` must be readable, as is guaranteed by hpb_EpsCopyInputStream.
+//
+// Stops early once fewer than 16 bytes or 16 elements of room are left, or
+// at a malformed varint, so the caller must decode the remainder one varint at
+// a time.  Sets `*count` to the number of varints decoded (always zero
+// without SIMD support) and returns a pointer past the last of them.
+HPB_INLINE const char* _hpb_WireReader_ReadPackedVarints(
+    const char* ptr, const char* end, char* out, size_t max, int valbytes,
+    bool zigzag, size_t* count) {
+#if HPB_PACKED_VARINT_SIMD
+  // Specialize the loop for each element type.
+  switch (valbytes) {
+    case 1:
+      return _hpb_PackedVarint_ReadBlocks(ptr, end, out, max, 1, false, count);
+    case 4:
+      return zigzag ? _hpb_PackedVarint_ReadBlocks(ptr, end, out, max, 4, true,
+                                                   count)
+                    : _hpb_PackedVarint_ReadBlocks(ptr, end, out, max, 4,
+                                                   false, count);
+    default:
+      return zigzag ? _hpb_PackedVarint_ReadBlocks(ptr, end, out, max, 8, true,
+                                                   count)
+                    : _hpb_PackedVarint_ReadBlocks(ptr, end, out, max, 8,
+                                                   false, count);
+  }
+#else
+  HPB_UNUSED(end);
+  HPB_UNUSED(out);
+  HPB_UNUSED(max);
+  HPB_UNUSED(valbytes);
+  HPB_UNUSED(zigzag);
+  *count = 0;
+  return ptr;
+#endif
+}
+
+// Returns the number of varints that end in [ptr, end), which is the number of
+// bytes without a continuation bit.
+HPB_INLINE size_t _hpb_WireReader_CountVarints(const char* ptr,
+                                               const char* end) {
+  size_t n = 0;
+#if HPB_PACKED_VARINT_SIMD
+  // Four masks share one popcount, which is a libgcc call on baseline x86-64.
+  for (; end - ptr >= 64; ptr += 64) {
+    uint64_t mask = _hpb_PackedVarint_ContinuationMask(ptr) |
+                    (uint64_t)_hpb_PackedVarint_ContinuationMask(ptr + 16)
+                        << 16 |
+                    (uint64_t)_hpb_PackedVarint_ContinuationMask(ptr + 32)
+                        << 32 |
+                    (uint64_t)_hpb_PackedVarint_ContinuationMask(ptr + 48)
+                        << 48;
+    n += 64 - __builtin_popcountll(mask);
+  }
+  for (; end - ptr >= 16; ptr += 16) {
+    n += 16 - __builtin_popcount(_hpb_PackedVarint_ContinuationMask(ptr));
+  }
+#endif
+  for (; ptr < end; ptr++) n += (*ptr & 0x80) == 0;
+  return n;
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "hpb/port/undef.inc"
+
+#endif /* HPB_WIRE_INTERNAL_PACKED_VARINT_H_ */
@@ -0,0 +1,443 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "hpb/wire/record_file.h"
+
+#include <string.h>
+
+#include "hpb/hash/crc32c.h"
+
+// Must be last.
+#include "hpb/port/def.inc"
+
+static const char kHpb_RecordFile_Magic[8] = {'h', 'p', 'b', 'r',
+                                              'e', 'c', '\n', '\0'};
+static const char kHpb_RecordFile_IndexMagic[4] = {'h', 'p', 'b', 'i'};
+
+enum {
+  kHpb_RecordFile_Version = 1,
+  kHpb_RecordFile_HeaderSize = 16,
+  kHpb_RecordFile_RecordHeaderSize = 8,
+  kHpb_RecordFile_IndexEntrySize = 16,
+  kHpb_RecordFile_TrailerSize = 32,
+  kHpb_RecordFile_DefaultBlockSize = 1 << 20,
+};
+
+static void hpb_RecordFile_Put32(char* p, uint32_t val) {
+  for (int i = 0; i < 4; i++) p[i] = (char)(val >> (8 * i));
+}
+
+static void hpb_RecordFile_Put64(char* p, uint64_t val) {
+  for (int i = 0; i < 8; i++) p[i] = (char)(val >> (8 * i));
+}
+
+static uint32_t hpb_RecordFile_Get32(const char* p) {
+  uint32_t val = 0;
+  for (int i = 0; i < 4; i++) val |= (uint32_t)(uint8_t)p[i] << (8 * i);
+  return val;
+}
+
+static uint64_t hpb_RecordFile_Get64(const char* p) {
+  uint64_t val = 0;
+  for (int i = 0; i < 8; i++) val |= (uint64_t)(uint8_t)p[i] << (8 * i);
+  return val;
+}
+
+typedef struct {
+  uint64_t offset;        // Of the first record, from the start of the file.
+  uint64_t first_record;  // Number of the first record.
+} hpb_RecordFile_Block;
+
+struct hpb_RecordWriter {
+  hpb_ZeroCopyOutputStream* stream;
+  hpb_Arena* arena;          // Holds the index.
+  hpb_Arena* scratch;        // Holds the current record.
+  int options;
+  size_t block_size;
+  uint64_t offset;           // Bytes written so far.
+  uint64_t block_end;        // Offset at which the current block is full.
+  uint64_t record_count;
+  hpb_RecordFile_Block* blocks;
+  size_t block_count;
+  size_t block_capacity;
+  uint32_t crc;              // Of the header, then of the index.
+  bool finished;
+};
+
+static bool hpb_RecordWriter_Put(hpb_RecordWriter* w, const char* data,
+                                 size_t size, hpb_Status* status) {
+  w->offset += size;
+  while (size) {
+    size_t avail;
+    char* buf = hpb_ZeroCopyOutputStream_Next(w->stream, &avail, status);
+    if (!buf) return false;
+    size_t n = HPB_MIN(avail, size);
+    memcpy(buf, data, n);
+    data += n;
+    size -= n;
+    if (n < avail) hpb_ZeroCopyOutputStream_BackUp(w->stream, avail - n);
+  }
+  return true;
+}
+
+hpb_RecordWriter* hpb_RecordWriter_New(hpb_ZeroCopyOutputStream* stream,
+                                       size_t block_size, int encode_options,
+                                       hpb_Arena* arena, hpb_Status* status) {
+  if (block_size == 0) block_size = kHpb_RecordFile_DefaultBlockSize;
+  if (block_size > UINT32_MAX) {
+    hpb_Status_SetErrorMessage(status, "record file block size too large");
+    return NULL;
+  }
+  hpb_RecordWriter* w = hpb_Arena_Malloc(arena, sizeof(*w));
+  if (!w) goto oom;
+  w->scratch = hpb_Arena_New();
+  if (!w->scratch) goto oom;
+  w->stream = stream;
+  w->arena = arena;
+  w->options = encode_options;
+  w->block_size = block_size;
+  w->offset = 0;
+  w->block_end = 0;
+  w->record_count = 0;
+  w->blocks = NULL;
+  w->block_count = 0;
+  w->block_capacity = 0;
+  w->finished = false;
+
+  char header[kHpb_RecordFile_HeaderSize];
+  memcpy(header, kHpb_RecordFile_Magic, 8);
+  hpb_RecordFile_Put32(header + 8, kHpb_RecordFile_Version);
+  hpb_RecordFile_Put32(header + 12, (uint32_t)block_size);
+  w->crc = hpb_Crc32c(header, sizeof(header));
+  if (!hpb_RecordWriter_Put(w, header, sizeof(header), status)) {
+    hpb_RecordWriter_Free(w);
+    return NULL;
+  }
+  w->block_end = w->offset;
+  return w;
+
+oom:
+  hpb_Status_SetErrorMessage(status, "out of memory");
+  return NULL;
+}
+
+// Starts a new block at the current offset if the current one is full.
+static bool hpb_RecordWriter_StartRecord(hpb_RecordWriter* w,
+                                         hpb_Status* status) {
+  if (w->offset < w->block_end) return true;
+  if (w->block_count == w->block_capacity) {
+    size_t old = w->block_capacity * sizeof(*w->blocks);
+    size_t capacity = HPB_MAX(8, w->block_capacity * 2);
+    void* blocks = hpb_Arena_Realloc(w->arena, w->blocks, old,
+                                     capacity * sizeof(*w->blocks));
+    if (!blocks) {
+      hpb_Status_SetErrorMessage(status, "out of memory");
+      return false;
+    }
+    w->blocks = blocks;
+    w->block_capacity = capacity;
+  }
+  hpb_RecordFile_Block* block = &w->blocks[w->block_count++];
+  block->offset = w->offset;
+  block->first_record = w->record_count;
+  w->block_end = w->offset + w->block_size;
+  return true;
+}
+
+bool hpb_RecordWriter_WriteRecord(hpb_RecordWriter* w, const char* data,
+                                  size_t size, hpb_Status* status) {
+  HPB_ASSERT(!w->finished);
+  if (size > UINT32_MAX) {
+    hpb_Status_SetErrorMessage(status, "record too large");
+    return false;
+  }
+  if (!hpb_RecordWriter_StartRecord(w, status)) return false;
+
+  char header[kHpb_RecordFile_RecordHeaderSize];
+  hpb_RecordFile_Put32(header, (uint32_t)size);
+  uint32_t crc = hpb_Crc32c(header, 4);
+  crc = hpb_Crc32c_Extend(crc, data, size);
+  hpb_RecordFile_Put32(header + 4, crc);
+  if (!hpb_RecordWriter_Put(w, header, sizeof(header), status) ||
+      !hpb_RecordWriter_Put(w, data, size, status)) {
+    return false;
+  }
+  w->record_count++;
+  return true;
+}
+
+hpb_EncodeStatus hpb_RecordWriter_Write(hpb_RecordWriter* w, const void* msg,
+                                        const hpb_MiniTable* l,
+                                        hpb_Status* status) {
+  // The arena is never fused, so this cannot fail.
+  hpb_Arena_Reset(w->scratch, SIZE_MAX);
+
+  // The CRC precedes the data, so the record is serialized before any of it
+  // is written.
+  char* buf;
+  size_t size;
+  hpb_EncodeStatus ret =
+      hpb_Encode(msg, l, w->options, w->scratch, &buf, &size);
+  if (ret != kHpb_EncodeStatus_Ok) return ret;
+  if (!hpb_RecordWriter_WriteRecord(w, buf, size, status)) {
+    return kHpb_EncodeStatus_WriteFailed;
+  }
+  return kHpb_EncodeStatus_Ok;
+}
+
+bool hpb_RecordWriter_Finish(hpb_RecordWriter* w, hpb_Status* status) {
+  HPB_ASSERT(!w->finished);
+  w->finished = true;
+  uint64_t index_offset = w->offset;
+  uint32_t crc = w->crc;
+  for (size_t i = 0; i < w->block_count; i++) {
+    char entry[kHpb_RecordFile_IndexEntrySize];
+    hpb_RecordFile_Put64(entry, w->blocks[i].offset);
+    hpb_RecordFile_Put64(entry + 8, w->blocks[i].first_record);
+    crc = hpb_Crc32c_Extend(crc, entry, sizeof(entry));
+    if (!hpb_RecordWriter_Put(w, entry, sizeof(entry), status)) return false;
+  }
+
+  char trailer[kHpb_RecordFile_TrailerSize];
+  hpb_RecordFile_Put64(trailer, index_offset);
+  hpb_RecordFile_Put64(trailer + 8, w->block_count);
+  hpb_RecordFile_Put64(trailer + 16, w->record_count);
+  crc = hpb_Crc32c_Extend(crc, trailer, 24);
+  hpb_RecordFile_Put32(trailer + 24, crc);
+  memcpy(trailer + 28, kHpb_RecordFile_IndexMagic, 4);
+  return hpb_RecordWriter_Put(w, trailer, sizeof(trailer), status);
+}
+
+void hpb_RecordWriter_Free(hpb_RecordWriter* w) {
+  if (w->scratch) hpb_Arena_Free(w->scratch);
+  w->scratch = NULL;
+}
+
+struct hpb_RecordFile {
+  const char* data;
+  const char* index;     // Index entries, still in file format.
+  uint64_t index_offset;
+  size_t block_count;
+  size_t record_count;
+};
+
+static hpb_RecordFile* hpb_RecordFile_Error(hpb_Status* status,
+                                            const char* msg) {
+  hpb_Status_SetErrorMessage(status, msg);
+  return NULL;
+}
+
+static uint64_t hpb_RecordFile_BlockOffset(const hpb_RecordFile* f,
+                                           size_t block) {
+  if (block == f->block_count) return f->index_offset;
+  return hpb_RecordFile_Get64(f->index +
+                              block * kHpb_RecordFile_IndexEntrySize);
+}
+
+hpb_RecordFile* hpb_RecordFile_Open(const char* data, size_t size,
+                                    hpb_Arena* arena, hpb_Status* status) {
+  if (size < kHpb_RecordFile_HeaderSize + kHpb_RecordFile_TrailerSize ||
+      memcmp(data, kHpb_RecordFile_Magic, 8) != 0) {
+    return hpb_RecordFile_Error(status, "not a record file");
+  }
+  if (hpb_RecordFile_Get32(data + 8) != kHpb_RecordFile_Version) {
+    return hpb_RecordFile_Error(status, "unsupported record file version");
+  }
+
+  const char* trailer = data + size - kHpb_RecordFile_TrailerSize;
+  if (memcmp(trailer + 28, kHpb_RecordFile_IndexMagic, 4) != 0) {
+    return hpb_RecordFile_Error(status, "record file has no index");
+  }
+  uint64_t index_offset = hpb_RecordFile_Get64(trailer);
+  uint64_t block_count = hpb_RecordFile_Get64(trailer + 8);
+  uint64_t record_count = hpb_RecordFile_Get64(trailer + 16);
+  uint64_t index_end = size - kHpb_RecordFile_TrailerSize;
+  if (index_offset < kHpb_RecordFile_HeaderSize || index_offset > index_end ||
+      (index_end - index_offset) / kHpb_RecordFile_IndexEntrySize !=
+          block_count ||
+      (index_end - index_offset) % kHpb_RecordFile_IndexEntrySize != 0) {
+    return hpb_RecordFile_Error(status, "corrupt record file index");
+  }
+  uint32_t crc = hpb_Crc32c(data, kHpb_RecordFile_HeaderSize);
+  crc = hpb_Crc32c_Extend(crc, data + index_offset, index_end - index_offset);
+  crc = hpb_Crc32c_Extend(crc, trailer, 24);
+  if (crc != hpb_RecordFile_Get32(trailer + 24)) {
+    return hpb_RecordFile_Error(status, "corrupt record file index");
+  }
+
+  hpb_RecordFile* f = hpb_Arena_Malloc(arena, sizeof(*f));
+  if (!f) return hpb_RecordFile_Error(status, "out of memory");
+  f->data = data;
+  f->index = data + index_offset;
+  f->index_offset = index_offset;
+  f->block_count = block_count;
+  f->record_count = record_count;
+
+  // Blocks must be in order and non-empty, so that iterators can trust the
+  // index.  Record headers are checked against block bounds as they are read.
+  // The first block starts right after the header with record 0, and an empty
+  // file has no blocks.
+  uint64_t prev_offset = kHpb_RecordFile_HeaderSize - 1;
+  uint64_t prev_record = 0;
+  for (size_t i = 0; i < f->block_count; i++) {
+    uint64_t offset = hpb_RecordFile_BlockOffset(f, i);
+    uint64_t first = hpb_RecordFile_BlockStart(f, i);
+    bool ok = i == 0 ? offset == kHpb_RecordFile_HeaderSize && first == 0
+                     : offset > prev_offset && first > prev_record;
+    if (!ok || offset >= index_offset || first >= record_count) {
+      return hpb_RecordFile_Error(status, "corrupt record file index");
+    }
+    prev_offset = offset;
+    prev_record = first;
+  }
+  if (f->block_count == 0 &&
+      (record_count != 0 || index_offset != kHpb_RecordFile_HeaderSize)) {
+    return hpb_RecordFile_Error(status, "corrupt record file index");
+  }
+  return f;
+}
+
+size_t hpb_RecordFile_RecordCount(const hpb_RecordFile* f) {
+  return f->record_count;
+}
+
+size_t hpb_RecordFile_BlockCount(const hpb_RecordFile* f) {
+  return f->block_count;
+}
+
+size_t hpb_RecordFile_BlockStart(const hpb_RecordFile* f, size_t block) {
+  HPB_ASSERT(block <= f->block_count);
+  if (block == f->block_count) return f->record_count;
+  return hpb_RecordFile_Get64(f->index +
+                              block * kHpb_RecordFile_IndexEntrySize + 8);
+}
+
+// Returns the first block whose data starts at or after `offset`.
+static size_t hpb_RecordFile_BlockAtOffset(const hpb_RecordFile* f,
+                                           uint64_t offset) {
+  size_t lo = 0, hi = f->block_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (hpb_RecordFile_BlockOffset(f, mid) < offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// Returns bytes * part / parts without overflowing.
+static uint64_t hpb_RecordFile_Share(uint64_t bytes, size_t part,
+                                     size_t parts) {
+  return bytes / parts * part + bytes % parts * part / parts;
+}
+
+void hpb_RecordFile_Split(const hpb_RecordFile* f, size_t part, size_t parts,
+                          size_t* begin, size_t* end) {
+  HPB_ASSERT(part < parts);
+  // Each part starts with the first block at or after its share of the bytes,
+  // so the parts of consecutive shares abut.
+  uint64_t first = hpb_RecordFile_BlockOffset(f, 0);
+  uint64_t bytes = f->index_offset - first;
+  uint64_t lo = first + hpb_RecordFile_Share(bytes, part, parts);
+  uint64_t hi = first + hpb_RecordFile_Share(bytes, part + 1, parts);
+  size_t begin_block = part == 0 ? 0 : hpb_RecordFile_BlockAtOffset(f, lo);
+  size_t end_block = part + 1 == parts ? f->block_count
+                                       : hpb_RecordFile_BlockAtOffset(f, hi);
+  *begin = hpb_RecordFile_BlockStart(f, begin_block);
+  *end = hpb_RecordFile_BlockStart(f, HPB_MAX(begin_block, end_block));
+}
+
+// Returns the block containing record `record`, which is the last block that
+// starts at or before it.
+static size_t hpb_RecordFile_BlockOfRecord(const hpb_RecordFile* f,
+                                           size_t record) {
+  size_t lo = 0, hi = f->block_count;
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (hpb_RecordFile_BlockStart(f, mid) <= record) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+void hpb_RecordIterator_Init(hpb_RecordIterator* it, const hpb_RecordFile* f,
+                             size_t begin, size_t end) {
+  it->file = f;
+  it->end = HPB_MIN(end, f->record_count);
+  it->index = HPB_MIN(begin, it->end);
+  it->ptr = NULL;
+  if (it->index == it->end) return;
+
+  size_t block = hpb_RecordFile_BlockOfRecord(f, it->index);
+  const char* ptr = f->data + hpb_RecordFile_BlockOffset(f, block);
+  const char* limit = f->data + hpb_RecordFile_BlockOffset(f, block + 1);
+  for (size_t i = hpb_RecordFile_BlockStart(f, block); i < it->index; i++) {
+    size_t avail = limit - ptr;
+    if (avail < kHpb_RecordFile_RecordHeaderSize ||
+        avail - kHpb_RecordFile_RecordHeaderSize < hpb_RecordFile_Get32(ptr)) {
+      // A skipped header is corrupt; make the first call to Next() fail.
+      ptr = f->data + f->index_offset;
+      break;
+    }
+    ptr += kHpb_RecordFile_RecordHeaderSize + hpb_RecordFile_Get32(ptr);
+  }
+  it->ptr = ptr;
+}
+
+bool hpb_RecordIterator_Next(hpb_RecordIterator* it, hpb_StringView* record,
+                             hpb_Status* status) {
+  if (it->index == it->end) return false;
+  const hpb_RecordFile* f = it->file;
+  const char* limit = f->data + f->index_offset;
+  const char* ptr = it->ptr;
+  size_t avail = limit - ptr;
+  if (avail < kHpb_RecordFile_RecordHeaderSize) goto corrupt;
+  uint32_t size = hpb_RecordFile_Get32(ptr);
+  const char* data = ptr + kHpb_RecordFile_RecordHeaderSize;
+  if (avail - kHpb_RecordFile_RecordHeaderSize < size) goto corrupt;
+  uint32_t crc = hpb_Crc32c_Extend(hpb_Crc32c(ptr, 4), data, size);
+  if (crc != hpb_RecordFile_Get32(ptr + 4)) goto corrupt;
+
+  *record = hpb_StringView_FromDataAndSize(data, size);
+  it->ptr = data + size;
+  it->index++;
+  return true;
+
+corrupt:
+  hpb_Status_SetErrorFormat(status, "corrupt record %zu in record file",
+                            it->index);
+  it->index = it->end;
+  return false;
+}
@@ -0,0 +1,157 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// A container for serialized messages that supports checksums, random access
+// and parallel reads.
+//
+// Layout (all integers are little-endian):
+//
+//   file    := header block* index trailer
+//   header  := "hpbrec\n\0" version:u32 block_size:u32
+//   block   := record*
+//   record  := size:u32 crc:u32 data[size]
+//   index   := (offset:u64 first_record:u64)*            one entry per block
+//   trailer := index_offset:u64 block_count:u64 record_count:u64 crc:u32
+//              "hpbi"
+//
+// A record's crc is the CRC32C of its size field and data; the trailer's crc
+// is the CRC32C of the header, the index and the first 24 bytes of the
+// trailer.  A new block starts with the first record written after the
+// current block reaches the block size, so records never straddle blocks and
+// every block can be read on its own, without looking at the records before
+// it.
+
+#ifndef HPB_WIRE_RECORD_FILE_H_
+#define HPB_WIRE_RECORD_FILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hpb/base/status.h"
+#include "hpb/base/string_view.h"
+#include "hpb/io/zero_copy_output_stream.h"
+#include "hpb/mem/arena.h"
+#include "hpb/mini_table/message.h"
+#include "hpb/wire/encode.h"
+
+// Must be last.
+#include "hpb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct hpb_RecordWriter hpb_RecordWriter;
+
+// Creates a writer that writes a record file to `stream`, starting with the
+// header.  A `block_size` of 0 selects a default of 1MB.  Scratch memory for
+// serializing messages is kept in an arena of its own that is released by
+// hpb_RecordWriter_Free(), which must be called before `arena` is freed.
+// Returns NULL on error.
+HPB_API hpb_RecordWriter* hpb_RecordWriter_New(hpb_ZeroCopyOutputStream* stream,
+                                               size_t block_size,
+                                               int encode_options,
+                                               hpb_Arena* arena,
+                                               hpb_Status* status);
+
+// Appends `msg` as a record.  An error from the stream is reported in
+// `status` and as kHpb_EncodeStatus_WriteFailed.
+HPB_API hpb_EncodeStatus hpb_RecordWriter_Write(hpb_RecordWriter* w,
+                                                const void* msg,
+                                                const hpb_MiniTable* l,
+                                                hpb_Status* status);
+
+// Appends `size` bytes of already serialized data as a record.
+HPB_API bool hpb_RecordWriter_WriteRecord(hpb_RecordWriter* w,
+                                          const char* data, size_t size,
+                                          hpb_Status* status);
+
+// Writes the index and trailer.  No records can be written afterwards.
+HPB_API bool hpb_RecordWriter_Finish(hpb_RecordWriter* w, hpb_Status* status);
+
+HPB_API void hpb_RecordWriter_Free(hpb_RecordWriter* w);
+
+typedef struct hpb_RecordFile hpb_RecordFile;
+
+// Opens the record file held in `data`, typically a memory-mapped file, which
+// must outlive the returned object.  The header, trailer and index are checked
+// here; records are checked as they are read.  Returns NULL on error.
+//
+// The returned object is immutable, so any number of threads can read from it
+// at once, each with its own iterator.  Records stay where they are in `data`,
+// so messages decoded with kHpb_DecodeOption_AliasString can point into it.
+HPB_API hpb_RecordFile* hpb_RecordFile_Open(const char* data, size_t size,
+                                            hpb_Arena* arena,
+                                            hpb_Status* status);
+
+HPB_API size_t hpb_RecordFile_RecordCount(const hpb_RecordFile* f);
+HPB_API size_t hpb_RecordFile_BlockCount(const hpb_RecordFile* f);
+
+// Returns the number of the first record in `block`, or the record count if
+// `block` is the block count.
+HPB_API size_t hpb_RecordFile_BlockStart(const hpb_RecordFile* f,
+                                         size_t block);
+
+// Divides the blocks into `parts` runs holding about the same number of bytes
+// and returns the records of run number `part` as [*begin, *end), ready to be
+// passed to hpb_RecordIterator_Init().  The runs of all parts cover every
+// record exactly once.
+HPB_API void hpb_RecordFile_Split(const hpb_RecordFile* f, size_t part,
+                                  size_t parts, size_t* begin, size_t* end);
+
+// Iterates over a range of records.  Members are private.
+typedef struct {
+  const hpb_RecordFile* file;
+  const char* ptr;
+  size_t index;
+  size_t end;
+} hpb_RecordIterator;
+
+// Positions `it` at record `begin`, to stop before record `end`.  The
+// position is found by a binary search over the index followed by a walk over
+// the record headers of one block, which does not look at record data.
+HPB_API void hpb_RecordIterator_Init(hpb_RecordIterator* it,
+                                     const hpb_RecordFile* f, size_t begin,
+                                     size_t end);
+
+// Returns the data of the next record in `*record`, after checking its CRC.
+// Returns false at the end of the range, or with `status` set if the record is
+// corrupt, after which the iterator is at the end of its range.
+HPB_API bool hpb_RecordIterator_Next(hpb_RecordIterator* it,
+                                     hpb_StringView* record,
+                                     hpb_Status* status);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "hpb/port/undef.inc"
+
+#endif  // HPB_WIRE_RECORD_FILE_H_
@@ -0,0 +1,251 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "hpb/wire/record_file.h"
+
+#include <string.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "hpb/base/status.hpp"
+#include "hpb/io/chunked_output_stream.h"
+#include "hpb/mem/arena.hpp"
+#include "hpb/message/accessors.h"
+#include "hpb/mini_descriptor/decode.h"
+#include "hpb/mini_descriptor/internal/encode.hpp"
+#include "hpb/wire/decode.h"
+
+namespace {
+
+// message M {
+//   optional int32 i = 1;
+//   optional string s = 2;
+// }
+hpb_MiniTable* BuildMiniTable(hpb_Arena* arena) {
+  hpb::MtDataEncoder e;
+  e.StartMessage(0);
+  e.PutField(kHpb_FieldType_Int32, 1, 0);
+  e.PutField(kHpb_FieldType_String, 2, 0);
+  hpb::Status status;
+  hpb_MiniTable* table = hpb_MiniTable_Build(e.data().data(), e.data().size(),
+                                             arena, status.ptr());
+  EXPECT_NE(nullptr, table);
+  return table;
+}
+
+std::string RecordString(int i) {
+  return std::string((i * 37) % 400, 'a' + i % 26);
+}
+
+class RecordFileTest : public testing::Test {
+ protected:
+  RecordFileTest() : table_(BuildMiniTable(arena_.ptr())) {}
+
+  // Writes `count` records into blocks of `block_size` bytes through
+  // `chunk`-sized output buffers.
+  std::string Write(int count, size_t block_size, size_t chunk = 64) {
+    std::string out(count * 500 + 1000, '\0');
+    hpb_ZeroCopyOutputStream* stream = hpb_ChunkedOutputStream_New(
+        out.data(), out.size(), chunk, arena_.ptr());
+    hpb::Status status;
+    hpb_RecordWriter* w = hpb_RecordWriter_New(stream, block_size, 0,
+                                               arena_.ptr(), status.ptr());
+    EXPECT_NE(nullptr, w) << status.error_message();
+    for (int i = 0; i < count; i++) {
+      hpb_Message* msg = hpb_Message_New(table_, arena_.ptr());
+      hpb_Message_SetInt32(msg, Field(1), i, nullptr);
+      std::string s = RecordString(i);
+      char* buf = static_cast<char*>(hpb_Arena_Malloc(arena_.ptr(), s.size()));
+      memcpy(buf, s.data(), s.size());
+      hpb_Message_SetString(msg, Field(2),
+                            hpb_StringView_FromDataAndSize(buf, s.size()),
+                            nullptr);
+      EXPECT_EQ(kHpb_EncodeStatus_Ok,
+                hpb_RecordWriter_Write(w, msg, table_, status.ptr()));
+    }
+    EXPECT_TRUE(hpb_RecordWriter_Finish(w, status.ptr()));
+    hpb_RecordWriter_Free(w);
+    out.resize(hpb_ZeroCopyOutputStream_ByteCount(stream));
+    return out;
+  }
+
+  // Decodes records [begin, end) into `arena`, checking their contents.
+  // Returns the number of records read.
+  int Read(const hpb_RecordFile* f, size_t begin, size_t end,
+           hpb_Arena* arena) {
+    hpb_RecordIterator it;
+    hpb_RecordIterator_Init(&it, f, begin, end);
+    hpb_StringView record;
+    hpb::Status status;
+    int count = 0;
+    while (hpb_RecordIterator_Next(&it, &record, status.ptr())) {
+      hpb_Message* msg = hpb_Message_New(table_, arena);
+      EXPECT_EQ(kHpb_DecodeStatus_Ok,
+                hpb_Decode(record.data, record.size, msg, table_, nullptr,
+                           kHpb_DecodeOption_AliasString, arena));
+      int i = begin + count++;
+      EXPECT_EQ(i, hpb_Message_GetInt32(msg, Field(1), -1));
+      hpb_StringView s = hpb_Message_GetString(msg, Field(2), {});
+      EXPECT_EQ(RecordString(i), std::string(s.data, s.size));
+    }
+    EXPECT_TRUE(status.ok()) << status.error_message();
+    return count;
+  }
+
+  const hpb_MiniTableField* Field(uint32_t number) {
+    return hpb_MiniTable_FindFieldByNumber(table_, number);
+  }
+
+  hpb::Arena arena_;
+  hpb_MiniTable* table_;
+};
+
+TEST_F(RecordFileTest, RoundTrip) {
+  for (size_t block_size : {1, 1000, 0}) {
+    for (size_t chunk : {1, 64, 4096}) {
+      SCOPED_TRACE(testing::Message() << block_size << " " << chunk);
+      std::string data = Write(100, block_size, chunk);
+      hpb::Status status;
+      hpb_RecordFile* f = hpb_RecordFile_Open(data.data(), data.size(),
+                                              arena_.ptr(), status.ptr());
+      ASSERT_NE(nullptr, f) << status.error_message();
+      EXPECT_EQ(100, hpb_RecordFile_RecordCount(f));
+      EXPECT_EQ(100, Read(f, 0, SIZE_MAX, arena_.ptr()));
+      if (block_size == 1) {
+        EXPECT_EQ(100, hpb_RecordFile_BlockCount(f));
+      } else if (block_size == 0) {
+        EXPECT_EQ(1, hpb_RecordFile_BlockCount(f));
+      } else {
+        EXPECT_LT(1, hpb_RecordFile_BlockCount(f));
+        EXPECT_GT(100, hpb_RecordFile_BlockCount(f));
+      }
+    }
+  }
+}
+
+TEST_F(RecordFileTest, Empty) {
+  std::string data = Write(0, 1000);
+  hpb::Status status;
+  hpb_RecordFile* f = hpb_RecordFile_Open(data.data(), data.size(),
+                                          arena_.ptr(), status.ptr());
+  ASSERT_NE(nullptr, f) << status.error_message();
+  EXPECT_EQ(0, hpb_RecordFile_RecordCount(f));
+  EXPECT_EQ(0, hpb_RecordFile_BlockCount(f));
+  EXPECT_EQ(0, Read(f, 0, SIZE_MAX, arena_.ptr()));
+  size_t begin, end;
+  hpb_RecordFile_Split(f, 1, 3, &begin, &end);
+  EXPECT_EQ(0, begin);
+  EXPECT_EQ(0, end);
+}
+
+TEST_F(RecordFileTest, RandomAccess) {
+  std::string data = Write(60, 1000);
+  hpb::Status status;
+  hpb_RecordFile* f = hpb_RecordFile_Open(data.data(), data.size(),
+                                          arena_.ptr(), status.ptr());
+  ASSERT_NE(nullptr, f) << status.error_message();
+  for (size_t begin = 0; begin <= 60; begin++) {
+    SCOPED_TRACE(begin);
+    EXPECT_EQ(60 - begin, Read(f, begin, 60, arena_.ptr()));
+    EXPECT_EQ(begin < 60 ? 1 : 0, Read(f, begin, begin + 1, arena_.ptr()));
+  }
+}
+
+TEST_F(RecordFileTest, ParallelRead) {
+  std::string data = Write(500, 2000);
+  hpb::Status status;
+  hpb_RecordFile* f = hpb_RecordFile_Open(data.data(), data.size(),
+                                          arena_.ptr(), status.ptr());
+  ASSERT_NE(nullptr, f) << status.error_message();
+  for (size_t parts : {1, 2, 3, 8, 1000}) {
+    SCOPED_TRACE(parts);
+    std::vector<size_t> counts(parts);
+    std::vector<std::thread> threads;
+    size_t next = 0;
+    for (size_t part = 0; part < parts; part++) {
+      size_t begin, end;
+      hpb_RecordFile_Split(f, part, parts, &begin, &end);
+      EXPECT_EQ(next, begin);
+      next = end;
+      threads.emplace_back([=, &counts] {
+        hpb::Arena arena;
+        counts[part] = Read(f, begin, end, arena.ptr());
+        EXPECT_EQ(end - begin, counts[part]);
+      });
+    }
+    EXPECT_EQ(500, next);
+    for (auto& t : threads) t.join();
+    size_t total = 0;
+    for (size_t count : counts) total += count;
+    EXPECT_EQ(500, total);
+  }
+}
+
+TEST_F(RecordFileTest, Corruption) {
+  std::string data = Write(20, 1000);
+  hpb::Status status;
+
+  // A flipped bit in a record is found when the record is read.
+  std::string bad = data;
+  bad[data.size() / 2] ^= 0x10;
+  hpb_RecordFile* f = hpb_RecordFile_Open(bad.data(), bad.size(),
+                                          arena_.ptr(), status.ptr());
+  ASSERT_NE(nullptr, f) << status.error_message();
+  hpb_RecordIterator it;
+  hpb_RecordIterator_Init(&it, f, 0, SIZE_MAX);
+  hpb_StringView record;
+  size_t count = 0;
+  while (hpb_RecordIterator_Next(&it, &record, status.ptr())) count++;
+  EXPECT_FALSE(status.ok());
+  EXPECT_GT(20, count);
+  EXPECT_FALSE(hpb_RecordIterator_Next(&it, &record, status.ptr()));
+
+  // Anywhere in the header, index or trailer it is found when opening.
+  const size_t index_size = 16 * hpb_RecordFile_BlockCount(f) + 32;
+  for (size_t pos = 0; pos < data.size(); pos++) {
+    if (pos == 16) pos = data.size() - index_size;
+    bad = data;
+    bad[pos] ^= 0x01;
+    status.Clear();
+    EXPECT_EQ(nullptr, hpb_RecordFile_Open(bad.data(), bad.size(),
+                                           arena_.ptr(), status.ptr()))
+        << pos;
+  }
+
+  // So is truncation.
+  status.Clear();
+  EXPECT_EQ(nullptr, hpb_RecordFile_Open(data.data(), data.size() - 1,
+                                         arena_.ptr(), status.ptr()));
+}
+
+}  // namespace
@@ -0,0 +1,512 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Checks that a payload would decode successfully, without decoding it.
+//
+// This mirrors the structure of decode.c; any change to what the decoder
+// accepts must be reflected here.  Nothing is stored, so the state that the
+// decoder keeps in the message it is building (presence of required fields)
+// is kept on the stack instead.
+
+#include <string.h>
+
+#include "hpb/mini_table/extension_registry.h"
+#include "hpb/mini_table/internal/enum.h"
+#include "hpb/mini_table/internal/message.h"
+#include "hpb/mini_table/sub.h"
+#include "hpb/wire/decode.h"
+#include "hpb/wire/eps_copy_input_stream.h"
+#include "hpb/wire/internal/common.h"
+#include "hpb/wire/internal/decode.h"
+#include "hpb/wire/internal/swap.h"
+#include "hpb/wire/reader.h"
+
+// Must be last.
+#include "hpb/port/def.inc"
+
+typedef struct {
+  hpb_EpsCopyInputStream input;
+  const hpb_ExtensionRegistry* extreg;
+  int depth;
+  uint32_t end_group;  // field number of END_GROUP tag, else DECODE_NOGROUP.
+  uint16_t options;
+  bool missing_required;
+  hpb_DecodeStatus status;
+  jmp_buf err;
+} hpb_Validator;
+
+// Hasbits of the required fields seen so far, laid out like the first eight
+// bytes of a message.
+typedef struct {
+  char bytes[8];
+} hpb_Validator_Presence;
+
+static const char* hpb_Validator_ValidateMessage(hpb_Validator* v,
+                                                 const char* ptr,
+                                                 const hpb_MiniTable* t);
+
+HPB_NORETURN static void hpb_Validator_ErrorJmp(hpb_Validator* v,
+                                                hpb_DecodeStatus status) {
+  HPB_ASSERT(status != kHpb_DecodeStatus_Ok);
+  v->status = status;
+  HPB_LONGJMP(v->err, 1);
+}
+
+HPB_FORCEINLINE
+static bool hpb_Validator_IsDone(hpb_Validator* v, const char** ptr) {
+  if (!hpb_EpsCopyInputStream_IsDone(&v->input, ptr)) return false;
+  if (hpb_EpsCopyInputStream_IsError(&v->input)) {
+    hpb_Validator_ErrorJmp(v, kHpb_DecodeStatus_Malformed);
+  }
+  return true;
+}
+
+HPB_FORCEINLINE
+static const char* hpb_Validator_ReadVarint(hpb_Validator* v, const char* ptr,
+                                            uint64_t* val) {
+  ptr = hpb_WireReader_ReadVarint(ptr, val);
+  if (!ptr) hpb_Validator_ErrorJmp(v, kHpb_DecodeStatus_Malformed);
+  return ptr;
+}
+
+HPB_FORCEINLINE
+static const char* hpb_Validator_ReadSize(hpb_Validator* v, const char* ptr,
+                                          int* size) {
+  ptr = hpb_WireReader_ReadSize(ptr, size);
+  if (!ptr || !hpb_EpsCopyInputStream_CheckSize(&v->input, ptr, *size)) {
+    hpb_Validator_ErrorJmp(v, kHpb_DecodeStatus_Malformed);
+  }
+  return ptr;
+}
+
+static const char* hpb_Validator_Recurse(hpb_Validator* v, const char* ptr,
+                                         const hpb_MiniTable* t,
+                                         uint32_t expected_end_group) {
+  if (--v->depth < 0) {
+    hpb_Validator_ErrorJmp(v, kHpb_DecodeStatus_MaxDepthExceeded);
+  }
+  ptr = hpb_Validator_ValidateMessage(v, ptr, t);
+  v->depth++;
+  if (v->end_group != expected_end_group) {
+    hpb_Validator_ErrorJmp(v, kHpb_DecodeStatus_Malformed);
+  }
+  return ptr;
+}
+
+static const char* hpb_Validator_ValidateSubMessage(hpb_Validator* v,
+                                                    const char* ptr,
+                                                    const hpb_MiniTable* t,
+                                                    int size) {
+  int saved_delta = hpb_EpsCopyInputStream_PushLimit(&v->input, ptr, size);
+  ptr = hpb_Validator_Recurse(v, ptr, t, DECODE_NOGROUP);
+  hpb_EpsCopyInputStream_PopLimit(&v->input, ptr, saved_delta);
+  return ptr;
+}
+
+// `t` is NULL for a group that is not a known field.
+static const char* hpb_Validator_ValidateGroup(hpb_Validator* v,
+                                               const char* ptr,
+                                               const hpb_MiniTable* t,
+                                               uint32_t number) {
+  if (hpb_Validator_IsDone(v, &ptr)) {
+    hpb_Validator_ErrorJmp(v, kHpb_DecodeStatus_Malformed);
+  }
+  ptr = hpb_Validator_Recurse(v, ptr, t, number);
+  v->end_group = DECODE_NOGROUP;
+  return ptr;
+}
+
+static const char* hpb_Validator_SkipField(hpb_Validator* v, const char* ptr,
+                                           uint32_t tag) {
+  switch (tag & 7) {
+    case kHpb_WireType_Varint: {
+      uint64_t val;
+      return hpb_Validator_ReadVarint(v, ptr, &val);
+    }
+    case kHpb_WireType_64Bit:
+      return ptr + 8;
+    case kHpb_WireType_32Bit:
+      return ptr + 4;
+    case kHpb_WireType_Delimited: {
+      int size;
+      ptr = hpb_Validator_ReadSize(v, ptr, &size);
+      return ptr + size;
+    }
+    case kHpb_WireType_StartGroup:
+      return hpb_Validator_ValidateGroup(v, ptr, NULL, tag >> 3);
+    default:
+      hpb_Validator_ErrorJmp(v, kHpb_DecodeStatus_Malformed);
+  }
+}
+
+enum {
+  kStartItemTag = ((kHpb_MsgSet_Item << 3) | kHpb_WireType_StartGroup),
+  kEndItemTag = ((kHpb_MsgSet_Item << 3) | kHpb_WireType_EndGroup),
+  kTypeIdTag = ((kHpb_MsgSet_TypeId << 3) | kHpb_WireType_Varint),
+  kMessageTag = ((kHpb_MsgSet_Message << 3) | kHpb_WireType_Delimited),
+};
+
+static void hpb_Validator_ValidateMessageSetPayload(hpb_Validator* v,
+                                                    const hpb_MiniTable* t,
+                                                    uint32_t type_id,
+                                                    const char* data,
+                                                    int size) {
+  // Like the decoder, parse the payload of a known item as a message of its
+  // own.  Unknown items are kept as they are.
+  const hpb_MiniTableExtension* item_mt =
+      hpb_ExtensionRegistry_Lookup(v->extreg, t, type_id);
+  if (!item_mt) return;
+  hpb_DecodeStatus status =
+      hpb_Validate(data, size, item_mt->sub.submsg, v->extreg, v->options);
+  if (status != kHpb_DecodeStatus_Ok) hpb_Validator_ErrorJmp(v, status);
+}
+
+static const char* hpb_Validator_ValidateMessageSetItem(
+    hpb_Validator* v, const char* ptr, const hpb_MiniTable* t) {
+  uint32_t type_id = 0;
+  const char* payload = NULL;
+  int payload_size = 0;
+  bool have_id = false;
+  bool have_payload = false;
+  while (!hpb_Validator_IsDone(v, &ptr)) {
+    uint32_t tag;
+    ptr = hpb_WireReader_ReadTag(ptr, &tag);
+    if (!ptr) hpb_Validator_ErrorJmp(v, kHpb_DecodeStatus_Malformed);
+    switch (tag) {
+      case kEndItemTag:
+        return ptr;
+      case kTypeIdTag: {
+        uint64_t tmp;
+        ptr = hpb_Validator_ReadVarint(v, ptr, &tmp);
+        if (have_id) break;  // Ignore dup.
+        have_id = true;
+        type_id = tmp;
+        if (have_payload) {
+          hpb_Validator_ValidateMessageSetPayload(v, t, type_id, payload,
+                                                  payload_size);
+        }
+        break;
+      }
+      case kMessageTag: {
+        int size;
+        ptr = hpb_Validator_ReadSize(v, ptr, &size);
+        const char* data = ptr;
+        ptr += size;
+        if (have_payload) break;  // Ignore dup.
+        have_payload = true;
+        if (have_id) {
+          hpb_Validator_ValidateMessageSetPayload(v, t, type_id, data, size);
+        } else {
+          payload = data;
+          payload_size = size;
+        }
+        break;
+      }
+      default:
+        ptr = hpb_Validator_SkipField(v, ptr, tag);
+        break;
+    }
+  }
+  hpb_Validator_ErrorJmp(v, kHpb_DecodeStatus_Malformed);
+}
+
+// Returns the sub-message table of `field`, or NULL if the field is unlinked
+// and the decoder would treat it as unknown.
+static const hpb_MiniTable* hpb_Validator_SubMessage(
+    hpb_Validator* v, const hpb_MiniTableSub* sub,
+    const hpb_MiniTableField* field) {
+  const hpb_MiniTable* subl = sub->submsg;
+  if (subl == &_kHpb_MiniTable_Empty &&
+      !(field->mode & kHpb_LabelFlags_IsExtension) &&
+      !(v->options & kHpb_DecodeOption_ExperimentalAllowUnlinked)) {
+    return NULL;
+  }
+  return subl;
+}
+
+static const char* hpb_Validator_ValidatePacked(hpb_Validator* v,
+                                                const char* ptr,
+                                                const hpb_MiniTableField* field,
+                                                int size) {
+  switch (field->HPB_PRIVATE(descriptortype)) {
+    case kHpb_FieldType_Double:
+    case kHpb_FieldType_Fixed64:
+    case kHpb_FieldType_SFixed64:
+      if (size & 7) hpb_Validator_ErrorJmp(v, kHpb_DecodeStatus_Malformed);
+      return ptr + size;
+    case kHpb_FieldType_Float:
+    case kHpb_FieldType_Fixed32:
+    case kHpb_FieldType_SFixed32:
+      if (size & 3) hpb_Validator_ErrorJmp(v, kHpb_DecodeStatus_Malformed);
+      return ptr + size;
+    default: {
+      // Out-of-range values of a closed enum would go to unknown fields, which
+      // cannot fail, so only the varints themselves are checked.
+      int saved_delta = hpb_EpsCopyInputStream_PushLimit(&v->input, ptr, size);
+      while (!hpb_Validator_IsDone(v, &ptr)) {
+        uint64_t val;
+        ptr = hpb_Validator_ReadVarint(v, ptr, &val);
+      }
+      hpb_EpsCopyInputStream_PopLimit(&v->input, ptr, saved_delta);
+      return ptr;
+    }
+  }
+}
+
+static bool hpb_Validator_IsPackable(const hpb_MiniTableField* field) {
+  switch (field->HPB_PRIVATE(descriptortype)) {
+    case kHpb_FieldType_String:
+    case kHpb_FieldType_Bytes:
+    case kHpb_FieldType_Message:
+    case kHpb_FieldType_Group:
+      return false;
+    default:
+      return true;
+  }
+}
+
+// Validates a length-delimited value of known field `field`.  Returns NULL if
+// the decoder would treat the value as an unknown field.
+static const char* hpb_Validator_ValidateDelimited(
+    hpb_Validator* v, const char* ptr, const hpb_MiniTableSub* sub,
+    const hpb_MiniTableField* field, int size) {
+  int type = field->HPB_PRIVATE(descriptortype);
+  hpb_FieldMode mode = hpb_FieldMode_Get(field);
+  if (mode == kHpb_FieldMode_Array && hpb_Validator_IsPackable(field)) {
+    return hpb_Validator_ValidatePacked(v, ptr, field, size);
+  }
+  switch (type) {
+    case kHpb_FieldType_String:
+      if (!_hpb_Decoder_VerifyUtf8Inline(ptr, size)) {
+        hpb_Validator_ErrorJmp(v, kHpb_DecodeStatus_BadUtf8);
+      }
+      return ptr + size;
+    case kHpb_FieldType_Bytes:
+      return ptr + size;
+    case kHpb_FieldType_Group: {
+      // The decoder parses a repeated group that arrives length-delimited as
+      // a group starting right after the length.
+      if (mode != kHpb_FieldMode_Array) return NULL;
+      const hpb_MiniTable* group = hpb_Validator_SubMessage(v, sub, field);
+      if (!group) return NULL;
+      return hpb_Validator_ValidateGroup(v, ptr, group, field->number);
+    }
+    case kHpb_FieldType_Message: {
+      const hpb_MiniTable* subl = hpb_Validator_SubMessage(v, sub, field);
+      if (!subl) return NULL;
+      if (mode == kHpb_FieldMode_Map) {
+        // The decoder creates the value of every entry up front.
+        const hpb_MiniTableField* val_field = &subl->fields[1];
+        if (hpb_MiniTableField_CType(val_field) == kHpb_CType_Message &&
+            subl->subs[val_field->HPB_PRIVATE(submsg_index)].submsg ==
+                &_kHpb_MiniTable_Empty &&
+            !(v->options & kHpb_DecodeOption_ExperimentalAllowUnlinked)) {
+          hpb_Validator_ErrorJmp(v, kHpb_DecodeStatus_UnlinkedSubMessage);
+        }
+      }
+      return hpb_Validator_ValidateSubMessage(v, ptr, subl, size);
+    }
+    default:
+      return NULL;
+  }
+}
+
+static bool hpb_Validator_IsVarintType(int type) {
+  static const unsigned kVarintMask =
+      (1 << kHpb_FieldType_Int64) | (1 << kHpb_FieldType_UInt64) |
+      (1 << kHpb_FieldType_Int32) | (1 << kHpb_FieldType_Bool) |
+      (1 << kHpb_FieldType_UInt32) | (1 << kHpb_FieldType_Enum) |
+      (1 << kHpb_FieldType_SInt32) | (1 << kHpb_FieldType_SInt64);
+  return (1 << type) & kVarintMask;
+}
+
+static bool hpb_Validator_IsFixedType(int type, int wire_type) {
+  static const unsigned kFixed32Mask = (1 << kHpb_FieldType_Float) |
+                                       (1 << kHpb_FieldType_Fixed32) |
+                                       (1 << kHpb_FieldType_SFixed32);
+  static const unsigned kFixed64Mask = (1 << kHpb_FieldType_Double) |
+                                       (1 << kHpb_FieldType_Fixed64) |
+                                       (1 << kHpb_FieldType_SFixed64);
+  return (1 << type) &
+         (wire_type == kHpb_WireType_32Bit ? kFixed32Mask : kFixed64Mask);
+}
+
+// Validates a value of known field `field`, setting `*unknown` if the decoder
+// would store it in unknown fields instead of the field.
+static const char* hpb_Validator_ValidateKnownField(
+    hpb_Validator* v, const char* ptr, const hpb_MiniTableSub* sub,
+    const hpb_MiniTableField* field, int wire_type, bool* unknown) {
+  int type = field->HPB_PRIVATE(descriptortype);
+  *unknown = false;
+  switch (wire_type) {
+    case kHpb_WireType_Varint: {
+      uint64_t val;
+      ptr = hpb_Validator_ReadVarint(v, ptr, &val);
+      if (!hpb_Validator_IsVarintType(type)) {
+        *unknown = true;
+      } else if (type == kHpb_FieldType_Enum &&
+                 !_hpb_MiniTable_CheckEnumValueSlow(sub->subenum,
+                                                    (uint32_t)val)) {
+        // Goes to unknown fields, so the field stays unset.
+        *unknown = true;
+      }
+      return ptr;
+    }
+    case kHpb_WireType_32Bit:
+    case kHpb_WireType_64Bit:
+      *unknown = !hpb_Validator_IsFixedType(type, wire_type);
+      return ptr + (wire_type == kHpb_WireType_32Bit ? 4 : 8);
+    case kHpb_WireType_Delimited: {
+      int size;
+      ptr = hpb_Validator_ReadSize(v, ptr, &size);
+      const char* end =
+          hpb_Validator_ValidateDelimited(v, ptr, sub, field, size);
+      if (end) return end;
+      *unknown = true;
+      return ptr + size;
+    }
+    case kHpb_WireType_StartGroup:
+      if (type == kHpb_FieldType_Group) {
+        const hpb_MiniTable* group = hpb_Validator_SubMessage(v, sub, field);
+        if (group) {
+          return hpb_Validator_ValidateGroup(v, ptr, group, field->number);
+        }
+      }
+      *unknown = true;
+      return hpb_Validator_ValidateGroup(v, ptr, NULL, field->number);
+    default:
+      hpb_Validator_ErrorJmp(v, kHpb_DecodeStatus_Malformed);
+  }
+}
+
+static const char* hpb_Validator_ValidateField(
+    hpb_Validator* v, const char* ptr, const hpb_MiniTable* t, uint32_t tag,
+    hpb_Validator_Presence* presence) {
+  uint32_t field_number = tag >> 3;
+  int wire_type = tag & 7;
+  if (field_number == 0) {
+    hpb_Validator_ErrorJmp(v, kHpb_DecodeStatus_Malformed);
+  }
+
+  const hpb_MiniTableField* field =
+      t ? hpb_MiniTable_FindFieldByNumber(t, field_number) : NULL;
+  const hpb_MiniTableSub* sub = NULL;
+  if (field) {
+    sub = &t->subs[field->HPB_PRIVATE(submsg_index)];
+  } else if (t && v->extreg) {
+    switch (t->ext) {
+      case kHpb_ExtMode_Extendable: {
+        const hpb_MiniTableExtension* ext =
+            hpb_ExtensionRegistry_Lookup(v->extreg, t, field_number);
+        if (ext) {
+          field = &ext->field;
+          sub = &ext->sub;
+        }
+        break;
+      }
+      case kHpb_ExtMode_IsMessageSet:
+        if (field_number == kHpb_MsgSet_Item &&
+            wire_type == kHpb_WireType_StartGroup) {
+          return hpb_Validator_ValidateMessageSetItem(v, ptr, t);
+        }
+        break;
+    }
+  }
+  if (!field) return hpb_Validator_SkipField(v, ptr, tag);
+
+  bool unknown;
+  ptr = hpb_Validator_ValidateKnownField(v, ptr, sub, field, wire_type,
+                                         &unknown);
+  if (!unknown && field->presence > 0 && field->presence < 64 &&
+      hpb_FieldMode_Get(field) == kHpb_FieldMode_Scalar &&
+      !(field->mode & kHpb_LabelFlags_IsExtension)) {
+    presence->bytes[field->presence / 8] |= 1 << (field->presence % 8);
+  }
+  return ptr;
+}
+
+static const char* hpb_Validator_ValidateMessage(hpb_Validator* v,
+                                                 const char* ptr,
+                                                 const hpb_MiniTable* t) {
+  hpb_Validator_Presence presence;
+  memset(&presence, 0, sizeof(presence));
+
+  while (!hpb_Validator_IsDone(v, &ptr)) {
+    uint32_t tag;
+    ptr = hpb_WireReader_ReadTag(ptr, &tag);
+    if (!ptr) hpb_Validator_ErrorJmp(v, kHpb_DecodeStatus_Malformed);
+    if ((tag & 7) == kHpb_WireType_EndGroup) {
+      v->end_group = tag >> 3;
+      return ptr;
+    }
+    ptr = hpb_Validator_ValidateField(v, ptr, t, tag, &presence);
+  }
+
+  if (HPB_UNLIKELY(t && t->required_count) &&
+      (v->options & kHpb_DecodeOption_CheckRequired)) {
+    // The same test as _hpb_Decoder_CheckRequired().
+    uint64_t msg_head;
+    memcpy(&msg_head, presence.bytes, 8);
+    msg_head = _hpb_BigEndian_Swap64(msg_head);
+    if (hpb_MiniTable_requiredmask(t) & ~msg_head) v->missing_required = true;
+  }
+  return ptr;
+}
+
+// Kept apart from hpb_Validate(), whose `buf` has its address taken, so that
+// nothing it modifies lives across longjmp().
+static hpb_DecodeStatus hpb_Validator_Validate(hpb_Validator* const v,
+                                               const char* buf,
+                                               const hpb_MiniTable* l) {
+  if (HPB_SETJMP(v->err) == 0) {
+    hpb_Validator_ValidateMessage(v, buf, l);
+    if (v->end_group != DECODE_NOGROUP) return kHpb_DecodeStatus_Malformed;
+    if (v->missing_required) return kHpb_DecodeStatus_MissingRequired;
+    return kHpb_DecodeStatus_Ok;
+  }
+  return v->status;
+}
+
+hpb_DecodeStatus hpb_Validate(const char* buf, size_t size,
+                              const hpb_MiniTable* l,
+                              const hpb_ExtensionRegistry* extreg,
+                              int options) {
+  hpb_Validator v;
+  unsigned depth = (unsigned)options >> 16;
+
+  hpb_EpsCopyInputStream_Init(&v.input, &buf, size, false);
+  v.extreg = extreg;
+  v.depth = depth ? depth : kHpb_WireFormat_DefaultDepthLimit;
+  v.end_group = DECODE_NOGROUP;
+  v.options = (uint16_t)options;
+  v.missing_required = false;
+
+  return hpb_Validator_Validate(&v, buf, l);
+}
@@ -0,0 +1,278 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdint.h>
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "hpb/base/status.hpp"
+#include "hpb/mem/arena.hpp"
+#include "hpb/message/message.h"
+#include "hpb/mini_descriptor/build_enum.h"
+#include "hpb/mini_descriptor/decode.h"
+#include "hpb/mini_descriptor/internal/encode.hpp"
+#include "hpb/mini_descriptor/internal/modifiers.h"
+#include "hpb/mini_table/message.h"
+#include "hpb/wire/decode.h"
+#include "hpb/wire/types.h"
+
+// Must be last
+#include "hpb/port/def.inc"
+
+namespace {
+
+// message M {
+//   required int32 req = 1;
+//   string s = 2;  // Validated as UTF-8.
+//   repeated int64 v = 3 [packed = true];
+//   repeated fixed32 f = 4 [packed = true];
+//   M child = 5;
+//   ClosedEnum e = 6;  // Values 0, 1 and 100.
+//   repeated M children = 7;
+//   group G = 8 { ... as M ... }
+//   map<int32, string> map = 9;
+//   bytes b = 10;
+//   fixed64 f64 = 11;
+// }
+class ValidateTest : public testing::Test {
+ protected:
+  ValidateTest() {
+    hpb::MtDataEncoder e;
+    e.StartMessage(kHpb_MessageModifier_ValidateUtf8);
+    e.PutField(kHpb_FieldType_Int32, 1, kHpb_FieldModifier_IsRequired);
+    e.PutField(kHpb_FieldType_String, 2, 0);
+    e.PutField(kHpb_FieldType_Int64, 3,
+               kHpb_FieldModifier_IsRepeated | kHpb_FieldModifier_IsPacked);
+    e.PutField(kHpb_FieldType_Fixed32, 4,
+               kHpb_FieldModifier_IsRepeated | kHpb_FieldModifier_IsPacked);
+    e.PutField(kHpb_FieldType_Message, 5, 0);
+    e.PutField(kHpb_FieldType_Enum, 6, kHpb_FieldModifier_IsClosedEnum);
+    e.PutField(kHpb_FieldType_Message, 7, kHpb_FieldModifier_IsRepeated);
+    e.PutField(kHpb_FieldType_Group, 8, 0);
+    e.PutField(kHpb_FieldType_Message, 9, kHpb_FieldModifier_IsRepeated);
+    e.PutField(kHpb_FieldType_Bytes, 10, 0);
+    e.PutField(kHpb_FieldType_Fixed64, 11, 0);
+    hpb::Status status;
+    table_ = hpb_MiniTable_Build(e.data().data(), e.data().size(),
+                                 arena_.ptr(), status.ptr());
+    EXPECT_NE(nullptr, table_) << status.error_message();
+
+    hpb::MtDataEncoder enum_e;
+    enum_e.StartEnum();
+    for (uint32_t v : {0, 1, 100}) enum_e.PutEnumValue(v);
+    enum_e.EndEnum();
+    hpb_MiniTableEnum* enum_table = hpb_MiniTableEnum_Build(
+        enum_e.data().data(), enum_e.data().size(), arena_.ptr(),
+        status.ptr());
+    EXPECT_NE(nullptr, enum_table) << status.error_message();
+
+    hpb::MtDataEncoder map_e;
+    map_e.EncodeMap(kHpb_FieldType_Int32, kHpb_FieldType_String, 0, 0);
+    hpb_MiniTable* entry =
+        hpb_MiniTable_Build(map_e.data().data(), map_e.data().size(),
+                            arena_.ptr(), status.ptr());
+    EXPECT_NE(nullptr, entry) << status.error_message();
+
+    for (uint32_t num : {5, 7, 8}) {
+      EXPECT_TRUE(hpb_MiniTable_SetSubMessage(table_, Field(num), table_));
+    }
+    EXPECT_TRUE(hpb_MiniTable_SetSubMessage(table_, Field(9), entry));
+    EXPECT_TRUE(hpb_MiniTable_SetSubEnum(table_, Field(6), enum_table));
+  }
+
+  hpb_MiniTableField* Field(uint32_t number) {
+    return const_cast<hpb_MiniTableField*>(
+        hpb_MiniTable_FindFieldByNumber(table_, number));
+  }
+
+  hpb_DecodeStatus Decode(const std::string& buf, int options) {
+    hpb::Arena arena;
+    hpb_Message* msg = hpb_Message_New(table_, arena.ptr());
+    return hpb_Decode(buf.data(), buf.size(), msg, table_, nullptr, options,
+                      arena.ptr());
+  }
+
+  hpb_DecodeStatus Validate(const std::string& buf, int options) {
+    return hpb_Validate(buf.data(), buf.size(), table_, nullptr, options);
+  }
+
+  hpb::Arena arena_;
+  hpb_MiniTable* table_;
+};
+
+std::string Varint(uint64_t val) {
+  std::string out;
+  do {
+    uint8_t byte = val & 0x7f;
+    val >>= 7;
+    if (val) byte |= 0x80;
+    out.push_back(byte);
+  } while (val);
+  return out;
+}
+
+std::string Tag(uint32_t number, int wire_type) {
+  return Varint((number << 3) | wire_type);
+}
+
+std::string Delimited(uint32_t number, const std::string& data) {
+  return Tag(number, kHpb_WireType_Delimited) + Varint(data.size()) + data;
+}
+
+std::string Group(uint32_t number, const std::string& data) {
+  return Tag(number, kHpb_WireType_StartGroup) + data +
+         Tag(number, kHpb_WireType_EndGroup);
+}
+
+// A message that uses every field of M, and a few unknown ones.
+std::string Sample(int depth) {
+  std::string out = Tag(1, kHpb_WireType_Varint) + Varint(150);
+  out += Delimited(2, "h\xc3\xa9llo");
+  out += Delimited(3, Varint(1) + Varint(uint64_t{1} << 62) + Varint(300));
+  out += Delimited(4, std::string(8, 'x'));
+  out += Tag(6, kHpb_WireType_Varint) + Varint(100);
+  out += Delimited(9, Tag(1, kHpb_WireType_Varint) + Varint(7) +
+                          Delimited(2, "seven"));
+  out += Delimited(10, "\xff\xfe");
+  out += Tag(11, kHpb_WireType_64Bit) + std::string(8, '\1');
+  out += Tag(99, kHpb_WireType_Varint) + Varint(5);
+  out += Group(98, Tag(1, kHpb_WireType_32Bit) + "abcd");
+  if (depth > 0) {
+    out += Delimited(5, Sample(depth - 1));
+    out += Delimited(7, Sample(depth - 1));
+    out += Group(8, Sample(depth - 1));
+  }
+  return out;
+}
+
+TEST_F(ValidateTest, Valid) {
+  std::string buf = Sample(2);
+  EXPECT_EQ(kHpb_DecodeStatus_Ok, Validate(buf, 0));
+  EXPECT_EQ(kHpb_DecodeStatus_Ok,
+            Validate(buf, kHpb_DecodeOption_CheckRequired));
+  EXPECT_EQ(kHpb_DecodeStatus_Ok, Validate("", 0));
+}
+
+TEST_F(ValidateTest, Errors) {
+  struct {
+    std::string buf;
+    uint32_t options;
+    hpb_DecodeStatus expected;
+  } cases[] = {
+      {Delimited(2, "\xc3"), 0, kHpb_DecodeStatus_BadUtf8},
+      {Delimited(5, Delimited(2, "\xff")), 0, kHpb_DecodeStatus_BadUtf8},
+      {Delimited(5, Delimited(5, "")), hpb_DecodeOptions_MaxDepth(1),
+       kHpb_DecodeStatus_MaxDepthExceeded},
+      {Group(98, Group(97, "")), hpb_DecodeOptions_MaxDepth(1),
+       kHpb_DecodeStatus_MaxDepthExceeded},
+      {"", kHpb_DecodeOption_CheckRequired, kHpb_DecodeStatus_MissingRequired},
+      {Sample(0) + Delimited(5, ""), kHpb_DecodeOption_CheckRequired,
+       kHpb_DecodeStatus_MissingRequired},
+      {Delimited(4, "abc"), 0, kHpb_DecodeStatus_Malformed},
+      {Delimited(3, "\x80"), 0, kHpb_DecodeStatus_Malformed},
+      {Tag(8, kHpb_WireType_StartGroup), 0, kHpb_DecodeStatus_Malformed},
+      {Tag(8, kHpb_WireType_EndGroup), 0, kHpb_DecodeStatus_Malformed},
+      {Tag(0, kHpb_WireType_Varint) + Varint(1), 0,
+       kHpb_DecodeStatus_Malformed},
+      {Tag(1, 6), 0, kHpb_DecodeStatus_Malformed},
+      {Tag(10, kHpb_WireType_Delimited) + Varint(10) + "short", 0,
+       kHpb_DecodeStatus_Malformed},
+  };
+  for (const auto& c : cases) {
+    SCOPED_TRACE(testing::PrintToString(c.buf));
+    EXPECT_EQ(c.expected, Validate(c.buf, c.options));
+    EXPECT_EQ(c.expected, Decode(c.buf, c.options));
+  }
+}
+
+TEST_F(ValidateTest, ClosedEnum) {
+  // A value outside the enum goes to unknown fields, which leaves the required
+  // field without a value when it is the only one.
+  int options = kHpb_DecodeOption_CheckRequired;
+  std::string req = Tag(1, kHpb_WireType_Varint) + Varint(1);
+  std::string bad = Tag(6, kHpb_WireType_Varint) + Varint(2);
+  EXPECT_EQ(kHpb_DecodeStatus_Ok, Validate(req + bad, options));
+  EXPECT_EQ(kHpb_DecodeStatus_Ok, Validate(bad, 0));
+  EXPECT_EQ(kHpb_DecodeStatus_MissingRequired, Validate(bad, options));
+}
+
+TEST_F(ValidateTest, Unlinked) {
+  hpb::MtDataEncoder e;
+  e.StartMessage(0);
+  e.PutField(kHpb_FieldType_Message, 1, 0);
+  hpb::Status status;
+  hpb_MiniTable* table = hpb_MiniTable_Build(e.data().data(), e.data().size(),
+                                             arena_.ptr(), status.ptr());
+  ASSERT_NE(nullptr, table);
+  // Without the option an unlinked sub-message is an unknown field, with it
+  // the contents are still checked.
+  std::string buf = Delimited(1, Tag(1, 7));
+  EXPECT_EQ(kHpb_DecodeStatus_Ok,
+            hpb_Validate(buf.data(), buf.size(), table, nullptr, 0));
+  EXPECT_EQ(kHpb_DecodeStatus_Malformed,
+            hpb_Validate(buf.data(), buf.size(), table, nullptr,
+                         kHpb_DecodeOption_ExperimentalAllowUnlinked));
+}
+
+// Every truncation and many corruptions of a valid payload get the same
+// status from hpb_Validate() as from hpb_Decode().
+TEST_F(ValidateTest, MatchesDecode) {
+  if (HPB_FASTTABLE) {
+    GTEST_SKIP() << "the fast parser reports some errors differently";
+  }
+  const uint32_t kOptions[] = {0, kHpb_DecodeOption_CheckRequired,
+                               hpb_DecodeOptions_MaxDepth(2)};
+  std::string sample = Sample(2);
+  int failures = 0;
+  for (size_t i = 0; i <= sample.size(); i++) {
+    std::string truncated = sample.substr(0, i);
+    for (uint32_t options : kOptions) {
+      EXPECT_EQ(Decode(truncated, options), Validate(truncated, options))
+          << "truncated to " << i << " options " << options;
+    }
+  }
+  for (size_t i = 0; i < sample.size(); i++) {
+    for (uint8_t flip : {0x01, 0x07, 0x40, 0x80, 0xff}) {
+      std::string corrupt = sample;
+      corrupt[i] ^= flip;
+      for (uint32_t options : kOptions) {
+        hpb_DecodeStatus status = Decode(corrupt, options);
+        if (status != kHpb_DecodeStatus_Ok) failures++;
+        EXPECT_EQ(status, Validate(corrupt, options))
+            << "byte " << i << " ^ " << int{flip} << " options " << options;
+      }
+    }
+  }
+  // Make sure the corruptions exercise the error paths.
+  EXPECT_LT(1000, failures);
+}
+
+}  // namespace
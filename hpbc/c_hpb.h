@@ -203,9 +203,14 @@ namespace hpbc {
         std::vector<TableEntry> FastDecodeTable(hpb::MessageDefPtr message,
                                                       const DefPoolPair& pools) const;
 
+        std::vector<TableEntry> FastDecodeTable(hpb::MessageDefPtr message,
+                                                      const DefPoolPair& pools,
+                                                      size_t max_size, size_t* placed,
+                                                      size_t* eligible) const;
+
         std::vector<hpb::FieldDefPtr> FieldHotnessOrder(hpb::MessageDefPtr message) const;
 
-        int GetTableSlot(hpb::FieldDefPtr field) const;
+        int GetTableSlot(hpb::FieldDefPtr field, size_t table_size) const;
 
         uint64_t GetEncodedTag(hpb::FieldDefPtr field) const;
 
@@ -213,6 +218,8 @@ namespace hpbc {
 
         bool TryFillTableEntry(const DefPoolPair& pools, hpb::FieldDefPtr field, TableEntry& ent) const;
 
+        bool TryFillMapTableEntry(const DefPoolPair& pools, hpb::FieldDefPtr field, TableEntry& ent) const;
+
         uint32_t MakeTag(uint32_t field_number, uint32_t wire_type) const {
             return field_number << 3 | wire_type;
         }
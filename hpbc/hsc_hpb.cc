@@ -1565,7 +1565,7 @@ namespace hpbc {
         }
 
         std::vector<TableEntry> table;
-        uint8_t table_mask = -1;
+        uint16_t table_mask = -1;
 
         table = FastDecodeTable(message, pools);
 
@@ -1714,11 +1714,40 @@ namespace hpbc {
 
     std::vector<TableEntry> HSChpb::FastDecodeTable(hpb::MessageDefPtr message,
                                             const DefPoolPair& pools) const {
+        // Fields whose tags collide in a 32-slot table are left to the generic
+        // parser.  Wider tables also index on the second tag byte, but they are
+        // only worth their size if they give more fields a slot, so take the
+        // smallest one that does best.
+        size_t placed;
+        size_t eligible;
+        std::vector<TableEntry> table =
+                FastDecodeTable(message, pools, 32, &placed, &eligible);
+        for (size_t size = 64; placed < eligible && size <= 128; size *= 2) {
+            size_t wide_placed;
+            std::vector<TableEntry> wide =
+                    FastDecodeTable(message, pools, size, &wide_placed, &eligible);
+            if (wide_placed > placed) {
+                table = std::move(wide);
+                placed = wide_placed;
+            }
+        }
+        return table;
+    }
+
+    std::vector<TableEntry> HSChpb::FastDecodeTable(hpb::MessageDefPtr message,
+                                            const DefPoolPair& pools,
+                                            size_t max_size, size_t* placed,
+                                            size_t* eligible) const {
         std::vector<TableEntry> table;
+        *placed = 0;
+        *eligible = 0;
+        if (max_size > 32) {
+            // Wide tables are always full size.
+            table.resize(max_size, TableEntry{"_hpb_FastDecoder_DecodeGeneric", 0});
+        }
         for (const auto field : FieldHotnessOrder(message)) {
             TableEntry ent;
-            int slot = GetTableSlot(field);
-            // std::cerr << "table slot: " << field->number() << ": " << slot << "\n";
+            int slot = GetTableSlot(field, max_size);
             if (slot < 0) {
                 // Tag can't fit in the table.
                 continue;
@@ -1727,15 +1756,26 @@ namespace hpbc {
                 // Unsupported field type or offset, hasbit index, etc. doesn't fit.
                 continue;
             }
+            ++*eligible;
             while ((size_t)slot >= table.size()) {
                 size_t size = std::max(static_cast<size_t>(1), table.size() * 2);
                 table.resize(size, TableEntry{"_hpb_FastDecoder_DecodeGeneric", 0});
             }
-            if (table[slot].first != "_hpb_FastDecoder_DecodeGeneric") {
-                // A hotter field already filled this slot.
+            // Wide tables index one-byte tags with bits of the following byte
+            // too, so they fill every slot that differs only in those bits.
+            size_t step = GetEncodedTag(field) < 0x80 ? 32 : table.size();
+            bool taken = false;
+            for (size_t i = slot; i < table.size(); i += step) {
+                taken |= table[i].first != "_hpb_FastDecoder_DecodeGeneric";
+            }
+            if (taken) {
+                // A hotter field already filled one of the slots.
                 continue;
             }
-            table[slot] = ent;
+            for (size_t i = slot; i < table.size(); i += step) {
+                table[i] = ent;
+            }
+            ++*placed;
         }
         return table;
     }
@@ -1755,13 +1795,15 @@ namespace hpbc {
         return fields;
     }
 
-    int HSChpb::GetTableSlot(hpb::FieldDefPtr field) const {
+    int HSChpb::GetTableSlot(hpb::FieldDefPtr field, size_t table_size) const {
         uint64_t tag = GetEncodedTag(field);
         if (tag > 0x7fff) {
             // Tag must fit within a two-byte varint.
             return -1;
         }
-        return (tag & 0xf8) >> 3;
+        // Bits 3 and up of the little-endian tag, ie. the low bits of the field
+        // number, the continuation bit and then the low bits of the next byte.
+        return (tag >> 3) & (table_size - 1);
     }
 
     uint64_t HSChpb::GetEncodedTag(hpb::FieldDefPtr field) const {
@@ -1819,8 +1861,9 @@ namespace hpbc {
                 break;
             case kHpb_FieldType_Enum:
                 if (hpb_MiniTableField_IsClosedEnum(mt_f)) {
-                    // We don't have the means to test proto2 enum fields for valid values.
-                    return false;
+                    // Values outside the enum's 64-bit mask go to the generic parser.
+                    type = "e4";
+                    break;
                 }
                 [[fallthrough]];
             case kHpb_FieldType_Int32:
@@ -1862,7 +1905,7 @@ namespace hpbc {
 
         switch (hpb_FieldMode_Get(mt_f)) {
             case kHpb_FieldMode_Map:
-                return false;  // Not supported yet (ever?).
+                return TryFillMapTableEntry(pools, field, ent);
             case kHpb_FieldMode_Array:
                 if (mt_f->mode & kHpb_LabelFlags_IsPacked) {
                     cardinality = "p";
@@ -1909,6 +1952,14 @@ namespace hpbc {
             data |= hasbit_index << 24;
         }
 
+        if (type == "e4") {
+            // Packed closed enums would have to move invalid values out of the array.
+            if (cardinality == "p") return false;
+            uint64_t idx = mt_f->HPB_PRIVATE(submsg_index);
+            if (idx > 255) return false;
+            data |= idx << 16;
+        }
+
         if (field.ctype() == kHpb_CType_Message) {
             uint64_t idx = mt_f->HPB_PRIVATE(submsg_index);
             if (idx > 255) return false;
@@ -1941,4 +1992,44 @@ namespace hpbc {
         ent.second = data;
         return true;
     }
+
+    bool HSChpb::TryFillMapTableEntry(const DefPoolPair& pools, hpb::FieldDefPtr field, TableEntry& ent) const {
+        const hpb_MiniTable* mt = pools.GetMiniTable64(field.containing_type());
+        const hpb_MiniTableField* mt_f =
+                hpb_MiniTable_FindFieldByNumber(mt, field.number());
+        const hpb_MiniTable* entry_mt = pools.GetMiniTable64(field.message_type());
+
+        // Map keys and values are either varints ("v"), strings ("s") or
+        // messages ("m"); anything else is left to the generic parser.
+        auto kind = [](const hpb_MiniTableField* f) -> std::string {
+            switch (hpb_MiniTableField_Type(f)) {
+                case kHpb_FieldType_Int32:
+                case kHpb_FieldType_Int64:
+                case kHpb_FieldType_UInt32:
+                case kHpb_FieldType_UInt64:
+                    return "v";
+                case kHpb_FieldType_String:
+                case kHpb_FieldType_Bytes:
+                    return "s";
+                case kHpb_FieldType_Message:
+                    return "m";
+                default:
+                    return "";
+            }
+        };
+        std::string key = kind(&entry_mt->fields[0]);
+        std::string val = kind(&entry_mt->fields[1]);
+        if (key.empty() || key == "m" || val.empty()) return false;
+
+        uint64_t idx = mt_f->HPB_PRIVATE(submsg_index);
+        if (idx > 255) return false;
+
+        uint64_t expected_tag = GetEncodedTag(field);
+        uint64_t hasbit_index = 63;  // Maps have no hasbit.
+        ent.first = absl::Substitute("hpb_pm$0$1_$2bt", key, val,
+                                     expected_tag > 0xff ? "2" : "1");
+        ent.second = static_cast<uint64_t>(mt_f->offset) << 48 |
+                     hasbit_index << 24 | idx << 16 | expected_tag;
+        return true;
+    }
 }  // namespace hpbc
\ No newline at end of file
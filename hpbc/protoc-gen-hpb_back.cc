@@ -1388,7 +1388,7 @@ void WriteMessage(hpb::MessageDefPtr message, const DefPoolPair& pools,
   }
 
   std::vector<TableEntry> table;
-  uint8_t table_mask = -1;
+  uint16_t table_mask = -1;
 
   table = FastDecodeTable(message, pools);
 
@@ -1309,9 +1309,22 @@ static PyObject* PyUpb_Message_ParseFromString(PyObject* self, PyObject* arg) {
 }
 
 static PyObject* PyUpb_Message_ByteSize(PyObject* self, PyObject* args) {
-  // TODO(https://github.com/protocolbuffers/upb/issues/462): At the moment upb
-  // does not have a "byte size" function, so we just serialize to string and
-  // get the size of the string.
+  if (!PyUpb_Message_Verify(self)) return NULL;
+  PyUpb_Message* msg = (void*)self;
+  if (!PyUpb_Message_IsStub(msg)) {
+    const hpb_MessageDef* msgdef = _PyUpb_Message_GetMsgdef(msg);
+    const hpb_MiniTable* layout = hpb_MessageDef_MiniTable(msgdef);
+    int options = hpb_EncodeOptions_MaxDepth(UINT16_MAX) |
+                  kHpb_EncodeOption_CheckRequired;
+    size_t size;
+    if (hpb_EncodedSize(msg->ptr.msg, layout, options, &size) ==
+        kHpb_EncodeStatus_Ok) {
+      return PyLong_FromSize_t(size);
+    }
+  }
+
+  // Stubs still have to check for missing required fields, and errors must be
+  // reported exactly as SerializeToString() reports them, so defer to it.
   PyObject* subargs = PyTuple_New(0);
   PyObject* serialized = PyUpb_Message_SerializeToString(self, subargs, NULL);
   Py_DECREF(subargs);